@@ -0,0 +1,177 @@
+/**
+ * XOR FEC在各指令集下的吞吐
+ * 用setFecSimdLevel依次固定为scalar/sse2/avx2，分别测fecXor、UlpfecEncoder生成和UlpfecDecoder恢复
+ * CPU不支持的级别会降到支持的最高一级，输出中的名字为实际使用的一级
+ * 用法: fec_bench [恢复测试的组数 默认2000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "rtc/byte_io.h"
+#include "rtc/fec_xor.h"
+#include "rtc/rtp_packet.h"
+#include "rtc/ulpfec.h"
+
+using namespace rtc;
+
+static const uint32_t kMediaSsrc = 0x1234;
+static const uint32_t kFecSsrc = 0x5678;
+static const size_t kPacketSize = 1200;
+static const int kGroupPackets = 10;
+
+//读出的值写到这里，防止计算被优化掉
+static volatile uint64_t s_sink;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static infra::PacketBuffer::Ptr makeMedia(uint16_t seq, uint32_t timestamp, bool marker) {
+    infra::PacketBuffer::Ptr packet = infra::PacketBuffer::create(kPacketSize);
+    uint8_t *data = packet->data();
+    for (size_t i = 0; i < kPacketSize; i++) {
+        data[i] = (uint8_t)rand();
+    }
+    data[0] = 0x80;
+    data[1] = (uint8_t)((marker ? 0x80 : 0) | 96);
+    writeBE16(data + 2, seq);
+    writeBE32(data + 4, timestamp);
+    writeBE32(data + 8, kMediaSsrc);
+    return packet;
+}
+
+static void benchXor(size_t size) {
+    std::vector<uint8_t> dst(size), src(size);
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = (uint8_t)rand();
+        src[i] = (uint8_t)rand();
+    }
+    const int iterations = (int)(2000000000 / (size + 64));
+    int64_t start = nowNs();
+    for (int i = 0; i < iterations; i++) {
+        fecXor(dst.data(), src.data(), size);
+        __asm__ volatile("" ::: "memory");
+    }
+    int64_t elapsed = nowNs() - start;
+    s_sink += dst[0];
+    printf("  xor %5zuB        %6.2f GB/s  %7.1f ns/call\n", size, (double)size * iterations / elapsed,
+           (double)elapsed / iterations);
+}
+
+//每组10个媒体包生成2个交织的FEC包
+static void benchEncode() {
+    UlpfecOptions options;
+    options.media_ssrc = kMediaSsrc;
+    options.fec_ssrc = kFecSsrc;
+    options.payload_type = 117;
+    options.media_packets = kGroupPackets;
+    options.fec_packets = 2;
+    options.frame_aligned = false;
+    UlpfecEncoder encoder(options);
+
+    std::vector<infra::PacketBuffer::Ptr> media;
+    for (int i = 0; i < kGroupPackets; i++) {
+        media.push_back(makeMedia((uint16_t)i, 0, false));
+    }
+    std::vector<infra::PacketBuffer::Ptr> fec;
+    const int rounds = 50000;
+    int64_t start = nowNs();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < kGroupPackets; i++) {
+            writeBE16(media[i]->data() + 2, (uint16_t)(r * kGroupPackets + i));
+            fec.clear();
+            encoder.addPacket(media[i], fec);
+        }
+    }
+    int64_t elapsed = nowNs() - start;
+    printf("  encode 10/2       %6.2f GB/s  %7.1f ns/media packet  fec %llu\n",
+           (double)kPacketSize * rounds * kGroupPackets / elapsed, (double)elapsed / (rounds * kGroupPackets),
+           (unsigned long long)encoder.stats().fec_packets);
+}
+
+//每组10个媒体包1个FEC包，丢掉每组中的一个媒体包，由FEC恢复
+struct RecoverInput {
+    std::vector<infra::PacketBuffer::Ptr> media;  //丢掉的包为空
+    std::vector<infra::PacketBuffer::Ptr> fec;    //和media中每组的最后一个位置对齐
+};
+
+static void prepareRecover(int groups, RecoverInput &input) {
+    UlpfecOptions options;
+    options.media_ssrc = kMediaSsrc;
+    options.fec_ssrc = kFecSsrc;
+    options.payload_type = 117;
+    options.media_packets = kGroupPackets;
+    options.fec_packets = 1;
+    options.frame_aligned = false;
+    UlpfecEncoder encoder(options);
+    std::vector<infra::PacketBuffer::Ptr> fec;
+    for (int g = 0; g < groups; g++) {
+        int lost = rand() % kGroupPackets;
+        for (int i = 0; i < kGroupPackets; i++) {
+            uint16_t seq = (uint16_t)(g * kGroupPackets + i);
+            infra::PacketBuffer::Ptr packet = makeMedia(seq, (uint32_t)g * 3000, i == kGroupPackets - 1);
+            fec.clear();
+            encoder.addPacket(packet, fec);
+            input.media.push_back(i == lost ? nullptr : packet);
+            input.fec.push_back(fec.empty() ? nullptr : fec[0]);
+        }
+    }
+}
+
+static void benchRecover(const RecoverInput &input) {
+    UlpfecDecoderOptions options;
+    options.media_ssrc = kMediaSsrc;
+    UlpfecDecoder decoder(options);
+    std::vector<infra::PacketBuffer::Ptr> recovered;
+    const int passes = 10;
+    uint64_t count = 0;
+    int64_t start = nowNs();
+    for (int pass = 0; pass < passes; pass++) {
+        decoder.reset();
+        for (size_t i = 0; i < input.media.size(); i++) {
+            recovered.clear();
+            if (input.media[i]) {
+                decoder.onMediaPacket(input.media[i], recovered);
+            }
+            if (input.fec[i]) {
+                decoder.onFecPacket(input.fec[i], recovered);
+            }
+            count += recovered.size();
+        }
+    }
+    int64_t elapsed = nowNs() - start;
+    //按每组收到的9个媒体包和1个FEC包计算，包括保存媒体包和恢复丢失的包
+    uint64_t groups = (uint64_t)passes * input.media.size() / kGroupPackets;
+    printf("  recover 10/1      %6.2f GB/s  %7.1f ns/group  recovered %llu/%llu\n",
+           (double)kPacketSize * kGroupPackets * groups / elapsed, (double)elapsed / groups, (unsigned long long)count,
+           (unsigned long long)groups);
+}
+
+int main(int argc, char *argv[]) {
+    int groups = argc > 1 ? atoi(argv[1]) : 2000;
+    if (groups <= 0 || groups * kGroupPackets > 32768) {
+        fprintf(stderr, "usage: %s [groups 1-3276]\n", argv[0]);
+        return 1;
+    }
+    srand(1);
+    RecoverInput input;
+    prepareRecover(groups, input);
+    printf("cpu supports %s\n", simdLevelName(detectSimdLevel()));
+    const SimdLevel kLevels[] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+    for (SimdLevel level : kLevels) {
+        SimdLevel actual = setFecSimdLevel(level);
+        if (actual != level) {
+            printf("%s: not supported, skipped\n", simdLevelName(level));
+            continue;
+        }
+        printf("%s:\n", simdLevelName(actual));
+        benchXor(200);
+        benchXor(kPacketSize);
+        benchEncode();
+        benchRecover(input);
+    }
+    setFecSimdLevel(detectSimdLevel());
+    return 0;
+}
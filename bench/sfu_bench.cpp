@@ -0,0 +1,131 @@
+/**
+ * SfuEngine的1对N扇出压测
+ * 一个发布者的VP8轨道被N个订阅者订阅，在分片线程里连续注入包，统计转发的包速率和一个包扇出到最后一个订阅者的耗时
+ * 用法: sfu_bench [每个N注入的总包数 默认2000000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <vector>
+#include "infra/logger.h"
+#include "rtc/byte_io.h"
+#include "rtc/rtp_packet.h"
+#include "rtc/sfu_engine.h"
+
+using namespace rtc;
+
+static const uint64_t kRoomId = 1;
+static const uint64_t kTrackId = 1;
+static const uint32_t kSsrc = 1000;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//1100字节负载的VP8包，第一个包为关键帧，时间层0、1、2轮流
+static infra::PacketBuffer::Ptr makePacket(uint16_t seq, uint32_t timestamp, bool keyframe, int temporal) {
+    const size_t payload_size = 1100;
+    infra::PacketBuffer::Ptr packet = infra::PacketBuffer::create(RTP_HEADER_SIZE + 4 + payload_size);
+    uint8_t *data = packet->data();
+    memset(data, 0, packet->size());
+    data[0] = 0x80;
+    data[1] = 96;
+    writeBE16(data + 2, seq);
+    writeBE32(data + 4, timestamp);
+    writeBE32(data + 8, kSsrc);
+    //VP8描述符: X=1 S=1，T=1，TID
+    data[12] = 0x90;
+    data[13] = 0x20;
+    data[14] = (uint8_t)(temporal << 6);
+    data[15] = keyframe ? 0x00 : 0x01;
+    return packet;
+}
+
+static void runOnShard(const std::shared_ptr<SfuEngine> &engine, const std::function<void()> &func) {
+    std::promise<void> done;
+    std::future<void> future = done.get_future();
+    engine->roomPool(kRoomId)->postTask([&]() {
+        func();
+        done.set_value();
+    });
+    future.wait();
+}
+
+static void runFanout(const std::shared_ptr<SfuEngine> &engine, int subscribers, int total_packets) {
+    SfuTrackConfig config;
+    config.track_id = kTrackId;
+    config.codec = CODEC_VP8;
+    config.video = true;
+    config.ssrcs.push_back(kSsrc);
+    engine->addTrack(kRoomId, config);
+
+    int packets = total_packets / subscribers;
+    if (packets > 100000) {
+        packets = 100000;
+    }
+    std::vector<int64_t> latency;
+    latency.reserve(packets);
+    uint64_t sent = 0;
+    int64_t inject_ns = 0;
+    for (int i = 0; i < subscribers; i++) {
+        //回调都在分片线程，不需要同步
+        bool last = i == subscribers - 1;
+        engine->addSubscriber(kRoomId, i, [&, last](const infra::BufferChain &) {
+            sent++;
+            if (last) {
+                latency.push_back(nowNs() - inject_ns);
+            }
+        });
+        engine->subscribe(kRoomId, i, kTrackId, 2000 + i, 0, 2);
+    }
+
+    std::vector<infra::PacketBuffer::Ptr> input;
+    input.reserve(packets);
+    for (int i = 0; i < packets; i++) {
+        input.push_back(makePacket((uint16_t)i, (uint32_t)i * 3000, i == 0, i % 3));
+    }
+
+    int64_t start_ns = 0;
+    int64_t end_ns = 0;
+    runOnShard(engine, [&]() {
+        start_ns = nowNs();
+        for (int i = 0; i < packets; i++) {
+            inject_ns = nowNs();
+            engine->onRtpPacket(kRoomId, input[i]);
+        }
+        end_ns = nowNs();
+    });
+
+    double seconds = (end_ns - start_ns) / 1e9;
+    std::sort(latency.begin(), latency.end());
+    int64_t p50 = latency.empty() ? 0 : latency[latency.size() / 2];
+    int64_t p99 = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+    printf("N=%-5d in %8.0f pkts/s  out %6.2f M pkts/s  fan-out p50 %7.1f us  p99 %7.1f us\n", subscribers,
+           packets / seconds, sent / seconds / 1e6, p50 / 1000.0, p99 / 1000.0);
+
+    for (int i = 0; i < subscribers; i++) {
+        engine->removeSubscriber(kRoomId, i);
+    }
+    engine->removeTrack(kRoomId, kTrackId);
+    runOnShard(engine, []() {});
+}
+
+int main(int argc, char *argv[]) {
+    int total_packets = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (total_packets <= 0) {
+        fprintf(stderr, "usage: %s [total packets]\n", argv[0]);
+        return 1;
+    }
+    infra::Logger::instance().setLevel(infra::LogLevelWarn);
+    SfuOptions options;
+    options.shards = 1;
+    std::shared_ptr<SfuEngine> engine = SfuEngine::create(options);
+    const int kSubscribers[] = {10, 100, 1000};
+    for (int subscribers : kSubscribers) {
+        runFanout(engine, subscribers, total_packets);
+    }
+    return 0;
+}
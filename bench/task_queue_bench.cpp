@@ -0,0 +1,204 @@
+/**
+ * 任务队列在1到64个生产者下的吞吐
+ * queue: 生产者和4个消费者线程直接读写队列，对比原来的mutex+std::queue和MpmcQueue
+ * pool: 生产者向4线程的池投递空任务直到全部执行完，对比原来每次投递都唤醒的实现和ThreadPool
+ * 用法: task_queue_bench [每种配置的任务数 默认400000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "infra/event_driver.h"
+#include "infra/logger.h"
+#include "infra/task.h"
+#include "infra/thread_pool.h"
+#include "infra/utils/mpmc_queue.h"
+
+static const int kConsumers = 4;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//原TaskQueue的存储
+template <typename T>
+class MutexQueue {
+public:
+    void push(T &&value) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        queue_.push(std::move(value));
+    }
+
+    bool pop(T &value) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        value = std::move(queue_.front());
+        queue_.pop();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::queue<T> queue_;
+};
+
+/**
+ * 原ThreadPool的投递路径: 加锁入队后每次都写唤醒fd，线程在EventDriver上等待
+ * 唤醒后把队列取空再等待，比原实现每次唤醒只取一个任务更有利
+ */
+class LegacyPool {
+public:
+    explicit LegacyPool(int threads) : driver_(std::make_shared<infra::EventDriver>()), running_(true) {
+        for (int i = 0; i < threads; i++) {
+            threads_.emplace_back([this]() {
+                run();
+            });
+        }
+    }
+
+    ~LegacyPool() {
+        running_ = false;
+        for (size_t i = 0; i < threads_.size(); i++) {
+            driver_->WakeUp();
+        }
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void postTask(std::function<void()> task) {
+        queue_.push(std::move(task));
+        driver_->WakeUp();
+    }
+
+private:
+    void run() {
+        while (running_) {
+            driver_->Wait(10);
+            std::function<void()> task;
+            while (queue_.pop(task)) {
+                task();
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<infra::EventDriver> driver_;
+    MutexQueue<std::function<void()>> queue_;
+    std::atomic<bool> running_;
+    std::vector<std::thread> threads_;
+};
+
+//所有线程就绪之后同时开始，返回从开始到全部线程结束的耗时
+static int64_t runThreads(int count, const std::function<void(int)> &func) {
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back([&, i]() {
+            ready++;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            func(i);
+        });
+    }
+    while (ready.load() < count) {
+        std::this_thread::yield();
+    }
+    int64_t start = nowNs();
+    go.store(true, std::memory_order_release);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return nowNs() - start;
+}
+
+template <typename Queue>
+static double benchQueue(Queue &queue, int producers, int tasks) {
+    int per_producer = tasks / producers;
+    int total = per_producer * producers;
+    std::atomic<int> consumed(0);
+    std::atomic<int> sink(0);
+    int64_t elapsed = runThreads(producers + kConsumers, [&](int index) {
+        if (index < producers) {
+            for (int i = 0; i < per_producer; i++) {
+                queue.push(infra::Task([&sink]() {
+                    sink.fetch_add(1, std::memory_order_relaxed);
+                }));
+            }
+            return;
+        }
+        infra::Task task;
+        while (consumed.load(std::memory_order_relaxed) < total) {
+            if (queue.pop(task)) {
+                task();
+                consumed.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    return total * 1000.0 / elapsed;
+}
+
+template <typename Pool>
+static double benchPool(Pool &pool, int producers, int tasks) {
+    int per_producer = tasks / producers;
+    int total = per_producer * producers;
+    std::atomic<int> executed(0);
+    int64_t start = nowNs();
+    runThreads(producers, [&](int) {
+        for (int i = 0; i < per_producer; i++) {
+            pool.postTask([&executed]() {
+                executed.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+    });
+    while (executed.load() < total) {
+        std::this_thread::yield();
+    }
+    return total * 1000.0 / (nowNs() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int tasks = argc > 1 ? atoi(argv[1]) : 400000;
+    if (tasks < 64) {
+        fprintf(stderr, "usage: %s [tasks >= 64]\n", argv[0]);
+        return 1;
+    }
+    infra::Logger::instance().setLevel(infra::LogLevelWarn);
+    const int kProducers[] = {1, 2, 4, 8, 16, 32, 64};
+
+    printf("queue, %d consumers (M tasks/s)\n", kConsumers);
+    printf("  producers     mutex      mpmc\n");
+    for (int producers : kProducers) {
+        MutexQueue<infra::Task> mutex_queue;
+        infra::MpmcQueue<infra::Task> mpmc_queue;
+        double old_rate = benchQueue(mutex_queue, producers, tasks);
+        double new_rate = benchQueue(mpmc_queue, producers, tasks);
+        printf("  %9d  %8.2f  %8.2f\n", producers, old_rate, new_rate);
+    }
+
+    printf("pool, %d threads (M tasks/s)\n", kConsumers);
+    printf("  producers    legacy  ThreadPool\n");
+    std::shared_ptr<infra::ThreadPool> pool = infra::ThreadPool::create("bench", kConsumers);
+    for (int producers : kProducers) {
+        double old_rate;
+        {
+            LegacyPool legacy(kConsumers);
+            old_rate = benchPool(legacy, producers, tasks);
+        }
+        double new_rate = benchPool(*pool, producers, tasks);
+        printf("  %9d  %8.2f  %10.2f\n", producers, old_rate, new_rate);
+    }
+    return 0;
+}
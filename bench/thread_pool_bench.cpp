@@ -0,0 +1,190 @@
+/**
+ * ThreadPool共享队列和work stealing两种调度的对比
+ * fan-out/fan-in: 池内一个任务投递M个子任务，每个子任务处理4KB数据，最后一个完成的子任务开始下一轮
+ * recursive split: 任务把区间一分为二投递两个子任务，直到区间小于阈值时求和
+ * 用法: thread_pool_bench [线程数 默认4]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "infra/logger.h"
+#include "infra/thread_pool.h"
+
+using infra::ThreadPool;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//等待最后一个任务设置完成标志，标志是任务对对象的最后一次访问，之后对象可以析构
+static void waitFinished(const std::atomic<bool> &finished) {
+    while (!finished.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+static uint64_t sumRange(const std::vector<uint32_t> &data, size_t begin, size_t end) {
+    uint64_t sum = 0;
+    for (size_t i = begin; i < end; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+//每个子任务处理数据中的一段，类似一个会话处理一批包
+static const size_t kFanOutChunk = 1024;
+
+class FanOut {
+public:
+    FanOut(const std::shared_ptr<ThreadPool> &pool, const std::vector<uint32_t> &data, int children, int rounds)
+        : pool_(pool), data_(data), children_(children), rounds_(rounds), round_(0), pending_(0), sum_(0),
+          finished_(false) {
+    }
+
+    uint64_t run() {
+        pool_->postTask([this]() {
+            startRound();
+        });
+        waitFinished(finished_);
+        return sum_.load();
+    }
+
+private:
+    void startRound() {
+        //投递出最后一个子任务后整个测试可能已经结束，循环中不能再访问成员
+        int children = children_;
+        ThreadPool *pool = pool_.get();
+        pending_.store(children, std::memory_order_relaxed);
+        for (int i = 0; i < children; i++) {
+            pool->postTask([this, i]() {
+                sum_.fetch_add(sumRange(data_, i * kFanOutChunk, (i + 1) * kFanOutChunk), std::memory_order_relaxed);
+                if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    finishRound();
+                }
+            });
+        }
+    }
+
+    void finishRound() {
+        if (++round_ < rounds_) {
+            startRound();
+        } else {
+            finished_.store(true, std::memory_order_release);
+        }
+    }
+
+private:
+    std::shared_ptr<ThreadPool> pool_;
+    const std::vector<uint32_t> &data_;
+    int children_;
+    int rounds_;
+    int round_;  //只在每轮最后一个完成的子任务中访问
+    std::atomic<int> pending_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<bool> finished_;
+};
+
+class RecursiveSplit {
+public:
+    RecursiveSplit(const std::shared_ptr<ThreadPool> &pool, const std::vector<uint32_t> &data, size_t grain)
+        : pool_(pool), data_(data), grain_(grain), pending_(0), sum_(0), tasks_(0), finished_(false) {
+    }
+
+    uint64_t run() {
+        pending_.store(1, std::memory_order_relaxed);
+        pool_->postTask([this]() {
+            split(0, data_.size());
+        });
+        waitFinished(finished_);
+        return sum_.load();
+    }
+
+    uint64_t tasks() const {
+        return tasks_.load();
+    }
+
+private:
+    //当前任务持有pending_中的一份，调用finish之前对象不会结束
+    void split(size_t begin, size_t end) {
+        tasks_.fetch_add(1, std::memory_order_relaxed);
+        if (end - begin <= grain_) {
+            sum_.fetch_add(sumRange(data_, begin, end), std::memory_order_relaxed);
+            finish();
+            return;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        pending_.fetch_add(2, std::memory_order_relaxed);
+        pool_->postTask([this, begin, middle]() {
+            split(begin, middle);
+        });
+        pool_->postTask([this, middle, end]() {
+            split(middle, end);
+        });
+        finish();
+    }
+
+    void finish() {
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            finished_.store(true, std::memory_order_release);
+        }
+    }
+
+private:
+    std::shared_ptr<ThreadPool> pool_;
+    const std::vector<uint32_t> &data_;
+    size_t grain_;
+    std::atomic<int64_t> pending_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> tasks_;
+    std::atomic<bool> finished_;
+};
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    if (threads <= 0) {
+        fprintf(stderr, "usage: %s [threads]\n", argv[0]);
+        return 1;
+    }
+    infra::Logger::instance().setLevel(infra::LogLevelWarn);
+    std::vector<uint32_t> data(1 << 22);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint32_t)i;
+    }
+    uint64_t expected = sumRange(data, 0, data.size());
+
+    const ThreadPool::Schedule kSchedules[] = {ThreadPool::SCHEDULE_SHARED_QUEUE, ThreadPool::SCHEDULE_WORK_STEALING};
+    const char *kNames[] = {"shared queue", "work stealing"};
+    printf("%d threads\n", threads);
+    for (int s = 0; s < 2; s++) {
+        std::shared_ptr<ThreadPool> pool = ThreadPool::create("bench", threads, ThreadPool::PRIORITY_NORMAL, kSchedules[s]);
+        printf("%s:\n", kNames[s]);
+
+        const int kChildren[] = {16, 256, 4096};
+        for (int children : kChildren) {
+            int rounds = 1024 * 64 / children;
+            FanOut fan_out(pool, data, children, rounds);
+            int64_t start = nowNs();
+            uint64_t sum = fan_out.run();
+            int64_t elapsed = nowNs() - start;
+            printf("  fan-out %4d x %4d rounds  %8.1f us/round  %6.2f M tasks/s%s\n", children, rounds,
+                   elapsed / 1000.0 / rounds, (double)children * rounds * 1000 / elapsed,
+                   sum == sumRange(data, 0, children * kFanOutChunk) * rounds ? "" : "  WRONG SUM");
+        }
+
+        const size_t kGrains[] = {4096, 256, 16};
+        for (size_t grain : kGrains) {
+            RecursiveSplit split(pool, data, grain);
+            int64_t start = nowNs();
+            uint64_t sum = split.run();
+            int64_t elapsed = nowNs() - start;
+            printf("  split grain %4zu  %8llu tasks  %8.1f ms  %6.2f M tasks/s%s\n", grain,
+                   (unsigned long long)split.tasks(), elapsed / 1e6, split.tasks() * 1000.0 / elapsed,
+                   sum == expected ? "" : "  WRONG SUM");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * loopback上三种udp发送路径的对比
+ * send: 每个包一次send；sendmmsg: sendBatch一次发一帧的所有包；gso: 一帧作为一个UDP_SEGMENT超大包交给内核切分
+ * 接收端开启GRO并在同一线程用recvBatch收完，分别统计发送调用和包括接收在内的总耗时
+ * 用法: udp_send_bench [每种方式发送的包数 默认40000] [每帧包数 默认40]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "infra/socket_util.h"
+
+using infra::SocketUtil;
+using infra::UdpPacket;
+
+static const size_t kDatagramSize = 1200;
+static const int kRecvBatch = 64;
+static const size_t kRecvCapacity = 65536;
+
+enum SendMode {
+    SEND_PLAIN = 0,
+    SEND_MMSG,
+    SEND_GSO
+};
+
+static const char *kModeNames[] = {"send", "sendmmsg", "gso"};
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void fillPacket(UdpPacket &packet, char *data, size_t size, uint16_t segment_size) {
+    memset(&packet, 0, sizeof(packet));
+    packet.data = data;
+    packet.size = size;
+    packet.segment_size = segment_size;
+}
+
+class Receiver {
+public:
+    explicit Receiver(int fd) : fd_(fd), buffers_(kRecvBatch * kRecvCapacity), packets_(kRecvBatch) {
+        for (int i = 0; i < kRecvBatch; i++) {
+            packets_[i].data = &buffers_[i * kRecvCapacity];
+            packets_[i].capacity = kRecvCapacity;
+        }
+    }
+
+    //收完socket中的数据，返回收到的包数，GRO合并的包按分段计数
+    int drain() {
+        int datagrams = 0;
+        int count;
+        while ((count = SocketUtil::recvBatch(fd_, packets_.data(), kRecvBatch)) > 0) {
+            for (int i = 0; i < count; i++) {
+                const UdpPacket &packet = packets_[i];
+                datagrams += packet.segment_size ? (int)((packet.size + packet.segment_size - 1) / packet.segment_size) : 1;
+            }
+        }
+        return datagrams;
+    }
+
+private:
+    int fd_;
+    std::vector<char> buffers_;
+    std::vector<UdpPacket> packets_;
+};
+
+//发一帧，返回发出的包数
+static int sendFrame(int fd, SendMode mode, std::vector<char> &frame, int segments) {
+    int sent = 0;
+    if (mode == SEND_PLAIN) {
+        for (int i = 0; i < segments; i++) {
+            if (::send(fd, &frame[i * kDatagramSize], kDatagramSize, 0) > 0) {
+                sent++;
+            }
+        }
+    } else if (mode == SEND_MMSG) {
+        UdpPacket packets[SOCKET_MAX_BATCH];
+        for (int i = 0; i < segments; i++) {
+            fillPacket(packets[i], &frame[i * kDatagramSize], kDatagramSize, 0);
+        }
+        int ret = SocketUtil::sendBatch(fd, packets, segments);
+        sent = ret > 0 ? ret : 0;
+    } else {
+        UdpPacket packet;
+        fillPacket(packet, frame.data(), kDatagramSize * segments, kDatagramSize);
+        sent = SocketUtil::sendBatch(fd, &packet, 1) == 1 ? segments : 0;
+    }
+    return sent;
+}
+
+int main(int argc, char *argv[]) {
+    int datagrams = argc > 1 ? atoi(argv[1]) : 40000;
+    int segments = argc > 2 ? atoi(argv[2]) : 40;
+    //GSO一次最多64个分段，总长不超过64KB
+    if (datagrams <= 0 || segments <= 0 || segments > SOCKET_MAX_BATCH || segments * kDatagramSize > 65000) {
+        fprintf(stderr, "usage: %s [datagrams] [datagrams per frame 1-54]\n", argv[0]);
+        return 1;
+    }
+
+    int rx = SocketUtil::bindUdpSock(0, "127.0.0.1");
+    if (rx < 0) {
+        fprintf(stderr, "bind udp socket failed\n");
+        return 1;
+    }
+    SocketUtil::setRecvBuf(rx, 64 * 1024 * 1024);
+    bool gro = SocketUtil::setUdpGro(rx) == 0;
+    int tx = SocketUtil::connectUdpSock("127.0.0.1", SocketUtil::get_local_port(rx), "127.0.0.1");
+    if (tx < 0) {
+        fprintf(stderr, "connect udp socket failed\n");
+        infra::close_socket(rx);
+        return 1;
+    }
+    SocketUtil::setSendBuf(tx, 4 * 1024 * 1024);
+    printf("%zu byte datagrams, %d per frame, gso %s, gro %s\n", kDatagramSize, segments,
+           SocketUtil::supportUdpGso(tx) ? "on" : "off (split in user space)", gro ? "on" : "off");
+
+    Receiver receiver(rx);
+    std::vector<char> frame(kDatagramSize * segments, 'x');
+    for (int mode = SEND_PLAIN; mode <= SEND_GSO; mode++) {
+        receiver.drain();
+        int sent = 0;
+        int received = 0;
+        int64_t send_ns = 0;
+        int64_t start = nowNs();
+        while (sent < datagrams) {
+            int64_t send_start = nowNs();
+            sent += sendFrame(tx, (SendMode)mode, frame, segments);
+            send_ns += nowNs() - send_start;
+            //每帧之后收完，避免接收缓冲区满了丢包
+            received += receiver.drain();
+        }
+        received += receiver.drain();
+        int64_t elapsed = nowNs() - start;
+        printf("  %-8s  send %6.0f ns/datagram  total %6.0f ns/datagram  received %d/%d\n", kModeNames[mode],
+               (double)send_ns / sent, (double)elapsed / sent, received, sent);
+    }
+    infra::close_socket(tx);
+    infra::close_socket(rx);
+    return 0;
+}
@@ -0,0 +1,571 @@
+#include "dns_resolver.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "logger.h"
+#include "utils/time.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#endif
+
+namespace infra {
+
+static const uint16_t kDnsPort = 53;
+static const uint16_t kTypeA = 1;
+static const uint16_t kTypeAAAA = 28;
+static const uint16_t kClassIN = 1;
+static const size_t kDnsHeaderSize = 12;
+static const size_t kMaxDnsMessage = 1232;
+//缓存时间的范围，ttl为0的记录也缓存一小段时间，避免热点域名反复查询
+static const uint32_t kMinTtl = 5;
+static const uint32_t kMaxTtl = 3600;
+
+static inline void writeUint16(std::string &out, uint16_t value) {
+    out += (char)(value >> 8);
+    out += (char)(value & 0xff);
+}
+
+static inline uint16_t readUint16(const uint8_t *data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline uint32_t readUint32(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+//按dns格式编码域名，非法时返回false
+static bool encodeName(const std::string &host, std::string &out) {
+    if (host.empty() || host.size() > 253) {
+        return false;
+    }
+    size_t begin = 0;
+    while (begin < host.size()) {
+        size_t end = host.find('.', begin);
+        if (end == std::string::npos) {
+            end = host.size();
+        }
+        size_t length = end - begin;
+        if (length == 0 || length > 63) {
+            return false;
+        }
+        out += (char)length;
+        out.append(host, begin, length);
+        begin = end + 1;
+    }
+    out += '\0';
+    return true;
+}
+
+//跳过报文中的域名，支持压缩指针，返回域名之后的偏移，出错返回0
+static size_t skipName(const uint8_t *data, size_t size, size_t offset) {
+    while (offset < size) {
+        uint8_t length = data[offset];
+        if ((length & 0xc0) == 0xc0) {
+            return offset + 2 <= size ? offset + 2 : 0;
+        }
+        if (length == 0) {
+            return offset + 1;
+        }
+        offset += 1 + length;
+    }
+    return 0;
+}
+
+static bool parseAddress(const std::string &host, struct sockaddr_storage &addr) {
+    memset(&addr, 0, sizeof(addr));
+    struct sockaddr_in *in4 = (struct sockaddr_in *)&addr;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+    if (inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1) {
+        in4->sin_family = AF_INET;
+        return true;
+    }
+    if (inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        return true;
+    }
+    return false;
+}
+
+static bool sameAddress(const struct sockaddr_storage &a, const struct sockaddr_storage &b) {
+    if (a.ss_family != b.ss_family) {
+        return false;
+    }
+    if (a.ss_family == AF_INET) {
+        const struct sockaddr_in &x = (const struct sockaddr_in &)a;
+        const struct sockaddr_in &y = (const struct sockaddr_in &)b;
+        return x.sin_port == y.sin_port && x.sin_addr.s_addr == y.sin_addr.s_addr;
+    }
+    const struct sockaddr_in6 &x = (const struct sockaddr_in6 &)a;
+    const struct sockaddr_in6 &y = (const struct sockaddr_in6 &)b;
+    return x.sin6_port == y.sin6_port && memcmp(&x.sin6_addr, &y.sin6_addr, sizeof(x.sin6_addr)) == 0;
+}
+
+//比较编码后的域名，忽略大小写
+static bool sameName(const uint8_t *data, const std::string &name) {
+    for (size_t i = 0; i < name.size(); i++) {
+        if (tolower(data[i]) != tolower((unsigned char)name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string toLower(const std::string &value) {
+    std::string result(value);
+    for (auto &c : result) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return result;
+}
+
+DnsResolver &DnsResolver::instance() {
+    static DnsResolver resolver;
+    return resolver;
+}
+
+DnsResolver::DnsResolver()
+    : timeout_ms_(2000), attempts_(2), fd4_(-1), fd6_(-1),
+      random_((uint32_t)getCurrentMicroseconds() ^ (uint32_t)(uintptr_t)this),
+      cache_(std::make_shared<CacheMap>()), cache_version_(1) {
+    //解析线程会打日志，先构造Logger保证进程退出时它在本对象之后析构
+    Logger::instance();
+    loadResolvConf();
+    loadHosts();
+    loop_ = ThreadPool::create("dns", 1);
+}
+
+DnsResolver::~DnsResolver() {
+    //先停止线程，之后不会再访问socket
+    loop_.reset();
+    if (fd4_ >= 0) {
+        close_socket(fd4_);
+    }
+    if (fd6_ >= 0) {
+        close_socket(fd6_);
+    }
+}
+
+std::string DnsResolver::cacheKey(const std::string &host, int family) {
+    return toLower(host) + "/" + std::to_string(family);
+}
+
+void DnsResolver::loadResolvConf() {
+#if !defined(_WIN32)
+    FILE *file = fopen("/etc/resolv.conf", "r");
+    if (file) {
+        char line[512];
+        while (fgets(line, sizeof(line), file)) {
+            char value[256];
+            if (sscanf(line, "nameserver %255s", value) == 1) {
+                struct sockaddr_storage addr;
+                //去掉ipv6地址中的scope id
+                char *scope = strchr(value, '%');
+                if (scope) {
+                    *scope = '\0';
+                }
+                if (parseAddress(value, addr)) {
+                    if (addr.ss_family == AF_INET) {
+                        ((struct sockaddr_in *)&addr)->sin_port = htons(kDnsPort);
+                    } else {
+                        ((struct sockaddr_in6 *)&addr)->sin6_port = htons(kDnsPort);
+                    }
+                    servers_.push_back(addr);
+                }
+            } else if (strncmp(line, "options", 7) == 0) {
+                const char *timeout = strstr(line, "timeout:");
+                const char *attempts = strstr(line, "attempts:");
+                if (timeout) {
+                    timeout_ms_ = std::max(1, atoi(timeout + 8)) * 1000;
+                }
+                if (attempts) {
+                    attempts_ = std::max(1, atoi(attempts + 9));
+                }
+            }
+        }
+        fclose(file);
+    }
+#endif
+    if (servers_.empty()) {
+        //与glibc一致，没有配置时使用本机
+        struct sockaddr_storage addr = SocketUtil::make_sockaddr("127.0.0.1", kDnsPort);
+        servers_.push_back(addr);
+    }
+}
+
+void DnsResolver::loadHosts() {
+#if defined(_WIN32)
+    FILE *file = fopen("C:\\Windows\\System32\\drivers\\etc\\hosts", "r");
+#else
+    FILE *file = fopen("/etc/hosts", "r");
+#endif
+    if (!file) {
+        return;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char *save = nullptr;
+#if defined(_WIN32)
+        char *token = strtok_s(line, " \t\r\n", &save);
+#else
+        char *token = strtok_r(line, " \t\r\n", &save);
+#endif
+        struct sockaddr_storage addr;
+        if (!token || !parseAddress(token, addr)) {
+            continue;
+        }
+#if defined(_WIN32)
+        while ((token = strtok_s(nullptr, " \t\r\n", &save)) != nullptr) {
+#else
+        while ((token = strtok_r(nullptr, " \t\r\n", &save)) != nullptr) {
+#endif
+            hosts_[toLower(token)].push_back(addr);
+        }
+    }
+    fclose(file);
+}
+
+bool DnsResolver::lookupLocal(const std::string &host, int family, std::vector<struct sockaddr_storage> &addrs) {
+    struct sockaddr_storage addr;
+    if (parseAddress(host, addr)) {
+        addrs.assign(1, addr);
+        return true;
+    }
+    auto it = hosts_.find(toLower(host));
+    if (it == hosts_.end()) {
+        return false;
+    }
+    addrs.clear();
+    for (auto &entry : it->second) {
+        if (family == AF_UNSPEC || entry.ss_family == family) {
+            addrs.push_back(entry);
+        }
+    }
+    return !addrs.empty();
+}
+
+bool DnsResolver::lookup(const std::string &host, int family, std::vector<struct sockaddr_storage> &addrs) {
+    //线程持有的缓存快照，版本号没有变化时直接使用，不加锁
+    struct Snapshot {
+        uint64_t version = 0;
+        std::shared_ptr<const CacheMap> cache;
+    };
+    static thread_local Snapshot s_snapshot;
+    uint64_t version = cache_version_.load(std::memory_order_acquire);
+    if (s_snapshot.version != version) {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        s_snapshot.cache = cache_;
+        s_snapshot.version = cache_version_.load(std::memory_order_relaxed);
+    }
+    const CacheMap &cache = *s_snapshot.cache;
+    auto it = cache.find(cacheKey(host, family));
+    if (it == cache.end() || it->second.expire_ms < getCurrentMilliseconds()) {
+        return false;
+    }
+    addrs = it->second.addrs;
+    return true;
+}
+
+void DnsResolver::updateCache(const std::string &key, const std::vector<struct sockaddr_storage> &addrs, uint32_t ttl) {
+    int64_t now = getCurrentMilliseconds();
+    //写时复制，顺便清理过期的记录
+    std::shared_ptr<CacheMap> cache = std::make_shared<CacheMap>();
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        for (auto &it : *cache_) {
+            if (it.second.expire_ms >= now) {
+                cache->insert(it);
+            }
+        }
+    }
+    CacheEntry &entry = (*cache)[key];
+    entry.addrs = addrs;
+    entry.expire_ms = now + (int64_t)std::min(std::max(ttl, kMinTtl), kMaxTtl) * 1000;
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    cache_ = cache;
+    cache_version_.fetch_add(1, std::memory_order_release);
+}
+
+void DnsResolver::resolve(const std::string &host, int family, const ResolveCallback &callback) {
+    std::vector<struct sockaddr_storage> addrs;
+    if (lookupLocal(host, family, addrs) || lookup(host, family, addrs)) {
+        callback(addrs);
+        return;
+    }
+    loop_->postTask([this, host, family, callback]() {
+        startRequest(host, family, callback);
+    });
+}
+
+void DnsResolver::setNameServers(const std::vector<struct sockaddr_storage> &servers) {
+    loop_->postTask([this, servers]() {
+        if (!servers.empty()) {
+            servers_ = servers;
+        }
+    });
+}
+
+void DnsResolver::setTimeout(int64_t timeout_ms, int32_t attempts) {
+    loop_->postTask([this, timeout_ms, attempts]() {
+        timeout_ms_ = std::max<int64_t>(timeout_ms, 1);
+        attempts_ = std::max(attempts, 1);
+    });
+}
+
+void DnsResolver::startRequest(const std::string &host, int family, const ResolveCallback &callback) {
+    std::string key = cacheKey(host, family);
+    auto it = requests_.find(key);
+    if (it != requests_.end()) {
+        it->second.callbacks.push_back(callback);
+        return;
+    }
+    //投递期间可能已经被其他请求写入缓存
+    std::vector<struct sockaddr_storage> addrs;
+    if (lookup(host, family, addrs)) {
+        callback(addrs);
+        return;
+    }
+    std::string name;
+    if (!encodeName(host, name)) {
+        warnf("dns resolve invalid host: %s\n", host.c_str());
+        callback(addrs);
+        return;
+    }
+
+    Request &request = requests_[key];
+    request.host = host;
+    request.family = family;
+    request.outstanding = family == AF_UNSPEC ? 2 : 1;
+    request.ttl = kMaxTtl;
+    request.callbacks.push_back(callback);
+    if (family != AF_INET6) {
+        startQuery(key, kTypeA);
+    }
+    if (family != AF_INET) {
+        startQuery(key, kTypeAAAA);
+    }
+}
+
+void DnsResolver::startQuery(const std::string &key, uint16_t type) {
+    uint16_t id = 0;
+    do {
+        random_ ^= random_ << 13;
+        random_ ^= random_ >> 17;
+        random_ ^= random_ << 5;
+        id = (uint16_t)random_;
+    } while (queries_.count(id));
+
+    Query &query = queries_[id];
+    query.key = key;
+    query.type = type;
+    query.tries = 0;
+    query.server = 0;
+    query.timer = 0;
+    sendQuery(id, query);
+}
+
+int DnsResolver::socketFor(int family) {
+    int &fd = family == AF_INET ? fd4_ : fd6_;
+    if (fd >= 0) {
+        return fd;
+    }
+    fd = SocketUtil::bindUdpSock(0, family == AF_INET ? "0.0.0.0" : "::");
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = loop_->eventDriver()->addEvent(fd, EventDriver::EventRead, [this, fd](int) {
+        onReadable(fd);
+    });
+    if (ret < 0) {
+        close_socket(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+void DnsResolver::sendQuery(uint16_t id, Query &query) {
+    const Request &request = requests_[query.key];
+    std::string message;
+    message.reserve(kDnsHeaderSize + request.host.size() + 6);
+    writeUint16(message, id);
+    writeUint16(message, 0x0100);  //RD
+    writeUint16(message, 1);       //QDCOUNT
+    writeUint16(message, 0);
+    writeUint16(message, 0);
+    writeUint16(message, 0);
+    encodeName(request.host, message);
+    writeUint16(message, query.type);
+    writeUint16(message, kClassIN);
+
+    const struct sockaddr_storage &server = servers_[query.server % servers_.size()];
+    int fd = socketFor(server.ss_family);
+    if (fd >= 0) {
+        int ret = (int)sendto(fd, message.data(), (int)message.size(), 0, (const struct sockaddr *)&server,
+            SocketUtil::get_sock_len((const struct sockaddr *)&server));
+        if (ret < 0) {
+            tracef("dns send query failed: %d\n", get_uv_error(true));
+        }
+    }
+    //发送失败也等待超时后重试下一个nameserver
+    query.timer = loop_->postDelayedTask([this, id]() {
+        onTimeout(id);
+    }, timeout_ms_);
+}
+
+void DnsResolver::onTimeout(uint16_t id) {
+    auto it = queries_.find(id);
+    if (it == queries_.end()) {
+        return;
+    }
+    Query &query = it->second;
+    query.tries++;
+    if (query.tries >= attempts_ * (int32_t)servers_.size()) {
+        warnf("dns query %s timeout\n", requests_[query.key].host.c_str());
+        finishQuery(id, std::vector<struct sockaddr_storage>(), 0);
+        return;
+    }
+    query.server++;
+    sendQuery(id, query);
+}
+
+void DnsResolver::onReadable(int fd) {
+    char buffer[kMaxDnsMessage];
+    while (true) {
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        int ret = (int)recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len);
+        if (ret < 0) {
+            if (get_uv_error(true) == EINTR) {
+                continue;
+            }
+            break;
+        }
+        onResponse(buffer, ret, from);
+    }
+}
+
+void DnsResolver::onResponse(const char *buffer, size_t size, const struct sockaddr_storage &from) {
+    const uint8_t *data = (const uint8_t *)buffer;
+    if (size < kDnsHeaderSize) {
+        return;
+    }
+    uint16_t id = readUint16(data);
+    auto it = queries_.find(id);
+    if (it == queries_.end()) {
+        return;
+    }
+    Query &query = it->second;
+    //只接受发往的nameserver的应答，并校验问题与查询一致
+    if (!sameAddress(from, servers_[query.server % servers_.size()])) {
+        return;
+    }
+    uint16_t flags = readUint16(data + 2);
+    uint16_t qdcount = readUint16(data + 4);
+    uint16_t ancount = readUint16(data + 6);
+    if (!(flags & 0x8000) || qdcount != 1) {
+        return;
+    }
+    size_t offset = kDnsHeaderSize;
+    std::string name;
+    const Request &request = requests_[query.key];
+    encodeName(request.host, name);
+    if (size < offset + name.size() + 4 || !sameName(data + offset, name) ||
+        readUint16(data + offset + name.size()) != query.type) {
+        return;
+    }
+    offset += name.size() + 4;
+
+    std::vector<struct sockaddr_storage> addrs;
+    uint32_t ttl = kMaxTtl;
+    int rcode = flags & 0x000f;
+    //应答被截断时使用已经收到的记录
+    for (uint16_t i = 0; i < ancount && rcode == 0; i++) {
+        offset = skipName(data, size, offset);
+        if (offset == 0 || offset + 10 > size) {
+            break;
+        }
+        uint16_t type = readUint16(data + offset);
+        uint16_t klass = readUint16(data + offset + 2);
+        uint32_t record_ttl = readUint32(data + offset + 4);
+        uint16_t length = readUint16(data + offset + 8);
+        offset += 10;
+        if (offset + length > size) {
+            break;
+        }
+        //CNAME链上的A/AAAA记录都属于查询的域名
+        if (klass == kClassIN && type == query.type) {
+            struct sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            if (type == kTypeA && length == 4) {
+                struct sockaddr_in *in4 = (struct sockaddr_in *)&addr;
+                in4->sin_family = AF_INET;
+                memcpy(&in4->sin_addr, data + offset, 4);
+                addrs.push_back(addr);
+                ttl = std::min(ttl, record_ttl);
+            } else if (type == kTypeAAAA && length == 16) {
+                struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+                in6->sin6_family = AF_INET6;
+                memcpy(&in6->sin6_addr, data + offset, 16);
+                addrs.push_back(addr);
+                ttl = std::min(ttl, record_ttl);
+            }
+        }
+        offset += length;
+    }
+    if (rcode != 0 && rcode != 3) {
+        //SERVFAIL等错误换下一个nameserver
+        tracef("dns query %s rcode %d\n", request.host.c_str(), rcode);
+        loop_->cancelDelayedTask(query.timer);
+        onTimeout(id);
+        return;
+    }
+    finishQuery(id, addrs, ttl);
+}
+
+void DnsResolver::finishQuery(uint16_t id, const std::vector<struct sockaddr_storage> &addrs, uint32_t ttl) {
+    auto it = queries_.find(id);
+    if (it == queries_.end()) {
+        return;
+    }
+    std::string key = it->second.key;
+    uint16_t type = it->second.type;
+    loop_->cancelDelayedTask(it->second.timer);
+    queries_.erase(it);
+
+    auto request = requests_.find(key);
+    if (request == requests_.end()) {
+        return;
+    }
+    auto &target = type == kTypeA ? request->second.addrs4 : request->second.addrs6;
+    target.insert(target.end(), addrs.begin(), addrs.end());
+    if (!addrs.empty()) {
+        request->second.ttl = std::min(request->second.ttl, ttl);
+    }
+    if (--request->second.outstanding == 0) {
+        finishRequest(key);
+    }
+}
+
+void DnsResolver::finishRequest(const std::string &key) {
+    auto it = requests_.find(key);
+    Request request = std::move(it->second);
+    requests_.erase(it);
+
+    std::vector<struct sockaddr_storage> addrs = std::move(request.addrs4);
+    addrs.insert(addrs.end(), request.addrs6.begin(), request.addrs6.end());
+    if (!addrs.empty()) {
+        updateCache(key, addrs, request.ttl);
+    } else {
+        warnf("dns resolve %s failed\n", request.host.c_str());
+    }
+    for (auto &callback : request.callbacks) {
+        callback(addrs);
+    }
+}
+
+}
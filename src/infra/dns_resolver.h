@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "socket_util.h"
+#include "thread_pool.h"
+
+namespace infra {
+
+/**
+ * 异步dns解析
+ * 在单独的事件循环线程向/etc/resolv.conf中的nameserver发送udp查询，超时后轮换nameserver重试
+ * 解析结果按ttl缓存，读缓存无锁，各线程持有缓存快照，只有缓存更新后第一次读取才加锁刷新
+ */
+class DnsResolver {
+public:
+    //解析得到的地址，端口为0，失败时为空
+    typedef std::function<void(const std::vector<struct sockaddr_storage> &addrs)> ResolveCallback;
+
+    static DnsResolver &instance();
+
+    DnsResolver(const DnsResolver&) = delete;
+
+    DnsResolver(DnsResolver&&) = delete;
+
+    ~DnsResolver();
+
+    /**
+     * @param family AF_INET只查A记录，AF_INET6只查AAAA记录，AF_UNSPEC两者都查，ipv4地址在前
+     * 命中缓存、host为ip地址或在/etc/hosts中时在调用线程直接回调，否则在解析线程回调
+     */
+    void resolve(const std::string &host, int family, const ResolveCallback &callback);
+
+    //只查缓存，不发起查询
+    bool lookup(const std::string &host, int family, std::vector<struct sockaddr_storage> &addrs);
+
+    //替换从resolv.conf读取的nameserver
+    void setNameServers(const std::vector<struct sockaddr_storage> &servers);
+
+    //每个nameserver的超时时间和所有nameserver轮询的次数
+    void setTimeout(int64_t timeout_ms, int32_t attempts);
+
+private:
+    DnsResolver();
+
+    struct CacheEntry {
+        std::vector<struct sockaddr_storage> addrs;
+        int64_t expire_ms;
+    };
+    typedef std::unordered_map<std::string, CacheEntry> CacheMap;
+
+    //同一个host和family的并发请求合并为一个
+    struct Request {
+        std::string host;
+        int family;
+        int32_t outstanding;  //还未完成的查询数
+        uint32_t ttl;
+        std::vector<struct sockaddr_storage> addrs4;
+        std::vector<struct sockaddr_storage> addrs6;
+        std::vector<ResolveCallback> callbacks;
+    };
+
+    struct Query {
+        std::string key;     //所属的Request
+        uint16_t type;       //A或AAAA
+        int32_t tries;
+        size_t server;       //当前发往的nameserver下标
+        TaskQueue::TaskId timer;
+    };
+
+    static std::string cacheKey(const std::string &host, int family);
+    bool lookupLocal(const std::string &host, int family, std::vector<struct sockaddr_storage> &addrs);
+    void loadResolvConf();
+    void loadHosts();
+    void startRequest(const std::string &host, int family, const ResolveCallback &callback);
+    void startQuery(const std::string &key, uint16_t type);
+    void sendQuery(uint16_t id, Query &query);
+    void onTimeout(uint16_t id);
+    void onReadable(int fd);
+    void onResponse(const char *data, size_t size, const struct sockaddr_storage &from);
+    void finishQuery(uint16_t id, const std::vector<struct sockaddr_storage> &addrs, uint32_t ttl);
+    void finishRequest(const std::string &key);
+    void updateCache(const std::string &key, const std::vector<struct sockaddr_storage> &addrs, uint32_t ttl);
+    int socketFor(int family);
+
+private:
+    //以下只在解析线程访问
+    std::vector<struct sockaddr_storage> servers_;
+    int64_t timeout_ms_;
+    int32_t attempts_;
+    int fd4_;
+    int fd6_;
+    uint32_t random_;
+    std::unordered_map<std::string, Request> requests_;
+    std::unordered_map<uint16_t, Query> queries_;
+
+    //启动时读取，之后只读
+    std::unordered_map<std::string, std::vector<struct sockaddr_storage>> hosts_;
+
+    std::shared_ptr<const CacheMap> cache_;
+    std::atomic<uint64_t> cache_version_;
+    std::mutex cache_mutex_;  //只在发布新快照和线程刷新快照时使用
+
+    std::shared_ptr<ThreadPool> loop_;  //最后声明，析构时先停止线程
+};
+
+}
@@ -3,10 +3,16 @@
 #include "socket_util.h"
 #include "logger.h"
 
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 namespace infra {
 
-EventDriver::EventDriver() {
 #if defined(_WIN32)
+EventDriver::EventDriver() {
     const char *localip = "127.0.0.1";
     auto fd = SocketUtil::listen(0, localip);
     if (fd < 0) {
@@ -22,15 +28,9 @@ EventDriver::EventDriver() {
     SocketUtil::setNoDelay(fd_[0]);
     SocketUtil::setNoDelay(fd_[1]);
     close_socket(fd);
-#else
-    if (pipe(fd_) == -1) {
-        throw runtime_error("Create posix pipe failed");
-    }
-#endif
+
     SocketUtil::setNoBlocked(fd_[0], true);
     SocketUtil::setNoBlocked(fd_[1], false);
-    SocketUtil::setCloExec(fd_[0]);
-    SocketUtil::setCloExec(fd_[1]);
 }
 
 EventDriver::~EventDriver() {
@@ -48,44 +48,294 @@ void EventDriver::WakeUp() {
     int ret;
     const char buf[1] = {};
     do {
-#if defined(_WIN32)
         ret = send(fd_[1], (char *)buf, 1, 0);
-#else
-        ret = ::write(_pipe_fd[1], buf, n);
-#endif // defined(_WIN32)
     } while (-1 == ret && EINTR == get_uv_error(true));
 }
 
-#if defined(_WIN32)
-bool EventDriver::Wait(int64_t wait_duration /*ms*/, bool process_io) {
+int EventDriver::addEvent(int fd, int events, EventCallback callback) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    if (handlers_.size() >= FD_SETSIZE - 1) {
+        errorf("select can not watch more than %d fds\n", FD_SETSIZE);
+        return -1;
+    }
+    EventHandler handler;
+    handler.events = events;
+    handler.callback = std::make_shared<EventCallback>(std::move(callback));
+    handlers_[fd] = handler;
+    //让正在select的线程重新收集fd
+    WakeUp();
+    return 0;
+}
 
-    fd_set socket_set;
-    FD_ZERO(&socket_set);
-    FD_SET(fd_[0], &socket_set);
+int EventDriver::modifyEvent(int fd, int events, EventCallback callback) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    auto it = handlers_.find(fd);
+    if (it == handlers_.end()) {
+        return -1;
+    }
+    it->second.events = events;
+    if (callback) {
+        it->second.callback = std::make_shared<EventCallback>(std::move(callback));
+    }
+    WakeUp();
+    return 0;
+}
 
-    long wait_seconds = long(wait_duration / 1000);
-    long wait_miliseconds = wait_duration % 10000000;
-    struct timeval timeout = {wait_seconds, wait_miliseconds};
-    if (select(FD_SETSIZE, &socket_set, NULL, NULL, &timeout) == SOCKET_ERROR) {
+int EventDriver::delEvent(int fd) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    return handlers_.erase(fd) ? 0 : -1;
+}
+
+//select的fd数量受FD_SETSIZE限制，仅作为windows下的兼容实现
+bool EventDriver::Wait(int64_t wait_duration /*ms*/, bool process_io) {
+    fd_set read_set, write_set, error_set;
+    FD_ZERO(&read_set);
+    FD_ZERO(&write_set);
+    FD_ZERO(&error_set);
+    FD_SET(fd_[0], &read_set);
+    if (process_io) {
+        std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+        for (auto &it : handlers_) {
+            if (it.second.events & EventRead) {
+                FD_SET(it.first, &read_set);
+            }
+            if (it.second.events & EventWrite) {
+                FD_SET(it.first, &write_set);
+            }
+            FD_SET(it.first, &error_set);
+        }
+    }
+
+    struct timeval timeout = {long(wait_duration / 1000), long(wait_duration % 1000) * 1000};
+    int ret = select(FD_SETSIZE, &read_set, &write_set, &error_set, wait_duration < 0 ? NULL : &timeout);
+    if (ret == SOCKET_ERROR) {
         errorf("select failed\n");
         return false;
     }
 
-    if (FD_ISSET(fd_[0], &socket_set)) {
-        char buffer[1];
-        const size_t res = ::recv(fd_[0], buffer, sizeof(buffer), 0);
-        if (res != 1) {
-            warnf("read fd_[0](%d) is not 1, res:%d\n", fd_[0], res);
-            return true;
-        }
+    if (FD_ISSET(fd_[0], &read_set)) {
+        char buffer[64];
+        ::recv(fd_[0], buffer, sizeof(buffer), 0);
     }
 
+    if (process_io && ret > 0) {
+        std::vector<std::pair<int, int>> ready;
+        {
+            std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+            for (auto &it : handlers_) {
+                int events = 0;
+                if (FD_ISSET(it.first, &read_set)) {
+                    events |= EventRead;
+                }
+                if (FD_ISSET(it.first, &write_set)) {
+                    events |= EventWrite;
+                }
+                if (FD_ISSET(it.first, &error_set)) {
+                    events |= EventError;
+                }
+                if (events) {
+                    ready.emplace_back(it.first, events);
+                }
+            }
+        }
+        for (auto &it : ready) {
+            dispatch(it.first, it.second);
+        }
+    }
     return true;
 }
 #else
+//ONESHOT保证同一fd的回调同一时刻只在一个线程执行，回调返回后由rearm重新激活
+static uint32_t toEpoll(int events) {
+    uint32_t ret = EPOLLET | EPOLLONESHOT;
+    if (events & EventDriver::EventRead) {
+        ret |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (events & EventDriver::EventWrite) {
+        ret |= EPOLLOUT;
+    }
+    return ret;
+}
+
+static int fromEpoll(uint32_t events) {
+    int ret = 0;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLPRI)) {
+        ret |= EventDriver::EventRead;
+    }
+    if (events & EPOLLOUT) {
+        ret |= EventDriver::EventWrite;
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        ret |= EventDriver::EventError;
+    }
+    return ret;
+}
+
+EventDriver::EventDriver() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+        throw std::runtime_error("epoll_create1 failed");
+    }
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ == -1) {
+        close_socket(epoll_fd_);
+        throw std::runtime_error("eventfd failed");
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = wakeup_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev) == -1) {
+        close_socket(wakeup_fd_);
+        close_socket(epoll_fd_);
+        throw std::runtime_error("epoll_ctl add eventfd failed");
+    }
+}
+
+EventDriver::~EventDriver() {
+    if (wakeup_fd_ != -1) {
+        close_socket(wakeup_fd_);
+        wakeup_fd_ = -1;
+    }
+    if (epoll_fd_ != -1) {
+        close_socket(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+}
+
+void EventDriver::WakeUp() {
+    //边沿触发下每次write都会产生新的事件，无需等待读端清零
+    uint64_t one = 1;
+    ssize_t ret;
+    do {
+        ret = ::write(wakeup_fd_, &one, sizeof(one));
+    } while (-1 == ret && EINTR == get_uv_error(true));
+}
+
+int EventDriver::addEvent(int fd, int events, EventCallback callback) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        errorf("epoll_ctl add fd %d failed, errno:%d\n", fd, get_uv_error(true));
+        return -1;
+    }
+    EventHandler handler;
+    handler.events = events;
+    handler.callback = std::make_shared<EventCallback>(std::move(callback));
+    handlers_[fd] = handler;
+    return 0;
+}
+
+int EventDriver::modifyEvent(int fd, int events, EventCallback callback) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    auto it = handlers_.find(fd);
+    if (it == handlers_.end()) {
+        return -1;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == -1) {
+        errorf("epoll_ctl mod fd %d failed, errno:%d\n", fd, get_uv_error(true));
+        return -1;
+    }
+    it->second.events = events;
+    if (callback) {
+        it->second.callback = std::make_shared<EventCallback>(std::move(callback));
+    }
+    return 0;
+}
+
+void EventDriver::rearm(int fd) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    auto it = handlers_.find(fd);
+    if (it == handlers_.end()) {
+        return;
+    }
+    //MOD会重新检查fd当前状态，回调执行期间到达的数据不会丢失
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(it->second.events);
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == -1) {
+        errorf("epoll_ctl rearm fd %d failed, errno:%d\n", fd, get_uv_error(true));
+    }
+}
+
+int EventDriver::delEvent(int fd) {
+    std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+    if (handlers_.erase(fd) == 0) {
+        return -1;
+    }
+    //fd可能已经被close，此时内核已自动移除，忽略错误
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    return 0;
+}
+
 bool EventDriver::Wait(int64_t wait_duration /*ms*/, bool process_io) {
-    return false;
+    static const int kMaxEvents = 128;
+    struct epoll_event events[kMaxEvents];
+
+    if (process_io) {
+        std::vector<std::pair<int, int>> pending;
+        {
+            std::lock_guard<decltype(pending_mutex_)> guard(pending_mutex_);
+            pending.swap(pending_events_);
+        }
+        for (auto &it : pending) {
+            dispatch(it.first, it.second);
+        }
+    }
+
+    int timeout = wait_duration < 0 ? -1 : (wait_duration > INT32_MAX ? INT32_MAX : (int)wait_duration);
+    int count = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
+    if (count == -1) {
+        if (get_uv_error(true) == EINTR) {
+            return true;
+        }
+        errorf("epoll_wait failed, errno:%d\n", get_uv_error(true));
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == wakeup_fd_) {
+            uint64_t value;
+            while (::read(wakeup_fd_, &value, sizeof(value)) > 0) {
+            }
+            continue;
+        }
+        int ready = fromEpoll(events[i].events);
+        if (process_io) {
+            dispatch(fd, ready);
+        } else {
+            std::lock_guard<decltype(pending_mutex_)> guard(pending_mutex_);
+            pending_events_.emplace_back(fd, ready);
+        }
+    }
+    return true;
 }
 #endif // defined(_WIN32)
 
-}
\ No newline at end of file
+void EventDriver::dispatch(int fd, int events) {
+    std::shared_ptr<EventCallback> callback;
+    {
+        std::lock_guard<decltype(handlers_mutex_)> guard(handlers_mutex_);
+        auto it = handlers_.find(fd);
+        if (it == handlers_.end()) {
+            return;
+        }
+        callback = it->second.callback;
+    }
+    //回调中可能delEvent，持有shared_ptr保证回调对象在执行期间有效
+    (*callback)(events);
+#if !defined(_WIN32)
+    rearm(fd);
+#endif
+}
+
+}
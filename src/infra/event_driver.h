@@ -2,6 +2,10 @@
 #include <stdint.h>
 #include <memory>
 #include <array>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 
 #include "socket_util.h"
 
@@ -10,23 +14,69 @@ namespace infra {
 class EventDriver {
 public:
 
+    enum Event {
+        EventRead  = 1 << 0,
+        EventWrite = 1 << 1,
+        EventError = 1 << 2
+    };
+
+    //fd就绪回调，参数为触发的Event组合
+    typedef std::function<void(int events)> EventCallback;
+
     EventDriver();
 
     virtual ~EventDriver();
 
+    /**
+     * 等待唤醒或io事件
+     * @param wait_duration 超时时间(ms)，小于0表示一直等待
+     * @param process_io 是否在当前线程派发fd回调，为false时就绪事件暂存到下一次process_io的Wait
+     * @return 出错返回false
+     */
     virtual bool Wait(int64_t wait_duration /*ms*/, bool process_io = false);
 
     virtual void WakeUp();
 
+    /**
+     * 注册fd，linux下为边沿触发，回调中需要把数据读/写到EAGAIN
+     * 多个线程同时Wait时，同一fd的回调不会并发执行，回调返回后才会再次派发该fd的事件
+     * @return 成功返回0，失败返回-1
+     */
+    int addEvent(int fd, int events, EventCallback callback);
+
+    //修改关注的事件，callback为空时沿用原来的回调
+    int modifyEvent(int fd, int events, EventCallback callback = nullptr);
+
+    int delEvent(int fd);
+
 private:
 
+    void dispatch(int fd, int events);
+
+#if !defined(_WIN32)
+    //ONESHOT触发后重新激活fd
+    void rearm(int fd);
+#endif
 
 private:
-    
+
+#if defined(_WIN32)
     std::array<int, 2> fd_;
+#else
+    int epoll_fd_;
+    int wakeup_fd_;
+#endif
 
-};
-    
+    struct EventHandler {
+        int events;
+        std::shared_ptr<EventCallback> callback;
+    };
+    std::unordered_map<int, EventHandler> handlers_;
+    std::mutex handlers_mutex_;
 
+    //process_io为false时收到的fd事件
+    std::vector<std::pair<int, int>> pending_events_;
+    std::mutex pending_mutex_;
+};
 
-}
\ No newline at end of file
+}
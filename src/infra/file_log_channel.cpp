@@ -0,0 +1,365 @@
+#include "file_log_channel.h"
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <algorithm>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+
+namespace infra {
+
+//日志线程追加的块大小，写满就交给写盘线程
+static const size_t kBlockSize = 64 * 1024;
+static const size_t kMaxFreeBlocks = 16;
+#if defined(IOV_MAX)
+static const int kMaxIov = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+static const int kMaxIov = 1024;
+#endif
+
+static int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+FileLogChannel::FileLogChannel(const std::string &path, const FileLogOptions &options, const std::string &name)
+    : LogChannel(name), path_(path), options_(options), pending_bytes_(0), dropped_bytes_(0), running_(true),
+      fd_(-1), file_size_(0), opened_time_(0) {
+    current_.reserve(kBlockSize);
+    loadRotatedFiles();
+    pruneRotatedFiles();
+    openFile();
+    thread_ = std::make_shared<std::thread>([this]() {run(); });
+}
+
+FileLogChannel::~FileLogChannel() {
+    handOff();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    if (thread_->joinable()) {
+        thread_->join();
+    }
+    closeFile();
+    reapCompressors(false);
+}
+
+void FileLogChannel::write(const LogContent &content) {
+    current_.append(content.data, content.size);
+    if (current_.size() >= kBlockSize) {
+        handOff();
+    }
+}
+
+void FileLogChannel::flush() {
+    //日志线程每处理完一批日志调用一次，写盘线程会把多次交付的块合并写入
+    handOff();
+}
+
+uint64_t FileLogChannel::droppedBytes() const {
+    return dropped_bytes_.load(std::memory_order_relaxed);
+}
+
+void FileLogChannel::handOff() {
+    if (current_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_bytes_ + current_.size() > options_.max_buffered_bytes) {
+            //磁盘跟不上，丢弃这一块保证内存有上限，不阻塞日志线程
+            dropped_bytes_.fetch_add(current_.size(), std::memory_order_relaxed);
+            current_.clear();
+            return;
+        }
+        pending_bytes_ += current_.size();
+        pending_.push_back(std::move(current_));
+        if (!free_blocks_.empty()) {
+            current_ = std::move(free_blocks_.back());
+            free_blocks_.pop_back();
+        } else {
+            current_ = std::string();
+        }
+    }
+    cond_.notify_one();
+    current_.clear();
+    current_.reserve(kBlockSize);
+}
+
+void FileLogChannel::run() {
+    std::vector<std::string> blocks;
+    while (true) {
+        size_t taken = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::seconds(1), [this]() {
+                return !pending_.empty() || !running_;
+            });
+            blocks.swap(pending_);
+            if (blocks.empty() && !running_) {
+                break;
+            }
+        }
+
+        if (!blocks.empty()) {
+            for (auto &block : blocks) {
+                taken += block.size();
+            }
+            writeBlocks(blocks);
+            std::lock_guard<std::mutex> lock(mutex_);
+            //写盘期间这些块仍占用内存，写完才从上限中扣除
+            pending_bytes_ -= taken;
+            for (auto &block : blocks) {
+                if (free_blocks_.size() >= kMaxFreeBlocks) {
+                    break;
+                }
+                block.clear();
+                free_blocks_.push_back(std::move(block));
+            }
+            blocks.clear();
+        }
+
+        if (options_.rotate_interval > 0 && nowSeconds() - opened_time_ >= options_.rotate_interval && file_size_ > 0) {
+            rotate();
+        }
+        reapCompressors(true);
+    }
+}
+
+void FileLogChannel::writeBlocks(std::vector<std::string> &blocks) {
+    if (fd_ < 0 && !openFile()) {
+        for (auto &block : blocks) {
+            dropped_bytes_.fetch_add(block.size(), std::memory_order_relaxed);
+        }
+        return;
+    }
+#if defined(_WIN32)
+    for (auto &block : blocks) {
+        int ret = _write(fd_, block.data(), (unsigned int)block.size());
+        if (ret < 0) {
+            dropped_bytes_.fetch_add(block.size(), std::memory_order_relaxed);
+            continue;
+        }
+        file_size_ += ret;
+        if (file_size_ >= options_.max_file_size) {
+            rotate();
+        }
+    }
+#else
+    struct iovec iov[kMaxIov];
+    size_t index = 0;
+    size_t offset = 0;  //blocks[index]中已写入的字节数
+    while (index < blocks.size()) {
+        int count = 0;
+        for (size_t i = index; i < blocks.size() && count < kMaxIov; i++, count++) {
+            size_t skip = i == index ? offset : 0;
+            iov[count].iov_base = const_cast<char*>(blocks[i].data()) + skip;
+            iov[count].iov_len = blocks[i].size() - skip;
+        }
+        ssize_t ret = ::writev(fd_, iov, count);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            //磁盘满等错误，丢弃本次剩余的内容
+            for (size_t i = index; i < blocks.size(); i++) {
+                dropped_bytes_.fetch_add(blocks[i].size() - (i == index ? offset : 0), std::memory_order_relaxed);
+            }
+            return;
+        }
+        file_size_ += ret;
+        size_t written = (size_t)ret;
+        while (index < blocks.size() && written >= blocks[index].size() - offset) {
+            written -= blocks[index].size() - offset;
+            offset = 0;
+            index++;
+        }
+        offset += written;
+        if (file_size_ >= options_.max_file_size) {
+            rotate();
+            if (fd_ < 0) {
+                return;
+            }
+        }
+    }
+#endif
+}
+
+bool FileLogChannel::openFile() {
+#if defined(_WIN32)
+    fd_ = _open(path_.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+    if (fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    file_size_ = fstat(fd_, &st) == 0 ? (uint64_t)st.st_size : 0;
+    opened_time_ = nowSeconds();
+    return true;
+}
+
+void FileLogChannel::closeFile() {
+    if (fd_ >= 0) {
+#if defined(_WIN32)
+        _close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
+    }
+}
+
+void FileLogChannel::rotate() {
+    closeFile();
+
+    time_t now = (time_t)nowSeconds();
+    struct tm tm;
+#if defined(_WIN32)
+    localtime_s(&tm, &now);
+#else
+    localtime_r(&now, &tm);
+#endif
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%04d%02d%02d-%02d%02d%02d",
+        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    std::string rotated = path_ + suffix;
+    //同一秒内多次切分时加序号区分
+    struct stat st;
+    for (int i = 1; stat(rotated.c_str(), &st) == 0 || stat((rotated + ".gz").c_str(), &st) == 0; i++) {
+        rotated = path_ + suffix + "." + std::to_string(i);
+    }
+    if (rename(path_.c_str(), rotated.c_str()) == 0) {
+        if (options_.compress) {
+            compress(rotated);
+        }
+        rotated_files_.push_back(rotated);
+        pruneRotatedFiles();
+    }
+    openFile();
+}
+
+void FileLogChannel::pruneRotatedFiles() {
+    while (options_.max_rotated_files > 0 && rotated_files_.size() > options_.max_rotated_files) {
+        //压缩失败时保留的是原文件，两个都尝试删除
+        remove((rotated_files_.front() + ".gz").c_str());
+        remove(rotated_files_.front().c_str());
+        rotated_files_.pop_front();
+    }
+}
+
+//解析path.YYYYmmdd-HHMMSS[.N][.gz]，返回不带.gz的文件名和排序用的时间、序号
+static bool parseRotatedName(const std::string &prefix, const std::string &name, std::string &rotated,
+                             std::string &stamp, long &sequence) {
+    static const size_t kStampSize = 15;
+    if (name.size() < prefix.size() + 1 + kStampSize || name.compare(0, prefix.size(), prefix) != 0 || name[prefix.size()] != '.') {
+        return false;
+    }
+    std::string rest = name.substr(prefix.size() + 1);
+    if (rest.size() > 3 && rest.compare(rest.size() - 3, 3, ".gz") == 0) {
+        rest.resize(rest.size() - 3);
+    }
+    for (size_t i = 0; i < kStampSize; i++) {
+        bool valid = i == 8 ? rest[i] == '-' : (rest[i] >= '0' && rest[i] <= '9');
+        if (!valid) {
+            return false;
+        }
+    }
+    stamp = rest.substr(0, kStampSize);
+    sequence = 0;
+    if (rest.size() > kStampSize) {
+        if (rest[kStampSize] != '.' || rest.size() == kStampSize + 1) {
+            return false;
+        }
+        for (size_t i = kStampSize + 1; i < rest.size(); i++) {
+            if (rest[i] < '0' || rest[i] > '9') {
+                return false;
+            }
+            sequence = sequence * 10 + (rest[i] - '0');
+        }
+    }
+    rotated = prefix + "." + rest;
+    return true;
+}
+
+void FileLogChannel::loadRotatedFiles() {
+#if !defined(_WIN32)
+    //之前的进程切分出的历史文件也要计入保留个数
+    size_t slash = path_.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path_.substr(0, slash));
+    std::string base = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+    std::string head = slash == std::string::npos ? "" : path_.substr(0, slash + 1);
+    DIR *handle = opendir(dir.c_str());
+    if (!handle) {
+        return;
+    }
+    struct Entry {
+        std::string stamp;
+        long sequence;
+        std::string path;
+    };
+    std::vector<Entry> entries;
+    struct dirent *item;
+    while ((item = readdir(handle)) != nullptr) {
+        Entry entry;
+        std::string rotated;
+        if (parseRotatedName(base, item->d_name, rotated, entry.stamp, entry.sequence)) {
+            entry.path = head + rotated;
+            entries.push_back(entry);
+        }
+    }
+    closedir(handle);
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.stamp != b.stamp ? a.stamp < b.stamp : a.sequence < b.sequence;
+    });
+    for (auto &entry : entries) {
+        //压缩中途退出时原文件和.gz可能同时存在
+        if (rotated_files_.empty() || rotated_files_.back() != entry.path) {
+            rotated_files_.push_back(entry.path);
+        }
+    }
+#endif
+}
+
+void FileLogChannel::compress(const std::string &path) {
+#if !defined(_WIN32)
+    char gzip[] = "gzip";
+    char force[] = "-f";
+    std::vector<char> file(path.begin(), path.end());
+    file.push_back('\0');
+    char *argv[] = {gzip, force, file.data(), nullptr};
+    pid_t pid = 0;
+    if (posix_spawnp(&pid, "gzip", nullptr, nullptr, argv, environ) == 0) {
+        compressors_.push_back(pid);
+    }
+#endif
+}
+
+void FileLogChannel::reapCompressors(bool nohang) {
+#if !defined(_WIN32)
+    for (auto it = compressors_.begin(); it != compressors_.end();) {
+        int status = 0;
+        if (waitpid((pid_t)*it, &status, nohang ? WNOHANG : 0) != 0) {
+            it = compressors_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#endif
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include "logger.h"
+
+namespace infra {
+
+typedef struct FileLogOptions_tag {
+    size_t max_file_size = 64 * 1024 * 1024;      //单个文件超过这个大小后切分
+    int64_t rotate_interval = 0;                   //按时间切分的间隔(秒)，0表示不按时间切分
+    size_t max_rotated_files = 10;                 //保留的历史文件个数(包括之前进程留下的)，0表示全部保留
+    bool compress = true;                          //切分后在后台用gzip压缩历史文件
+    size_t max_buffered_bytes = 16 * 1024 * 1024;  //等待写盘的最大字节数，磁盘跟不上时丢弃
+} FileLogOptions;
+
+/**
+ * 文件日志输出
+ * 日志线程只把内容追加到内存块，写满或flush时交给写盘线程，写盘线程用writev批量写入
+ * 按大小或时间切分文件，历史文件重命名为path.YYYYmmdd-HHMMSS并在后台压缩
+ */
+class FileLogChannel : public LogChannel {
+public:
+    FileLogChannel(const std::string &path, const FileLogOptions &options = FileLogOptions(), const std::string &name = "file");
+    virtual ~FileLogChannel() override;
+    virtual void write(const LogContent &content) override;
+    virtual void flush() override;
+    //因等待写盘的数据超过上限或写文件失败而丢弃的字节数
+    uint64_t droppedBytes() const;
+private:
+    void handOff();
+    void run();
+    void writeBlocks(std::vector<std::string> &blocks);
+    bool openFile();
+    void closeFile();
+    void rotate();
+    void pruneRotatedFiles();
+    void loadRotatedFiles();
+    void compress(const std::string &path);
+    void reapCompressors(bool nohang);
+private:
+    std::string path_;
+    FileLogOptions options_;
+    std::string current_;                  //日志线程正在追加的块
+    std::vector<std::string> pending_;     //等待写盘的块
+    std::vector<std::string> free_blocks_; //写完回收的块，复用内存
+    size_t pending_bytes_;                 //pending_和写盘线程正在写的块的总字节数
+    std::atomic<uint64_t> dropped_bytes_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool running_;
+    std::shared_ptr<std::thread> thread_;
+
+    //以下只在写盘线程访问
+    int fd_;
+    uint64_t file_size_;
+    int64_t opened_time_;                  //当前文件的打开时间(秒)
+    std::deque<std::string> rotated_files_;
+    std::vector<int64_t> compressors_;     //正在运行的压缩进程
+};
+
+}
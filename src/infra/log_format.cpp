@@ -0,0 +1,218 @@
+#include "log_format.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+namespace infra {
+
+namespace {
+
+//按顺序读取编码后的参数
+class LogArgReader {
+public:
+    LogArgReader(const char *data, size_t size) : data_(data), size_(size), offset_(0) {}
+
+    bool next(LogArgType &type, int64_t &integer, double &real, const char *&str, size_t &length) {
+        if (offset_ >= size_) {
+            return false;
+        }
+        type = (LogArgType)data_[offset_];
+        size_t remain = size_ - offset_ - 1;
+        const char *payload = data_ + offset_ + 1;
+        switch (type) {
+        case LogArgInt:
+        case LogArgUint:
+        case LogArgPointer:
+            if (remain < sizeof(int64_t)) {
+                break;
+            }
+            memcpy(&integer, payload, sizeof(int64_t));
+            offset_ += 1 + sizeof(int64_t);
+            return true;
+        case LogArgDouble:
+            if (remain < sizeof(double)) {
+                break;
+            }
+            memcpy(&real, payload, sizeof(double));
+            offset_ += 1 + sizeof(double);
+            return true;
+        case LogArgString: {
+            uint16_t size = 0;
+            if (remain < sizeof(size)) {
+                break;
+            }
+            memcpy(&size, payload, sizeof(size));
+            if (remain - sizeof(size) < size) {
+                break;
+            }
+            str = payload + sizeof(size);
+            length = size;
+            offset_ += 1 + sizeof(size) + size;
+            return true;
+        }
+        default:
+            break;
+        }
+        offset_ = size_;  //数据损坏，不再继续读取
+        return false;
+    }
+
+private:
+    const char *data_;
+    size_t size_;
+    size_t offset_;
+};
+
+void appendFormat(std::string &out, const char *spec, ...) {
+    char buffer[512];
+    va_list ap;
+    va_start(ap, spec);
+    int size = vsnprintf(buffer, sizeof(buffer), spec, ap);
+    va_end(ap);
+    if (size > 0) {
+        out.append(buffer, (size_t)size < sizeof(buffer) ? (size_t)size : sizeof(buffer) - 1);
+    }
+}
+
+}
+
+void formatLogArgs(const char *fmt, const char *args, size_t size, std::string &out) {
+    LogArgReader reader(args, size);
+    LogArgType type;
+    int64_t integer = 0;
+    double real = 0;
+    const char *str = nullptr;
+    size_t length = 0;
+
+    const char *p = fmt;
+    while (*p) {
+        if (*p != '%') {
+            const char *begin = p;
+            while (*p && *p != '%') {
+                p++;
+            }
+            out.append(begin, p - begin);
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        //重新拼出不含长度修饰符的格式说明，'*'宽度和精度替换为实际参数
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = *p++;
+        bool bad = false;
+        while (*p && strchr("-+ #0", *p) && n < 16) {
+            spec[n++] = *p++;
+        }
+        for (int part = 0; part < 2 && !bad; part++) {
+            if (part == 1) {
+                if (*p != '.') {
+                    break;
+                }
+                spec[n++] = *p++;
+            }
+            if (*p == '*') {
+                p++;
+                if (!reader.next(type, integer, real, str, length) || (type != LogArgInt && type != LogArgUint)) {
+                    bad = true;
+                    break;
+                }
+                n += snprintf(spec + n, 16, "%d", (int)integer);
+            } else {
+                while (*p >= '0' && *p <= '9' && n < 40) {
+                    spec[n++] = *p++;
+                }
+            }
+        }
+        while (*p && strchr("hljztLq", *p)) {
+            p++;
+        }
+        char conversion = *p;
+        if (conversion) {
+            p++;
+        }
+        if (bad || !conversion || !reader.next(type, integer, real, str, length)) {
+            out += "<?>";
+            continue;
+        }
+
+        if (type == LogArgString && conversion != 's') {
+            out += "<?>";
+            continue;
+        }
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = 'd';
+            spec[n] = 0;
+            appendFormat(out, spec, type == LogArgDouble ? (long long)real : (long long)integer);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conversion;
+            spec[n] = 0;
+            appendFormat(out, spec, type == LogArgDouble ? (unsigned long long)real : (unsigned long long)integer);
+            break;
+        case 'c':
+            if (type == LogArgDouble) {
+                out += "<?>";
+                break;
+            }
+            spec[n++] = 'c';
+            spec[n] = 0;
+            appendFormat(out, spec, (int)integer);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec[n++] = conversion;
+            spec[n] = 0;
+            if (type == LogArgDouble) {
+                appendFormat(out, spec, real);
+            } else if (type == LogArgInt) {
+                appendFormat(out, spec, (double)integer);
+            } else {
+                appendFormat(out, spec, (double)(uint64_t)integer);
+            }
+            break;
+        case 's':
+            if (type != LogArgString) {
+                out += "<?>";
+                break;
+            }
+            if (n == 1) {
+                out.append(str, length);  //常见的"%s"直接追加
+            } else {
+                std::string value(str, length);
+                spec[n++] = 's';
+                spec[n] = 0;
+                appendFormat(out, spec, value.c_str());
+            }
+            break;
+        case 'p':
+            appendFormat(out, "0x%" PRIx64, (uint64_t)integer);
+            break;
+        default:
+            out += "<?>";
+            break;
+        }
+    }
+}
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+namespace infra {
+
+typedef enum {
+    LogLevelError = 0,
+    LogLevelWarn,
+    LogLevelInfo,
+    LogLevelDebug,
+    LogLevelTrace
+} LogLevel;
+
+/**
+ * 二进制日志调用点的静态信息，由printBinLogf在调用点定义为static变量
+ * 日志只记录指向它的指针和原始参数，格式化推迟到日志线程或离线解码工具
+ */
+typedef struct LogFormat_tag {
+    LogLevel level;
+    const char *file;
+    int line;
+    const char *fmt;   //必须是字符串常量
+} LogFormat;
+
+//参数类型标记，每个参数编码为1字节类型+数据
+typedef enum {
+    LogArgInt = 1,     //int64_t
+    LogArgUint,        //uint64_t
+    LogArgDouble,      //double
+    LogArgPointer,     //uint64_t
+    LogArgString       //uint16_t长度+内容，不含结尾的0
+} LogArgType;
+
+//单条二进制日志参数的最大长度，超出的参数被截断
+static const size_t kLogMaxArgsSize = 512;
+//单个字符串参数的最大长度
+static const size_t kLogMaxStringArg = 256;
+
+/**
+ * 二进制日志文件格式，整数为本机字节序
+ * 文件头: "SRTCBLOG" + uint32_t版本号
+ * 之后是若干条目，首字节为LogFileEntry:
+ *   LogFileFormat: uint32_t id, uint8_t level, int32_t line, uint16_t长度+file, uint16_t长度+fmt
+ *   LogFileRecord: uint32_t id, int64_t timestamp(ms), uint16_t长度+参数
+ *   LogFileText:   uint8_t level, int64_t timestamp(ms), uint32_t长度+已格式化的日志行
+ */
+static const char kLogFileMagic[8] = {'S', 'R', 'T', 'C', 'B', 'L', 'O', 'G'};
+static const uint32_t kLogFileVersion = 1;
+
+typedef enum {
+    LogFileFormat = 1,
+    LogFileRecord,
+    LogFileText
+} LogFileEntry;
+
+//在调用线程把参数编码到栈上的缓冲区，空间不足时丢弃后续参数
+class LogArgWriter {
+public:
+    LogArgWriter(char *buffer, size_t capacity) : buffer_(buffer), capacity_(capacity), size_(0) {}
+
+    size_t size() const {
+        return size_;
+    }
+
+    void write() {}
+
+    template <typename T, typename... Args>
+    void write(const T &value, const Args&... args) {
+        put(value);
+        write(args...);
+    }
+
+private:
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(T value) {
+        putScalar(LogArgInt, (int64_t)value);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(T value) {
+        putScalar(LogArgUint, (uint64_t)value);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type put(T value) {
+        putScalar(LogArgInt, (int64_t)value);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(T value) {
+        putScalar(LogArgDouble, (double)value);
+    }
+
+    template <typename T>
+    void put(T *value) {
+        putScalar(LogArgPointer, (uint64_t)(uintptr_t)value);
+    }
+
+    void put(const char *value) {
+        putString(value, value ? strlen(value) : 0);
+    }
+
+    void put(char *value) {
+        put((const char*)value);
+    }
+
+    void put(const std::string &value) {
+        putString(value.data(), value.size());
+    }
+
+    template <typename T>
+    void putScalar(LogArgType type, T value) {
+        if (size_ + 1 + sizeof(T) > capacity_) {
+            capacity_ = size_;  //后续参数也不再写入，避免与格式串错位
+            return;
+        }
+        buffer_[size_] = (char)type;
+        memcpy(buffer_ + size_ + 1, &value, sizeof(T));
+        size_ += 1 + sizeof(T);
+    }
+
+    void putString(const char *value, size_t length) {
+        if (length > kLogMaxStringArg) {
+            length = kLogMaxStringArg;
+        }
+        if (size_ + 1 + sizeof(uint16_t) + length > capacity_) {
+            capacity_ = size_;
+            return;
+        }
+        uint16_t size = (uint16_t)length;
+        buffer_[size_] = (char)LogArgString;
+        memcpy(buffer_ + size_ + 1, &size, sizeof(size));
+        if (length) {
+            memcpy(buffer_ + size_ + 1 + sizeof(size), value, length);
+        }
+        size_ += 1 + sizeof(size) + length;
+    }
+
+private:
+    char *buffer_;
+    size_t capacity_;
+    size_t size_;
+};
+
+/**
+ * 按fmt把编码后的参数格式化后追加到out
+ * 长度修饰符由参数的实际类型决定，参数缺失或类型不符时输出占位符而不会越界读取
+ */
+void formatLogArgs(const char *fmt, const char *args, size_t size, std::string &out);
+
+}
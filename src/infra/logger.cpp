@@ -1,7 +1,7 @@
 #include "logger.h"
 #include <stdio.h>
 #include <stdarg.h>
-#include <iostream>
+#include <string.h>
 #include <time.h>
 #include <chrono>
 #include "utils/time.h"
@@ -15,16 +15,23 @@ namespace infra {
 ConsoleLogChannel::ConsoleLogChannel(const std::string &name) : LogChannel(name) {
 }
 
-void ConsoleLogChannel::write(const std::shared_ptr<LogContent> &content) {
-    content_.push_back(content);
+void ConsoleLogChannel::write(const LogContent &content) {
+#ifdef _WIN32
+    //windows控制台颜色不能通过转义码设置，只能逐条输出
+    setConsoleColour(content.level);
+    fwrite(content.data, 1, content.size, stdout);
+#else
+    setConsoleColour(content.level);
+    buffer_.append(content.data, content.size);
+#endif
 }
 
 void ConsoleLogChannel::flush() {
-    for (auto i = 0; i < content_.size(); i++) {
-        setConsoleColour(content_[i]->level);
-        std::cout << content_[i]->content;
+    if (!buffer_.empty()) {
+        fwrite(buffer_.data(), 1, buffer_.size(), stdout);
+        buffer_.clear();
     }
-    content_.clear();
+    fflush(stdout);
 }
 
 void ConsoleLogChannel::setConsoleColour(LogLevel level) {
@@ -35,7 +42,7 @@ void ConsoleLogChannel::setConsoleColour(LogLevel level) {
         {0xE7, 0x0E , 'W'},  //黄底灰字，黑底黄字
         {0xB7, 0x0B , 'I'},  //天蓝底灰字，黑底天蓝字
         {0xA7, 0x0A , 'D'},  //绿底灰字，黑底绿字
-        {0x97, 0x09 , 'T'}   //蓝底灰字，黑底蓝字，window console默认黑底  
+        {0x97, 0x09 , 'T'}   //蓝底灰字，黑底蓝字，window console默认黑底
     };
     HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
     if (handle == 0)
@@ -43,34 +50,231 @@ void ConsoleLogChannel::setConsoleColour(LogLevel level) {
     SetConsoleTextAttribute(handle, LOG_CONST_TABLE[int(level)][1]);
 #else
 #define CLEAR_COLOR "\033[0m"
+    //与LogLevel顺序一致
     static const char* LOG_CONST_TABLE[][3] = {
-            {"\033[44;37m", "\033[34m", "T"},
-            {"\033[42;37m", "\033[32m", "D"},
-            {"\033[46;37m", "\033[36m", "I"},
+            {"\033[41;37m", "\033[31m", "E"},
             {"\033[43;37m", "\033[33m", "W"},
-            {"\033[41;37m", "\033[31m", "E"} };
-    std::cout << LOG_CONST_TABLE[int(level)][1];
+            {"\033[46;37m", "\033[36m", "I"},
+            {"\033[42;37m", "\033[32m", "D"},
+            {"\033[44;37m", "\033[34m", "T"} };
+    buffer_.append(LOG_CONST_TABLE[int(level)][1]);
 #endif
 }
 
+BinaryLogChannel::BinaryLogChannel(const std::string &path, const std::string &name) : LogChannel(name) {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_) {
+        fwrite(kLogFileMagic, 1, sizeof(kLogFileMagic), file_);
+        fwrite(&kLogFileVersion, 1, sizeof(kLogFileVersion), file_);
+    }
+}
+
+BinaryLogChannel::~BinaryLogChannel() {
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+template <typename T>
+static inline void writeValue(FILE *file, T value) {
+    fwrite(&value, 1, sizeof(value), file);
+}
+
+void BinaryLogChannel::write(const LogContent &content) {
+    if (!file_) {
+        return;
+    }
+    int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    writeValue<uint8_t>(file_, LogFileText);
+    writeValue<uint8_t>(file_, (uint8_t)content.level);
+    writeValue<int64_t>(file_, timestamp);
+    writeValue<uint32_t>(file_, (uint32_t)content.size);
+    fwrite(content.data, 1, content.size, file_);
+}
+
+void BinaryLogChannel::writeBinary(const LogBinaryContent &content) {
+    if (!file_) {
+        return;
+    }
+    auto it = format_ids_.find(content.format);
+    if (it == format_ids_.end()) {
+        //调用点第一次出现时写入格式定义，之后的记录只引用id
+        uint32_t id = (uint32_t)format_ids_.size();
+        it = format_ids_.emplace(content.format, id).first;
+        const LogFormat &format = *content.format;
+        uint16_t file_size = (uint16_t)strlen(format.file);
+        uint16_t fmt_size = (uint16_t)strlen(format.fmt);
+        writeValue<uint8_t>(file_, LogFileFormat);
+        writeValue<uint32_t>(file_, id);
+        writeValue<uint8_t>(file_, (uint8_t)format.level);
+        writeValue<int32_t>(file_, format.line);
+        writeValue<uint16_t>(file_, file_size);
+        fwrite(format.file, 1, file_size, file_);
+        writeValue<uint16_t>(file_, fmt_size);
+        fwrite(format.fmt, 1, fmt_size, file_);
+    }
+    writeValue<uint8_t>(file_, LogFileRecord);
+    writeValue<uint32_t>(file_, it->second);
+    writeValue<int64_t>(file_, content.timestamp);
+    writeValue<uint16_t>(file_, (uint16_t)content.size);
+    fwrite(content.args, 1, content.size, file_);
+}
+
+void BinaryLogChannel::flush() {
+    if (file_) {
+        fflush(file_);
+    }
+}
+
+/**
+ * 单生产者单消费者的字节环形缓冲区，生产者为打印日志的线程，消费者为日志线程
+ * 记录按8字节对齐，尾部放不下时写一条填充记录后从头开始
+ */
+class LogRing {
+public:
+    enum Kind {
+        KindText = 0,
+        KindBinary,   //内容为LogArgWriter编码的参数
+        KindPadding
+    };
+
+    struct Record {
+        uint32_t size;       //整条记录占用的字节数，含头部和对齐
+        uint16_t kind;
+        uint16_t level;
+        int32_t line;
+        uint32_t text_size;
+        const char *file;
+        const LogFormat *format;  //只有二进制日志有效
+        int64_t timestamp;   //ms
+    };
+
+    static const size_t kCapacity = 256 * 1024;
+    static const size_t kMaxText = 1024;
+    static_assert(kLogMaxArgsSize <= kMaxText, "binary log args exceed ring record");
+
+    LogRing() : buffer_(new char[kCapacity]), write_pos_(0), read_pos_(0), cached_read_pos_(0), closed_(false) {}
+
+    ~LogRing() {
+        delete[] buffer_;
+    }
+
+    //预留一条内容不超过text_size的记录，空间不足返回nullptr
+    Record *reserve(size_t text_size) {
+        size_t needed = align(sizeof(Record) + text_size);
+        size_t head = write_pos_.load(std::memory_order_relaxed);
+        size_t offset = head & (kCapacity - 1);
+        size_t contiguous = kCapacity - offset;
+        size_t required = contiguous < needed ? contiguous + needed : needed;
+        if (kCapacity - (head - cached_read_pos_) < required) {
+            cached_read_pos_ = read_pos_.load(std::memory_order_acquire);
+            if (kCapacity - (head - cached_read_pos_) < required) {
+                return nullptr;
+            }
+        }
+        if (contiguous < needed) {
+            Record *padding = reinterpret_cast<Record*>(buffer_ + offset);
+            padding->size = (uint32_t)contiguous;
+            padding->kind = KindPadding;
+            head += contiguous;
+            write_pos_.store(head, std::memory_order_release);
+            offset = 0;
+        }
+        return reinterpret_cast<Record*>(buffer_ + offset);
+    }
+
+    char *text(Record *record) {
+        return reinterpret_cast<char*>(record) + sizeof(Record);
+    }
+
+    void commit(Record *record) {
+        record->size = (uint32_t)align(sizeof(Record) + record->text_size);
+        write_pos_.store(write_pos_.load(std::memory_order_relaxed) + record->size, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return read_pos_.load(std::memory_order_relaxed) == write_pos_.load(std::memory_order_acquire);
+    }
+
+    //消费所有已提交的记录
+    template <typename F>
+    bool consume(F &&on_record) {
+        size_t tail = read_pos_.load(std::memory_order_relaxed);
+        size_t head = write_pos_.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+        while (tail != head) {
+            Record *record = reinterpret_cast<Record*>(buffer_ + (tail & (kCapacity - 1)));
+            if (record->kind != KindPadding) {
+                on_record(record, text(record));
+            }
+            tail += record->size;
+        }
+        read_pos_.store(tail, std::memory_order_release);
+        return true;
+    }
+
+    void close() {
+        closed_.store(true, std::memory_order_release);
+    }
+
+    bool closed() const {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+private:
+    static size_t align(size_t size) {
+        return (size + 7) & ~size_t(7);
+    }
+
+private:
+    static const size_t kCacheLineSize = 64;
+
+    char *buffer_;
+    std::atomic<size_t> write_pos_;
+    char pad0_[kCacheLineSize];
+    std::atomic<size_t> read_pos_;
+    char pad1_[kCacheLineSize];
+    size_t cached_read_pos_;  //生产者缓存的消费位置，减少跨核读取
+    std::atomic<bool> closed_;  //所属线程已退出
+};
+
+//线程退出时通知日志线程回收缓冲区
+struct LocalRings {
+    std::vector<std::pair<Logger*, std::shared_ptr<LogRing>>> rings;
+
+    ~LocalRings() {
+        for (auto &it : rings) {
+            it.second->close();
+        }
+    }
+};
+
+static thread_local LocalRings s_local_rings;
+
 Logger& Logger::instance() {
     static std::shared_ptr<LogChannel> console = std::make_shared<ConsoleLogChannel>();
     static std::shared_ptr<Logger> slogger = std::make_shared<Logger>(console, LogLevelTrace);
     return *slogger;
 }
 
-Logger::Logger(const std::shared_ptr<LogChannel>& channel, LogLevel level) : level_(level), running_(true) {
+Logger::Logger(const std::shared_ptr<LogChannel>& channel, LogLevel level)
+    : level_(level), overflow_policy_(LogOverflowDrop), running_(true), sleeping_(false), dropped_(0), reported_dropped_(0),
+      cached_second_(-1) {
+    line_.reserve(2048);
     addLogChannel(channel);
     thread_ = std::make_shared<std::thread>([this]() {run(); });
 }
 
 Logger::~Logger() {
-    std::lock_guard<decltype(logChannelsMutex_)> lock(logChannelsMutex_);
-    logChannels_.clear();
     running_ = false;
+    semaphore_.notify();
     if (thread_->joinable()) {
         thread_->join();
     }
+    std::lock_guard<decltype(logChannelsMutex_)> lock(logChannelsMutex_);
+    logChannels_.clear();
 }
 
 void Logger::addLogChannel(const std::shared_ptr<LogChannel>& channel) {
@@ -78,63 +282,279 @@ void Logger::addLogChannel(const std::shared_ptr<LogChannel>& channel) {
     logChannels_.push_back(channel);
 }
 
+void Logger::setLevel(LogLevel level) {
+    std::lock_guard<decltype(modulesMutex_)> lock(modulesMutex_);
+    level_.store(level, std::memory_order_relaxed);
+    for (auto &it : modules_) {
+        if (!it.second->overridden) {
+            it.second->level.store(level, std::memory_order_relaxed);
+        }
+    }
+}
+
+//由__FILE__得到的模块名去掉目录，方便按文件名设置
+static std::string moduleName(const std::string &module) {
+    size_t pos = module.find_last_of("/\\");
+    return pos == std::string::npos ? module : module.substr(pos + 1);
+}
+
+Logger::ModuleLevel *Logger::findModule(const std::string &module) {
+    auto &entry = modules_[moduleName(module)];
+    if (!entry) {
+        entry.reset(new ModuleLevel());
+        entry->level.store(level_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        entry->overridden = false;
+    }
+    return entry.get();
+}
+
+void Logger::setModuleLevel(const std::string &module, LogLevel level) {
+    std::lock_guard<decltype(modulesMutex_)> lock(modulesMutex_);
+    ModuleLevel *entry = findModule(module);
+    entry->overridden = true;
+    entry->level.store(level, std::memory_order_relaxed);
+}
+
+void Logger::resetModuleLevel(const std::string &module) {
+    std::lock_guard<decltype(modulesMutex_)> lock(modulesMutex_);
+    ModuleLevel *entry = findModule(module);
+    entry->overridden = false;
+    entry->level.store(level_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+std::atomic<int> *Logger::moduleLevel(const char *module) {
+    std::lock_guard<decltype(modulesMutex_)> lock(modulesMutex_);
+    return &findModule(module)->level;
+}
+
+void Logger::setOverflowPolicy(LogOverflowPolicy policy) {
+    overflow_policy_.store(policy, std::memory_order_relaxed);
+}
+
+uint64_t Logger::droppedCount() const {
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+LogRing *Logger::localRing() {
+    for (auto &it : s_local_rings.rings) {
+        if (it.first == this) {
+            return it.second.get();
+        }
+    }
+    auto ring = std::make_shared<LogRing>();
+    {
+        std::lock_guard<decltype(ringsMutex_)> lock(ringsMutex_);
+        rings_.push_back(ring);
+    }
+    s_local_rings.rings.emplace_back(this, ring);
+    return ring.get();
+}
+
+void Logger::wakeUp() {
+    //与run中sleeping_置位后的再次检查配对，只有日志线程在等待时才需要通知
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed) && sleeping_.exchange(false)) {
+        semaphore_.notify();
+    }
+}
+
+bool Logger::drain() {
+    std::vector<std::shared_ptr<LogRing>> rings;
+    {
+        std::lock_guard<decltype(ringsMutex_)> lock(ringsMutex_);
+        //回收线程已退出且已消费完的缓冲区
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            if ((*it)->closed() && (*it)->empty()) {
+                it = rings_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        rings = rings_;
+    }
+
+    bool consumed = false;
+    for (auto &ring : rings) {
+        consumed |= ring->consume([this](LogRing::Record *record, const char *text) {
+            if (record->kind == LogRing::KindText) {
+                writeLine(LogLevel(record->level), record->timestamp, record->file, record->line, text, record->text_size, false);
+                return;
+            }
+            LogBinaryContent content;
+            content.format = record->format;
+            content.timestamp = record->timestamp;
+            content.args = text;
+            content.size = record->text_size;
+            writeBinary(content);
+        });
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_dropped_) {
+        char buffer[128];
+        int size = snprintf(buffer, sizeof(buffer), "[logger] %llu logs dropped for buffer overflow\n",
+                            (unsigned long long)(dropped - reported_dropped_));
+        reported_dropped_ = dropped;
+        write(LogLevelWarn, buffer, size);
+        consumed = true;
+    }
+    return consumed;
+}
+
 void Logger::flush() {
     std::lock_guard<decltype(logChannelsMutex_)> lock(logChannelsMutex_);
-    for (auto it : logChannels_) {
+    for (auto &it : logChannels_) {
         it->flush();
     }
 }
 
 void Logger::run() {
     while (running_) {
+        if (drain()) {
+            flush();
+            continue;
+        }
+        sleeping_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        //置位后再检查一次，避免错过置位前写入的日志
+        if (drain()) {
+            sleeping_.store(false);
+            flush();
+            continue;
+        }
         semaphore_.wait();
-        flush();
+        sleeping_.store(false);
     }
+    //退出前输出剩余日志
+    while (drain()) {
+    }
+    flush();
 }
 
-std::string Logger::printTime() {
-    uint64_t timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
-    uint64_t milli = timestamp + 8 * 60 * 60 * 1000;  //time zone
-    auto mTime = std::chrono::milliseconds(milli);
-    auto tp = std::chrono::time_point<std::chrono::system_clock, std::chrono::milliseconds>(mTime);
-    struct tm now;
-    auto tt = std::chrono::system_clock::to_time_t(tp);
-    gmtime_s(&now, &tt);
-
-    char buffer[64] = { 0 };
-    snprintf(buffer, sizeof(buffer), "[%4d-%02d-%02d %02d:%02d:%02d.%03d]", 
-        now.tm_year + 1900, now.tm_mon + 1, now.tm_mday, now.tm_hour, now.tm_min, now.tm_sec, int(timestamp % 1000));
-    return buffer;
+size_t Logger::printTime(int64_t timestamp, char *buffer, size_t size) {
+    int64_t second = timestamp / 1000;
+    if (second != cached_second_) {
+        //同一秒内只格式化一次日期
+        time_t tt = (time_t)(second + 8 * 60 * 60);  //time zone
+        struct tm now;
+#if defined(_WIN32)
+        gmtime_s(&now, &tt);
+#else
+        gmtime_r(&tt, &now);
+#endif
+        snprintf(cached_time_, sizeof(cached_time_), "[%4d-%02d-%02d %02d:%02d:%02d",
+            now.tm_year + 1900, now.tm_mon + 1, now.tm_mday, now.tm_hour, now.tm_min, now.tm_sec);
+        cached_second_ = second;
+    }
+    int ret = snprintf(buffer, size, "%s.%03d]", cached_time_, int(timestamp % 1000));
+    return ret > 0 ? (size_t)ret : 0;
 }
 
-void Logger::write(LogLevel level, const std::string &content) {
+void Logger::write(LogLevel level, const char *data, size_t size, bool text_only) {
+    LogContent content;
+    content.level = level;
+    content.data = data;
+    content.size = size;
     std::lock_guard<decltype(logChannelsMutex_)> lock(logChannelsMutex_);
-    for (auto it : logChannels_) {
-        std::shared_ptr<LogContent> log(new LogContent(level, content));
-        it->write(log);
+    for (auto &it : logChannels_) {
+        if (!text_only || !it->binary()) {
+            it->write(content);
+        }
     }
-    semaphore_.notify();
 }
 
+void Logger::writeLine(LogLevel level, int64_t timestamp, const char *file, int line, const char *text, size_t size, bool text_only) {
+    static const char* sLogLevelString[] = {"[error]", "[warning]", "[info]", "[debug]", "[trace]"};
+    char prefix[128];
+    size_t length = printTime(timestamp, prefix, sizeof(prefix));
+    line_.assign(prefix, length);
+    line_ += sLogLevelString[level];
+    line_ += '[';
+    line_ += file;
+    line_ += ':';
+    length = snprintf(prefix, sizeof(prefix), "%d", line);
+    line_.append(prefix, length);
+    line_ += ']';
+    line_.append(text, size);
+    write(level, line_.data(), line_.size(), text_only);
+}
 
-static const char* sLogLevelString[] = {"[error]", "[warning]", "[info]", "[debug]", "[trace]"};
+void Logger::writeBinary(const LogBinaryContent &content) {
+    bool has_text_channel = false;
+    {
+        std::lock_guard<decltype(logChannelsMutex_)> lock(logChannelsMutex_);
+        for (auto &it : logChannels_) {
+            if (it->binary()) {
+                it->writeBinary(content);
+            } else {
+                has_text_channel = true;
+            }
+        }
+    }
+    //只有二进制通道时不需要格式化
+    if (has_text_channel) {
+        const LogFormat &format = *content.format;
+        text_.clear();
+        formatLogArgs(format.fmt, content.args, content.size, text_);
+        writeLine(format.level, content.timestamp, format.file, format.line, text_.data(), text_.size(), true);
+    }
+}
+
+void *Logger::reserve(LogRing *ring, size_t size) {
+    LogRing::Record *record = ring->reserve(size);
+    while (!record) {
+        if (overflow_policy_.load(std::memory_order_relaxed) == LogOverflowDrop || !running_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        wakeUp();
+        std::this_thread::yield();
+        record = ring->reserve(size);
+    }
+    return record;
+}
 
 void Logger::printLog(LogLevel level, const char *file, int line, const char *fmt, ...) {
-    if (level > level_) {
+    LogRing *ring = localRing();
+    LogRing::Record *record = static_cast<LogRing::Record*>(reserve(ring, LogRing::kMaxText));
+    if (!record) {
         return;
     }
+
     va_list ap;
     va_start(ap, fmt);
-    char buffer[1024] = { 0 };
-    if (vsprintf_s(buffer, sizeof(buffer), fmt, ap) > 0) {
-        std::string str;
-        str += printTime();
-        str += sLogLevelString[int(level)];
-        str += std::string("[") + file + std::string(":") + std::to_string(line) + std::string("]");
-        str += buffer;
-        write(LogLevel(level), str);
-    }
+    int size = vsnprintf(ring->text(record), LogRing::kMaxText, fmt, ap);
     va_end(ap);
+    if (size <= 0) {
+        return;
+    }
+    record->kind = LogRing::KindText;
+    record->level = (uint16_t)level;
+    record->line = line;
+    record->file = file;
+    record->format = nullptr;
+    record->text_size = (uint32_t)(size < (int)LogRing::kMaxText ? size : LogRing::kMaxText - 1);
+    record->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    ring->commit(record);
+    wakeUp();
 }
 
-}
\ No newline at end of file
+void Logger::pushBinaryLog(const LogFormat &format, const char *args, size_t size) {
+    LogRing *ring = localRing();
+    LogRing::Record *record = static_cast<LogRing::Record*>(reserve(ring, size));
+    if (!record) {
+        return;
+    }
+    memcpy(ring->text(record), args, size);
+    record->kind = LogRing::KindBinary;
+    record->level = (uint16_t)format.level;
+    record->line = format.line;
+    record->file = format.file;
+    record->format = &format;
+    record->text_size = (uint32_t)size;
+    record->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    ring->commit(record);
+    wakeUp();
+}
+
+}
@@ -3,36 +3,50 @@
 #include <thread>
 #include <mutex>
 #include <map>
+#include <unordered_map>
+#include <stdio.h>
 #include <vector>
-#include <fstream>
+#include <atomic>
+#include <memory>
 #include "utils/semaphore.h"
 #include "utils/utils.h"
+#include "log_format.h"
 
 namespace infra {
 
+//日志写满线程缓冲区时的处理方式
 typedef enum {
-    LogLevelError = 0,
-    LogLevelWarn,
-    LogLevelInfo,
-    LogLevelDebug,
-    LogLevelTrace
-} LogLevel;
+    LogOverflowDrop = 0,  //丢弃并计数，不阻塞业务线程
+    LogOverflowBlock      //等待日志线程腾出空间
+} LogOverflowPolicy;
 
+//一条格式化好的日志，data指向Logger内部缓冲，write返回后失效
 typedef struct LogContent_tag{
     LogLevel level;
-    std::string content;
-    LogContent_tag(LogLevel l, const std::string& c) : level(l), content(c) {}
+    const char *data;
+    size_t size;
 }LogContent;
 
+//一条未格式化的二进制日志，args为LogArgWriter编码的参数
+typedef struct LogBinaryContent_tag{
+    const LogFormat *format;
+    int64_t timestamp;  //ms
+    const char *args;
+    size_t size;
+}LogBinaryContent;
+
 class LogChannel : public noncopyable {
 public:
     LogChannel(const std::string &name) : name_(name) {};
-    virtual ~LogChannel() { content_.clear(); };
-    virtual void write(const std::shared_ptr<LogContent> &content) = 0;
+    virtual ~LogChannel() {};
+    //只在日志线程调用，需要保留的内容要自行拷贝
+    virtual void write(const LogContent &content) = 0;
     virtual void flush() = 0;
-protected:    
+    //返回true时二进制日志通过writeBinary原样交给通道，不在日志线程格式化
+    virtual bool binary() const { return false; }
+    virtual void writeBinary(const LogBinaryContent &) {}
+protected:
     std::string name_;
-    std::vector<std::shared_ptr<LogContent>> content_;
 };
 
 //控制台日志输出
@@ -40,42 +54,177 @@ class ConsoleLogChannel : public LogChannel {
 public:
     ConsoleLogChannel(const std::string &name = "console");
     virtual ~ConsoleLogChannel() override = default;
-    virtual void write(const std::shared_ptr<LogContent> &content) override;
+    virtual void write(const LogContent &content) override;
     virtual void flush() override;
     void setConsoleColour(LogLevel level);
 private:
+    std::string buffer_;  //一批日志拼接后一次写出
+};
 
+/**
+ * 二进制日志文件，格式见log_format.h，用tools/log_decoder解码
+ * 文本日志也会写入，保证文件中的日志完整
+ */
+class BinaryLogChannel : public LogChannel {
+public:
+    BinaryLogChannel(const std::string &path, const std::string &name = "binary");
+    virtual ~BinaryLogChannel() override;
+    virtual void write(const LogContent &content) override;
+    virtual void flush() override;
+    virtual bool binary() const override { return true; }
+    virtual void writeBinary(const LogBinaryContent &content) override;
+private:
+    FILE *file_;
+    std::unordered_map<const LogFormat*, uint32_t> format_ids_;  //已写入文件的格式定义
 };
 
-//异步输出日志，线程安全
+class LogRing;
+
+/**
+ * 异步输出日志，线程安全
+ * 每个线程把日志写入自己的单生产者单消费者环形缓冲区，日志线程汇总输出，打印路径无锁、不分配内存
+ */
 class Logger : public noncopyable {
 public:
     static Logger &instance();
     Logger(const std::shared_ptr<LogChannel>& channel, LogLevel level = LogLevelInfo);
     ~Logger();
     void addLogChannel(const std::shared_ptr<LogChannel>& channel);
+    //修改全局级别，单独设置过级别的模块不受影响
     void setLevel(LogLevel level);
+    /**
+     * 单独设置模块的级别，运行中修改立即生效
+     * 模块名为调用点的LOG_MODULE，未定义LOG_MODULE时为源文件名(不含目录)，例如"socket_util.cpp"
+     */
+    void setModuleLevel(const std::string &module, LogLevel level);
+    //恢复为全局级别
+    void resetModuleLevel(const std::string &module);
+    //调用点缓存返回的指针，之后每次只需一次relaxed读取，指针在Logger生存期内有效
+    std::atomic<int> *moduleLevel(const char *module);
+    void setOverflowPolicy(LogOverflowPolicy policy);
+    //因缓冲区满丢弃的日志条数
+    uint64_t droppedCount() const;
+    //不再检查级别，由调用点通过moduleLevel过滤，避免禁用时仍然计算参数
     void printLog(LogLevel level, const char *file, int line, const char *fmt, ...);
+
+    //只记录调用点和原始参数，格式化推迟到日志线程，fmt中的长度修饰符会被忽略
+    template <typename... Args>
+    void printBinaryLog(const LogFormat &format, const Args&... args) {
+        char buffer[kLogMaxArgsSize];
+        LogArgWriter writer(buffer, sizeof(buffer));
+        writer.write(args...);
+        pushBinaryLog(format, buffer, writer.size());
+    }
 private:
+    struct ModuleLevel {
+        std::atomic<int> level;
+        bool overridden;  //通过setModuleLevel单独设置过
+    };
+    ModuleLevel *findModule(const std::string &module);
+    void pushBinaryLog(const LogFormat &format, const char *args, size_t size);
     void run();
+    bool drain();
     void flush();
-    void write(LogLevel level, const std::string &content);
-    std::string printTime();
+    void write(LogLevel level, const char *data, size_t size, bool text_only = false);
+    void writeBinary(const LogBinaryContent &content);
+    void writeLine(LogLevel level, int64_t timestamp, const char *file, int line, const char *text, size_t size, bool text_only);
+    void wakeUp();
+    LogRing *localRing();
+    void *reserve(LogRing *ring, size_t size);  //按溢出策略预留一条记录，丢弃时返回nullptr
+    size_t printTime(int64_t timestamp, char *buffer, size_t size);
 private:
-    LogLevel level_;
-    bool running_;
+    std::atomic<int> level_;
+    std::atomic<int> overflow_policy_;
+    std::atomic<bool> running_;
+    std::atomic<bool> sleeping_;  //日志线程已经或即将等待semaphore_
+    std::atomic<uint64_t> dropped_;
+    uint64_t reported_dropped_;
     Semaphore semaphore_;
     std::shared_ptr<std::thread> thread_;
     std::vector<std::shared_ptr<LogChannel>> logChannels_;
     std::mutex logChannelsMutex_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    std::mutex ringsMutex_;  //只在线程第一次打印日志时注册缓冲区
+    std::string line_;       //日志线程拼接一行日志的缓冲，复用避免分配
+    std::string text_;       //二进制日志格式化后的内容
+    int64_t cached_second_;
+    char cached_time_[80];
+    std::map<std::string, std::unique_ptr<ModuleLevel>> modules_;  //只增不删，调用点持有其中的指针
+    std::mutex modulesMutex_;
 };
 
 }
 
 
-#define printLogf(level, ...) infra::Logger::instance().printLog(level, __FILE__, __LINE__, ##__VA_ARGS__)
-#define errorf(...) printLogf(infra::LogLevelError, ##__VA_ARGS__)
+//编译期最低级别，级别数值大于LOG_ACTIVE_LEVEL的日志宏展开为空，参数也不会计算
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4
+#ifndef LOG_ACTIVE_LEVEL
+#define LOG_ACTIVE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+//在包含本文件前定义LOG_MODULE可以把多个源文件归为一个模块
+#ifndef LOG_MODULE
+#define LOG_MODULE __FILE__
+#endif
+
+//调用点第一次执行时查找模块级别并缓存，之后只有一次relaxed读取
+#define LOG_SITE_LEVEL() \
+        static std::atomic<int> *_log_level = infra::Logger::instance().moduleLevel(LOG_MODULE)
+#define LOG_SITE_ENABLED(level) ((level) <= _log_level->load(std::memory_order_relaxed))
+
+#define LOG_DISABLED(...) do {} while (0)
+
+#define printLogf(level, ...) do { \
+        LOG_SITE_LEVEL(); \
+        if (LOG_SITE_ENABLED(level)) { \
+            infra::Logger::instance().printLog(level, __FILE__, __LINE__, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+//二进制日志，用于打印频率很高的调用点，fmt必须是字符串常量
+#define printBinLogf(level, fmt, ...) do { \
+        LOG_SITE_LEVEL(); \
+        if (LOG_SITE_ENABLED(level)) { \
+            static const infra::LogFormat _log_format = {level, __FILE__, __LINE__, fmt}; \
+            infra::Logger::instance().printBinaryLog(_log_format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define errorf(...)  printLogf(infra::LogLevelError, ##__VA_ARGS__)
+#define errorbf(...) printBinLogf(infra::LogLevelError, ##__VA_ARGS__)
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_WARN
 #define warnf(...)  printLogf(infra::LogLevelWarn, ##__VA_ARGS__)
+#define warnbf(...) printBinLogf(infra::LogLevelWarn, ##__VA_ARGS__)
+#else
+#define warnf(...)  LOG_DISABLED()
+#define warnbf(...) LOG_DISABLED()
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_INFO
 #define infof(...)  printLogf(infra::LogLevelInfo, ##__VA_ARGS__)
-#define debugf(...) printLogf(infra::LogLevelDebug, ##__VA_ARGS__)
-#define tracef(...) printLogf(infra::LogLevelTrace, ##__VA_ARGS__)
+#define infobf(...) printBinLogf(infra::LogLevelInfo, ##__VA_ARGS__)
+#else
+#define infof(...)  LOG_DISABLED()
+#define infobf(...) LOG_DISABLED()
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_DEBUG
+#define debugf(...)  printLogf(infra::LogLevelDebug, ##__VA_ARGS__)
+#define debugbf(...) printBinLogf(infra::LogLevelDebug, ##__VA_ARGS__)
+#else
+#define debugf(...)  LOG_DISABLED()
+#define debugbf(...) LOG_DISABLED()
+#endif
+
+#if LOG_ACTIVE_LEVEL >= LOG_LEVEL_TRACE
+#define tracef(...)  printLogf(infra::LogLevelTrace, ##__VA_ARGS__)
+#define tracebf(...) printBinLogf(infra::LogLevelTrace, ##__VA_ARGS__)
+#else
+#define tracef(...)  LOG_DISABLED()
+#define tracebf(...) LOG_DISABLED()
+#endif
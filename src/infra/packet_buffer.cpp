@@ -0,0 +1,319 @@
+#include "packet_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace infra {
+
+//PacketBuffer头部占用的空间，数据从这里开始，保持缓存行对齐
+static const size_t kHeaderSize = 64;
+//一次从系统分配的slab数
+static const size_t kChunkSlabs = 64;
+//线程本地链表超过kMaxCached块时，归还kBatch块到全局链表
+static const size_t kMaxCached = 2048;
+static const size_t kBatch = 256;
+
+static_assert(sizeof(PacketBuffer) <= kHeaderSize, "PacketBuffer header too large");
+
+struct BufferCache {
+    PacketBuffer *local = nullptr;              //只在所属线程访问
+    size_t count = 0;
+    std::atomic<PacketBuffer *> remote{nullptr};  //其他线程归还的slab
+    BufferCache *next_orphan = nullptr;
+};
+
+//线程退出时把缓存交还给pool，之后这个线程的释放直接走全局链表
+struct BufferCacheHolder {
+    BufferCache *cache = nullptr;
+
+    ~BufferCacheHolder();
+};
+
+static thread_local BufferCacheHolder s_cache_holder;
+//析构函数对成员的写入在对象生命周期结束后可能被编译器优化掉，退出标记放在没有析构的变量里
+static thread_local bool s_cache_exited = false;
+
+BufferCacheHolder::~BufferCacheHolder() {
+    s_cache_exited = true;
+    if (cache) {
+        BufferPool::instance().retire(cache);
+    }
+}
+
+uint8_t *PacketBuffer::storage() {
+    return reinterpret_cast<uint8_t *>(this) + kHeaderSize;
+}
+
+void PacketBuffer::destroy() {
+    BufferPool::instance().free(this);
+}
+
+PacketBuffer::Ptr PacketBuffer::create(size_t size, size_t headroom, size_t tailroom) {
+    PacketBuffer *buffer = BufferPool::instance().allocate(headroom + size + tailroom);
+    buffer->offset_ = (uint32_t)headroom;
+    buffer->size_ = (uint32_t)size;
+    return Ptr(buffer, false);
+}
+
+PacketBuffer::Ptr PacketBuffer::copyFrom(const void *data, size_t size, size_t headroom) {
+    Ptr buffer = create(size, headroom);
+    memcpy(buffer->data(), data, size);
+    return buffer;
+}
+
+PacketBuffer::Ptr PacketBuffer::clone(size_t headroom) const {
+    return copyFrom(data(), size_, headroom);
+}
+
+BufferPool &BufferPool::instance() {
+    static BufferPool *pool = new BufferPool();  //线程退出时仍可能归还，不析构
+    return *pool;
+}
+
+BufferPool::BufferPool() : slab_count_(0), global_count_(0), global_free_(nullptr), orphans_(nullptr) {
+}
+
+size_t BufferPool::slabCapacity() {
+    return PACKET_SLAB_SIZE - kHeaderSize;
+}
+
+size_t BufferPool::slabCount() const {
+    return slab_count_.load(std::memory_order_relaxed);
+}
+
+size_t BufferPool::globalFreeCount() const {
+    return global_count_.load(std::memory_order_relaxed);
+}
+
+BufferCache *BufferPool::localCache() {
+    if (s_cache_exited) {
+        return nullptr;
+    }
+    BufferCacheHolder &holder = s_cache_holder;
+    if (holder.cache) {
+        return holder.cache;
+    }
+    {
+        //优先接手已退出线程的缓存，它们的归还栈上可能还有slab
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (orphans_) {
+            holder.cache = orphans_;
+            orphans_ = orphans_->next_orphan;
+            holder.cache->next_orphan = nullptr;
+        }
+    }
+    if (!holder.cache) {
+        holder.cache = new BufferCache();  //可能仍被已分配的slab引用，不释放
+    }
+    return holder.cache;
+}
+
+PacketBuffer *BufferPool::allocate(size_t capacity) {
+    if (capacity > slabCapacity()) {
+        void *memory = malloc(kHeaderSize + capacity);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return new (memory) PacketBuffer((uint32_t)capacity, nullptr);
+    }
+
+    BufferCache *cache = localCache();
+    void *memory = nullptr;
+    if (cache) {
+        if (!cache->local && !refill(cache)) {
+            throw std::bad_alloc();
+        }
+        PacketBuffer *slab = cache->local;
+        cache->local = slab->next_;
+        cache->count--;
+        memory = slab;
+    } else {
+        //线程正在退出，直接从全局链表分配
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (global_free_) {
+            memory = global_free_;
+            global_free_ = global_free_->next_;
+            global_count_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    if (!memory) {
+        //单独分配的slab同样计入slab总数，释放时进入全局链表，不还给系统
+        memory = malloc(PACKET_SLAB_SIZE);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        slab_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return new (memory) PacketBuffer((uint32_t)slabCapacity(), cache);
+}
+
+bool BufferPool::refill(BufferCache *cache) {
+    //先取回其他线程归还的
+    PacketBuffer *remote = cache->remote.exchange(nullptr, std::memory_order_acquire);
+    while (remote) {
+        PacketBuffer *next = remote->next_;
+        remote->next_ = cache->local;
+        cache->local = remote;
+        cache->count++;
+        remote = next;
+    }
+    if (cache->local) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        size_t taken = 0;
+        while (taken < kBatch && global_free_) {
+            PacketBuffer *slab = global_free_;
+            global_free_ = slab->next_;
+            slab->next_ = cache->local;
+            cache->local = slab;
+            taken++;
+        }
+        cache->count += taken;
+        global_count_.fetch_sub(taken, std::memory_order_relaxed);
+    }
+    if (cache->local) {
+        return true;
+    }
+
+    //整块分配，切分后放入本地链表
+    char *chunk = static_cast<char *>(malloc(PACKET_SLAB_SIZE * kChunkSlabs));
+    if (!chunk) {
+        return false;
+    }
+    for (size_t i = 0; i < kChunkSlabs; i++) {
+        PacketBuffer *slab = reinterpret_cast<PacketBuffer *>(chunk + i * PACKET_SLAB_SIZE);
+        slab->next_ = cache->local;
+        cache->local = slab;
+    }
+    cache->count += kChunkSlabs;
+    slab_count_.fetch_add(kChunkSlabs, std::memory_order_relaxed);
+    return true;
+}
+
+void BufferPool::free(PacketBuffer *buffer) {
+    BufferCache *owner = buffer->owner_;
+    bool large = buffer->capacity_ > slabCapacity();
+    buffer->~PacketBuffer();
+    if (large) {
+        ::free(buffer);
+        return;
+    }
+    if (!owner) {
+        //线程退出期间分配的slab，可能是某个整块中间的一段，只能放回全局链表
+        std::lock_guard<std::mutex> guard(mutex_);
+        buffer->next_ = global_free_;
+        global_free_ = buffer;
+        global_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    BufferCache *cache = localCache();
+    if (cache == owner) {
+        buffer->next_ = cache->local;
+        cache->local = buffer;
+        if (++cache->count > kMaxCached) {
+            spill(cache, kBatch);
+        }
+        return;
+    }
+
+    //跨线程释放，挂到分配线程的归还栈上，分配线程一次取走整个栈所以没有ABA问题
+    PacketBuffer *head = owner->remote.load(std::memory_order_relaxed);
+    do {
+        buffer->next_ = head;
+    } while (!owner->remote.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void BufferPool::spill(BufferCache *cache, size_t count) {
+    if (!cache->local || count == 0) {
+        return;
+    }
+    //先在锁外把要归还的一段链表摘下来
+    PacketBuffer *first = cache->local;
+    PacketBuffer *last = first;
+    size_t taken = 1;
+    while (taken < count && last->next_) {
+        last = last->next_;
+        taken++;
+    }
+    cache->local = last->next_;
+    cache->count -= taken;
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    last->next_ = global_free_;
+    global_free_ = first;
+    global_count_.fetch_add(taken, std::memory_order_relaxed);
+}
+
+void BufferPool::retire(BufferCache *cache) {
+    spill(cache, cache->count);
+    std::lock_guard<std::mutex> guard(mutex_);
+    cache->next_orphan = orphans_;
+    orphans_ = cache;
+}
+
+bool BufferChain::append(const PacketBuffer::Ptr &buffer) {
+    return append(buffer, 0, buffer->size());
+}
+
+bool BufferChain::append(const PacketBuffer::Ptr &buffer, size_t offset, size_t size) {
+    if (count_ >= kMaxSlices || offset + size > buffer->size()) {
+        return false;
+    }
+    Slice &slice = slices_[count_++];
+    slice.buffer = buffer;
+    slice.offset = (uint32_t)offset;
+    slice.size = (uint32_t)size;
+    size_ += size;
+    return true;
+}
+
+void BufferChain::clear() {
+    for (int i = 0; i < count_; i++) {
+        slices_[i].buffer.reset();
+    }
+    count_ = 0;
+    size_ = 0;
+}
+
+size_t BufferChain::copyTo(uint8_t *out, size_t capacity) const {
+    size_t copied = 0;
+    for (int i = 0; i < count_ && copied < capacity; i++) {
+        size_t len = slices_[i].size;
+        if (len > capacity - copied) {
+            len = capacity - copied;
+        }
+        memcpy(out + copied, slices_[i].data(), len);
+        copied += len;
+    }
+    return copied;
+}
+
+PacketBuffer::Ptr BufferChain::flatten(size_t headroom) const {
+    if (count_ == 1 && slices_[0].offset == 0 && slices_[0].size == slices_[0].buffer->size()) {
+        return slices_[0].buffer;
+    }
+    PacketBuffer::Ptr buffer = PacketBuffer::create(size_, headroom);
+    copyTo(buffer->data(), size_);
+    return buffer;
+}
+
+#if !defined(_WIN32)
+int BufferChain::toIovec(struct iovec *iov, int max) const {
+    int count = 0;
+    for (int i = 0; i < count_ && count < max; i++) {
+        if (slices_[i].size == 0) {
+            continue;
+        }
+        iov[count].iov_base = const_cast<uint8_t *>(slices_[i].data());
+        iov[count].iov_len = slices_[i].size;
+        count++;
+    }
+    return count;
+}
+#endif
+
+}
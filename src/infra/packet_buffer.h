@@ -0,0 +1,267 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include "utils/ref_ptr.h"
+
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
+
+namespace infra {
+
+//每个slab的大小，包含PacketBuffer头部
+#define PACKET_SLAB_SIZE 2048
+//默认在数据前预留的空间，用于添加隧道、TURN等外层头部
+#define PACKET_DEFAULT_HEADROOM 128
+
+struct BufferCache;
+struct BufferCacheHolder;
+
+/**
+ * 带引用计数的包缓冲，头部和数据在同一块内存里
+ * 不超过一个slab的缓冲从BufferPool的线程本地空闲链表分配，更大的直接malloc
+ * 一个收到的包可以被多个订阅者同时持有，共享期间(unique()为false)不应修改数据
+ */
+class PacketBuffer {
+public:
+    typedef RefPtr<PacketBuffer> Ptr;
+
+    PacketBuffer(const PacketBuffer&) = delete;
+
+    PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+    /**
+     * @param size 初始数据长度，内容未初始化
+     * @param headroom 数据前预留的空间
+     * @param tailroom 数据后至少预留的空间
+     */
+    static Ptr create(size_t size = 0, size_t headroom = PACKET_DEFAULT_HEADROOM, size_t tailroom = 0);
+
+    static Ptr copyFrom(const void *data, size_t size, size_t headroom = PACKET_DEFAULT_HEADROOM);
+
+    //复制一份独占的缓冲，修改共享的包前使用
+    Ptr clone(size_t headroom = PACKET_DEFAULT_HEADROOM) const;
+
+    uint8_t *data() {
+        return storage() + offset_;
+    }
+
+    const uint8_t *data() const {
+        return const_cast<PacketBuffer *>(this)->storage() + offset_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    size_t headroom() const {
+        return offset_;
+    }
+
+    size_t tailroom() const {
+        return capacity_ - offset_ - size_;
+    }
+
+    //在数据前扩展len字节并返回新的数据起始位置，头部空间不足时返回nullptr
+    uint8_t *prepend(size_t len) {
+        if (len > offset_) {
+            return nullptr;
+        }
+        offset_ -= (uint32_t)len;
+        size_ += (uint32_t)len;
+        return data();
+    }
+
+    //在数据后扩展len字节并返回扩展部分的起始位置，尾部空间不足时返回nullptr
+    uint8_t *append(size_t len) {
+        if (len > tailroom()) {
+            return nullptr;
+        }
+        uint8_t *tail = data() + size_;
+        size_ += (uint32_t)len;
+        return tail;
+    }
+
+    //去掉头部len字节，空出的空间成为headroom
+    void consume(size_t len) {
+        if (len > size_) {
+            len = size_;
+        }
+        offset_ += (uint32_t)len;
+        size_ -= (uint32_t)len;
+    }
+
+    //截断到len字节
+    void truncate(size_t len) {
+        if (len < size_) {
+            size_ = (uint32_t)len;
+        }
+    }
+
+    //在不超过capacity的前提下设置数据长度，用于直接写入tailroom之后提交
+    bool resize(size_t len) {
+        if (offset_ + len > capacity_) {
+            return false;
+        }
+        size_ = (uint32_t)len;
+        return true;
+    }
+
+    void addRef() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        //只有一个引用时不会再有其他线程增加计数，省掉一次原子减
+        if (refs_.load(std::memory_order_acquire) == 1 || refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            destroy();
+        }
+    }
+
+    bool unique() const {
+        return refs_.load(std::memory_order_acquire) == 1;
+    }
+
+    uint32_t refCount() const {
+        return refs_.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class BufferPool;
+
+    PacketBuffer(uint32_t capacity, BufferCache *owner)
+        : refs_(1), capacity_(capacity), offset_(0), size_(0), owner_(owner), next_(nullptr) {}
+
+    ~PacketBuffer() = default;
+
+    uint8_t *storage();
+
+    void destroy();
+
+private:
+    std::atomic<uint32_t> refs_;
+    uint32_t capacity_;
+    uint32_t offset_;
+    uint32_t size_;
+    BufferCache *owner_;     //分配时所在线程的缓存，线程退出期间分配的slab和超过slab大小单独malloc的缓冲为nullptr
+    PacketBuffer *next_;     //在空闲链表中时使用
+};
+
+/**
+ * PacketBuffer的slab分配器
+ * 每个线程有自己的空闲链表，分配和同线程释放不加锁
+ * 其他线程释放的slab无锁地挂回分配线程的归还栈，分配线程本地链表为空时一次取回
+ * 本地链表过长时批量移到全局链表，线程退出后它的缓存留给之后的新线程使用
+ */
+class BufferPool {
+public:
+    static BufferPool &instance();
+
+    BufferPool(const BufferPool&) = delete;
+
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    //每个slab中可用于数据的字节数
+    static size_t slabCapacity();
+
+    //已从系统分配的slab总数
+    size_t slabCount() const;
+
+    //全局链表中的空闲slab数
+    size_t globalFreeCount() const;
+
+private:
+    friend class PacketBuffer;
+    friend struct BufferCacheHolder;
+
+    BufferPool();
+
+    ~BufferPool() = default;
+
+    PacketBuffer *allocate(size_t capacity);
+
+    void free(PacketBuffer *buffer);
+
+    BufferCache *localCache();
+
+    bool refill(BufferCache *cache);
+
+    void spill(BufferCache *cache, size_t count);
+
+    void retire(BufferCache *cache);
+
+private:
+    std::atomic<size_t> slab_count_;
+    std::atomic<size_t> global_count_;
+    std::mutex mutex_;
+    PacketBuffer *global_free_;
+    BufferCache *orphans_;         //所属线程已退出的缓存
+};
+
+/**
+ * 分散-聚集的缓冲链，元素是对PacketBuffer一段数据的引用
+ * 转发时每个订阅者只需要自己的头部缓冲加上共享的负载，发送时转换成iovec交给sendmsg
+ */
+class BufferChain {
+public:
+    static const int kMaxSlices = 8;
+
+    struct Slice {
+        PacketBuffer::Ptr buffer;
+        uint32_t offset;
+        uint32_t size;
+
+        const uint8_t *data() const {
+            return buffer->data() + offset;
+        }
+    };
+
+    BufferChain() : count_(0), size_(0) {}
+
+    //超过kMaxSlices时返回false
+    bool append(const PacketBuffer::Ptr &buffer);
+
+    bool append(const PacketBuffer::Ptr &buffer, size_t offset, size_t size);
+
+    void clear();
+
+    int count() const {
+        return count_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return count_ == 0;
+    }
+
+    const Slice &slice(int index) const {
+        return slices_[index];
+    }
+
+    //拷贝所有数据到out，返回拷贝的字节数，不超过capacity
+    size_t copyTo(uint8_t *out, size_t capacity) const;
+
+    //合并成一个连续的缓冲，只有一段且是完整的缓冲时直接返回它
+    PacketBuffer::Ptr flatten(size_t headroom = PACKET_DEFAULT_HEADROOM) const;
+
+#if !defined(_WIN32)
+    //填充iovec，返回使用的个数
+    int toIovec(struct iovec *iov, int max) const;
+#endif
+
+private:
+    Slice slices_[kMaxSlices];
+    int count_;
+    size_t size_;
+};
+
+}
@@ -0,0 +1,100 @@
+#include "serial_task_queue.h"
+#include <thread>
+
+namespace infra {
+
+//单个strand每次最多连续执行的任务数，执行完后让出线程保证其他strand的公平性
+static const int kMaxBatch = 32;
+static const size_t kQueueCapacity = 256;
+//队首元素还没写完时的重试次数，超过后把strand重新投递到线程池，不占着线程空转
+static const int kMaxPopRetries = 16;
+
+static thread_local const SerialTaskQueue *s_current_queue = nullptr;
+
+std::shared_ptr<SerialTaskQueue> SerialTaskQueue::create(const std::shared_ptr<ThreadPool> &pool) {
+    if (!pool) {
+        return nullptr;
+    }
+    return std::shared_ptr<SerialTaskQueue>(new SerialTaskQueue(pool));
+}
+
+SerialTaskQueue::SerialTaskQueue(const std::shared_ptr<ThreadPool> &pool)
+    : TaskQueue(kQueueCapacity), pool_(pool), pending_(0) {
+}
+
+SerialTaskQueue::~SerialTaskQueue() {
+}
+
+void SerialTaskQueue::postTask(Task task) {
+    TaskQueue::postTask(std::move(task));
+    //计数从0变为1的投递者负责调度，调度任务执行期间计数不为0，保证同一时间只有一个线程在执行
+    if (pending_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+        schedule();
+    }
+}
+
+namespace {
+//Task只能移动，C++11的lambda无法移动捕获，用函数对象转发
+struct DelayedForward {
+    std::weak_ptr<SerialTaskQueue> queue;
+    Task task;
+
+    void operator()() {
+        auto strong_queue = queue.lock();
+        if (strong_queue) {
+            strong_queue->postTask(std::move(task));
+        }
+    }
+};
+}
+
+SerialTaskQueue::TaskId SerialTaskQueue::postDelayedTask(Task task, int64_t delay_ms) {
+    DelayedForward forward;
+    forward.queue = shared_from_this();
+    forward.task = std::move(task);
+    return pool_->postDelayedTask(std::move(forward), delay_ms);
+}
+
+bool SerialTaskQueue::cancelDelayedTask(TaskId id) {
+    return pool_->cancelDelayedTask(id);
+}
+
+bool SerialTaskQueue::isCurrent() const {
+    return s_current_queue == this;
+}
+
+void SerialTaskQueue::schedule() {
+    auto self = shared_from_this();
+    pool_->postTask([self]() {
+        self->drain();
+    });
+}
+
+void SerialTaskQueue::drain() {
+    const SerialTaskQueue *previous = s_current_queue;
+    s_current_queue = this;
+    Task task;
+    for (int i = 0; i < kMaxBatch; i++) {
+        //计数大于0时元素已经或即将写入队列(另一个投递者只完成了占位)
+        int retries = 0;
+        while (!popTask(task)) {
+            if (++retries > kMaxPopRetries) {
+                //投递者可能被抢占，计数仍大于0，重新调度期间不会有其他线程执行本队列
+                s_current_queue = previous;
+                schedule();
+                return;
+            }
+            std::this_thread::yield();
+        }
+        task();
+        task = nullptr;
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            s_current_queue = previous;
+            return;
+        }
+    }
+    s_current_queue = previous;
+    schedule();
+}
+
+}
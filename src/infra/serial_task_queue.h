@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include "task_queue.h"
+#include "thread_pool.h"
+
+namespace infra {
+
+/**
+ * 串行任务队列(strand)，复用ThreadPool的线程
+ * 同一个SerialTaskQueue上的任务按投递顺序执行且不会并发，不同队列之间可以并行
+ * 投递路径无锁，只有队列从空变为非空时才向线程池投递一次调度任务
+ */
+class SerialTaskQueue : public TaskQueue, public std::enable_shared_from_this<SerialTaskQueue> {
+public:
+
+    static std::shared_ptr<SerialTaskQueue> create(const std::shared_ptr<ThreadPool> &pool);
+
+    ~SerialTaskQueue();
+
+    //串行队列按投递顺序执行，忽略任务优先级
+    using TaskQueue::postTask;
+
+    virtual void postTask(Task task) override;
+
+    //延时任务由线程池的时间轮管理，到期后再投递到本队列
+    virtual TaskId postDelayedTask(Task task, int64_t delay_ms) override;
+
+    virtual bool cancelDelayedTask(TaskId id) override;
+
+    //当前线程是否正在执行本队列的任务
+    bool isCurrent() const;
+
+private:
+
+    explicit SerialTaskQueue(const std::shared_ptr<ThreadPool> &pool);
+
+    void schedule();
+
+    void drain();
+
+private:
+
+    std::shared_ptr<ThreadPool> pool_;
+    std::atomic<size_t> pending_;  //已投递未执行完的任务数
+};
+
+}
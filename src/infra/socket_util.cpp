@@ -3,13 +3,64 @@
 #include <unordered_map>
 #include "socket_util.h"
 #include "logger.h"
+#include "dns_resolver.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+#if defined(__linux__)
+#include <atomic>
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
 
 namespace infra {
 
+#if defined(__linux__)
+/**
+ * 按fd记录内核拒绝过UDP_SEGMENT的socket(如隧道接口上的路由)，之后这个socket在用户态切分
+ * 其他socket不受影响，fd创建和关闭时清除，避免复用的fd继承旧状态，超出范围的fd每次都重新尝试
+ */
+static const int kGsoFdLimit = 64 * 1024;
+static std::atomic<uint64_t> s_gso_disabled[kGsoFdLimit / 64];
+
+static bool gso_disabled(int fd) {
+    if (fd < 0 || fd >= kGsoFdLimit) {
+        return false;
+    }
+    return (s_gso_disabled[fd / 64].load(std::memory_order_relaxed) >> (fd % 64)) & 1;
+}
+
+static void set_gso_disabled(int fd, bool disabled) {
+    if (fd < 0 || fd >= kGsoFdLimit) {
+        return;
+    }
+    uint64_t bit = (uint64_t)1 << (fd % 64);
+    if (disabled) {
+        s_gso_disabled[fd / 64].fetch_or(bit, std::memory_order_relaxed);
+    } else if (s_gso_disabled[fd / 64].load(std::memory_order_relaxed) & bit) {
+        s_gso_disabled[fd / 64].fetch_and(~bit, std::memory_order_relaxed);
+    }
+}
+#endif
+
 int close_socket(int fd) {
     #if defined(_WIN32)
         return closesocket(fd);
     #else
+    #if defined(__linux__)
+        set_gso_disabled(fd, false);
+    #endif
         return close(fd);
     #endif
 }
@@ -18,7 +69,7 @@ int ioctl(int fd, long cmd, u_long *ptr) {
 #if defined(_WIN32)
     return ioctlsocket(fd, cmd, ptr);
 #else
-    return ioctl(fd, cmd, ptr);
+    return ::ioctl(fd, cmd, ptr);
 #endif
 }
 
@@ -26,7 +77,9 @@ int get_uv_error(bool netErr) {
 #if defined(_WIN32)
     auto errCode = netErr ? WSAGetLastError() : GetLastError();
     return errCode;
-#endif 
+#else
+    return errno;
+#endif
 }
 
 static int set_ipv6_only(int fd, bool flag) {
@@ -101,6 +154,12 @@ public:
             storage = SocketUtil::make_sockaddr(host, 0);
             return true;
         } catch (...) {
+            //异步解析器已经缓存的结果直接使用
+            std::vector<struct sockaddr_storage> addrs;
+            if (DnsResolver::instance().lookup(host, ai_family, addrs) && !addrs.empty()) {
+                storage = addrs[0];
+                return true;
+            }
             auto item = getCacheDomainIP(host, expire_sec);
             if (!item) {
                 item = getSystemDomainIP(host);
@@ -233,6 +292,44 @@ int SocketUtil::listen(const uint16_t port, const char *local_ip, int back_log)
     return fd;
 }
 
+static int connect_sockaddr(const struct sockaddr_storage &addr, bool async, const char *local_ip, uint16_t local_port) {
+    int sockfd = (int) socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (sockfd < 0) {
+        warnf("Create socket failed\n");
+        return -1;
+    }
+
+    SocketUtil::setReuseable(sockfd);
+    SocketUtil::setNoSigpipe(sockfd);
+    SocketUtil::setNoBlocked(sockfd, async);
+    SocketUtil::setNoDelay(sockfd);
+    SocketUtil::setSendBuf(sockfd);
+    SocketUtil::setRecvBuf(sockfd);
+    SocketUtil::setCloseWait(sockfd);
+    SocketUtil::setCloExec(sockfd);
+
+    if (bind_sock(sockfd, local_ip, local_port, addr.ss_family) == -1) {
+        close_socket(sockfd);
+        return -1;
+    }
+    if (::connect(sockfd, (sockaddr *) &addr, SocketUtil::get_sock_len((sockaddr *)&addr)) == 0) {
+        //同步连接成功
+        return sockfd;
+    }
+    int error = get_uv_error(true);
+#if defined(_WIN32)
+    if (async && error == WSAEWOULDBLOCK) {
+#else
+    if (async && error == EINPROGRESS) {
+#endif
+        //异步连接中，fd可写时连接完成，用SO_ERROR获取结果
+        return sockfd;
+    }
+    errorf("connect error %d\n", error);
+    close_socket(sockfd);
+    return -1;
+}
+
 int SocketUtil::connect(const char *host, uint16_t port, bool async, const char *local_ip, uint16_t local_port) {
     struct sockaddr_storage addr;
     //dns
@@ -240,40 +337,368 @@ int SocketUtil::connect(const char *host, uint16_t port, bool async, const char
         //dns解析失败
         return -1;
     }
+    return connect_sockaddr(addr, async, local_ip, local_port);
+}
 
-    int sockfd = (int) socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
-    if (sockfd < 0) {
-        warnf("Create socket failed: %s", host);
+void SocketUtil::connectAsync(const char *host, uint16_t port, const std::function<void(int fd)> &callback,
+                              const char *local_ip, uint16_t local_port) {
+    std::string local(local_ip);
+    //绑定了具体地址时只能连接同一协议族，通配地址时A和AAAA都查
+    int family = AF_UNSPEC;
+    if (!support_ipv6() || is_ipv4(local_ip)) {
+        family = AF_INET;
+    } else if (is_ipv6(local_ip) && strcmp(local_ip, "::") != 0) {
+        family = AF_INET6;
+    }
+    DnsResolver::instance().resolve(host, family, [port, callback, local, local_port, family](const std::vector<struct sockaddr_storage> &addrs) {
+        //依次尝试解析到的地址，立即失败(如没有ipv6路由)时换下一个
+        for (auto addr : addrs) {
+            if (family != AF_UNSPEC && addr.ss_family != family) {
+                //host为另一协议族的ip地址
+                continue;
+            }
+            if (addr.ss_family == AF_INET) {
+                ((sockaddr_in *) &addr)->sin_port = htons(port);
+            } else {
+                ((sockaddr_in6 *) &addr)->sin6_port = htons(port);
+            }
+            int fd = connect_sockaddr(addr, true, local.c_str(), local_port);
+            if (fd >= 0) {
+                callback(fd);
+                return;
+            }
+        }
+        callback(-1);
+    });
+}
+
+int SocketUtil::bindUdpSock(uint16_t port, const char *local_ip, bool reuse_port) {
+    int family = support_ipv6() ? (is_ipv4(local_ip) ? AF_INET : AF_INET6) : AF_INET;
+    int fd = (int)socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd == -1) {
+        warnf("Create udp socket failed!\n");
         return -1;
     }
+#if defined(__linux__)
+    set_gso_disabled(fd, false);
+#endif
 
-    setReuseable(sockfd);
-    setNoSigpipe(sockfd);
-    setNoBlocked(sockfd, async);
-    setNoDelay(sockfd);
-    setSendBuf(sockfd);
-    setRecvBuf(sockfd);
-    setCloseWait(sockfd);
-    setCloExec(sockfd);
+    setReuseable(fd, true, reuse_port);
+    setNoSigpipe(fd);
+    setNoBlocked(fd);
+    setSendBuf(fd);
+    setRecvBuf(fd);
+    setCloseWait(fd);
+    setCloExec(fd);
 
-    if (bind_sock(sockfd, local_ip, local_port, addr.ss_family) == -1) {
-        close_socket(sockfd);
+    if (bind_sock(fd, local_ip, port, family) == -1) {
+        close_socket(fd);
         return -1;
     }
-    if (::connect(sockfd, (sockaddr *) &addr, get_sock_len((sockaddr *)&addr)) == 0) {
-        //同步连接成功
-        return sockfd;
+    return fd;
+}
+
+int SocketUtil::connectUdpSock(const char *host, uint16_t port, const char *local_ip, uint16_t local_port) {
+    struct sockaddr_storage addr;
+    if (!getDomainIP(host, port, addr, AF_INET, SOCK_DGRAM, IPPROTO_UDP)) {
+        return -1;
     }
-    int error = get_uv_error(true);
-    errorf("connect error %d", error);
 
-    //返回错误码判断
-    close_socket(sockfd);
+    int fd = (int)socket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd == -1) {
+        warnf("Create udp socket failed: %s\n", host);
+        return -1;
+    }
+#if defined(__linux__)
+    set_gso_disabled(fd, false);
+#endif
+
+    setReuseable(fd);
+    setNoSigpipe(fd);
+    setNoBlocked(fd);
+    setSendBuf(fd);
+    setRecvBuf(fd);
+    setCloseWait(fd);
+    setCloExec(fd);
+
+    if (bind_sock(fd, local_ip, local_port, addr.ss_family) == -1) {
+        close_socket(fd);
+        return -1;
+    }
+    if (::connect(fd, (sockaddr *) &addr, get_sock_len((sockaddr *)&addr)) == -1) {
+        errorf("connect udp socket failed: %d\n", get_uv_error(true));
+        close_socket(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool would_block(int error) {
+#if defined(_WIN32)
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+//包需要按segment_size切分成多个udp包发送
+static inline bool need_segment(const UdpPacket &packet) {
+    return packet.segment_size > 0 && packet.size > packet.segment_size;
+}
+
+//逐个收包，recvmmsg不可用时使用
+static int recv_one_by_one(int fd, UdpPacket *packets, int count) {
+    int received = 0;
+    for (; received < count; received++) {
+        UdpPacket &packet = packets[received];
+        packet.addr_len = sizeof(packet.addr);
+        packet.segment_size = 0;
+        int ret = (int)recvfrom(fd, packet.data, (int)packet.capacity, 0, (struct sockaddr *)&packet.addr, &packet.addr_len);
+        if (ret < 0) {
+            int error = get_uv_error(true);
+#if defined(_WIN32)
+            if (error == WSAEMSGSIZE) {
+                packet.size = packet.capacity;
+                packet.truncated = true;
+                continue;
+            }
+#endif
+            if (error == EINTR) {
+                received--;
+                continue;
+            }
+            if (would_block(error)) {
+                break;
+            }
+            return received > 0 ? received : -1;
+        }
+        packet.size = ret;
+        packet.truncated = false;
+    }
+    return received;
+}
+
+//逐个发包，需要切分的包在用户态切分
+static int send_one_by_one(int fd, const UdpPacket *packets, int count) {
+    int sent = 0;
+    for (; sent < count; sent++) {
+        const UdpPacket &packet = packets[sent];
+        size_t segment = need_segment(packet) ? packet.segment_size : packet.size;
+        size_t offset = 0;
+        do {
+            size_t length = packet.size - offset < segment ? packet.size - offset : segment;
+            int ret = (int)sendto(fd, packet.data + offset, (int)length, 0,
+                packet.addr_len ? (const struct sockaddr *)&packet.addr : nullptr, packet.addr_len);
+            if (ret < 0) {
+                int error = get_uv_error(true);
+                if (error == EINTR) {
+                    continue;
+                }
+                if (would_block(error)) {
+                    return sent;
+                }
+                return sent > 0 ? sent : -1;
+            }
+            offset += length;
+        } while (offset < packet.size);
+    }
+    return sent;
+}
+
+#if defined(__linux__)
+//内核单次GSO发送的限制，超出的包在用户态切分
+static const int kMaxGsoSegments = 64;
+static const size_t kMaxGsoSize = 65000;
+typedef union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} ControlBuffer;
+
+static bool use_gso(bool disabled, const UdpPacket &packet) {
+    return !disabled && need_segment(packet) && packet.size <= kMaxGsoSize &&
+        (packet.size + packet.segment_size - 1) / packet.segment_size <= (size_t)kMaxGsoSegments;
+}
+#endif
+
+int SocketUtil::setUdpGro(int fd, bool on) {
+#if defined(__linux__)
+    int opt = on ? 1 : 0;
+    int ret = setsockopt(fd, SOL_UDP, UDP_GRO, (char *) &opt, static_cast<socklen_t>(sizeof(opt)));
+    if (ret == -1) {
+        tracef("setsockopt UDP_GRO failed: %d\n", get_uv_error(true));
+    }
+    return ret;
+#else
     return -1;
+#endif
+}
+
+bool SocketUtil::supportUdpGso(int fd) {
+#if defined(__linux__)
+    if (gso_disabled(fd)) {
+        return false;
+    }
+    int segment = 0;
+    socklen_t len = sizeof(segment);
+    return getsockopt(fd, SOL_UDP, UDP_SEGMENT, (char *) &segment, &len) == 0;
+#else
+    return false;
+#endif
 }
 
+int SocketUtil::recvBatch(int fd, UdpPacket *packets, int count) {
+#if defined(__linux__)
+    struct mmsghdr msgs[SOCKET_MAX_BATCH];
+    struct iovec iovs[SOCKET_MAX_BATCH];
+    ControlBuffer controls[SOCKET_MAX_BATCH];
+    int received = 0;
+    while (received < count) {
+        int batch = count - received < SOCKET_MAX_BATCH ? count - received : SOCKET_MAX_BATCH;
+        for (int i = 0; i < batch; i++) {
+            UdpPacket &packet = packets[received + i];
+            iovs[i].iov_base = packet.data;
+            iovs[i].iov_len = packet.capacity;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = &packet.addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(packet.addr);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = controls[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+        }
+        int ret = recvmmsg(fd, msgs, batch, 0, nullptr);
+        if (ret < 0) {
+            int error = get_uv_error(true);
+            if (error == EINTR) {
+                continue;
+            }
+            if (error == ENOSYS) {
+                ret = recv_one_by_one(fd, packets + received, count - received);
+                return ret < 0 ? (received > 0 ? received : -1) : received + ret;
+            }
+            if (would_block(error)) {
+                break;
+            }
+            return received > 0 ? received : -1;
+        }
+        for (int i = 0; i < ret; i++) {
+            UdpPacket &packet = packets[received + i];
+            packet.size = msgs[i].msg_len;
+            packet.addr_len = msgs[i].msg_hdr.msg_namelen;
+            packet.truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            packet.segment_size = 0;
+            //开启GRO后内核把同一来源的连续包合并，附带原始包的长度
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int segment = 0;
+                    memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+                    if (segment > 0 && (size_t)segment < packet.size) {
+                        packet.segment_size = (uint16_t)segment;
+                    }
+                }
+            }
+        }
+        received += ret;
+        if (ret < batch) {
+            //socket中已经没有更多的包
+            break;
+        }
+    }
+    return received;
+#else
+    return recv_one_by_one(fd, packets, count);
+#endif
+}
 
+int SocketUtil::sendBatch(int fd, const UdpPacket *packets, int count) {
+#if defined(__linux__)
+    struct mmsghdr msgs[SOCKET_MAX_BATCH];
+    struct iovec iovs[SOCKET_MAX_BATCH];
+    ControlBuffer controls[SOCKET_MAX_BATCH];
+    size_t ends[SOCKET_MAX_BATCH];  //每条消息发送后所属包已发送到的位置
+    int sent = 0;                   //已经完整发送的包数
+    size_t offset = 0;              //packets[sent]在用户态切分时已发送的长度
+    bool disabled = gso_disabled(fd);
+    while (sent < count) {
+        int batch = 0;
+        int index = sent;
+        size_t position = offset;
+        bool gso = false;
+        while (batch < SOCKET_MAX_BATCH && index < count) {
+            const UdpPacket &packet = packets[index];
+            struct msghdr &hdr = msgs[batch].msg_hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = packet.addr_len ? (void *)&packet.addr : nullptr;
+            hdr.msg_namelen = packet.addr_len;
+            hdr.msg_iov = &iovs[batch];
+            hdr.msg_iovlen = 1;
+            if (position == 0 && use_gso(disabled, packet)) {
+                //整个包交给内核按segment_size切分
+                iovs[batch].iov_base = packet.data;
+                iovs[batch].iov_len = packet.size;
+                hdr.msg_control = controls[batch].buf;
+                hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                memcpy(CMSG_DATA(cmsg), &packet.segment_size, sizeof(uint16_t));
+                position = packet.size;
+                gso = gso || batch == 0;
+            } else {
+                size_t segment = need_segment(packet) ? packet.segment_size : packet.size;
+                size_t length = packet.size - position < segment ? packet.size - position : segment;
+                iovs[batch].iov_base = packet.data + position;
+                iovs[batch].iov_len = length;
+                position += length;
+            }
+            ends[batch] = position;
+            batch++;
+            if (position >= packet.size) {
+                index++;
+                position = 0;
+            }
+        }
 
+        int ret = sendmmsg(fd, msgs, batch, 0);
+        if (ret < 0) {
+            int error = get_uv_error(true);
+            if (error == EINTR) {
+                continue;
+            }
+            //第一条消息失败才会返回错误，GSO被拒绝时改为用户态切分后重试
+            if (gso && (error == EIO || error == EINVAL || error == ENOPROTOOPT || error == EOPNOTSUPP)) {
+                warnf("udp gso unsupported on fd %d: %d, fallback to segment in user space\n", fd, error);
+                set_gso_disabled(fd, true);
+                disabled = true;
+                continue;
+            }
+            if (error == ENOSYS && offset == 0) {
+                ret = send_one_by_one(fd, packets + sent, count - sent);
+                return ret < 0 ? (sent > 0 ? sent : -1) : sent + ret;
+            }
+            if (would_block(error)) {
+                break;
+            }
+            return sent > 0 ? sent : -1;
+        }
+        for (int i = 0; i < ret; i++) {
+            if (ends[i] >= packets[sent].size) {
+                sent++;
+                offset = 0;
+            } else {
+                offset = ends[i];
+            }
+        }
+        if (ret < batch) {
+            break;
+        }
+    }
+    return sent;
+#else
+    return send_one_by_one(fd, packets, count);
+#endif
+}
 
 int SocketUtil::setNoBlocked(int fd, bool noblock) {
 #if defined(_WIN32)
@@ -281,7 +706,7 @@ int SocketUtil::setNoBlocked(int fd, bool noblock) {
     int ret = ioctlsocket(fd, FIONBIO, &ul); //设置为非阻塞模式
 #else
     int ul = noblock;
-    int ret = ioctl(fd, FIONBIO, &ul);
+    int ret = ::ioctl(fd, FIONBIO, &ul);
 #endif //defined(_WIN32)
     if (ret == -1) {
         tracef("ioctl FIONBIO failed");
@@ -313,7 +738,7 @@ int SocketUtil::setNoSigpipe(int fd) {
     int set = 1;
     auto ret = setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (char *) &set, sizeof(int));
     if (ret == -1) {
-        TraceL << "setsockopt SO_NOSIGPIPE failed";
+        tracef("setsockopt SO_NOSIGPIPE failed");
     }
     return ret;
 #else
@@ -414,6 +839,34 @@ static uint16_t get_socket_port(int fd, getsockname_type func) {
     return SocketUtil::inet_port((struct sockaddr *)&addr);
 }
 
+static std::string get_socket_ip(int fd, getsockname_type func) {
+    struct sockaddr_storage addr;
+    if (!get_socket_addr(fd, addr, func)) {
+        return "";
+    }
+    char buf[INET6_ADDRSTRLEN] = {0};
+    if (addr.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((struct sockaddr_in *)&addr)->sin_addr, buf, sizeof(buf));
+    } else if (addr.ss_family == AF_INET6) {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
+        if (IN6_IS_ADDR_V4MAPPED(&addr6->sin6_addr)) {
+            //双栈socket上的ipv4连接
+            inet_ntop(AF_INET, &addr6->sin6_addr.s6_addr[12], buf, sizeof(buf));
+        } else {
+            inet_ntop(AF_INET6, &addr6->sin6_addr, buf, sizeof(buf));
+        }
+    }
+    return buf;
+}
+
+std::string SocketUtil::get_local_ip(int fd) {
+    return get_socket_ip(fd, getsockname);
+}
+
+std::string SocketUtil::get_peer_ip(int fd) {
+    return get_socket_ip(fd, getpeername);
+}
+
 uint16_t SocketUtil::get_local_port(int fd) {
     return get_socket_port(fd, getsockname);
 }
@@ -21,11 +21,30 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <functional>
 
 #define SOCKET_DEFAULT_BUF_SIZE (256 * 1024)
 
 namespace infra {
 
+//批量收发的一个udp包，缓冲区由调用方提供
+typedef struct UdpPacket_tag {
+    char *data;
+    size_t capacity;                 //data的容量，接收时使用
+    size_t size;                     //收到或要发送的长度
+    struct sockaddr_storage addr;    //接收时为来源地址，发送时为目的地址
+    socklen_t addr_len;              //发送时为0表示使用connect的地址
+    bool truncated;                  //接收时包比capacity大，超出部分已丢弃
+    /**
+     * 大于0时data由多个长度为segment_size的udp包首尾相连组成，最后一个可以更短
+     * 发送时支持GSO则由内核切分，否则在用户态切分；接收时开启GRO后由内核填写，0表示只有一个包
+     */
+    uint16_t segment_size;
+} UdpPacket;
+
+//单次recvmmsg/sendmmsg最多处理的包数
+#define SOCKET_MAX_BATCH 64
+
 int close_socket(int fd);
 int ioctl(int fd, long cmd, u_long *ptr);
 int get_uv_error(bool netErr);
@@ -42,8 +61,42 @@ public:
 
     static int listen(const uint16_t port, const char *local_ip = "::", int back_log = 1024);
 
+    //async为true时返回正在连接的fd，fd可写后用SO_ERROR判断是否连接成功
     static int connect(const char *host, uint16_t port, bool async = true, const char *local_ip = "::", uint16_t local_port = 0);
 
+    /**
+     * 用DnsResolver异步解析host后发起非阻塞连接，不会阻塞调用线程
+     * local_ip为通配地址时同时解析ipv4和ipv6，按解析顺序尝试，发起连接立即失败的地址会跳过
+     * callback参数为正在连接的fd，失败为-1，未命中缓存时在解析线程回调
+     */
+    static void connectAsync(const char *host, uint16_t port, const std::function<void(int fd)> &callback,
+                             const char *local_ip = "::", uint16_t local_port = 0);
+
+    //创建非阻塞的udp socket并绑定到本地地址，port为0时由系统分配
+    static int bindUdpSock(uint16_t port, const char *local_ip = "::", bool reuse_port = false);
+
+    //创建udp socket并connect到对端，之后收发只针对这个对端
+    static int connectUdpSock(const char *host, uint16_t port, const char *local_ip = "::", uint16_t local_port = 0);
+
+    /**
+     * 批量接收udp包，linux下用recvmmsg一次系统调用收多个包，其他平台逐个recvfrom
+     * 返回收到的包数，没有数据时返回0，出错返回-1
+     */
+    static int recvBatch(int fd, UdpPacket *packets, int count);
+
+    /**
+     * 批量发送udp包，linux下用sendmmsg
+     * 返回已发送的包数，发送缓冲区满时可能小于count，一个也发不出去时返回0，出错返回-1
+     * 在用户态切分的包只发出一部分时不计入返回值，重发时已发出的分段会重复
+     */
+    static int sendBatch(int fd, const UdpPacket *packets, int count);
+
+    //开启UDP_GRO，内核把同一来源的连续包合并后一次交给recvBatch，不支持时返回-1
+    static int setUdpGro(int fd, bool on = true);
+
+    //内核是否支持UDP_SEGMENT，这个socket发送时被拒绝过也返回false，不支持时sendBatch自动在用户态切分
+    static bool supportUdpGso(int fd);
+
     static int setNoBlocked(int fd, bool noblock = true);
 
     static int setReuseable(int fd, bool on = true, bool reuse_port = true);
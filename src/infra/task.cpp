@@ -0,0 +1,120 @@
+#include "task.h"
+#include <stdlib.h>
+#include <mutex>
+
+namespace infra {
+
+//大小分级：128、256、512、1024字节，更大的直接使用operator new
+static const int kSizeClassCount = 4;
+static const size_t kMinBlockSize = 128;
+static const size_t kMaxBlockSize = kMinBlockSize << (kSizeClassCount - 1);
+//线程本地缓存超过kMaxCached块时，归还kBatch块到全局链表
+static const size_t kMaxCached = 64;
+static const size_t kBatch = 32;
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct FreeList {
+    FreeBlock *head = nullptr;
+    size_t count = 0;
+
+    void push(FreeBlock *block) {
+        block->next = head;
+        head = block;
+        count++;
+    }
+
+    FreeBlock *pop() {
+        FreeBlock *block = head;
+        if (block) {
+            head = block->next;
+            count--;
+        }
+        return block;
+    }
+};
+
+class GlobalFreeLists {
+public:
+    static GlobalFreeLists &instance() {
+        static GlobalFreeLists *lists = new GlobalFreeLists();  //线程退出时仍可能归还，不析构
+        return *lists;
+    }
+
+    void put(int size_class, FreeList &local, size_t count) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        while (count-- > 0 && local.head) {
+            lists_[size_class].push(local.pop());
+        }
+    }
+
+    void take(int size_class, FreeList &local, size_t count) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        while (count-- > 0 && lists_[size_class].head) {
+            local.push(lists_[size_class].pop());
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    FreeList lists_[kSizeClassCount];
+};
+
+struct ThreadCache {
+    FreeList lists[kSizeClassCount];
+
+    ~ThreadCache() {
+        for (int i = 0; i < kSizeClassCount; i++) {
+            GlobalFreeLists::instance().put(i, lists[i], lists[i].count);
+        }
+    }
+};
+
+static thread_local ThreadCache s_thread_cache;
+
+static inline int sizeClass(size_t size) {
+    int size_class = 0;
+    size_t block = kMinBlockSize;
+    while (block < size) {
+        block <<= 1;
+        size_class++;
+    }
+    return size_class;
+}
+
+void *TaskAllocator::allocate(size_t size) {
+    if (size > kMaxBlockSize) {
+        return ::operator new(size);
+    }
+    int size_class = sizeClass(size);
+    FreeList &list = s_thread_cache.lists[size_class];
+    if (!list.head) {
+        GlobalFreeLists::instance().take(size_class, list, kBatch);
+    }
+    FreeBlock *block = list.pop();
+    if (block) {
+        return block;
+    }
+    void *memory = malloc(kMinBlockSize << size_class);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void TaskAllocator::deallocate(void *ptr, size_t size) {
+    if (size > kMaxBlockSize) {
+        ::operator delete(ptr);
+        return;
+    }
+    int size_class = sizeClass(size);
+    FreeList &list = s_thread_cache.lists[size_class];
+    list.push(static_cast<FreeBlock*>(ptr));
+    if (list.count > kMaxCached) {
+        GlobalFreeLists::instance().put(size_class, list, kBatch);
+    }
+}
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//Task内联存储的容量，捕获的对象不超过这个大小时投递任务不需要分配内存
+#ifndef INFRA_TASK_INLINE_SIZE
+#define INFRA_TASK_INLINE_SIZE 64
+#endif
+
+namespace infra {
+
+/**
+ * 超出内联容量的任务对象从这里分配
+ * 按大小分级，每个线程缓存一部分空闲块，多出的批量归还到全局链表，跨线程释放也不会回到malloc
+ */
+class TaskAllocator {
+public:
+    static void *allocate(size_t size);
+    static void deallocate(void *ptr, size_t size);
+};
+
+/**
+ * 只能移动的void()任务，替代std::function
+ * 可调用对象不超过InlineSize且移动构造不抛异常时存放在内部，否则从TaskAllocator分配
+ */
+template <size_t InlineSize>
+class InlineTask {
+public:
+    InlineTask() : ops_(nullptr) {}
+
+    InlineTask(std::nullptr_t) : ops_(nullptr) {}
+
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, InlineTask>::value &&
+        !std::is_same<typename std::decay<F>::type, std::nullptr_t>::value>::type>
+    InlineTask(F &&f) : ops_(nullptr) {
+        typedef typename std::decay<F>::type Functor;
+        construct<Functor>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Functor>()>());
+    }
+
+    InlineTask(InlineTask &&other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InlineTask &operator=(InlineTask &&other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->move(storage_, other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineTask &operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    InlineTask(const InlineTask&) = delete;
+
+    InlineTask &operator=(const InlineTask&) = delete;
+
+    ~InlineTask() {
+        reset();
+    }
+
+    void operator()() {
+        ops_->invoke(storage_);
+    }
+
+    explicit operator bool() const {
+        return ops_ != nullptr;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src);  //移动到dst并析构src
+        void (*destroy)(void *storage);
+    };
+
+    template <typename F>
+    static constexpr bool fitsInline() {
+        return sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value;
+    }
+
+    template <typename F>
+    struct InlineOps {
+        static void invoke(void *storage) {
+            (*static_cast<F*>(storage))();
+        }
+        static void move(void *dst, void *src) {
+            new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        }
+        static void destroy(void *storage) {
+            static_cast<F*>(storage)->~F();
+        }
+        static const Ops ops;
+    };
+
+    template <typename F>
+    struct HeapOps {
+        static void invoke(void *storage) {
+            (**static_cast<F**>(storage))();
+        }
+        static void move(void *dst, void *src) {
+            *static_cast<F**>(dst) = *static_cast<F**>(src);
+        }
+        static void destroy(void *storage) {
+            F *f = *static_cast<F**>(storage);
+            f->~F();
+            TaskAllocator::deallocate(f, sizeof(F));
+        }
+        static const Ops ops;
+    };
+
+    template <typename F, typename Arg>
+    void construct(Arg &&f, std::true_type) {
+        new (storage_) F(std::forward<Arg>(f));
+        ops_ = &InlineOps<F>::ops;
+    }
+
+    template <typename F, typename Arg>
+    void construct(Arg &&f, std::false_type) {
+        void *memory = TaskAllocator::allocate(sizeof(F));
+        try {
+            *reinterpret_cast<F**>(storage_) = new (memory) F(std::forward<Arg>(f));
+        } catch (...) {
+            TaskAllocator::deallocate(memory, sizeof(F));
+            throw;
+        }
+        ops_ = &HeapOps<F>::ops;
+    }
+
+    void reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    static_assert(InlineSize >= sizeof(void*), "inline size too small");
+
+    alignas(std::max_align_t) unsigned char storage_[InlineSize];
+    const Ops *ops_;
+};
+
+template <size_t InlineSize>
+template <typename F>
+const typename InlineTask<InlineSize>::Ops InlineTask<InlineSize>::InlineOps<F>::ops = {
+    &InlineTask<InlineSize>::InlineOps<F>::invoke,
+    &InlineTask<InlineSize>::InlineOps<F>::move,
+    &InlineTask<InlineSize>::InlineOps<F>::destroy
+};
+
+template <size_t InlineSize>
+template <typename F>
+const typename InlineTask<InlineSize>::Ops InlineTask<InlineSize>::HeapOps<F>::ops = {
+    &InlineTask<InlineSize>::HeapOps<F>::invoke,
+    &InlineTask<InlineSize>::HeapOps<F>::move,
+    &InlineTask<InlineSize>::HeapOps<F>::destroy
+};
+
+typedef InlineTask<INFRA_TASK_INLINE_SIZE> Task;
+
+}
@@ -2,18 +2,24 @@
 
 namespace infra {
 
-TaskQueue::TaskQueue() {
+TaskQueue::TaskQueue(size_t capacity) : task_queue_(capacity) {
 
 }
 
 TaskQueue::~TaskQueue() {
-    
+
 }
 
-void TaskQueue::postTask(std::function<void()> task) {
-    std::lock_guard<decltype(task_queue_mutex_)> guard(task_queue_mutex_);
+void TaskQueue::postTask(Task task) {
     task_queue_.push(std::move(task));
 }
 
+void TaskQueue::postTask(Task task, TaskPriority) {
+    postTask(std::move(task));
+}
 
-}
\ No newline at end of file
+bool TaskQueue::popTask(Task &task) {
+    return task_queue_.pop(task);
+}
+
+}
@@ -1,47 +1,59 @@
 #pragma once
 
-#include <functional>
-#include <queue>
-#include <mutex>
-#include <list>
 #include <memory>
+#include "utils/mpmc_queue.h"
+#include "task.h"
+#include "timing_wheel.h"
 
 namespace infra {
 
+/**
+ * 任务队列接口，投递路径为无锁队列
+ * 延时任务由实现者管理(ThreadPool持有时间轮，SerialTaskQueue转交给所在的线程池)
+ */
 class TaskQueue {
 public:
 
-    TaskQueue();  //默认构造函数
+    typedef TimingWheel::TimerId TaskId;  //延时任务句柄，0为无效值
+
+    //任务优先级，高优先级(音频、RTCP)不会排在低优先级(视频、统计)后面
+    enum TaskPriority {
+        TASK_PRIORITY_LOW = 0,
+        TASK_PRIORITY_NORMAL,
+        TASK_PRIORITY_HIGH
+    };
+
+    TaskQueue(size_t capacity = 8192);  //capacity为无锁队列容量，超出部分进入溢出队列
 
     TaskQueue(const TaskQueue&) = delete;  //拷贝构造函数
 
     TaskQueue(TaskQueue&&) = delete;   //移动构造函数
 
-    ~TaskQueue();
-
-	virtual void postTask(std::function<void()> task);
+    virtual ~TaskQueue();
 
+	virtual void postTask(Task task);
 
-	void postDelayedTask(std::function<void() &&> task, int64_t delayTime);
+    //默认实现忽略优先级，由支持优先级的队列重写
+    virtual void postTask(Task task, TaskPriority priority);
 
-protected:
+    /**
+     * 延时delay_ms毫秒后执行task，到期后task被投递到postTask
+     * @return 用于cancelDelayedTask的句柄
+     */
+	virtual TaskId postDelayedTask(Task task, int64_t delay_ms) = 0;
 
-    std::queue<std::function<void()>> task_queue_;
-    std::mutex task_queue_mutex_;
+    /**
+     * 取消还未到期的延时任务，已经到期或已取消返回false
+     */
+    virtual bool cancelDelayedTask(TaskId id) = 0;
 
-    struct DelayedTask {
-        bool operator< (const DelayedTask& delayedTask) const {
-            return (delayedTask.run_time_ms < run_time_ms);
-        }
+protected:
 
-        int64_t delay_ms;
-        int64_t run_time_ms;
-        uint32_t task_number;
-        std::function<void()> task;
-    };
+    bool popTask(Task &task);
 
-    std::priority_queue<DelayedTask> delayed_task_queue_;
+protected:
 
+    MpmcQueue<Task> task_queue_;
 };
 
 }
@@ -0,0 +1,408 @@
+#include "tcp_connection.h"
+#include "logger.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace infra {
+
+static const size_t kDefaultWriteHigh = 4 * 1024 * 1024;
+static const size_t kDefaultWriteLow = 256 * 1024;
+static const size_t kDefaultReadHigh = 4 * 1024 * 1024;
+//单次sendmsg最多合并的块数
+static const int kMaxIov = 64;
+
+static bool would_block(int error) {
+#if defined(_WIN32)
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+TcpConnection::Ptr TcpConnection::create(const std::shared_ptr<ThreadPool> &loop, int fd) {
+    if (!loop || fd < 0) {
+        return nullptr;
+    }
+    return Ptr(new TcpConnection(loop, fd));
+}
+
+TcpConnection::TcpConnection(const std::shared_ptr<ThreadPool> &loop, int fd)
+    : loop_(loop), fd_(fd), registered_(false), closed_(false), shutdown_(false), reading_(true), writing_(false),
+      above_high_(false), write_high_(kDefaultWriteHigh), write_low_(kDefaultWriteLow), read_high_(kDefaultReadHigh),
+      input_(16 * 1024), output_offset_(0), output_bytes_(0) {
+}
+
+TcpConnection::~TcpConnection() {
+    if (!closed_) {
+        if (registered_) {
+            loop_->eventDriver()->delEvent(fd_);
+        }
+        close_socket(fd_);
+    }
+}
+
+void TcpConnection::setMessageCallback(const MessageCallback &callback) {
+    message_callback_ = callback;
+}
+
+void TcpConnection::setCloseCallback(const CloseCallback &callback) {
+    close_callback_ = callback;
+}
+
+void TcpConnection::setHighWatermarkCallback(const WatermarkCallback &callback) {
+    high_watermark_callback_ = callback;
+}
+
+void TcpConnection::setLowWatermarkCallback(const WatermarkCallback &callback) {
+    low_watermark_callback_ = callback;
+}
+
+void TcpConnection::setWatermarks(size_t write_high, size_t write_low, size_t read_high) {
+    write_high_ = write_high;
+    write_low_ = write_low < write_high ? write_low : write_high;
+    read_high_ = read_high;
+}
+
+void TcpConnection::start() {
+    auto self = shared_from_this();
+    runInLoop([self]() {
+        if (self->closed_ || self->registered_) {
+            return;
+        }
+        //事件回调只持有弱引用，连接的生命周期由使用者决定
+        std::weak_ptr<TcpConnection> weak_self = self;
+        int ret = self->loop_->eventDriver()->addEvent(self->fd_, self->reading_ ? EventDriver::EventRead : 0, [weak_self](int events) {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->onEvents(events);
+            }
+        });
+        if (ret < 0) {
+            self->handleClose();
+            return;
+        }
+        self->registered_ = true;
+        if (!self->output_.empty()) {
+            self->writing_ = true;
+            self->updateEvents();
+        }
+    });
+}
+
+void TcpConnection::runInLoop(Task task) {
+    if (loop_->isCurrentThread()) {
+        task();
+    } else {
+        loop_->postTask(std::move(task));
+    }
+}
+
+//C++11的lambda无法移动捕获，用函数对象把数据移动到所属线程
+struct TcpConnection::SendTask {
+    Ptr conn;
+    std::string data;
+
+    void operator()() {
+        conn->sendInLoop(std::move(data));
+    }
+};
+
+void TcpConnection::send(const char *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (loop_->isCurrentThread()) {
+        sendInLoop(std::string(data, size));
+        return;
+    }
+    send(std::string(data, size));
+}
+
+void TcpConnection::send(std::string &&data) {
+    if (data.empty()) {
+        return;
+    }
+    if (loop_->isCurrentThread()) {
+        sendInLoop(std::move(data));
+        return;
+    }
+    SendTask task;
+    task.conn = shared_from_this();
+    task.data = std::move(data);
+    loop_->postTask(std::move(task));
+}
+
+void TcpConnection::sendInLoop(std::string &&data) {
+    if (closed_ || shutdown_) {
+        return;
+    }
+    size_t written = 0;
+    if (output_.empty() && registered_) {
+        //没有排队的数据时直接发送，发不完的再排队
+        int ret = (int)::send(fd_, data.data(), (int)data.size(), MSG_NOSIGNAL);
+        if (ret >= 0) {
+            written = ret;
+        } else if (!would_block(get_uv_error(true)) && get_uv_error(true) != EINTR) {
+            handleClose();
+            return;
+        }
+        if (written == data.size()) {
+            return;
+        }
+    }
+    if (output_.empty()) {
+        output_offset_ = written;
+    }
+    output_bytes_ += data.size() - written;
+    output_.push_back(std::move(data));
+    if (!above_high_ && output_bytes_ >= write_high_) {
+        above_high_ = true;
+        if (high_watermark_callback_) {
+            high_watermark_callback_(shared_from_this(), output_bytes_);
+        }
+    }
+    if (!writing_ && registered_) {
+        writing_ = true;
+        updateEvents();
+    }
+}
+
+void TcpConnection::onEvents(int events) {
+    if (closed_) {
+        return;
+    }
+    if (events & EventDriver::EventRead) {
+        handleRead();
+    }
+    if (!closed_ && (events & EventDriver::EventWrite)) {
+        handleWrite();
+    }
+    if (!closed_ && (events & EventDriver::EventError)) {
+        handleClose();
+    }
+}
+
+void TcpConnection::handleRead() {
+    auto self = shared_from_this();
+    //linux下为边沿触发，需要一直读到EAGAIN
+    while (reading_ && !closed_) {
+        char extra[64 * 1024];
+        int ret = 0;
+        size_t writable = input_.writableSize();
+#if defined(_WIN32)
+        if (writable == 0) {
+            input_.ensureWritable(sizeof(extra));
+            writable = input_.writableSize();
+        }
+        ret = ::recv(fd_, input_.writable(), (int)writable, 0);
+        if (ret > 0) {
+            input_.commit(ret);
+        }
+#else
+        //缓冲区不够时先读到栈上，避免为每个连接预留大块内存
+        struct iovec iov[2];
+        iov[0].iov_base = input_.writable();
+        iov[0].iov_len = writable;
+        iov[1].iov_base = extra;
+        iov[1].iov_len = sizeof(extra);
+        ret = (int)::readv(fd_, iov, 2);
+        if (ret > 0) {
+            if ((size_t)ret <= writable) {
+                input_.commit(ret);
+            } else {
+                input_.commit(writable);
+                input_.append(extra, ret - writable);
+            }
+        }
+#endif
+        if (ret > 0) {
+            if (message_callback_) {
+                message_callback_(self, input_);
+            }
+            if (input_.size() >= read_high_) {
+                //使用者处理不过来，暂停读让tcp流控生效
+                reading_ = false;
+                updateEvents();
+            }
+            continue;
+        }
+        if (ret == 0) {
+            handleClose();
+            return;
+        }
+        int error = get_uv_error(true);
+        if (error == EINTR) {
+            continue;
+        }
+        if (!would_block(error)) {
+            handleClose();
+        }
+        return;
+    }
+}
+
+void TcpConnection::handleWrite() {
+    while (!output_.empty()) {
+        int ret = 0;
+#if defined(_WIN32)
+        const std::string &front = output_.front();
+        ret = ::send(fd_, front.data() + output_offset_, (int)(front.size() - output_offset_), 0);
+#else
+        //多个排队的块合并为一次系统调用，sendmsg相当于带MSG_NOSIGNAL的writev
+        struct iovec iov[kMaxIov];
+        int count = 0;
+        for (auto it = output_.begin(); it != output_.end() && count < kMaxIov; ++it, ++count) {
+            size_t offset = count == 0 ? output_offset_ : 0;
+            iov[count].iov_base = const_cast<char *>(it->data()) + offset;
+            iov[count].iov_len = it->size() - offset;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ret = (int)::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+#endif
+        if (ret < 0) {
+            int error = get_uv_error(true);
+            if (error == EINTR) {
+                continue;
+            }
+            if (!would_block(error)) {
+                handleClose();
+            }
+            return;
+        }
+        size_t written = ret;
+        output_bytes_ -= written;
+        while (written > 0) {
+            size_t remain = output_.front().size() - output_offset_;
+            if (written < remain) {
+                output_offset_ += written;
+                break;
+            }
+            written -= remain;
+            output_.pop_front();
+            output_offset_ = 0;
+        }
+        if (above_high_ && output_bytes_ <= write_low_) {
+            above_high_ = false;
+            if (low_watermark_callback_) {
+                low_watermark_callback_(shared_from_this(), output_bytes_);
+            }
+        }
+    }
+
+    writing_ = false;
+    updateEvents();
+    if (shutdown_) {
+#if defined(_WIN32)
+        ::shutdown(fd_, SD_SEND);
+#else
+        ::shutdown(fd_, SHUT_WR);
+#endif
+    }
+}
+
+void TcpConnection::handleClose() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    if (registered_) {
+        loop_->eventDriver()->delEvent(fd_);
+    }
+    auto self = shared_from_this();
+    if (close_callback_) {
+        close_callback_(self);
+    }
+    close_socket(fd_);
+    output_.clear();
+    output_bytes_ = 0;
+}
+
+void TcpConnection::updateEvents() {
+    if (!registered_ || closed_) {
+        return;
+    }
+    int events = (reading_ ? EventDriver::EventRead : 0) | (writing_ ? EventDriver::EventWrite : 0);
+    loop_->eventDriver()->modifyEvent(fd_, events);
+}
+
+void TcpConnection::shutdown() {
+    auto self = shared_from_this();
+    runInLoop([self]() {
+        if (self->closed_ || self->shutdown_) {
+            return;
+        }
+        self->shutdown_ = true;
+        if (self->output_.empty()) {
+#if defined(_WIN32)
+            ::shutdown(self->fd_, SD_SEND);
+#else
+            ::shutdown(self->fd_, SHUT_WR);
+#endif
+        }
+    });
+}
+
+void TcpConnection::close() {
+    auto self = shared_from_this();
+    runInLoop([self]() {
+        self->handleClose();
+    });
+}
+
+void TcpConnection::pauseRead() {
+    auto self = shared_from_this();
+    runInLoop([self]() {
+        if (self->reading_) {
+            self->reading_ = false;
+            self->updateEvents();
+        }
+    });
+}
+
+void TcpConnection::resumeRead() {
+    auto self = shared_from_this();
+    runInLoop([self]() {
+        if (!self->reading_ && !self->closed_) {
+            //重新关注可读时epoll会再次检查就绪状态，暂停期间到达的数据不会丢失
+            self->reading_ = true;
+            self->updateEvents();
+        }
+    });
+}
+
+int TcpConnection::fd() const {
+    return fd_;
+}
+
+bool TcpConnection::connected() const {
+    return !closed_;
+}
+
+const std::shared_ptr<ThreadPool> &TcpConnection::loop() const {
+    return loop_;
+}
+
+std::string TcpConnection::peerIp() const {
+    return SocketUtil::get_peer_ip(fd_);
+}
+
+uint16_t TcpConnection::peerPort() const {
+    return SocketUtil::get_peer_port(fd_);
+}
+
+size_t TcpConnection::pendingBytes() const {
+    return output_bytes_;
+}
+
+}
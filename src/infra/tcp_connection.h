@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include "socket_util.h"
+#include "thread_pool.h"
+#include "utils/byte_buffer.h"
+
+namespace infra {
+
+/**
+ * 基于EventDriver的非阻塞tcp连接
+ * 所有回调和读写都在所属的单线程ThreadPool中执行，其他线程调用send会投递到该线程
+ */
+class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
+public:
+    typedef std::shared_ptr<TcpConnection> Ptr;
+    //收到数据，处理完的部分从input中consume，剩余的保留到下一次回调
+    typedef std::function<void(const Ptr &conn, ByteBuffer &input)> MessageCallback;
+    typedef std::function<void(const Ptr &conn)> CloseCallback;
+    //待发送数据超过高水位时回调一次，之后降到低水位以下时回调低水位
+    typedef std::function<void(const Ptr &conn, size_t pending)> WatermarkCallback;
+
+    TcpConnection(const TcpConnection&) = delete;
+
+    TcpConnection(TcpConnection&&) = delete;
+
+    /**
+     * @param loop 必须是单线程的ThreadPool
+     * @param fd 已连接或正在连接的非阻塞socket，由连接负责关闭
+     */
+    static Ptr create(const std::shared_ptr<ThreadPool> &loop, int fd);
+
+    ~TcpConnection();
+
+    void setMessageCallback(const MessageCallback &callback);
+    void setCloseCallback(const CloseCallback &callback);
+    void setHighWatermarkCallback(const WatermarkCallback &callback);
+    void setLowWatermarkCallback(const WatermarkCallback &callback);
+
+    /**
+     * @param write_high/write_low 待发送数据的高低水位
+     * @param read_high 未处理的接收数据超过后暂停读，调用resumeRead恢复
+     */
+    void setWatermarks(size_t write_high, size_t write_low, size_t read_high);
+
+    //注册到事件循环开始收发，应在设置回调后调用
+    void start();
+
+    void send(const char *data, size_t size);
+    void send(std::string &&data);
+
+    //待发送的数据发送完后关闭写方向
+    void shutdown();
+
+    //立即关闭，丢弃未发送的数据
+    void close();
+
+    void pauseRead();
+    void resumeRead();
+
+    int fd() const;
+    bool connected() const;
+    const std::shared_ptr<ThreadPool> &loop() const;
+    std::string peerIp() const;
+    uint16_t peerPort() const;
+
+    //连接内所有待发送数据的字节数，只在所属线程调用
+    size_t pendingBytes() const;
+
+private:
+    struct SendTask;
+
+    TcpConnection(const std::shared_ptr<ThreadPool> &loop, int fd);
+
+    void runInLoop(Task task);
+    void sendInLoop(std::string &&data);
+    void onEvents(int events);
+    void handleRead();
+    void handleWrite();
+    void handleClose();
+    void updateEvents();
+
+private:
+    std::shared_ptr<ThreadPool> loop_;
+    int fd_;
+    bool registered_;
+    bool closed_;
+    bool shutdown_;        //发送完后关闭写方向
+    bool reading_;
+    bool writing_;         //已关注可写事件
+    bool above_high_;      //已触发高水位，等待降到低水位
+    size_t write_high_;
+    size_t write_low_;
+    size_t read_high_;
+
+    ByteBuffer input_;
+    std::deque<std::string> output_;
+    size_t output_offset_;  //output_.front()中已发送的字节数
+    size_t output_bytes_;
+
+    MessageCallback message_callback_;
+    CloseCallback close_callback_;
+    WatermarkCallback high_watermark_callback_;
+    WatermarkCallback low_watermark_callback_;
+};
+
+}
@@ -0,0 +1,224 @@
+#include "tcp_server.h"
+#include <fcntl.h>
+#include <future>
+#include "logger.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+namespace infra {
+
+std::shared_ptr<TcpServer> TcpServer::create(uint16_t port, const char *local_ip, int32_t io_threads) {
+    std::shared_ptr<TcpServer> server(new TcpServer(io_threads));
+    if (!server->start(port, local_ip)) {
+        return nullptr;
+    }
+    return server;
+}
+
+TcpServer::TcpServer(int32_t io_threads)
+    : io_threads_(io_threads > 0 ? io_threads : 1), listen_fd_(-1), idle_fd_(-1), port_(0), next_loop_(0),
+      connection_count_(0), write_high_(0), write_low_(0), read_high_(0) {
+}
+
+TcpServer::~TcpServer() {
+    stop();
+}
+
+bool TcpServer::start(uint16_t port, const char *local_ip) {
+    listen_fd_ = SocketUtil::listen(port, local_ip);
+    if (listen_fd_ < 0) {
+        return false;
+    }
+    port_ = SocketUtil::get_local_port(listen_fd_);
+#if !defined(_WIN32)
+    idle_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+
+    for (int32_t i = 0; i < io_threads_; i++) {
+        std::unique_ptr<IoLoop> loop(new IoLoop());
+        loop->pool = ThreadPool::create("tcp" + std::to_string(port_) + "-" + std::to_string(i), 1);
+        if (!loop->pool) {
+            stop();
+            return false;
+        }
+        loops_.push_back(std::move(loop));
+    }
+
+    acceptor_ = ThreadPool::create("tcp" + std::to_string(port_) + "-accept", 1);
+    if (!acceptor_) {
+        stop();
+        return false;
+    }
+    //accept线程在析构时先于io线程停止，回调不需要持有server
+    int ret = acceptor_->eventDriver()->addEvent(listen_fd_, EventDriver::EventRead, [this](int) {
+        onAccept();
+    });
+    if (ret < 0) {
+        stop();
+        return false;
+    }
+    infof("tcp server listen on port %d with %d io threads\n", port_, io_threads_);
+    return true;
+}
+
+void TcpServer::stop() {
+    //先停止accept，保证不会再有新连接投递到io线程
+    if (acceptor_) {
+        acceptor_->eventDriver()->delEvent(listen_fd_);
+        acceptor_.reset();
+    }
+    if (listen_fd_ >= 0) {
+        close_socket(listen_fd_);
+        listen_fd_ = -1;
+    }
+    if (idle_fd_ >= 0) {
+        close_socket(idle_fd_);
+        idle_fd_ = -1;
+    }
+
+    //在各自的io线程关闭连接，关闭回调会从连接表中移除
+    std::vector<std::future<void>> futures;
+    for (auto &loop : loops_) {
+        if (!loop->pool) {
+            continue;
+        }
+        if (loop->pool->isCurrentThread()) {
+            errorf("tcp server %d destroyed on its own io thread, this will deadlock\n", port_);
+        }
+        std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+        futures.push_back(done->get_future());
+        IoLoop *raw = loop.get();
+        loop->pool->postTask([raw, done]() {
+            std::unordered_map<int, TcpConnection::Ptr> connections;
+            connections.swap(raw->connections);
+            for (auto &it : connections) {
+                it.second->close();
+            }
+            done->set_value();
+        });
+    }
+    for (auto &future : futures) {
+        future.wait();
+    }
+    loops_.clear();
+}
+
+void TcpServer::onAccept() {
+    //边沿触发，一直accept到没有新连接
+    while (true) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+#if defined(__linux__)
+        int fd = ::accept4(listen_fd_, (struct sockaddr *)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int fd = (int)::accept(listen_fd_, (struct sockaddr *)&addr, &addr_len);
+        if (fd >= 0) {
+            SocketUtil::setNoBlocked(fd);
+            SocketUtil::setCloExec(fd);
+        }
+#endif
+        if (fd < 0) {
+            int error = get_uv_error(true);
+#if !defined(_WIN32)
+            if (error == EINTR || error == ECONNABORTED) {
+                continue;
+            }
+            if ((error == EMFILE || error == ENFILE) && idle_fd_ >= 0) {
+                //fd耗尽时连接会一直留在backlog中让listen fd持续可读，先腾出一个fd接受并关闭它
+                warnf("tcp server accept failed, too many open files\n");
+                ::close(idle_fd_);
+                idle_fd_ = ::accept(listen_fd_, nullptr, nullptr);
+                if (idle_fd_ >= 0) {
+                    ::close(idle_fd_);
+                }
+                idle_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                continue;
+            }
+            if (error != EAGAIN && error != EWOULDBLOCK) {
+                errorf("tcp server accept failed: %d\n", error);
+            }
+#endif
+            break;
+        }
+        SocketUtil::setNoSigpipe(fd);
+        SocketUtil::setNoDelay(fd);
+
+        int32_t index = (int32_t)(next_loop_++ % loops_.size());
+        loops_[index]->pool->postTask([this, index, fd]() {
+            newConnection(index, fd);
+        });
+    }
+}
+
+void TcpServer::newConnection(int32_t index, int fd) {
+    TcpConnection::Ptr conn = TcpConnection::create(loops_[index]->pool, fd);
+    conn->setMessageCallback(message_callback_);
+    conn->setHighWatermarkCallback(high_watermark_callback_);
+    conn->setLowWatermarkCallback(low_watermark_callback_);
+    if (write_high_ > 0) {
+        conn->setWatermarks(write_high_, write_low_, read_high_);
+    }
+    conn->setCloseCallback([this, index](const TcpConnection::Ptr &conn) {
+        removeConnection(index, conn);
+    });
+    loops_[index]->connections[fd] = conn;
+    connection_count_++;
+
+    //注册事件的任务在当前线程直接执行，回调返回前不会派发该fd的事件
+    conn->start();
+    if (connection_callback_) {
+        connection_callback_(conn);
+    }
+}
+
+void TcpServer::removeConnection(int32_t index, const TcpConnection::Ptr &conn) {
+    if (close_callback_) {
+        close_callback_(conn);
+    }
+    //停止时连接表已被取出，这里找不到
+    auto &connections = loops_[index]->connections;
+    auto it = connections.find(conn->fd());
+    if (it != connections.end() && it->second == conn) {
+        connections.erase(it);
+    }
+    connection_count_--;
+}
+
+void TcpServer::setConnectionCallback(const ConnectionCallback &callback) {
+    connection_callback_ = callback;
+}
+
+void TcpServer::setMessageCallback(const TcpConnection::MessageCallback &callback) {
+    message_callback_ = callback;
+}
+
+void TcpServer::setCloseCallback(const TcpConnection::CloseCallback &callback) {
+    close_callback_ = callback;
+}
+
+void TcpServer::setHighWatermarkCallback(const TcpConnection::WatermarkCallback &callback) {
+    high_watermark_callback_ = callback;
+}
+
+void TcpServer::setLowWatermarkCallback(const TcpConnection::WatermarkCallback &callback) {
+    low_watermark_callback_ = callback;
+}
+
+void TcpServer::setWatermarks(size_t write_high, size_t write_low, size_t read_high) {
+    write_high_ = write_high;
+    write_low_ = write_low;
+    read_high_ = read_high;
+}
+
+uint16_t TcpServer::port() const {
+    return port_;
+}
+
+size_t TcpServer::connectionCount() const {
+    return connection_count_;
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "tcp_connection.h"
+
+namespace infra {
+
+/**
+ * tcp服务
+ * 监听socket在单独的accept线程处理，新连接轮询分配给io线程，连接之后的所有回调都在分配到的io线程执行
+ */
+class TcpServer {
+public:
+    typedef std::function<void(const TcpConnection::Ptr &conn)> ConnectionCallback;
+
+    TcpServer(const TcpServer&) = delete;
+
+    TcpServer(TcpServer&&) = delete;
+
+    /**
+     * @param port 为0时由系统分配
+     * @param io_threads io线程数，每个线程是独立的单线程ThreadPool
+     */
+    static std::shared_ptr<TcpServer> create(uint16_t port, const char *local_ip = "::", int32_t io_threads = 1);
+
+    /**
+     * 在各io线程关闭连接并等待完成，然后停止io线程
+     * 不能在server自己的io线程(包括连接回调里)释放最后一个引用，否则会等待自己而死锁，应投递到其他线程释放
+     */
+    ~TcpServer();
+
+    //以下回调应在create之后、有连接之前设置
+    void setConnectionCallback(const ConnectionCallback &callback);
+    void setMessageCallback(const TcpConnection::MessageCallback &callback);
+    void setCloseCallback(const TcpConnection::CloseCallback &callback);
+    void setHighWatermarkCallback(const TcpConnection::WatermarkCallback &callback);
+    void setLowWatermarkCallback(const TcpConnection::WatermarkCallback &callback);
+    void setWatermarks(size_t write_high, size_t write_low, size_t read_high);
+
+    uint16_t port() const;
+
+    //当前连接数
+    size_t connectionCount() const;
+
+private:
+    TcpServer(int32_t io_threads);
+
+    bool start(uint16_t port, const char *local_ip);
+
+    void stop();
+
+    void onAccept();
+
+    void newConnection(int32_t index, int fd);
+
+    void removeConnection(int32_t index, const TcpConnection::Ptr &conn);
+
+private:
+    struct IoLoop {
+        std::shared_ptr<ThreadPool> pool;
+        std::unordered_map<int, TcpConnection::Ptr> connections;  //只在本线程访问
+    };
+
+    int32_t io_threads_;
+    int listen_fd_;
+    int idle_fd_;            //fd耗尽时用来接受并关闭新连接
+    uint16_t port_;
+    uint32_t next_loop_;     //只在accept线程访问
+    std::atomic<size_t> connection_count_;
+
+    ConnectionCallback connection_callback_;
+    TcpConnection::MessageCallback message_callback_;
+    TcpConnection::CloseCallback close_callback_;
+    TcpConnection::WatermarkCallback high_watermark_callback_;
+    TcpConnection::WatermarkCallback low_watermark_callback_;
+    size_t write_high_;
+    size_t write_low_;
+    size_t read_high_;       //write_high_为0时使用连接的默认水位
+
+    std::shared_ptr<ThreadPool> acceptor_;
+    std::vector<std::unique_ptr<IoLoop>> loops_;
+};
+
+}
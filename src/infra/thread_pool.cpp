@@ -1,26 +1,67 @@
 #include "thread_pool.h"
 #include <chrono>
+#include <limits>
 #include "event_driver.h"
+#include "utils/time.h"
 #include "logger.h"
 
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
 namespace infra {
 
-ThreadPool::ThreadPool(const std::string& name, int32_t threadCount, Priority priority)
-    : name_(name), threadCount_(threadCount), priority_(priority), running(false) {
+//每执行这么多个任务，优先从低优先级队列取一个，避免饿死
+static const int kLowPriorityInterval = 16;
+static const size_t kPriorityQueueCapacity = 1024;
+static const int64_t kNoDeadline = std::numeric_limits<int64_t>::max();
+
+//本地双端队列只能存指针，节点同样从TaskAllocator分配
+static Task *newTaskNode(Task &&task) {
+    return new (TaskAllocator::allocate(sizeof(Task))) Task(std::move(task));
+}
+
+static void deleteTaskNode(Task *node) {
+    node->~Task();
+    TaskAllocator::deallocate(node, sizeof(Task));
+}
+
+//当前线程所属的线程池及其下标，用于work stealing模式下判断是否投递到本地队列
+static thread_local ThreadPool *s_current_pool = nullptr;
+static thread_local int32_t s_current_index = -1;
+
+ThreadPool::ThreadPool(const std::string& name, int32_t threadCount, Priority priority, Schedule schedule, const std::vector<int32_t> &cpus)
+    : name_(name), threadCount_(threadCount), priority_(priority), schedule_(schedule), cpus_(cpus), running(false), alive_threads_(0), idle_threads_(0),
+      high_priority_queue_(kPriorityQueueCapacity), low_priority_queue_(kPriorityQueueCapacity),
+      timing_wheel_(getCurrentMilliseconds()), next_deadline_(kNoDeadline) {
 
     event_driver_ = std::make_shared<EventDriver>();
+    if (schedule_ == SCHEDULE_WORK_STEALING) {
+        for (int32_t i = 0; i < threadCount_; i++) {
+            std::unique_ptr<Worker> worker(new Worker());
+            worker->random = 0x9E3779B9u * (uint32_t)(i + 1);
+            workers_.push_back(std::move(worker));
+        }
+    }
 }
 
 ThreadPool::~ThreadPool() {
     stop();
 }
 
-std::shared_ptr<ThreadPool> ThreadPool::create(const std::string& name, int32_t threadCount, Priority priority) {
+std::shared_ptr<ThreadPool> ThreadPool::create(const std::string& name, int32_t threadCount, Priority priority, Schedule schedule,
+                                               const std::vector<int32_t> &cpus) {
     
     if (threadCount < 1) {
         return nullptr;
     }
-    std::shared_ptr<ThreadPool> pool(new ThreadPool(name, threadCount, priority));
+    std::shared_ptr<ThreadPool> pool(new ThreadPool(name, threadCount, priority, schedule, cpus));
     if (pool->start() == false) {
         return nullptr;
     }
@@ -28,22 +69,31 @@ std::shared_ptr<ThreadPool> ThreadPool::create(const std::string& name, int32_t
 }
 
 bool ThreadPool::start() {
+    running = true;
+    alive_threads_ = threadCount_;
     for (int i = 0; i < threadCount_; i++) {
         auto thread = std::make_shared<std::thread>([this, i]() {run(i);});
         auto id = thread->get_id();
         threads_[id] = thread;
     }
-    running = true;
     return true;
 }
 
 void ThreadPool::stop() {
     running = false;
-    task_queue_mutex_.lock();
-    for (auto i = 0; i < task_queue_.size(); i++) {
-        task_queue_.pop();
+    //多个线程等待同一个eventfd时唤醒可能被合并，一直唤醒直到全部线程退出循环
+    while (alive_threads_ > 0) {
+        event_driver_->WakeUp();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    Task task;
+    while (popTask(task) || high_priority_queue_.pop(task) || low_priority_queue_.pop(task)) {
+    }
+    for (auto &worker : workers_) {
+        while (auto item = worker->deque.pop()) {
+            deleteTaskNode(item);
+        }
     }
-    task_queue_mutex_.unlock();
 
     for (auto it : threads_) {
         if (it.second->joinable()) {
@@ -53,30 +103,218 @@ void ThreadPool::stop() {
     tracef("~ThreadPool\n");
 }
 
-void ThreadPool::postTask(std::function<void()> task) {
-    TaskQueue::postTask(std::move(task));
-    event_driver_->WakeUp();
+void ThreadPool::postTask(Task task) {
+    if (schedule_ == SCHEDULE_WORK_STEALING && s_current_pool == this) {
+        workers_[s_current_index]->deque.push(newTaskNode(std::move(task)));
+    } else {
+        TaskQueue::postTask(std::move(task));
+    }
+    wakeUpIdle();
+}
+
+void ThreadPool::postTask(Task task, TaskPriority priority) {
+    switch (priority) {
+        case TASK_PRIORITY_HIGH:
+            high_priority_queue_.push(std::move(task));
+            break;
+        case TASK_PRIORITY_LOW:
+            low_priority_queue_.push(std::move(task));
+            break;
+        default:
+            postTask(std::move(task));
+            return;
+    }
+    wakeUpIdle();
+}
+
+ThreadPool::TaskId ThreadPool::postDelayedTask(Task task, int64_t delay_ms) {
+    int64_t deadline = getCurrentMilliseconds() + (delay_ms > 0 ? delay_ms : 0);
+    bool earlier = false;
+    TaskId id;
+    {
+        std::lock_guard<decltype(delayed_task_mutex_)> guard(delayed_task_mutex_);
+        id = timing_wheel_.add(deadline, std::move(task));
+        if (deadline < next_deadline_.load(std::memory_order_relaxed)) {
+            next_deadline_.store(deadline, std::memory_order_release);
+            earlier = true;
+        }
+    }
+    if (earlier) {
+        //最近的到期时间提前了，让等待中的线程重新计算超时
+        wakeUpIdle();
+    }
+    return id;
+}
+
+bool ThreadPool::cancelDelayedTask(TaskId id) {
+    std::lock_guard<decltype(delayed_task_mutex_)> guard(delayed_task_mutex_);
+    return timing_wheel_.cancel(id);
+}
+
+int64_t ThreadPool::runDelayedTasks() {
+    int64_t next_deadline = next_deadline_.load(std::memory_order_acquire);
+    if (next_deadline == kNoDeadline) {
+        return -1;
+    }
+    int64_t now = getCurrentMilliseconds();
+    if (now < next_deadline) {
+        return next_deadline - now;
+    }
+
+    //同一时间只需要一个线程推进时间轮
+    std::unique_lock<decltype(delayed_task_mutex_)> lock(delayed_task_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return 1;
+    }
+    timing_wheel_.advance(now, [this](Task &&task) {
+        postTask(std::move(task));
+    });
+    int64_t timeout = timing_wheel_.nextTimeout(now);
+    next_deadline_.store(timeout < 0 ? kNoDeadline : now + timeout, std::memory_order_release);
+    return timeout;
+}
+
+void ThreadPool::wakeUpIdle() {
+    //与run中idle_threads_++之后的再次检查队列配对，保证不会丢失唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_threads_.load(std::memory_order_relaxed) > 0) {
+        event_driver_->WakeUp();
+    }
+}
+
+bool ThreadPool::getTask(int32_t index, Task &task, bool prefer_low) {
+    if (high_priority_queue_.pop(task)) {
+        return true;
+    }
+    if (prefer_low && low_priority_queue_.pop(task)) {
+        return true;
+    }
+    if (schedule_ == SCHEDULE_WORK_STEALING) {
+        auto item = workers_[index]->deque.pop();
+        if (item) {
+            task = std::move(*item);
+            deleteTaskNode(item);
+            return true;
+        }
+    }
+    if (popTask(task)) {
+        return true;
+    }
+    if (schedule_ == SCHEDULE_WORK_STEALING && stealTask(index, task)) {
+        return true;
+    }
+    return low_priority_queue_.pop(task);
+}
+
+void ThreadPool::setThreadScheduling(int32_t index) {
+#if defined(_WIN32)
+    if (priority_ != PRIORITY_NORMAL) {
+        int level = priority_ == PRIORIYY_HIGH ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_BELOW_NORMAL;
+        if (!SetThreadPriority(GetCurrentThread(), level)) {
+            warnf("threadpool %s %d SetThreadPriority failed\n", name_.c_str(), index);
+        }
+    }
+    if (!cpus_.empty()) {
+        DWORD_PTR mask = DWORD_PTR(1) << cpus_[index % cpus_.size()];
+        if (!SetThreadAffinityMask(GetCurrentThread(), mask)) {
+            warnf("threadpool %s %d SetThreadAffinityMask failed\n", name_.c_str(), index);
+        }
+    }
+#else
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (priority_ == PRIORIYY_HIGH) {
+        //实时调度需要CAP_SYS_NICE，没有权限时退化为提高nice
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0 && setpriority(PRIO_PROCESS, tid, -10) != 0) {
+            warnf("threadpool %s %d raise priority failed, errno:%d\n", name_.c_str(), index, errno);
+        }
+    } else if (priority_ == PRIORITY_LOW) {
+        if (setpriority(PRIO_PROCESS, tid, 10) != 0) {
+            warnf("threadpool %s %d lower priority failed, errno:%d\n", name_.c_str(), index, errno);
+        }
+    }
+#if defined(__linux__)
+    if (!cpus_.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus_[index % cpus_.size()], &set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0) {
+            warnf("threadpool %s %d set affinity to cpu %d failed, errno:%d\n", name_.c_str(), index, cpus_[index % cpus_.size()], ret);
+        }
+    }
+#endif
+#endif
+}
+
+bool ThreadPool::stealTask(int32_t index, Task &task) {
+    //xorshift随机选择起始窃取对象，避免所有空闲线程同时窃取同一个线程
+    uint32_t &random = workers_[index]->random;
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    int32_t count = (int32_t)workers_.size();
+    int32_t start = (int32_t)(random % (uint32_t)count);
+    for (int32_t i = 0; i < count; i++) {
+        int32_t victim = (start + i) % count;
+        if (victim == index) {
+            continue;
+        }
+        auto item = workers_[victim]->deque.steal();
+        if (item) {
+            task = std::move(*item);
+            deleteTaskNode(item);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<EventDriver> ThreadPool::eventDriver() const {
+    return event_driver_;
+}
+
+bool ThreadPool::isCurrentThread() const {
+    return s_current_pool == this;
 }
 
 void ThreadPool::run(int32_t index) {
     infof("threadpool:%s %d start\n", name_.c_str(), index);
+    s_current_pool = this;
+    s_current_index = index;
+    setThreadScheduling(index);
+    static const int64_t kMaxWaitMs = 1000 * 10;
+    static const int kTimerCheckInterval = 32;
+    Task task;
+    int executed = 0;
     while (running) {
-        event_driver_->Wait(1000 * 10);
-
-        task_queue_mutex_.lock();
-        if (!task_queue_.empty()) {
-            size_t task_queue_size = task_queue_.size();
-            auto task = task_queue_.front();
-            task_queue_.pop();
-            task_queue_mutex_.unlock();
-            
-            //infof("thread {} exec task, size:{}", index, (int)task_queue_size);
+        if (getTask(index, task, executed % kLowPriorityInterval == kLowPriorityInterval - 1)) {
+            task();
+            task = nullptr;
+            //持续有任务时也要定期推进时间轮和处理io，避免延时任务和fd事件饿死
+            if (++executed % kTimerCheckInterval == 0) {
+                runDelayedTasks();
+                event_driver_->Wait(0, true);
+            }
+            continue;
+        }
+        int64_t timeout = runDelayedTasks();
+        idle_threads_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (getTask(index, task, false)) {
+            idle_threads_.fetch_sub(1, std::memory_order_relaxed);
             task();
-        } else {
-            task_queue_mutex_.unlock();
+            task = nullptr;
+            continue;
+        }
+        if (running) {
+            event_driver_->Wait(timeout < 0 || timeout > kMaxWaitMs ? kMaxWaitMs : timeout, true);
         }
-        
+        idle_threads_.fetch_sub(1, std::memory_order_relaxed);
     }
+    alive_threads_--;
     infof("threadpool %s %d exit\n", name_.c_str(), index);
 
 }
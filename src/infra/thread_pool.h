@@ -4,8 +4,12 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
 #include "task_queue.h"
 #include "event_driver.h"
+#include "utils/work_stealing_deque.h"
 
 
 namespace infra {
@@ -19,19 +23,48 @@ public:
         PRIORIYY_HIGH
     };
 
+    enum Schedule {
+        SCHEDULE_SHARED_QUEUE = 0,  //所有线程共享一个FIFO队列
+        SCHEDULE_WORK_STEALING      //每个线程一个本地队列，空闲时从其他线程窃取
+    };
+
     ThreadPool(const ThreadPool&) = delete; 
 
     ThreadPool(ThreadPool&&) = delete;
 
-    static std::shared_ptr<ThreadPool> create(const std::string& name, int32_t threadCount = 1, Priority priority = PRIORITY_NORMAL);
+    /**
+     * @param priority 线程的系统调度优先级，高优先级尝试SCHED_FIFO，没有权限时退化为nice
+     * @param cpus 绑定的cpu列表，第i个线程绑定到cpus[i % cpus.size()]，为空不绑定
+     */
+    static std::shared_ptr<ThreadPool> create(const std::string& name, int32_t threadCount = 1, Priority priority = PRIORITY_NORMAL,
+                                              Schedule schedule = SCHEDULE_SHARED_QUEUE,
+                                              const std::vector<int32_t> &cpus = std::vector<int32_t>());
+
+    /**
+     * SCHEDULE_WORK_STEALING模式下，池内线程post的任务放入本线程队列(LIFO)，其他线程post的进入共享队列
+     */
+    virtual void postTask(Task task) override;
+
+    /**
+     * 高优先级任务总是先于其他任务执行，低优先级任务每隔若干个任务保证执行一次，避免饿死
+     */
+    virtual void postTask(Task task, TaskPriority priority) override;
 
-    virtual void postTask(std::function<void()> task) override;
+    virtual TaskId postDelayedTask(Task task, int64_t delay_ms) override;
+
+    virtual bool cancelDelayedTask(TaskId id) override;
+
+    //线程池的事件循环，注册到这里的fd由池中线程派发回调
+    std::shared_ptr<EventDriver> eventDriver() const;
+
+    //当前线程是否属于这个线程池，单线程的池可以用来判断是否需要投递到事件循环
+    bool isCurrentThread() const;
 
     ~ThreadPool();
 
 private:
 
-    ThreadPool(const std::string& name, int32_t threadCount = 1, Priority priority = PRIORITY_NORMAL);
+    ThreadPool(const std::string& name, int32_t threadCount, Priority priority, Schedule schedule, const std::vector<int32_t> &cpus);
 
     bool start();  //启动
 
@@ -39,18 +72,49 @@ private:
 
     void run(int32_t index);
 
+    bool getTask(int32_t index, Task &task, bool prefer_low);
+
+    void setThreadScheduling(int32_t index);
+
+    bool stealTask(int32_t index, Task &task);
+
+    void wakeUpIdle();
+
+    /**
+     * 把到期的延时任务投递到postTask
+     * @return 距离下一个延时任务到期的时间(ms)，没有延时任务返回-1
+     */
+    int64_t runDelayedTasks();
 
 private:
 
     std::string name_;
     int32_t threadCount_;
     Priority priority_;
+    Schedule schedule_;
+    std::vector<int32_t> cpus_;
 
-    bool running;
+    std::atomic<bool> running;
+    std::atomic<int32_t> alive_threads_;
+    std::atomic<int32_t> idle_threads_;  //阻塞在Wait中的线程数，为0时post不需要唤醒
 
     std::shared_ptr<EventDriver> event_driver_;
 
+    //普通优先级使用TaskQueue::task_queue_
+    MpmcQueue<Task> high_priority_queue_;
+    MpmcQueue<Task> low_priority_queue_;
+
     std::unordered_map<std::thread::id, std::shared_ptr<std::thread>> threads_;
+
+    struct Worker {
+        WorkStealingDeque<Task> deque;
+        uint32_t random;  //选择窃取对象的随机数种子
+    };
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex delayed_task_mutex_;
+    TimingWheel timing_wheel_;
+    std::atomic<int64_t> next_deadline_;  //最近的到期时间，不加锁判断是否需要推进时间轮
 };
 
 
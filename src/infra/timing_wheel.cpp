@@ -0,0 +1,185 @@
+#include "timing_wheel.h"
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace infra {
+
+TimingWheel::TimingWheel(int64_t now_ms) : current_tick_(now_ms), size_(0), free_head_(kInvalid) {
+    for (int i = 0; i < kSlotCount; i++) {
+        heads_[i] = kInvalid;
+    }
+    memset(bitmap_, 0, sizeof(bitmap_));
+}
+
+int TimingWheel::levelIndex(int level, int64_t tick) {
+    if (level == 0) {
+        return (int)(tick & (kLevel0Size - 1));
+    }
+    return (int)((tick >> (kLevel0Bits + (level - 1) * kLevelBits)) & (kLevelSize - 1));
+}
+
+int TimingWheel::slotBase(int level) {
+    return level == 0 ? 0 : kLevel0Size + (level - 1) * kLevelSize;
+}
+
+static inline int lowestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+void TimingWheel::setBit(int slot) {
+    bitmap_[slot >> 6] |= uint64_t(1) << (slot & 63);
+}
+
+void TimingWheel::clearBit(int slot) {
+    bitmap_[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+}
+
+bool TimingWheel::level0Pending(int from, int &pos) const {
+    for (int word = from >> 6; word < kLevel0Size / 64; word++) {
+        uint64_t bits = bitmap_[word];
+        if (word == (from >> 6)) {
+            bits &= ~uint64_t(0) << (from & 63);
+        }
+        if (bits) {
+            pos = word * 64 + lowestBit(bits);
+            return true;
+        }
+    }
+    return false;
+}
+
+TimingWheel::TimerId TimingWheel::add(int64_t deadline_ms, Task task) {
+    uint32_t index;
+    if (free_head_ != kInvalid) {
+        index = free_head_;
+        free_head_ = nodes_[index].next;
+    } else {
+        index = (uint32_t)nodes_.size();
+        nodes_.push_back(Node());
+        nodes_[index].generation = 0;
+    }
+    Node &node = nodes_[index];
+    node.generation++;
+    if (node.generation == 0) {
+        node.generation = 1;
+    }
+    node.deadline = deadline_ms;
+    node.task = std::move(task);
+    insert(index);
+    size_++;
+    return (uint64_t(node.generation) << 32) | index;
+}
+
+bool TimingWheel::cancel(TimerId id) {
+    uint32_t index = (uint32_t)id;
+    uint32_t generation = (uint32_t)(id >> 32);
+    if (index >= nodes_.size()) {
+        return false;
+    }
+    Node &node = nodes_[index];
+    if (node.slot < 0 || node.generation != generation) {
+        //已经执行或取消
+        return false;
+    }
+    unlink(index);
+    node.task = nullptr;
+    freeNode(index);
+    return true;
+}
+
+void TimingWheel::insert(uint32_t index) {
+    Node &node = nodes_[index];
+    int64_t expires = node.deadline < current_tick_ ? current_tick_ : node.deadline;
+    int64_t delta = expires - current_tick_;
+    if (delta >= kMaxSpan) {
+        expires = current_tick_ + kMaxSpan - 1;
+        delta = kMaxSpan - 1;
+    }
+
+    int level = 0;
+    int64_t span = kLevel0Size;
+    while (delta >= span) {
+        level++;
+        span <<= kLevelBits;
+    }
+    int slot = slotBase(level) + levelIndex(level, expires);
+
+    node.slot = slot;
+    node.prev = kInvalid;
+    node.next = heads_[slot];
+    if (node.next != kInvalid) {
+        nodes_[node.next].prev = index;
+    }
+    heads_[slot] = index;
+    setBit(slot);
+}
+
+void TimingWheel::unlink(uint32_t index) {
+    Node &node = nodes_[index];
+    if (node.prev != kInvalid) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        heads_[node.slot] = node.next;
+        if (node.next == kInvalid) {
+            clearBit(node.slot);
+        }
+    }
+    if (node.next != kInvalid) {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.slot = -1;
+}
+
+uint32_t TimingWheel::takeSlot(int slot) {
+    uint32_t head = heads_[slot];
+    heads_[slot] = kInvalid;
+    clearBit(slot);
+    for (uint32_t node = head; node != kInvalid; node = nodes_[node].next) {
+        nodes_[node].slot = -1;
+    }
+    return head;
+}
+
+bool TimingWheel::cascade(int level) {
+    int index = levelIndex(level, current_tick_);
+    uint32_t node = takeSlot(slotBase(level) + index);
+    while (node != kInvalid) {
+        uint32_t next = nodes_[node].next;
+        insert(node);
+        node = next;
+    }
+    //本层也转完一圈，需要继续降级上一层
+    return index == 0;
+}
+
+void TimingWheel::freeNode(uint32_t index) {
+    Node &node = nodes_[index];
+    node.slot = -1;
+    node.next = free_head_;
+    free_head_ = index;
+    size_--;
+}
+
+int64_t TimingWheel::nextTimeout(int64_t now_ms) const {
+    if (size_ == 0) {
+        return -1;
+    }
+    int pos;
+    int64_t next_tick;
+    if (level0Pending((int)(current_tick_ & (kLevel0Size - 1)), pos)) {
+        next_tick = (current_tick_ & ~int64_t(kLevel0Size - 1)) + pos;
+    } else {
+        next_tick = (current_tick_ | (kLevel0Size - 1)) + 1;
+    }
+    return next_tick > now_ms ? next_tick - now_ms : 0;
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "task.h"
+
+namespace infra {
+
+/**
+ * 分层时间轮，精度1ms，插入和取消都是O(1)
+ * 第0层256个槽，1~3层各64个槽，覆盖2^26ms(约18.6小时)，更长的定时在到达上限后重新插入
+ * 非线程安全，由TaskQueue加锁使用
+ */
+class TimingWheel {
+public:
+
+    typedef uint64_t TimerId;  //高32位为代数，低32位为节点下标，0为无效值
+
+    explicit TimingWheel(int64_t now_ms);
+
+    TimingWheel(const TimingWheel&) = delete;
+
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    TimerId add(int64_t deadline_ms, Task task);
+
+    bool cancel(TimerId id);
+
+    /**
+     * 推进到now_ms，对每个到期任务调用on_expired(Task&&)
+     */
+    template <typename F>
+    void advance(int64_t now_ms, F &&on_expired);
+
+    /**
+     * 距离下一次需要advance的时间(ms)，没有定时任务返回-1
+     * 只在第0层是精确值，高层返回下一次降级的时间
+     */
+    int64_t nextTimeout(int64_t now_ms) const;
+
+    size_t size() const { return size_; }
+
+private:
+
+    static const uint32_t kInvalid = 0xFFFFFFFF;
+    static const int kLevels = 4;
+    static const int kLevel0Bits = 8;
+    static const int kLevelBits = 6;
+    static const int kLevel0Size = 1 << kLevel0Bits;
+    static const int kLevelSize = 1 << kLevelBits;
+    static const int kSlotCount = kLevel0Size + (kLevels - 1) * kLevelSize;
+    static const int64_t kMaxSpan = int64_t(1) << (kLevel0Bits + (kLevels - 1) * kLevelBits);
+
+    struct Node {
+        int64_t deadline;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t generation;
+        int32_t slot;  //-1表示空闲节点
+        Task task;
+    };
+
+    void insert(uint32_t index);
+
+    void unlink(uint32_t index);
+
+    uint32_t takeSlot(int slot);
+
+    bool cascade(int level);
+
+    void freeNode(uint32_t index);
+
+    static int levelIndex(int level, int64_t tick);
+
+    static int slotBase(int level);
+
+    void setBit(int slot);
+
+    void clearBit(int slot);
+
+    bool level0Pending(int from, int &pos) const;
+
+private:
+
+    int64_t current_tick_;  //下一个待处理的tick
+    size_t size_;
+    std::vector<Node> nodes_;
+    uint32_t free_head_;
+    uint32_t heads_[kSlotCount];
+    uint64_t bitmap_[kLevel0Size / 64 + kLevels - 1];  //槽非空标记
+};
+
+template <typename F>
+void TimingWheel::advance(int64_t now_ms, F &&on_expired) {
+    while (current_tick_ <= now_ms) {
+        int index = (int)(current_tick_ & (kLevel0Size - 1));
+        if (index == 0) {
+            //第0层转完一圈，逐层把高层的槽降级下来
+            for (int level = 1; level < kLevels && cascade(level); level++) {
+            }
+        }
+
+        uint32_t node = takeSlot(index);
+        while (node != kInvalid) {
+            uint32_t next = nodes_[node].next;
+            if (nodes_[node].deadline > now_ms) {
+                //超过时间轮跨度的定时，重新插入
+                insert(node);
+            } else {
+                Task task(std::move(nodes_[node].task));
+                freeNode(node);
+                on_expired(std::move(task));
+            }
+            node = next;
+        }
+
+        //跳过空槽，但不能越过下一圈的起点(需要降级)
+        int pos;
+        int64_t next_tick = (current_tick_ | (kLevel0Size - 1)) + 1;
+        if (index + 1 < kLevel0Size && level0Pending(index + 1, pos)) {
+            next_tick = (current_tick_ & ~int64_t(kLevel0Size - 1)) + pos;
+        }
+        current_tick_ = next_tick < now_ms + 1 ? next_tick : now_ms + 1;
+    }
+}
+
+}
@@ -0,0 +1,168 @@
+#include "udp_server.h"
+#include <thread>
+#include "logger.h"
+
+#if defined(__linux__)
+#include <linux/filter.h>
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
+namespace infra {
+
+std::shared_ptr<UdpServer> UdpServer::create(uint16_t port, const PacketCallback &callback, const char *local_ip,
+                                             const UdpServerOptions &options) {
+    if (!callback) {
+        return nullptr;
+    }
+    std::shared_ptr<UdpServer> server(new UdpServer(callback, options));
+    if (!server->start(port, local_ip)) {
+        return nullptr;
+    }
+    return server;
+}
+
+UdpServer::UdpServer(const PacketCallback &callback, const UdpServerOptions &options)
+    : callback_(callback), options_(options), port_(0) {
+    if (options_.shards <= 0) {
+        options_.shards = (int32_t)std::thread::hardware_concurrency();
+        if (options_.shards <= 0) {
+            options_.shards = 1;
+        }
+    }
+}
+
+UdpServer::~UdpServer() {
+    stop();
+}
+
+bool UdpServer::start(uint16_t port, const char *local_ip) {
+    for (int32_t i = 0; i < options_.shards; i++) {
+        std::unique_ptr<Shard> shard(new Shard());
+        //第一个socket可能由系统分配端口，之后的都绑定到同一个端口
+        shard->fd = SocketUtil::bindUdpSock(i == 0 ? port : port_, local_ip, true);
+        if (shard->fd < 0) {
+            errorf("udp server bind port %d failed\n", i == 0 ? port : port_);
+            stop();
+            return false;
+        }
+        if (i == 0) {
+            port_ = SocketUtil::get_local_port(shard->fd);
+        }
+        if (options_.gro) {
+            SocketUtil::setUdpGro(shard->fd);
+        }
+        shard->buffer.resize(options_.packet_capacity * SOCKET_MAX_BATCH);
+        shard->packets.resize(SOCKET_MAX_BATCH);
+        for (int32_t j = 0; j < SOCKET_MAX_BATCH; j++) {
+            shard->packets[j].data = &shard->buffer[j * options_.packet_capacity];
+            shard->packets[j].capacity = options_.packet_capacity;
+        }
+        shards_.push_back(std::move(shard));
+    }
+
+    //socket全部加入reuseport组之后再挂载，组内socket的下标即创建顺序
+    if (options_.cpu_steering && !attachSteering()) {
+        warnf("udp server attach reuseport cpu steering failed, fallback to hash\n");
+    }
+
+    for (int32_t i = 0; i < (int32_t)shards_.size(); i++) {
+        std::vector<int32_t> cpus(1, options_.cpus.empty() ? i : options_.cpus[i % options_.cpus.size()]);
+        shards_[i]->pool = ThreadPool::create("udp" + std::to_string(port_) + "-" + std::to_string(i), 1,
+                                              ThreadPool::PRIORITY_NORMAL, ThreadPool::SCHEDULE_SHARED_QUEUE, cpus);
+        if (!shards_[i]->pool) {
+            stop();
+            return false;
+        }
+        //回调只会在分片线程执行，析构时先删除事件并停止线程，不需要持有server
+        int ret = shards_[i]->pool->eventDriver()->addEvent(shards_[i]->fd, EventDriver::EventRead, [this, i](int) {
+            onReadable(i);
+        });
+        if (ret < 0) {
+            stop();
+            return false;
+        }
+    }
+    infof("udp server listen on port %d with %d shards\n", port_, (int)shards_.size());
+    return true;
+}
+
+void UdpServer::stop() {
+    for (auto &shard : shards_) {
+        if (shard->pool) {
+            shard->pool->eventDriver()->delEvent(shard->fd);
+            shard->pool.reset();
+        }
+    }
+    for (auto &shard : shards_) {
+        if (shard->fd >= 0) {
+            close_socket(shard->fd);
+            shard->fd = -1;
+        }
+    }
+    shards_.clear();
+}
+
+bool UdpServer::attachSteering() {
+#if defined(__linux__)
+    //返回收包cpu对分片数取模的结果作为组内socket下标
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)shards_.size()},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    return setsockopt(shards_[0]->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+#else
+    return false;
+#endif
+}
+
+void UdpServer::onReadable(int32_t shard_index) {
+    Shard &shard = *shards_[shard_index];
+    //边沿触发，一直读到没有数据
+    while (true) {
+        int count = SocketUtil::recvBatch(shard.fd, shard.packets.data(), (int)shard.packets.size());
+        if (count <= 0) {
+            break;
+        }
+        callback_(shard_index, shard.packets.data(), count);
+        if (count < (int)shard.packets.size()) {
+            break;
+        }
+    }
+}
+
+uint16_t UdpServer::port() const {
+    return port_;
+}
+
+int32_t UdpServer::shardCount() const {
+    return (int32_t)shards_.size();
+}
+
+std::shared_ptr<ThreadPool> UdpServer::shardPool(int32_t shard) const {
+    if (shard < 0 || shard >= (int32_t)shards_.size()) {
+        return nullptr;
+    }
+    return shards_[shard]->pool;
+}
+
+int UdpServer::shardFd(int32_t shard) const {
+    if (shard < 0 || shard >= (int32_t)shards_.size()) {
+        return -1;
+    }
+    return shards_[shard]->fd;
+}
+
+int UdpServer::send(int32_t shard, const UdpPacket *packets, int32_t count) {
+    if (shard < 0 || shard >= (int32_t)shards_.size()) {
+        return -1;
+    }
+    return SocketUtil::sendBatch(shards_[shard]->fd, packets, count);
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include "socket_util.h"
+#include "thread_pool.h"
+
+namespace infra {
+
+typedef struct UdpServerOptions_tag {
+    int32_t shards = 0;              //分片数，0表示cpu核数
+    std::vector<int32_t> cpus;       //第i个分片绑定到cpus[i % cpus.size()]，为空时绑定到cpu i
+    bool cpu_steering = false;       //用cBPF按收包的cpu选择分片，要求分片i绑定在cpu i上
+    bool gro = false;                //开启UDP_GRO
+    size_t packet_capacity = 2048;   //每个包的接收缓冲大小，开启GRO时应不小于64KB
+} UdpServerOptions;
+
+/**
+ * SO_REUSEPORT分片的udp服务
+ * 同一端口创建多个socket，每个socket由一个绑核的单线程ThreadPool独占，收发都在本分片线程完成
+ * 内核默认按四元组哈希选择socket，同一个对端总是落在同一个分片上
+ */
+class UdpServer {
+public:
+    //在分片线程回调，packets只在回调期间有效
+    typedef std::function<void(int32_t shard, UdpPacket *packets, int32_t count)> PacketCallback;
+
+    UdpServer(const UdpServer&) = delete;
+
+    UdpServer(UdpServer&&) = delete;
+
+    /**
+     * @param port 为0时由系统分配，之后的分片绑定到同一个端口
+     */
+    static std::shared_ptr<UdpServer> create(uint16_t port, const PacketCallback &callback, const char *local_ip = "::",
+                                             const UdpServerOptions &options = UdpServerOptions());
+
+    ~UdpServer();
+
+    uint16_t port() const;
+
+    int32_t shardCount() const;
+
+    //分片的事件循环，向它投递任务可以在分片线程中处理与该分片相关的状态
+    std::shared_ptr<ThreadPool> shardPool(int32_t shard) const;
+
+    int shardFd(int32_t shard) const;
+
+    //从分片的socket批量发送，应在该分片线程调用
+    int send(int32_t shard, const UdpPacket *packets, int32_t count);
+
+private:
+    UdpServer(const PacketCallback &callback, const UdpServerOptions &options);
+
+    bool start(uint16_t port, const char *local_ip);
+
+    void stop();
+
+    bool attachSteering();
+
+    void onReadable(int32_t shard);
+
+private:
+    struct Shard {
+        int fd;
+        std::shared_ptr<ThreadPool> pool;
+        std::vector<char> buffer;          //接收缓冲，只在分片线程使用
+        std::vector<UdpPacket> packets;
+    };
+
+    PacketCallback callback_;
+    UdpServerOptions options_;
+    uint16_t port_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}
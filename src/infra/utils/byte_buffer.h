@@ -0,0 +1,76 @@
+#pragma once
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+
+namespace infra {
+
+/**
+ * 连续的字节缓冲，从头部读取、尾部追加
+ * 读取只移动读位置，追加空间不足时先把未读数据移到开头，避免频繁分配
+ */
+class ByteBuffer {
+public:
+    explicit ByteBuffer(size_t capacity = 4096) : buffer_(capacity), read_pos_(0), write_pos_(0) {}
+
+    const char *data() const {
+        return buffer_.data() + read_pos_;
+    }
+
+    size_t size() const {
+        return write_pos_ - read_pos_;
+    }
+
+    bool empty() const {
+        return read_pos_ == write_pos_;
+    }
+
+    void consume(size_t size) {
+        if (size >= this->size()) {
+            read_pos_ = write_pos_ = 0;
+        } else {
+            read_pos_ += size;
+        }
+    }
+
+    void append(const char *data, size_t size) {
+        ensureWritable(size);
+        memcpy(buffer_.data() + write_pos_, data, size);
+        write_pos_ += size;
+    }
+
+    //尾部可直接写入的空间，写入后调用commit
+    char *writable() {
+        return buffer_.data() + write_pos_;
+    }
+
+    size_t writableSize() const {
+        return buffer_.size() - write_pos_;
+    }
+
+    void commit(size_t size) {
+        write_pos_ += size;
+    }
+
+    void ensureWritable(size_t size) {
+        if (writableSize() >= size) {
+            return;
+        }
+        if (read_pos_ + writableSize() >= size) {
+            //前面已读的空间足够，移动数据而不扩容
+            size_t readable = this->size();
+            memmove(buffer_.data(), buffer_.data() + read_pos_, readable);
+            read_pos_ = 0;
+            write_pos_ = readable;
+            return;
+        }
+        buffer_.resize(write_pos_ + size);
+    }
+
+private:
+    std::vector<char> buffer_;
+    size_t read_pos_;
+    size_t write_pos_;
+};
+
+}
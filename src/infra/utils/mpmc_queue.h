@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace infra {
+
+//有界无锁MPMC队列(Dmitry Vyukov)，环形队列满了之后退化到带锁的溢出队列，push永远成功
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity = 8192) : overflow_size_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_ = new Cell[size];
+        for (size_t i = 0; i < size; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    ~MpmcQueue() {
+        delete[] cells_;
+    }
+
+    void push(T &&value) {
+        //溢出队列非空时继续写溢出队列，保证先进先出
+        if (overflow_size_.load(std::memory_order_acquire) == 0 && tryPush(value)) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(overflow_mutex_);
+        overflow_.push(std::move(value));
+        overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+
+    bool pop(T &value) {
+        if (tryPop(value)) {
+            return true;
+        }
+        if (overflow_size_.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(overflow_mutex_);
+        if (overflow_.empty()) {
+            return false;
+        }
+        value = std::move(overflow_.front());
+        overflow_.pop();
+        overflow_size_.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    //并发情况下只是近似值
+    size_t size() const {
+        size_t enqueue = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t dequeue = dequeue_pos_.load(std::memory_order_relaxed);
+        return (enqueue > dequeue ? enqueue - dequeue : 0) + overflow_size_.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    bool tryPush(T &value) {
+        Cell *cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                //满了
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &value) {
+        Cell *cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                //空了
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->data = T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static const size_t kCacheLineSize = 64;
+
+    Cell *cells_;
+    size_t mask_;
+    char pad0_[kCacheLineSize];
+    std::atomic<size_t> enqueue_pos_;
+    char pad1_[kCacheLineSize];
+    std::atomic<size_t> dequeue_pos_;
+    char pad2_[kCacheLineSize];
+
+    std::atomic<size_t> overflow_size_;
+    std::queue<T> overflow_;
+    std::mutex overflow_mutex_;
+};
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+
+namespace infra {
+
+/**
+ * 侵入式引用计数指针，T需要提供addRef()和release()
+ * 计数放在对象内部，复制只是一次原子加，不需要shared_ptr的控制块
+ */
+template <typename T>
+class RefPtr {
+public:
+    RefPtr() : ptr_(nullptr) {}
+
+    RefPtr(std::nullptr_t) : ptr_(nullptr) {}
+
+    //add_ref为false时接管已有的一个引用
+    explicit RefPtr(T *ptr, bool add_ref = true) : ptr_(ptr) {
+        if (ptr_ && add_ref) {
+            ptr_->addRef();
+        }
+    }
+
+    RefPtr(const RefPtr &other) : ptr_(other.ptr_) {
+        if (ptr_) {
+            ptr_->addRef();
+        }
+    }
+
+    RefPtr(RefPtr &&other) noexcept : ptr_(other.ptr_) {
+        other.ptr_ = nullptr;
+    }
+
+    RefPtr &operator=(const RefPtr &other) {
+        RefPtr(other).swap(*this);
+        return *this;
+    }
+
+    RefPtr &operator=(RefPtr &&other) noexcept {
+        RefPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    RefPtr &operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    ~RefPtr() {
+        if (ptr_) {
+            ptr_->release();
+        }
+    }
+
+    void reset() {
+        RefPtr().swap(*this);
+    }
+
+    //交出持有的引用，调用者负责release
+    T *detach() {
+        T *ptr = ptr_;
+        ptr_ = nullptr;
+        return ptr;
+    }
+
+    void swap(RefPtr &other) noexcept {
+        std::swap(ptr_, other.ptr_);
+    }
+
+    T *get() const {
+        return ptr_;
+    }
+
+    T *operator->() const {
+        return ptr_;
+    }
+
+    T &operator*() const {
+        return *ptr_;
+    }
+
+    explicit operator bool() const {
+        return ptr_ != nullptr;
+    }
+
+    bool operator==(const RefPtr &other) const {
+        return ptr_ == other.ptr_;
+    }
+
+    bool operator!=(const RefPtr &other) const {
+        return ptr_ != other.ptr_;
+    }
+
+private:
+    T *ptr_;
+};
+
+}
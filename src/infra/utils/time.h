@@ -1,3 +1,17 @@
 #pragma once
 #include <time.h>
+#include <stdint.h>
+#include <chrono>
 
+namespace infra {
+
+//单调时钟，不受系统时间调整影响，用于定时器和耗时统计
+inline int64_t getCurrentMilliseconds() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int64_t getCurrentMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace infra {
+
+/**
+ * Chase-Lev工作窃取双端队列(Le et al. 2013, C11内存模型版本)
+ * push/pop只能由所属线程调用(LIFO)，steal可由任意线程调用(FIFO)
+ * 元素为指针，扩容后的旧数组保留到析构时释放，避免窃取线程访问已释放内存
+ */
+template <typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024) : top_(0), bottom_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        array_.store(new Array(size), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    ~WorkStealingDeque() {
+        for (auto array : retired_) {
+            delete array;
+        }
+        delete array_.load(std::memory_order_relaxed);
+    }
+
+    void push(T *item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array *array = array_.load(std::memory_order_relaxed);
+        if (b - t > (int64_t)array->capacity - 1) {
+            array = grow(array, b, t);
+        }
+        array->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    T *pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *array = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        T *item = nullptr;
+        if (t <= b) {
+            item = array->get(b);
+            if (t == b) {
+                //最后一个元素，和steal竞争
+                if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    T *steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        Array *array = array_.load(std::memory_order_acquire);
+        T *item = array->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    //并发情况下只是近似值
+    bool empty() const {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Array {
+        explicit Array(size_t size) : capacity(size), mask(size - 1), buffer(new std::atomic<T*>[size]) {}
+        ~Array() { delete[] buffer; }
+
+        T *get(int64_t index) const {
+            return buffer[index & mask].load(std::memory_order_relaxed);
+        }
+        void put(int64_t index, T *item) {
+            buffer[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        size_t capacity;
+        size_t mask;
+        std::atomic<T*> *buffer;
+    };
+
+    Array *grow(Array *array, int64_t bottom, int64_t top) {
+        Array *bigger = new Array(array->capacity * 2);
+        for (int64_t i = top; i < bottom; i++) {
+            bigger->put(i, array->get(i));
+        }
+        retired_.push_back(array);
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    static const size_t kCacheLineSize = 64;
+
+    std::atomic<int64_t> top_;
+    char pad0_[kCacheLineSize];
+    std::atomic<int64_t> bottom_;
+    char pad1_[kCacheLineSize];
+    std::atomic<Array*> array_;
+    std::vector<Array*> retired_;  //只有所属线程访问
+};
+
+}
@@ -0,0 +1,746 @@
+#include "aes.h"
+#include <string.h>
+#include <atomic>
+#include "byte_io.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AES_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rtc {
+
+static inline uint8_t xtime(uint8_t value) {
+    //不用分支，避免按密钥或明文的最高位走不同路径
+    return (uint8_t)((value << 1) ^ (0x1b & (uint8_t)-(value >> 7)));
+}
+
+/**
+ * 位切片的S盒，q[i]的第j位是第j个字节的第i位，64个字节同时计算
+ * 用Boyar-Peralta的电路(113个门)，只有与和异或，没有查表，耗时与数据无关
+ */
+static void sliceSbox(uint64_t *q) {
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19, t20, t21, t22;
+    uint64_t t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39, t40, t41, t42, t43;
+    uint64_t t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59, t60, t61, t62, t63, t64;
+    uint64_t t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    //上层线性变换
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    //GF(2^4)上的求逆
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    //下层线性变换，仿射变换的常数0x63合并在取反里
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+//8x8的位矩阵转置，第r个字节的第c位和第c个字节的第r位交换
+static inline uint64_t transpose8x8(uint64_t x) {
+    uint64_t t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull;
+    return x ^ t ^ (t << 28);
+}
+
+/**
+ * 64字节和位平面互转，planes[i]的第j位是第j个字节的第i位
+ * 每个分组16字节按列存放，第c列第r行在分组内的第c * 4 + r位
+ * 每8字节按小端组成一个64位整数再转置，编译器会合并成一次读写
+ */
+static void toPlanes(const uint8_t *bytes, uint64_t *planes) {
+    for (int i = 0; i < 8; i++) {
+        planes[i] = 0;
+    }
+    for (int g = 0; g < 8; g++) {
+        uint64_t word = 0;
+        for (int j = 0; j < 8; j++) {
+            word |= (uint64_t)bytes[g * 8 + j] << (j * 8);
+        }
+        word = transpose8x8(word);
+        for (int i = 0; i < 8; i++) {
+            planes[i] |= ((word >> (i * 8)) & 0xff) << (g * 8);
+        }
+    }
+}
+
+static void fromPlanes(const uint64_t *planes, uint8_t *bytes) {
+    for (int g = 0; g < 8; g++) {
+        uint64_t word = 0;
+        for (int i = 0; i < 8; i++) {
+            word |= ((planes[i] >> (g * 8)) & 0xff) << (i * 8);
+        }
+        word = transpose8x8(word);
+        for (int j = 0; j < 8; j++) {
+            bytes[g * 8 + j] = (uint8_t)(word >> (j * 8));
+        }
+    }
+}
+
+//第r行循环左移r列，即分组内第((c + r) & 3) * 4 + r位移到第c * 4 + r位
+static void sliceShiftRows(uint64_t *q) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t x = q[i];
+        q[i] = (x & 0x1111111111111111ull) |
+               ((x >> 4) & 0x0222022202220222ull) | ((x << 12) & 0x2000200020002000ull) |
+               ((x >> 8) & 0x0044004400440044ull) | ((x << 8) & 0x4400440044004400ull) |
+               ((x >> 12) & 0x0008000800080008ull) | ((x << 4) & 0x8880888088808880ull);
+    }
+}
+
+//每列的4个字节在相邻的4位里，rotate后第r位为原来的第(r + n) & 3位
+static inline uint64_t rotateRows1(uint64_t x) {
+    return ((x >> 1) & 0x7777777777777777ull) | ((x << 3) & 0x8888888888888888ull);
+}
+
+static inline uint64_t rotateRows2(uint64_t x) {
+    return ((x >> 2) & 0x3333333333333333ull) | ((x << 2) & 0xccccccccccccccccull);
+}
+
+//b = 2(a ^ a1) ^ a1 ^ a2 ^ a3，令u = a ^ a1，则b = 2u ^ a1 ^ rotate2(u)
+static void sliceMixColumns(uint64_t *q) {
+    uint64_t a1[8], u[8];
+    for (int i = 0; i < 8; i++) {
+        a1[i] = rotateRows1(q[i]);
+        u[i] = q[i] ^ a1[i];
+    }
+    //2u按x^8 + x^4 + x^3 + x + 1归约
+    uint64_t u7 = u[7];
+    q[7] = u[6] ^ a1[7] ^ rotateRows2(u[7]);
+    q[6] = u[5] ^ a1[6] ^ rotateRows2(u[6]);
+    q[5] = u[4] ^ a1[5] ^ rotateRows2(u[5]);
+    q[4] = u[3] ^ u7 ^ a1[4] ^ rotateRows2(u[4]);
+    q[3] = u[2] ^ u7 ^ a1[3] ^ rotateRows2(u[3]);
+    q[2] = u[1] ^ a1[2] ^ rotateRows2(u[2]);
+    q[1] = u[0] ^ u7 ^ a1[1] ^ rotateRows2(u[1]);
+    q[0] = u7 ^ a1[0] ^ rotateRows2(u[0]);
+}
+
+//软件实现一次加密4个分组，64字节正好用满位平面的64位，不足4个分组时补0
+#define AES_SOFT_BLOCKS 4
+
+static void encryptBlocksSoftware(const uint64_t (*keys)[8], int rounds, uint8_t *blocks) {
+    uint64_t q[8];
+    toPlanes(blocks, q);
+    for (int i = 0; i < 8; i++) {
+        q[i] ^= keys[0][i];
+    }
+    for (int r = 1; r <= rounds; r++) {
+        sliceSbox(q);
+        sliceShiftRows(q);
+        if (r != rounds) {
+            sliceMixColumns(q);
+        }
+        for (int i = 0; i < 8; i++) {
+            q[i] ^= keys[r][i];
+        }
+    }
+    fromPlanes(q, blocks);
+}
+
+//密钥扩展里的SubWord，只在setKey时调用
+static void subWord(uint8_t *word) {
+    uint8_t bytes[AES_SOFT_BLOCKS * AES_BLOCK_SIZE] = {0};
+    memcpy(bytes, word, 4);
+    uint64_t q[8];
+    toPlanes(bytes, q);
+    sliceSbox(q);
+    fromPlanes(q, bytes);
+    memcpy(word, bytes, 4);
+}
+
+static bool detectHardware() {
+#ifdef AES_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
+
+static std::atomic<int> s_hardware(-1);
+
+bool aesHardwareAvailable() {
+    static const bool available = detectHardware();
+    return available;
+}
+
+bool aesHardwareEnabled() {
+    int enabled = s_hardware.load(std::memory_order_relaxed);
+    if (enabled < 0) {
+        enabled = aesHardwareAvailable() ? 1 : 0;
+        s_hardware.store(enabled, std::memory_order_relaxed);
+    }
+    return enabled != 0;
+}
+
+bool setAesHardwareEnabled(bool enable) {
+    bool enabled = enable && aesHardwareAvailable();
+    s_hardware.store(enabled ? 1 : 0, std::memory_order_relaxed);
+    return enabled;
+}
+
+static inline void xorBlock(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        x ^= y;
+        memcpy(out + i, &x, 8);
+    }
+    for (; i < size; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+#ifdef AES_X86
+__attribute__((target("aes,sse2")))
+static void encryptBlockHardware(const uint8_t *round_keys, int rounds, const uint8_t *in, uint8_t *out) {
+    __m128i state = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), _mm_loadu_si128((const __m128i *)round_keys));
+    for (int r = 1; r < rounds; r++) {
+        state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)(round_keys + r * 16)));
+    }
+    state = _mm_aesenclast_si128(state, _mm_loadu_si128((const __m128i *)(round_keys + rounds * 16)));
+    _mm_storeu_si128((__m128i *)out, state);
+}
+
+//4个分组交错执行，掩盖aesenc的延迟
+__attribute__((target("aes,sse2,ssse3")))
+static void ctrHardware(const uint8_t *round_keys, int rounds, const uint8_t *counter, const uint8_t *in, uint8_t *out,
+                        size_t size) {
+    __m128i keys[AES_MAX_ROUNDS + 1];
+    for (int r = 0; r <= rounds; r++) {
+        keys[r] = _mm_loadu_si128((const __m128i *)(round_keys + r * 16));
+    }
+    //把最后4字节换成小端，计数器递增就是一次32位加法
+    const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i c0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)counter), swap);
+    __m128i c1 = _mm_add_epi32(c0, _mm_set_epi32(1, 0, 0, 0));
+    __m128i c2 = _mm_add_epi32(c0, _mm_set_epi32(2, 0, 0, 0));
+    __m128i c3 = _mm_add_epi32(c0, _mm_set_epi32(3, 0, 0, 0));
+    const __m128i four = _mm_set_epi32(4, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i b0 = _mm_xor_si128(_mm_shuffle_epi8(c0, swap), keys[0]);
+        __m128i b1 = _mm_xor_si128(_mm_shuffle_epi8(c1, swap), keys[0]);
+        __m128i b2 = _mm_xor_si128(_mm_shuffle_epi8(c2, swap), keys[0]);
+        __m128i b3 = _mm_xor_si128(_mm_shuffle_epi8(c3, swap), keys[0]);
+        c0 = _mm_add_epi32(c0, four);
+        c1 = _mm_add_epi32(c1, four);
+        c2 = _mm_add_epi32(c2, four);
+        c3 = _mm_add_epi32(c3, four);
+        for (int r = 1; r < rounds; r++) {
+            b0 = _mm_aesenc_si128(b0, keys[r]);
+            b1 = _mm_aesenc_si128(b1, keys[r]);
+            b2 = _mm_aesenc_si128(b2, keys[r]);
+            b3 = _mm_aesenc_si128(b3, keys[r]);
+        }
+        b0 = _mm_aesenclast_si128(b0, keys[rounds]);
+        b1 = _mm_aesenclast_si128(b1, keys[rounds]);
+        b2 = _mm_aesenclast_si128(b2, keys[rounds]);
+        b3 = _mm_aesenclast_si128(b3, keys[rounds]);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(b0, _mm_loadu_si128((const __m128i *)(in + i))));
+        _mm_storeu_si128((__m128i *)(out + i + 16), _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *)(in + i + 16))));
+        _mm_storeu_si128((__m128i *)(out + i + 32), _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *)(in + i + 32))));
+        _mm_storeu_si128((__m128i *)(out + i + 48), _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *)(in + i + 48))));
+    }
+    for (; i < size; i += 16) {
+        __m128i b = _mm_xor_si128(_mm_shuffle_epi8(c0, swap), keys[0]);
+        c0 = _mm_add_epi32(c0, _mm_set_epi32(1, 0, 0, 0));
+        for (int r = 1; r < rounds; r++) {
+            b = _mm_aesenc_si128(b, keys[r]);
+        }
+        b = _mm_aesenclast_si128(b, keys[rounds]);
+        if (i + 16 <= size) {
+            _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(b, _mm_loadu_si128((const __m128i *)(in + i))));
+        } else {
+            uint8_t stream[16];
+            _mm_storeu_si128((__m128i *)stream, b);
+            xorBlock(out + i, in + i, stream, size - i);
+        }
+    }
+}
+#endif
+
+Aes::Aes() : rounds_(0), hardware_(false) {
+    memset(round_keys_, 0, sizeof(round_keys_));
+    memset(slice_keys_, 0, sizeof(slice_keys_));
+}
+
+bool Aes::setKey(const uint8_t *key, size_t key_size) {
+    if (key_size != 16 && key_size != 32) {
+        return false;
+    }
+    hardware_ = aesHardwareEnabled();
+    int nk = (int)key_size / 4;
+    rounds_ = nk + 6;
+    int total = 4 * (rounds_ + 1);
+    memcpy(round_keys_, key, key_size);
+    uint8_t rcon = 1;
+    for (int i = nk; i < total; i++) {
+        uint8_t t[4];
+        memcpy(t, round_keys_ + (i - 1) * 4, 4);
+        if (i % nk == 0) {
+            uint8_t first = t[0];
+            t[0] = t[1];
+            t[1] = t[2];
+            t[2] = t[3];
+            t[3] = first;
+        }
+        if (i % nk == 0 || (nk > 6 && i % nk == 4)) {
+            subWord(t);
+        }
+        if (i % nk == 0) {
+            t[0] ^= rcon;
+            rcon = xtime(rcon);
+        }
+        for (int k = 0; k < 4; k++) {
+            round_keys_[i * 4 + k] = (uint8_t)(round_keys_[(i - nk) * 4 + k] ^ t[k]);
+        }
+    }
+    //每轮的密钥重复4次后转成位平面，软件实现直接异或
+    uint8_t repeated[AES_SOFT_BLOCKS * AES_BLOCK_SIZE];
+    for (int r = 0; r <= rounds_; r++) {
+        for (int b = 0; b < AES_SOFT_BLOCKS; b++) {
+            memcpy(repeated + b * AES_BLOCK_SIZE, round_keys_ + r * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        }
+        toPlanes(repeated, slice_keys_[r]);
+    }
+    return true;
+}
+
+void Aes::encryptBlock(const uint8_t *in, uint8_t *out) const {
+#ifdef AES_X86
+    if (hardware_) {
+        encryptBlockHardware(round_keys_, rounds_, in, out);
+        return;
+    }
+#endif
+    uint8_t blocks[AES_SOFT_BLOCKS * AES_BLOCK_SIZE] = {0};
+    memcpy(blocks, in, AES_BLOCK_SIZE);
+    encryptBlocksSoftware(slice_keys_, rounds_, blocks);
+    memcpy(out, blocks, AES_BLOCK_SIZE);
+}
+
+void Aes::ctr(const uint8_t *counter, const uint8_t *in, uint8_t *out, size_t size) const {
+#ifdef AES_X86
+    if (hardware_) {
+        ctrHardware(round_keys_, rounds_, counter, in, out, size);
+        return;
+    }
+#endif
+    uint8_t stream[AES_SOFT_BLOCKS * AES_BLOCK_SIZE] = {0};
+    uint32_t count = readBE32(counter + 12);
+    for (size_t i = 0; i < size; i += sizeof(stream)) {
+        size_t remain = size - i < sizeof(stream) ? size - i : sizeof(stream);
+        int blocks = (int)((remain + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE);
+        for (int b = 0; b < blocks; b++) {
+            memcpy(stream + b * AES_BLOCK_SIZE, counter, 12);
+            writeBE32(stream + b * AES_BLOCK_SIZE + 12, count++);
+        }
+        encryptBlocksSoftware(slice_keys_, rounds_, stream);
+        xorBlock(out + i, in + i, stream, remain);
+    }
+}
+
+/**
+ * 64位无进位乘法的低64位，用整数乘法实现，不查表
+ * 每个操作数按位置模4拆成4份，同一份里的1间隔4位，乘积中每4位最多累加15个1，不会进位到同一份的下一位
+ */
+static inline uint64_t carrylessMultiply(uint64_t x, uint64_t y) {
+    uint64_t x0 = x & 0x1111111111111111ull;
+    uint64_t x1 = x & 0x2222222222222222ull;
+    uint64_t x2 = x & 0x4444444444444444ull;
+    uint64_t x3 = x & 0x8888888888888888ull;
+    uint64_t y0 = y & 0x1111111111111111ull;
+    uint64_t y1 = y & 0x2222222222222222ull;
+    uint64_t y2 = y & 0x4444444444444444ull;
+    uint64_t y3 = y & 0x8888888888888888ull;
+    uint64_t z0 = (x0 * y0) ^ (x1 * y3) ^ (x2 * y2) ^ (x3 * y1);
+    uint64_t z1 = (x0 * y1) ^ (x1 * y0) ^ (x2 * y3) ^ (x3 * y2);
+    uint64_t z2 = (x0 * y2) ^ (x1 * y1) ^ (x2 * y0) ^ (x3 * y3);
+    uint64_t z3 = (x0 * y3) ^ (x1 * y2) ^ (x2 * y1) ^ (x3 * y0);
+    return (z0 & 0x1111111111111111ull) | (z1 & 0x2222222222222222ull) | (z2 & 0x4444444444444444ull) |
+           (z3 & 0x8888888888888888ull);
+}
+
+static inline uint64_t reverseBits64(uint64_t x) {
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+    x = ((x >> 8) & 0x00ff00ff00ff00ffull) | ((x & 0x00ff00ff00ff00ffull) << 8);
+    x = ((x >> 16) & 0x0000ffff0000ffffull) | ((x & 0x0000ffff0000ffffull) << 16);
+    return (x >> 32) | (x << 32);
+}
+
+/**
+ * x = x * H，软件实现，耗时与数据无关
+ * 高64位由位反转后的低64位得到，三次乘法用Karatsuba合成128位乘积，再按GCM的位序左移一位并归约
+ */
+static void ghashMultiply(const uint64_t *h, uint8_t *x) {
+    uint64_t y1 = readBE64(x);
+    uint64_t y0 = readBE64(x + 8);
+    uint64_t h1 = h[0];
+    uint64_t h0 = h[1];
+    uint64_t h0r = reverseBits64(h0);
+    uint64_t h1r = reverseBits64(h1);
+    uint64_t y0r = reverseBits64(y0);
+    uint64_t y1r = reverseBits64(y1);
+
+    uint64_t z0 = carrylessMultiply(y0, h0);
+    uint64_t z1 = carrylessMultiply(y1, h1);
+    uint64_t z2 = carrylessMultiply(y0 ^ y1, h0 ^ h1);
+    uint64_t z0h = carrylessMultiply(y0r, h0r);
+    uint64_t z1h = carrylessMultiply(y1r, h1r);
+    uint64_t z2h = carrylessMultiply(y0r ^ y1r, h0r ^ h1r);
+    z2 ^= z0 ^ z1;
+    z2h ^= z0h ^ z1h;
+    z0h = reverseBits64(z0h) >> 1;
+    z1h = reverseBits64(z1h) >> 1;
+    z2h = reverseBits64(z2h) >> 1;
+
+    uint64_t v0 = z0;
+    uint64_t v1 = z0h ^ z2;
+    uint64_t v2 = z1 ^ z2h;
+    uint64_t v3 = z1h;
+    v3 = (v3 << 1) | (v2 >> 63);
+    v2 = (v2 << 1) | (v1 >> 63);
+    v1 = (v1 << 1) | (v0 >> 63);
+    v0 = (v0 << 1);
+    //按x^128 + x^7 + x^2 + x + 1归约
+    v2 ^= v0 ^ (v0 >> 1) ^ (v0 >> 2) ^ (v0 >> 7);
+    v1 ^= (v0 << 63) ^ (v0 << 62) ^ (v0 << 57);
+    v3 ^= v1 ^ (v1 >> 1) ^ (v1 >> 2) ^ (v1 >> 7);
+    v2 ^= (v1 << 63) ^ (v1 << 62) ^ (v1 << 57);
+    writeBE64(x, v3);
+    writeBE64(x + 8, v2);
+}
+
+#ifdef AES_X86
+//按字节反序表示的无归约乘积，结果为256位(low, high)
+__attribute__((target("pclmul,sse2")))
+static inline void clmul(__m128i a, __m128i b, __m128i &low, __m128i &high) {
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+    __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+    t1 = _mm_xor_si128(t1, t2);
+    low = _mm_xor_si128(t0, _mm_slli_si128(t1, 8));
+    high = _mm_xor_si128(t3, _mm_srli_si128(t1, 8));
+}
+
+//反序表示下先整体左移一位，再按x^128 + x^7 + x^2 + x + 1归约
+__attribute__((target("pclmul,sse2")))
+static inline __m128i reduce(__m128i low, __m128i high) {
+    __m128i t7 = _mm_srli_epi32(low, 31);
+    __m128i t8 = _mm_srli_epi32(high, 31);
+    low = _mm_slli_epi32(low, 1);
+    high = _mm_slli_epi32(high, 1);
+    __m128i t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    low = _mm_or_si128(low, t7);
+    high = _mm_or_si128(high, t8);
+    high = _mm_or_si128(high, t9);
+
+    t7 = _mm_slli_epi32(low, 31);
+    t8 = _mm_slli_epi32(low, 30);
+    t9 = _mm_slli_epi32(low, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    low = _mm_xor_si128(low, t7);
+    __m128i t2 = _mm_srli_epi32(low, 1);
+    __m128i t4 = _mm_srli_epi32(low, 2);
+    __m128i t5 = _mm_srli_epi32(low, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    low = _mm_xor_si128(low, t2);
+    return _mm_xor_si128(high, low);
+}
+
+__attribute__((target("pclmul,sse2")))
+static inline __m128i gfMultiply(__m128i a, __m128i b) {
+    __m128i low, high;
+    clmul(a, b, low, high);
+    return reduce(low, high);
+}
+
+__attribute__((target("pclmul,sse2,ssse3")))
+static void ghashPowers(const uint8_t *h, uint8_t (*powers)[16]) {
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i h1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)h), swap);
+    __m128i hn = h1;
+    _mm_storeu_si128((__m128i *)powers[0], h1);
+    for (int i = 1; i < 4; i++) {
+        hn = gfMultiply(hn, h1);
+        _mm_storeu_si128((__m128i *)powers[i], hn);
+    }
+}
+
+__attribute__((target("pclmul,sse2,ssse3")))
+static void ghashHardware(const uint8_t (*powers)[16], uint8_t *state, const uint8_t *data, size_t size) {
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i h1 = _mm_loadu_si128((const __m128i *)powers[0]);
+    __m128i h2 = _mm_loadu_si128((const __m128i *)powers[1]);
+    __m128i h3 = _mm_loadu_si128((const __m128i *)powers[2]);
+    __m128i h4 = _mm_loadu_si128((const __m128i *)powers[3]);
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)state), swap);
+    size_t i = 0;
+    //X' = (X + C0)H^4 + C1H^3 + C2H^2 + C3H，4个乘积相加后只归约一次
+    for (; i + 64 <= size; i += 64) {
+        __m128i c0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i)), swap);
+        __m128i c1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i + 16)), swap);
+        __m128i c2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i + 32)), swap);
+        __m128i c3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i + 48)), swap);
+        __m128i low, high, l, h;
+        clmul(_mm_xor_si128(x, c0), h4, low, high);
+        clmul(c1, h3, l, h);
+        low = _mm_xor_si128(low, l);
+        high = _mm_xor_si128(high, h);
+        clmul(c2, h2, l, h);
+        low = _mm_xor_si128(low, l);
+        high = _mm_xor_si128(high, h);
+        clmul(c3, h1, l, h);
+        low = _mm_xor_si128(low, l);
+        high = _mm_xor_si128(high, h);
+        x = reduce(low, high);
+    }
+    for (; i < size; i += 16) {
+        __m128i c;
+        if (i + 16 <= size) {
+            c = _mm_loadu_si128((const __m128i *)(data + i));
+        } else {
+            uint8_t block[16] = {0};
+            memcpy(block, data + i, size - i);
+            c = _mm_loadu_si128((const __m128i *)block);
+        }
+        x = gfMultiply(_mm_xor_si128(x, _mm_shuffle_epi8(c, swap)), h1);
+    }
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi8(x, swap));
+}
+#endif
+
+AesGcm::AesGcm() {
+    memset(h_, 0, sizeof(h_));
+    memset(powers_, 0, sizeof(powers_));
+}
+
+bool AesGcm::setKey(const uint8_t *key, size_t key_size) {
+    if (!aes_.setKey(key, key_size)) {
+        return false;
+    }
+    uint8_t h[AES_BLOCK_SIZE] = {0};
+    aes_.encryptBlock(h, h);
+    h_[0] = readBE64(h);
+    h_[1] = readBE64(h + 8);
+#ifdef AES_X86
+    if (aes_.hardware_) {
+        ghashPowers(h, powers_);
+    }
+#endif
+    return true;
+}
+
+void AesGcm::ghash(uint8_t *state, const uint8_t *data, size_t size) const {
+#ifdef AES_X86
+    if (aes_.hardware_) {
+        ghashHardware(powers_, state, data, size);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < size; i += AES_BLOCK_SIZE) {
+        xorBlock(state, state, data + i, size - i < AES_BLOCK_SIZE ? size - i : AES_BLOCK_SIZE);
+        ghashMultiply(h_, state);
+    }
+}
+
+void AesGcm::computeTag(const uint8_t *iv, const uint8_t *aad, size_t aad_size, const uint8_t *data, size_t size,
+                        uint8_t *tag) const {
+    uint8_t state[AES_BLOCK_SIZE] = {0};
+    ghash(state, aad, aad_size);
+    ghash(state, data, size);
+    uint8_t lengths[AES_BLOCK_SIZE];
+    uint64_t aad_bits = (uint64_t)aad_size * 8;
+    uint64_t data_bits = (uint64_t)size * 8;
+    writeBE32(lengths, (uint32_t)(aad_bits >> 32));
+    writeBE32(lengths + 4, (uint32_t)aad_bits);
+    writeBE32(lengths + 8, (uint32_t)(data_bits >> 32));
+    writeBE32(lengths + 12, (uint32_t)data_bits);
+    ghash(state, lengths, AES_BLOCK_SIZE);
+
+    uint8_t j0[AES_BLOCK_SIZE];
+    memcpy(j0, iv, AES_GCM_IV_SIZE);
+    writeBE32(j0 + 12, 1);
+    aes_.encryptBlock(j0, j0);
+    xorBlock(tag, state, j0, AES_BLOCK_SIZE);
+}
+
+void AesGcm::seal(const uint8_t *iv, const uint8_t *aad, size_t aad_size, const uint8_t *in, uint8_t *out, size_t size,
+                  uint8_t *tag) const {
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, iv, AES_GCM_IV_SIZE);
+    writeBE32(counter + 12, 2);
+    aes_.ctr(counter, in, out, size);
+    computeTag(iv, aad, aad_size, out, size, tag);
+}
+
+bool AesGcm::open(const uint8_t *iv, const uint8_t *aad, size_t aad_size, const uint8_t *in, uint8_t *out, size_t size,
+                  const uint8_t *tag) const {
+    uint8_t expected[AES_GCM_TAG_SIZE];
+    computeTag(iv, aad, aad_size, in, size, expected);
+    //常数时间比较
+    uint8_t diff = 0;
+    for (int i = 0; i < AES_GCM_TAG_SIZE; i++) {
+        diff |= (uint8_t)(expected[i] ^ tag[i]);
+    }
+    if (diff) {
+        return false;
+    }
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, iv, AES_GCM_IV_SIZE);
+    writeBE32(counter + 12, 2);
+    aes_.ctr(counter, in, out, size);
+    return true;
+}
+
+}
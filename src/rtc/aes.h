@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rtc {
+
+#define AES_BLOCK_SIZE 16
+#define AES_MAX_ROUNDS 14
+#define AES_GCM_IV_SIZE 12
+#define AES_GCM_TAG_SIZE 16
+
+//CPU是否支持AES-NI和PCLMULQDQ
+bool aesHardwareAvailable();
+
+bool aesHardwareEnabled();
+
+/**
+ * 关闭或打开硬件加速，只用于测试和对比软件实现的开销，不支持时打开无效
+ * 只影响之后调用setKey的对象，已经设置过密钥的会话不受影响
+ * @return 实际是否使用硬件加速
+ */
+bool setAesHardwareEnabled(bool enable);
+
+/**
+ * AES分组加密，只实现加密方向，CTR和GCM都不需要解密
+ * 支持AES-NI时用硬件指令，否则用位切片的S盒，不查表，耗时与密钥和数据无关
+ * 用哪种实现在setKey时确定
+ */
+class Aes {
+public:
+    Aes();
+
+    //key_size为16或32
+    bool setKey(const uint8_t *key, size_t key_size);
+
+    void encryptBlock(const uint8_t *in, uint8_t *out) const;
+
+    /**
+     * CTR模式，counter的最后32位按大端递增，一次调用内不会进位到前面的字节
+     * SRTP的AES-CM和GCM都可以直接使用，out可以等于in
+     */
+    void ctr(const uint8_t *counter, const uint8_t *in, uint8_t *out, size_t size) const;
+
+private:
+    friend class AesGcm;
+
+    int rounds_;
+    bool hardware_;
+    uint8_t round_keys_[16 * (AES_MAX_ROUNDS + 1)];  //按字节排列，AES-NI直接加载
+    uint64_t slice_keys_[AES_MAX_ROUNDS + 1][8];     //位切片的轮密钥，软件实现使用
+};
+
+/**
+ * AES-GCM，只支持96位IV
+ * GHASH在支持PCLMULQDQ时每4个分组做一次归约，否则用整数乘法拼出无进位乘法，同样不查表
+ */
+class AesGcm {
+public:
+    AesGcm();
+
+    bool setKey(const uint8_t *key, size_t key_size);
+
+    //加密size字节并输出16字节的tag，out可以等于in
+    void seal(const uint8_t *iv, const uint8_t *aad, size_t aad_size, const uint8_t *in, uint8_t *out, size_t size,
+              uint8_t *tag) const;
+
+    //先校验tag再解密，校验失败时out不会被改写
+    bool open(const uint8_t *iv, const uint8_t *aad, size_t aad_size, const uint8_t *in, uint8_t *out, size_t size,
+              const uint8_t *tag) const;
+
+private:
+    void computeTag(const uint8_t *iv, const uint8_t *aad, size_t aad_size, const uint8_t *data, size_t size,
+                    uint8_t *tag) const;
+
+    void ghash(uint8_t *state, const uint8_t *data, size_t size) const;
+
+private:
+    Aes aes_;
+    uint64_t h_[2];                  //大端的H，软件实现使用
+    uint8_t powers_[4][16];          //按字节反序的H, H^2, H^3, H^4，PCLMULQDQ使用
+};
+
+}
@@ -0,0 +1,322 @@
+#include "bandwidth_estimator.h"
+#include <math.h>
+
+namespace rtc {
+
+//同一组的最大发送间隔
+#define BWE_GROUP_SPAN_US 5000
+//确认码率的统计窗口
+#define BWE_ACKED_WINDOW_US 250000
+//计算探测码率最少需要的包数
+#define BWE_PROBE_MIN_PACKETS 5
+//计算丢包率最少需要的包数
+#define BWE_LOSS_MIN_PACKETS 20
+
+TrendlineEstimator::TrendlineEstimator(size_t window_size, double smoothing, double threshold_gain)
+    : window_size_(window_size < 2 ? 2 : window_size), smoothing_(smoothing), threshold_gain_(threshold_gain), num_deltas_(0),
+      first_arrival_ms_(-1), accumulated_delay_(0), smoothed_delay_(0), history_pos_(0), history_count_(0), trend_(0),
+      prev_trend_(0), threshold_(12.5), last_threshold_update_ms_(-1), time_over_using_(-1), overuse_counter_(0),
+      state_(BANDWIDTH_NORMAL) {
+    history_.resize(window_size_);
+}
+
+void TrendlineEstimator::update(double recv_delta_ms, double send_delta_ms, int64_t arrival_ms) {
+    if (num_deltas_ < 1000) {
+        num_deltas_++;
+    }
+    if (first_arrival_ms_ < 0) {
+        first_arrival_ms_ = arrival_ms;
+    }
+    accumulated_delay_ += recv_delta_ms - send_delta_ms;
+    smoothed_delay_ = smoothing_ * smoothed_delay_ + (1 - smoothing_) * accumulated_delay_;
+
+    history_[history_pos_] = std::make_pair((double)(arrival_ms - first_arrival_ms_), smoothed_delay_);
+    history_pos_ = (history_pos_ + 1) % window_size_;
+    if (history_count_ < window_size_) {
+        history_count_++;
+    }
+
+    double trend = prev_trend_;
+    if (history_count_ == window_size_) {
+        //最小二乘拟合的斜率
+        double x_sum = 0, y_sum = 0;
+        for (auto &point : history_) {
+            x_sum += point.first;
+            y_sum += point.second;
+        }
+        double x_avg = x_sum / window_size_;
+        double y_avg = y_sum / window_size_;
+        double numerator = 0, denominator = 0;
+        for (auto &point : history_) {
+            numerator += (point.first - x_avg) * (point.second - y_avg);
+            denominator += (point.first - x_avg) * (point.first - x_avg);
+        }
+        if (denominator != 0) {
+            trend = numerator / denominator;
+        }
+    }
+    detect(trend, send_delta_ms, arrival_ms);
+}
+
+void TrendlineEstimator::detect(double trend, double send_delta_ms, int64_t now_ms) {
+    if (num_deltas_ < 2) {
+        state_ = BANDWIDTH_NORMAL;
+        return;
+    }
+    //样本少时斜率不可靠，按样本数放大后再和阈值比较
+    double modified_trend = (num_deltas_ < 60 ? num_deltas_ : 60) * trend * threshold_gain_;
+    if (modified_trend > threshold_) {
+        if (time_over_using_ < 0) {
+            time_over_using_ = send_delta_ms / 2;
+        } else {
+            time_over_using_ += send_delta_ms;
+        }
+        overuse_counter_++;
+        //持续超过阈值且还在上升才判断为过载
+        if (time_over_using_ > 10 && overuse_counter_ > 1 && trend >= prev_trend_) {
+            time_over_using_ = 0;
+            overuse_counter_ = 0;
+            state_ = BANDWIDTH_OVERUSING;
+        }
+    } else if (modified_trend < -threshold_) {
+        time_over_using_ = -1;
+        overuse_counter_ = 0;
+        state_ = BANDWIDTH_UNDERUSING;
+    } else {
+        time_over_using_ = -1;
+        overuse_counter_ = 0;
+        state_ = BANDWIDTH_NORMAL;
+    }
+    prev_trend_ = trend;
+    trend_ = trend;
+    updateThreshold(modified_trend, now_ms);
+}
+
+void TrendlineEstimator::updateThreshold(double modified_trend, int64_t now_ms) {
+    if (last_threshold_update_ms_ < 0) {
+        last_threshold_update_ms_ = now_ms;
+    }
+    double abs_trend = fabs(modified_trend);
+    //突发的尖峰不调整阈值
+    if (abs_trend > threshold_ + 15) {
+        last_threshold_update_ms_ = now_ms;
+        return;
+    }
+    double k = abs_trend < threshold_ ? 0.039 : 0.0087;
+    int64_t elapsed = now_ms - last_threshold_update_ms_;
+    if (elapsed > 100) {
+        elapsed = 100;
+    }
+    threshold_ += k * (abs_trend - threshold_) * elapsed;
+    if (threshold_ < 6) {
+        threshold_ = 6;
+    } else if (threshold_ > 600) {
+        threshold_ = 600;
+    }
+    last_threshold_update_ms_ = now_ms;
+}
+
+BandwidthEstimator::BandwidthEstimator(const BandwidthEstimatorOptions &options)
+    : options_(options), acked_window_start_us_(-1), acked_window_last_us_(0), acked_window_bytes_(0), acked_bps_(0),
+      probe_bps_(0), delay_bps_(options.start_bitrate_bps), last_decrease_ms_(-1), last_increase_ms_(-1), loss_packets_(0),
+      loss_lost_(0), loss_rate_(0), loss_bps_(options.start_bitrate_bps), last_loss_update_ms_(-1),
+      target_bps_(options.start_bitrate_bps) {
+    results_.reserve(512);
+    target_bps_ = clamp(target_bps_);
+}
+
+int64_t BandwidthEstimator::clamp(int64_t bitrate) const {
+    if (bitrate < options_.min_bitrate_bps) {
+        return options_.min_bitrate_bps;
+    }
+    if (bitrate > options_.max_bitrate_bps) {
+        return options_.max_bitrate_bps;
+    }
+    return bitrate;
+}
+
+void BandwidthEstimator::onPacketSent(uint16_t transport_seq, size_t size, int64_t send_us, int32_t probe_id) {
+    adapter_.onPacketSent(transport_seq, size, send_us, probe_id);
+}
+
+int64_t BandwidthEstimator::onTransportFeedback(const RtcpTransportFeedback &feedback, int64_t now_ms) {
+    if (!adapter_.onFeedback(feedback, results_)) {
+        return target_bps_;
+    }
+    for (auto &result : results_) {
+        //迟到的接收在报告丢失时已经计入，每个序号只统计一次
+        if (!result.reported_lost) {
+            loss_packets_++;
+        }
+        if (!result.received) {
+            loss_lost_++;
+            continue;
+        }
+        updateDelay(result);
+        updateProbe(result);
+        if (acked_window_start_us_ < 0) {
+            acked_window_start_us_ = result.arrival_us;
+        }
+        acked_window_bytes_ += result.size;
+        if (result.arrival_us > acked_window_last_us_) {
+            acked_window_last_us_ = result.arrival_us;
+        }
+    }
+    updateAckedBitrate();
+    updateAimd(now_ms);
+    updateLoss(now_ms);
+
+    int64_t target = delay_bps_ < loss_bps_ ? delay_bps_ : loss_bps_;
+    target_bps_ = clamp(target);
+    return target_bps_;
+}
+
+void BandwidthEstimator::updateDelay(const PacketResult &result) {
+    if (current_group_.first_send_us < 0) {
+        current_group_.first_send_us = result.send_us;
+        current_group_.last_send_us = result.send_us;
+        current_group_.last_arrival_us = result.arrival_us;
+        return;
+    }
+    if (result.send_us - current_group_.first_send_us <= BWE_GROUP_SPAN_US) {
+        //同一次突发发出的包看作一组，只比较组的最后到达时间
+        if (result.send_us > current_group_.last_send_us) {
+            current_group_.last_send_us = result.send_us;
+        }
+        if (result.arrival_us > current_group_.last_arrival_us) {
+            current_group_.last_arrival_us = result.arrival_us;
+        }
+        return;
+    }
+    if (prev_group_.first_send_us >= 0) {
+        double send_delta_ms = (current_group_.last_send_us - prev_group_.last_send_us) / 1000.0;
+        double recv_delta_ms = (current_group_.last_arrival_us - prev_group_.last_arrival_us) / 1000.0;
+        trendline_.update(recv_delta_ms, send_delta_ms, current_group_.last_arrival_us / 1000);
+    }
+    prev_group_ = current_group_;
+    current_group_.first_send_us = result.send_us;
+    current_group_.last_send_us = result.send_us;
+    current_group_.last_arrival_us = result.arrival_us;
+}
+
+void BandwidthEstimator::updateAckedBitrate() {
+    int64_t span_us = acked_window_last_us_ - acked_window_start_us_;
+    if (acked_window_start_us_ < 0 || span_us < BWE_ACKED_WINDOW_US) {
+        return;
+    }
+    acked_bps_ = (int64_t)(acked_window_bytes_ * 8 * 1000000 / (uint64_t)span_us);
+    acked_window_start_us_ = acked_window_last_us_;
+    acked_window_bytes_ = 0;
+}
+
+void BandwidthEstimator::updateProbe(const PacketResult &result) {
+    if (result.probe_id == 0) {
+        return;
+    }
+    if (result.probe_id != probe_.id) {
+        probe_ = ProbeCluster();
+        probe_.id = result.probe_id;
+        probe_.first_send_us = result.send_us;
+        probe_.last_send_us = result.send_us;
+        probe_.first_arrival_us = result.arrival_us;
+        probe_.last_arrival_us = result.arrival_us;
+        probe_.first_size = result.size;
+        probe_.last_size = result.size;
+    }
+    probe_.packets++;
+    probe_.bytes += result.size;
+    if (result.send_us >= probe_.last_send_us) {
+        probe_.last_send_us = result.send_us;
+        probe_.last_size = result.size;
+    }
+    if (result.arrival_us < probe_.first_arrival_us) {
+        probe_.first_arrival_us = result.arrival_us;
+        probe_.first_size = result.size;
+    }
+    if (result.arrival_us > probe_.last_arrival_us) {
+        probe_.last_arrival_us = result.arrival_us;
+    }
+    int64_t send_span = probe_.last_send_us - probe_.first_send_us;
+    int64_t recv_span = probe_.last_arrival_us - probe_.first_arrival_us;
+    if (probe_.packets < BWE_PROBE_MIN_PACKETS || send_span <= 0 || recv_span <= 0) {
+        return;
+    }
+    //发送速率不算最后发出的包，接收速率不算最先到达的包
+    int64_t send_bps = (int64_t)((probe_.bytes - probe_.last_size) * 8 * 1000000 / (uint64_t)send_span);
+    int64_t recv_bps = (int64_t)((probe_.bytes - probe_.first_size) * 8 * 1000000 / (uint64_t)recv_span);
+    //接收速率明显低于发送速率说明链路已经饱和，接收速率就是可用带宽
+    probe_bps_ = recv_bps < send_bps * 9 / 10 ? recv_bps * 95 / 100 : (send_bps < recv_bps ? send_bps : recv_bps);
+}
+
+void BandwidthEstimator::updateAimd(int64_t now_ms) {
+    if (last_increase_ms_ < 0) {
+        last_increase_ms_ = now_ms;
+    }
+    switch (trendline_.state()) {
+    case BANDWIDTH_OVERUSING:
+        if (last_decrease_ms_ < 0 || now_ms - last_decrease_ms_ >= 300) {
+            int64_t base = acked_bps_ > 0 ? acked_bps_ : delay_bps_;
+            int64_t decreased = base * 85 / 100;
+            if (decreased < delay_bps_) {
+                delay_bps_ = decreased;
+            }
+            last_decrease_ms_ = now_ms;
+        }
+        last_increase_ms_ = now_ms;
+        break;
+    case BANDWIDTH_UNDERUSING:
+        //队列正在排空，保持当前码率
+        last_increase_ms_ = now_ms;
+        break;
+    default: {
+        int64_t elapsed = now_ms - last_increase_ms_;
+        if (elapsed > 1000) {
+            elapsed = 1000;
+        }
+        //应用发送不满时估计不超过确认码率的1.5倍，避免无限增长
+        int64_t limit = acked_bps_ > 0 ? acked_bps_ * 3 / 2 + 10000 : options_.max_bitrate_bps;
+        if (elapsed > 0 && delay_bps_ < limit) {
+            int64_t increase = (int64_t)(delay_bps_ * (pow(1.08, elapsed / 1000.0) - 1)) + 1000 * elapsed / 1000;
+            delay_bps_ = delay_bps_ + increase < limit ? delay_bps_ + increase : limit;
+        }
+        last_increase_ms_ = now_ms;
+        break;
+    }
+    }
+
+    if (probe_bps_ > 0) {
+        //探测结果高于当前估计时直接采用
+        if (probe_bps_ > delay_bps_) {
+            delay_bps_ = probe_bps_;
+        }
+        if (probe_bps_ > loss_bps_) {
+            loss_bps_ = probe_bps_;
+        }
+        probe_bps_ = 0;
+    }
+    delay_bps_ = clamp(delay_bps_);
+}
+
+void BandwidthEstimator::updateLoss(int64_t now_ms) {
+    if (loss_packets_ < BWE_LOSS_MIN_PACKETS) {
+        return;
+    }
+    loss_rate_ = (double)loss_lost_ / loss_packets_;
+    loss_packets_ = 0;
+    loss_lost_ = 0;
+    int64_t elapsed = last_loss_update_ms_ < 0 ? 1000 : now_ms - last_loss_update_ms_;
+    //以当前目标码率为基准，时延受限时丢包部分不会单独涨上去
+    if (loss_rate_ < 0.02) {
+        if (elapsed >= 1000) {
+            loss_bps_ = clamp(target_bps_ * 108 / 100 + 1000);
+            last_loss_update_ms_ = now_ms;
+        }
+    } else if (loss_rate_ > 0.1) {
+        if (elapsed >= 300) {
+            loss_bps_ = clamp((int64_t)(target_bps_ * (1 - 0.5 * loss_rate_)));
+            last_loss_update_ms_ = now_ms;
+        }
+    }
+}
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "transport_feedback.h"
+
+namespace rtc {
+
+enum BandwidthUsage {
+    BANDWIDTH_NORMAL = 0,
+    BANDWIDTH_UNDERUSING,
+    BANDWIDTH_OVERUSING
+};
+
+/**
+ * 基于单向时延梯度的拥塞检测
+ * 对按发送时间分组后的排队时延累积值做指数平滑，在最近的窗口上线性回归得到时延趋势
+ * 趋势与自适应阈值比较判断过载、欠载
+ */
+class TrendlineEstimator {
+public:
+    explicit TrendlineEstimator(size_t window_size = 20, double smoothing = 0.9, double threshold_gain = 4.0);
+
+    //相邻两组包的到达间隔和发送间隔(ms)
+    void update(double recv_delta_ms, double send_delta_ms, int64_t arrival_ms);
+
+    BandwidthUsage state() const {
+        return state_;
+    }
+
+    double trend() const {
+        return trend_;
+    }
+
+private:
+    void detect(double trend, double send_delta_ms, int64_t now_ms);
+
+    void updateThreshold(double modified_trend, int64_t now_ms);
+
+private:
+    size_t window_size_;
+    double smoothing_;
+    double threshold_gain_;
+
+    int32_t num_deltas_;
+    int64_t first_arrival_ms_;
+    double accumulated_delay_;
+    double smoothed_delay_;
+    //(到达时间, 平滑后的时延)组成的环
+    std::vector<std::pair<double, double>> history_;
+    size_t history_pos_;
+    size_t history_count_;
+
+    double trend_;
+    double prev_trend_;
+    double threshold_;
+    int64_t last_threshold_update_ms_;
+    double time_over_using_;
+    int32_t overuse_counter_;
+    BandwidthUsage state_;
+};
+
+typedef struct BandwidthEstimatorOptions_tag {
+    int64_t start_bitrate_bps = 1000000;
+    int64_t min_bitrate_bps = 50000;
+    int64_t max_bitrate_bps = 20000000;
+} BandwidthEstimatorOptions;
+
+/**
+ * 发送端带宽估计
+ * 时延部分：包按5ms发送间隔分组送给TrendlineEstimator，过载时把码率降到确认码率的0.85倍，正常时按每秒8%增长
+ * 丢包部分：丢包率低于2%时每秒最多增长8%，高于10%时按丢包率降低
+ * 目标码率取两者的较小值，带宽探测的结果高于当前估计时直接采用
+ * 每个包只有O(1)的记录，计算都在收到反馈时进行，不是线程安全的
+ */
+class BandwidthEstimator {
+public:
+    explicit BandwidthEstimator(const BandwidthEstimatorOptions &options = BandwidthEstimatorOptions());
+
+    BandwidthEstimator(const BandwidthEstimator&) = delete;
+
+    BandwidthEstimator(BandwidthEstimator&&) = delete;
+
+    //包交给socket时调用，通常在Pacer的发送回调里
+    void onPacketSent(uint16_t transport_seq, size_t size, int64_t send_us, int32_t probe_id);
+
+    /**
+     * 处理一个transport-cc反馈
+     * @return 更新后的目标码率，用于Pacer::setBitrate和选择转发的simulcast层
+     */
+    int64_t onTransportFeedback(const RtcpTransportFeedback &feedback, int64_t now_ms);
+
+    int64_t targetBitrate() const {
+        return target_bps_;
+    }
+
+    //接收端确认收到的码率，没有足够的样本时为0
+    int64_t ackedBitrate() const {
+        return acked_bps_;
+    }
+
+    BandwidthUsage usage() const {
+        return trendline_.state();
+    }
+
+    //最近一个统计周期的丢包率
+    double lossRate() const {
+        return loss_rate_;
+    }
+
+private:
+    void updateDelay(const PacketResult &result);
+    void updateAckedBitrate();
+    void updateProbe(const PacketResult &result);
+    void updateAimd(int64_t now_ms);
+    void updateLoss(int64_t now_ms);
+    int64_t clamp(int64_t bitrate) const;
+
+private:
+    BandwidthEstimatorOptions options_;
+    TransportFeedbackAdapter adapter_;
+    TrendlineEstimator trendline_;
+    std::vector<PacketResult> results_;
+
+    //按发送时间分组
+    struct PacketGroup {
+        int64_t first_send_us = -1;
+        int64_t last_send_us = 0;
+        int64_t last_arrival_us = 0;
+    };
+    PacketGroup current_group_;
+    PacketGroup prev_group_;
+
+    //确认码率，按到达时间累计一个窗口的字节数
+    int64_t acked_window_start_us_;
+    int64_t acked_window_last_us_;
+    uint64_t acked_window_bytes_;
+    int64_t acked_bps_;
+
+    //带宽探测，同时只跟踪最近的一个
+    struct ProbeCluster {
+        int32_t id = 0;
+        int32_t packets = 0;
+        int64_t first_send_us = 0;
+        int64_t last_send_us = 0;
+        int64_t first_arrival_us = 0;
+        int64_t last_arrival_us = 0;
+        uint64_t bytes = 0;
+        uint32_t last_size = 0;
+        uint32_t first_size = 0;
+    };
+    ProbeCluster probe_;
+    int64_t probe_bps_;
+
+    //时延部分的AIMD
+    int64_t delay_bps_;
+    int64_t last_decrease_ms_;       //持续过载时每300ms最多降一次
+    int64_t last_increase_ms_;
+
+    //丢包部分
+    uint32_t loss_packets_;
+    uint32_t loss_lost_;
+    double loss_rate_;
+    int64_t loss_bps_;
+    int64_t last_loss_update_ms_;
+
+    int64_t target_bps_;
+};
+
+}
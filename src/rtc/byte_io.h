@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+
+namespace rtc {
+
+//网络字节序(大端)读写，不要求对齐
+
+inline uint16_t readBE16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+inline uint32_t readBE24(const uint8_t *p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+inline uint32_t readBE32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline uint64_t readBE64(const uint8_t *p) {
+    return ((uint64_t)readBE32(p) << 32) | readBE32(p + 4);
+}
+
+inline void writeBE16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+inline void writeBE24(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 16);
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)value;
+}
+
+inline void writeBE32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+inline void writeBE64(uint8_t *p, uint64_t value) {
+    writeBE32(p, (uint32_t)(value >> 32));
+    writeBE32(p + 4, (uint32_t)value);
+}
+
+}
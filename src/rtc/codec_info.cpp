@@ -0,0 +1,105 @@
+#include "codec_info.h"
+#include "byte_io.h"
+
+namespace rtc {
+
+//RFC 7741 VP8负载描述符
+static bool parse_vp8(const uint8_t *payload, size_t size, RtpPacketInfo &info) {
+    if (size < 1) {
+        return false;
+    }
+    size_t pos = 0;
+    uint8_t first = payload[pos++];
+    bool extended = (first & 0x80) != 0;
+    bool start = (first & 0x10) != 0;
+    uint8_t partition = first & 0x07;
+    if (extended) {
+        if (pos >= size) {
+            return false;
+        }
+        uint8_t ext = payload[pos++];
+        if (ext & 0x80) {
+            //picture id，M位为1时是15位
+            if (pos >= size) {
+                return false;
+            }
+            pos += (payload[pos] & 0x80) ? 2 : 1;
+        }
+        if (ext & 0x40) {
+            pos++;  //TL0PICIDX
+        }
+        if (ext & 0x30) {
+            if (pos >= size) {
+                return false;
+            }
+            uint8_t tid = payload[pos++];
+            if (ext & 0x20) {
+                info.temporal_id = tid >> 6;
+                info.layer_sync = (tid & 0x20) != 0;
+            }
+        }
+    }
+    if (pos >= size) {
+        return false;
+    }
+    //帧的第一个分区开头是VP8帧头，P位为0表示关键帧
+    if (start && partition == 0) {
+        info.keyframe = (payload[pos] & 0x01) == 0;
+    }
+    if (info.keyframe) {
+        info.layer_sync = true;
+    }
+    return true;
+}
+
+static inline bool h264_key_nalu(uint8_t type) {
+    return type == 5 || type == 7;  //IDR或SPS
+}
+
+//RFC 6184
+static bool parse_h264(const uint8_t *payload, size_t size, RtpPacketInfo &info) {
+    if (size < 1) {
+        return false;
+    }
+    uint8_t type = payload[0] & 0x1f;
+    if (type >= 1 && type <= 23) {
+        info.keyframe = h264_key_nalu(type);
+    } else if (type == 24) {
+        //STAP-A，遍历聚合的每个NALU
+        size_t pos = 1;
+        while (pos + 2 < size) {
+            size_t length = readBE16(payload + pos);
+            pos += 2;
+            if (length == 0 || pos + length > size) {
+                break;
+            }
+            if (h264_key_nalu(payload[pos] & 0x1f)) {
+                info.keyframe = true;
+                break;
+            }
+            pos += length;
+        }
+    } else if (type == 28) {
+        //FU-A，只有分片开始的包才算
+        if (size < 2) {
+            return false;
+        }
+        info.keyframe = (payload[1] & 0x80) && h264_key_nalu(payload[1] & 0x1f);
+    }
+    info.layer_sync = info.keyframe;
+    return true;
+}
+
+bool parseCodecInfo(CodecType codec, const uint8_t *payload, size_t size, RtpPacketInfo &info) {
+    info = RtpPacketInfo();
+    switch (codec) {
+        case CODEC_VP8:
+            return parse_vp8(payload, size, info);
+        case CODEC_H264:
+            return parse_h264(payload, size, info);
+        default:
+            return true;
+    }
+}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rtc {
+
+enum CodecType {
+    CODEC_UNKNOWN = 0,
+    CODEC_OPUS,
+    CODEC_VP8,
+    CODEC_H264,
+};
+
+//转发决策需要的负载信息
+struct RtpPacketInfo {
+    bool keyframe = false;      //关键帧的第一个包，可以在这里切换空间层
+    uint8_t temporal_id = 0;
+    bool layer_sync = false;    //之后的帧只参考tl0，可以在这里升高时间层
+};
+
+/**
+ * 从RTP负载中解析关键帧和时间层，只读取负载描述符和开头的几个字节
+ * 音频和未知编码总是返回空信息
+ */
+bool parseCodecInfo(CodecType codec, const uint8_t *payload, size_t size, RtpPacketInfo &info);
+
+}
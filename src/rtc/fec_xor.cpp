@@ -0,0 +1,157 @@
+#include "fec_xor.h"
+#include <string.h>
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FEC_XOR_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rtc {
+
+typedef void (*XorFunction)(uint8_t *dst, const uint8_t *src, size_t size);
+
+static void xorScalar(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t i = 0;
+    //按8字节处理，memcpy避免非对齐访问，编译器会优化成普通的load/store
+    for (; i + 8 <= size; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < size; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+#ifdef FEC_XOR_X86
+__attribute__((target("sse2")))
+static void xorSse2(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(dst + i + 16));
+        __m128i a2 = _mm_loadu_si128((const __m128i *)(dst + i + 32));
+        __m128i a3 = _mm_loadu_si128((const __m128i *)(dst + i + 48));
+        a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i *)(src + i)));
+        a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i *)(src + i + 16)));
+        a2 = _mm_xor_si128(a2, _mm_loadu_si128((const __m128i *)(src + i + 32)));
+        a3 = _mm_xor_si128(a3, _mm_loadu_si128((const __m128i *)(src + i + 48)));
+        _mm_storeu_si128((__m128i *)(dst + i), a0);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), a1);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), a2);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), a3);
+    }
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)(src + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+    }
+    xorScalar(dst + i, src + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void xorAvx2(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(dst + i + 32));
+        __m256i a2 = _mm256_loadu_si256((const __m256i *)(dst + i + 64));
+        __m256i a3 = _mm256_loadu_si256((const __m256i *)(dst + i + 96));
+        a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i *)(src + i)));
+        a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i *)(src + i + 32)));
+        a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((const __m256i *)(src + i + 64)));
+        a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((const __m256i *)(src + i + 96)));
+        _mm256_storeu_si256((__m256i *)(dst + i), a0);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), a1);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), a2);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), a3);
+    }
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)(src + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+    }
+    if (i + 16 <= size) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)(src + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        i += 16;
+    }
+    xorScalar(dst + i, src + i, size - i);
+}
+#endif
+
+static XorFunction functionOf(SimdLevel level) {
+    switch (level) {
+#ifdef FEC_XOR_X86
+    case SIMD_AVX2:
+        return xorAvx2;
+    case SIMD_SSE2:
+        return xorSse2;
+#endif
+    default:
+        return xorScalar;
+    }
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef FEC_XOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+static void xorSelect(uint8_t *dst, const uint8_t *src, size_t size);
+
+//第一次调用时按CPU选定，之后每次调用只是一次间接跳转
+static std::atomic<XorFunction> s_xor(xorSelect);
+static std::atomic<int> s_level(-1);
+
+static void xorSelect(uint8_t *dst, const uint8_t *src, size_t size) {
+    fecSimdLevel();
+    s_xor.load(std::memory_order_relaxed)(dst, src, size);
+}
+
+SimdLevel fecSimdLevel() {
+    int level = s_level.load(std::memory_order_relaxed);
+    if (level < 0) {
+        return setFecSimdLevel(detectSimdLevel());
+    }
+    return (SimdLevel)level;
+}
+
+SimdLevel setFecSimdLevel(SimdLevel level) {
+    SimdLevel supported = detectSimdLevel();
+    if (level > supported) {
+        level = supported;
+    }
+    s_xor.store(functionOf(level), std::memory_order_relaxed);
+    s_level.store(level, std::memory_order_relaxed);
+    return level;
+}
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+void fecXor(uint8_t *dst, const uint8_t *src, size_t size) {
+    s_xor.load(std::memory_order_relaxed)(dst, src, size);
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rtc {
+
+//XOR内核使用的指令集，按从低到高排列
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+//CPU支持的最高一级
+SimdLevel detectSimdLevel();
+
+//当前使用的一级，默认是detectSimdLevel()
+SimdLevel fecSimdLevel();
+
+/**
+ * 强制使用某一级，用于对比各指令集的吞吐，高于CPU支持时降到支持的最高一级
+ * 不是线程安全的，应在开始编解码之前调用
+ * @return 实际使用的一级
+ */
+SimdLevel setFecSimdLevel(SimdLevel level);
+
+const char *simdLevelName(SimdLevel level);
+
+//dst[i] ^= src[i]，不要求对齐，两块内存不能部分重叠
+void fecXor(uint8_t *dst, const uint8_t *src, size_t size);
+
+}
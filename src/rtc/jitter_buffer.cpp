@@ -0,0 +1,326 @@
+#include "jitter_buffer.h"
+#include <math.h>
+#include "infra/utils/time.h"
+#include "rtp_packet.h"
+
+namespace rtc {
+
+std::shared_ptr<JitterBuffer> JitterBuffer::create(const std::shared_ptr<infra::TaskQueue> &queue, const FrameCallback &callback,
+                                                   const JitterBufferOptions &options) {
+    if (!queue || !callback) {
+        return nullptr;
+    }
+    return std::shared_ptr<JitterBuffer>(new JitterBuffer(queue, callback, options));
+}
+
+JitterBuffer::JitterBuffer(const std::shared_ptr<infra::TaskQueue> &queue, const FrameCallback &callback,
+                           const JitterBufferOptions &options)
+    : queue_(queue), callback_(callback), options_(options), mask_(0), started_(false), head_seq_(0), highest_seq_(0),
+      stored_(0), head_is_start_(true), head_fixed_(false), timing_started_(false), last_unwrapped_ts_(0), last_ts_(0), base_ts_(0),
+      base_arrival_ms_(0), prev_frame_ts_(0), prev_frame_arrival_ms_(0), jitter_ms_(0), target_delay_ms_(options.min_delay_ms),
+      timer_(0), timer_deadline_ms_(0) {
+    size_t capacity = 16;
+    while (capacity < options_.capacity && capacity < 0x8000) {
+        capacity <<= 1;
+    }
+    slots_.resize(capacity);
+    mask_ = (uint16_t)(capacity - 1);
+    frame_.reserve(64);
+    if (options_.clock_rate == 0) {
+        options_.clock_rate = 90000;
+    }
+}
+
+JitterBuffer::~JitterBuffer() {
+    if (timer_) {
+        queue_->cancelDelayedTask(timer_);
+    }
+}
+
+void JitterBuffer::reset() {
+    for (auto &slot : slots_) {
+        slot.packet.reset();
+    }
+    stored_ = 0;
+    started_ = false;
+    head_is_start_ = true;
+    timing_started_ = false;
+    if (timer_) {
+        queue_->cancelDelayedTask(timer_);
+        timer_ = 0;
+    }
+}
+
+void JitterBuffer::insert(const infra::PacketBuffer::Ptr &packet, int64_t arrival_ms) {
+    RtpPacket rtp;
+    if (!rtp.parse(packet->data(), packet->size())) {
+        return;
+    }
+    stats_.received++;
+    uint16_t seq = rtp.sequenceNumber();
+    if (!started_) {
+        started_ = true;
+        head_seq_ = seq;
+        highest_seq_ = seq;
+        head_is_start_ = true;
+        head_fixed_ = false;
+    }
+
+    uint16_t diff = (uint16_t)(seq - head_seq_);
+    if (diff >= 0x8000 && !head_fixed_ && (uint16_t)(highest_seq_ - seq) <= mask_) {
+        //还没有输出过，开始阶段乱序到达的更早的包前移队头
+        head_seq_ = seq;
+        diff = 0;
+    }
+    if (diff >= 0x8000) {
+        if ((uint16_t)(head_seq_ - seq) <= slots_.size()) {
+            //迟到的包也要参与抖动估计，否则目标延时永远追不上
+            stats_.late++;
+            updateTiming(unwrapTimestamp(rtp.timestamp()), arrival_ms);
+            return;
+        }
+        //远远落后于队头，认为发送端重启了序号
+        reset();
+        insert(packet, arrival_ms);
+        return;
+    }
+    if (diff > mask_) {
+        //超出环的跨度，丢弃最旧的包给新包腾出位置
+        uint16_t new_head = (uint16_t)(seq - mask_);
+        if (stored_ == 0) {
+            head_seq_ = new_head;
+        }
+        while (head_seq_ != new_head && stored_ > 0) {
+            if (present(head_seq_)) {
+                release(head_seq_);
+                stats_.overflow++;
+            }
+            head_seq_++;
+        }
+        head_seq_ = new_head;
+        head_is_start_ = false;
+        head_fixed_ = true;
+    }
+
+    Slot &slot = slotOf(seq);
+    if (slot.packet && slot.seq == seq) {
+        stats_.duplicate++;
+        return;
+    }
+    slot.packet = packet;
+    slot.seq = seq;
+    slot.timestamp = rtp.timestamp();
+    slot.marker = rtp.marker();
+    stored_++;
+    if (isNewerSequence(seq, highest_seq_)) {
+        highest_seq_ = seq;
+    }
+    updateTiming(unwrapTimestamp(rtp.timestamp()), arrival_ms);
+    process(infra::getCurrentMilliseconds());
+}
+
+int64_t JitterBuffer::unwrapTimestamp(uint32_t timestamp) {
+    if (!timing_started_) {
+        last_ts_ = timestamp;
+        last_unwrapped_ts_ = timestamp;
+        return last_unwrapped_ts_;
+    }
+    int64_t unwrapped = last_unwrapped_ts_ + (int32_t)(timestamp - last_ts_);
+    if (unwrapped > last_unwrapped_ts_) {
+        last_ts_ = timestamp;
+        last_unwrapped_ts_ = unwrapped;
+    }
+    return unwrapped;
+}
+
+void JitterBuffer::updateTiming(int64_t timestamp, int64_t arrival_ms) {
+    if (!timing_started_) {
+        timing_started_ = true;
+        base_ts_ = timestamp;
+        base_arrival_ms_ = (double)arrival_ms;
+        prev_frame_ts_ = timestamp;
+        prev_frame_arrival_ms_ = arrival_ms;
+        return;
+    }
+    //基准跟随最早的到达时间，晚到时缓慢上移以适应时钟漂移和路由变化
+    double expected = base_arrival_ms_ + (double)(timestamp - base_ts_) * 1000.0 / options_.clock_rate;
+    double delta = arrival_ms - expected;
+    base_arrival_ms_ += delta < 0 ? delta : delta / 256;
+
+    if (timestamp != prev_frame_ts_) {
+        //RFC 3550的到达间隔抖动，按到达顺序在时间戳变化的包之间计算
+        double d = (double)(arrival_ms - prev_frame_arrival_ms_) -
+                   (double)(timestamp - prev_frame_ts_) * 1000.0 / options_.clock_rate;
+        jitter_ms_ += (fabs(d) - jitter_ms_) / 16;
+        prev_frame_ts_ = timestamp;
+        prev_frame_arrival_ms_ = arrival_ms;
+
+        int64_t target = (int64_t)(jitter_ms_ * options_.jitter_factor);
+        if (target < options_.min_delay_ms) {
+            target = options_.min_delay_ms;
+        } else if (target > options_.max_delay_ms) {
+            target = options_.max_delay_ms;
+        }
+        //抖动变大时立即增加延时，变小时缓慢减少
+        if (target > target_delay_ms_) {
+            target_delay_ms_ = target;
+        } else {
+            target_delay_ms_ -= (target_delay_ms_ - target + 15) / 16;
+        }
+    }
+}
+
+int64_t JitterBuffer::playoutTime(uint32_t timestamp) const {
+    int64_t unwrapped = last_unwrapped_ts_ + (int32_t)(timestamp - last_ts_);
+    double expected = base_arrival_ms_ + (double)(unwrapped - base_ts_) * 1000.0 / options_.clock_rate;
+    return (int64_t)ceil(expected) + target_delay_ms_;
+}
+
+void JitterBuffer::release(uint16_t seq) {
+    slotOf(seq).packet.reset();
+    stored_--;
+}
+
+uint16_t JitterBuffer::completeFrameSize() const {
+    if (!head_is_start_) {
+        return 0;
+    }
+    //从队头开始连续且时间戳相同，直到marker或下一个时间戳
+    const Slot &head = slots_[head_seq_ & mask_];
+    uint16_t seq = head_seq_;
+    uint16_t count = 0;
+    while (count < stored_) {
+        const Slot &slot = slots_[seq & mask_];
+        if (!slot.packet || slot.seq != seq) {
+            return 0;
+        }
+        if (slot.timestamp != head.timestamp) {
+            return count;
+        }
+        count++;
+        if (slot.marker) {
+            return count;
+        }
+        seq++;
+    }
+    return 0;
+}
+
+void JitterBuffer::output(uint16_t count) {
+    frame_.clear();
+    for (uint16_t i = 0; i < count; i++) {
+        Slot &slot = slotOf(head_seq_);
+        frame_.push_back(std::move(slot.packet));
+        stored_--;
+        head_seq_++;
+    }
+    head_is_start_ = true;
+    head_fixed_ = true;
+    stats_.frames++;
+    callback_(frame_.data(), frame_.size());
+    frame_.clear();
+}
+
+void JitterBuffer::dropHead(bool discard_frame) {
+    uint32_t timestamp = slotOf(head_seq_).timestamp;
+    head_is_start_ = false;
+    head_fixed_ = true;
+    while (stored_ > 0) {
+        if (!present(head_seq_)) {
+            //帧中间的缺包一起跳过，之后是别的帧时停在缺包处
+            uint16_t seq = (uint16_t)(head_seq_ + 1);
+            while (!present(seq)) {
+                seq++;
+            }
+            if (slotOf(seq).timestamp != timestamp) {
+                break;
+            }
+            stats_.lost += (uint16_t)(seq - head_seq_);
+            head_seq_ = seq;
+        }
+        Slot &slot = slotOf(head_seq_);
+        if (slot.timestamp != timestamp) {
+            head_is_start_ = true;
+            break;
+        }
+        bool marker = slot.marker;
+        release(head_seq_);
+        head_seq_++;
+        if (marker) {
+            head_is_start_ = true;
+            break;
+        }
+    }
+    if (discard_frame) {
+        stats_.discarded_frames++;
+    }
+}
+
+void JitterBuffer::process(int64_t now_ms) {
+    while (stored_ > 0) {
+        if (present(head_seq_)) {
+            int64_t play_ms = playoutTime(slotOf(head_seq_).timestamp);
+            if (!options_.video) {
+                if (now_ms < play_ms) {
+                    schedule(play_ms, now_ms);
+                    return;
+                }
+                output(1);
+                continue;
+            }
+            if (!head_is_start_) {
+                //帧的开头已经丢失，不可能再完整
+                dropHead(true);
+                continue;
+            }
+            uint16_t count = completeFrameSize();
+            if (now_ms < play_ms) {
+                schedule(play_ms, now_ms);
+                return;
+            }
+            if (count > 0) {
+                output(count);
+            } else {
+                //到了输出时间仍不完整
+                dropHead(true);
+            }
+            continue;
+        }
+
+        //队头缺包，等到后面第一个已到达的包的输出时间再放弃
+        uint16_t seq = (uint16_t)(head_seq_ + 1);
+        while (!present(seq)) {
+            seq++;
+        }
+        int64_t play_ms = playoutTime(slotOf(seq).timestamp);
+        if (now_ms < play_ms) {
+            schedule(play_ms, now_ms);
+            return;
+        }
+        stats_.lost += (uint16_t)(seq - head_seq_);
+        head_seq_ = seq;
+        head_is_start_ = false;
+        head_fixed_ = true;
+    }
+}
+
+void JitterBuffer::schedule(int64_t deadline_ms, int64_t now_ms) {
+    if (timer_) {
+        if (timer_deadline_ms_ == deadline_ms) {
+            return;
+        }
+        queue_->cancelDelayedTask(timer_);
+    }
+    std::weak_ptr<JitterBuffer> weak_self = shared_from_this();
+    int64_t delay = deadline_ms - now_ms;
+    timer_deadline_ms_ = deadline_ms;
+    timer_ = queue_->postDelayedTask([weak_self]() {
+        auto self = weak_self.lock();
+        if (self) {
+            self->timer_ = 0;
+            self->process(infra::getCurrentMilliseconds());
+        }
+    }, delay > 0 ? delay : 1);
+}
+
+}
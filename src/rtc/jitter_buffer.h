@@ -0,0 +1,136 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "infra/task_queue.h"
+#include "infra/packet_buffer.h"
+
+namespace rtc {
+
+typedef struct JitterBufferOptions_tag {
+    uint32_t clock_rate = 90000;
+    bool video = true;               //视频按帧输出，音频按包输出
+    uint16_t capacity = 512;         //环形缓冲的槽数，取整为2的幂，序号跨度超过时丢弃最旧的包
+    int64_t min_delay_ms = 10;
+    int64_t max_delay_ms = 500;
+    double jitter_factor = 3.0;      //目标延时 = 抖动 * jitter_factor
+} JitterBufferOptions;
+
+struct JitterBufferStats {
+    uint64_t received = 0;
+    uint64_t duplicate = 0;
+    uint64_t late = 0;               //到达时已经输出或放弃了同序号的位置
+    uint64_t lost = 0;               //等到超时仍未到达而跳过的序号数
+    uint64_t overflow = 0;           //序号跨度超出容量被丢弃的包数
+    uint64_t frames = 0;             //输出的帧数(音频为包数)
+    uint64_t discarded_frames = 0;   //不完整而丢弃的帧数
+};
+
+/**
+ * 接收端抖动缓冲
+ * 按序号存放在固定大小的环形缓冲里，插入、查找都是O(1)且稳态下不分配内存
+ * 以到达时间的下沿估计每个时间戳的期望到达时间，加上按到达抖动自适应的目标延时作为输出时间
+ * 输出由TaskQueue的延时任务驱动，所有接口必须在queue的线程(或串行队列)中调用
+ */
+class JitterBuffer : public std::enable_shared_from_this<JitterBuffer> {
+public:
+    //packets按序号排列，只在回调期间有效
+    typedef std::function<void(const infra::PacketBuffer::Ptr *packets, size_t count)> FrameCallback;
+
+    JitterBuffer(const JitterBuffer&) = delete;
+
+    JitterBuffer(JitterBuffer&&) = delete;
+
+    static std::shared_ptr<JitterBuffer> create(const std::shared_ptr<infra::TaskQueue> &queue, const FrameCallback &callback,
+                                                const JitterBufferOptions &options = JitterBufferOptions());
+
+    ~JitterBuffer();
+
+    /**
+     * @param packet 必须是合法的RTP包
+     * @param arrival_ms 必须和infra::getCurrentMilliseconds()是同一个时钟，输出定时器用它计算播放时间
+     */
+    void insert(const infra::PacketBuffer::Ptr &packet, int64_t arrival_ms);
+
+    //丢弃所有缓存的包，下一个包重新开始
+    void reset();
+
+    const JitterBufferStats &stats() const {
+        return stats_;
+    }
+
+    //平滑后的到达抖动(ms)
+    double jitter() const {
+        return jitter_ms_;
+    }
+
+    int64_t targetDelay() const {
+        return target_delay_ms_;
+    }
+
+private:
+    JitterBuffer(const std::shared_ptr<infra::TaskQueue> &queue, const FrameCallback &callback, const JitterBufferOptions &options);
+
+    struct Slot {
+        infra::PacketBuffer::Ptr packet;
+        uint32_t timestamp = 0;
+        uint16_t seq = 0;
+        bool marker = false;
+    };
+
+    Slot &slotOf(uint16_t seq) {
+        return slots_[seq & mask_];
+    }
+
+    bool present(uint16_t seq) const {
+        const Slot &slot = slots_[seq & mask_];
+        return slot.packet && slot.seq == seq;
+    }
+
+    int64_t unwrapTimestamp(uint32_t timestamp);
+    void updateTiming(int64_t timestamp, int64_t arrival_ms);
+    int64_t playoutTime(uint32_t timestamp) const;
+
+    //队头完整帧的包数，不完整返回0
+    uint16_t completeFrameSize() const;
+    void output(uint16_t count);
+    void dropHead(bool discard_frame);
+    void release(uint16_t seq);
+
+    void process(int64_t now_ms);
+    void schedule(int64_t deadline_ms, int64_t now_ms);
+
+private:
+    std::shared_ptr<infra::TaskQueue> queue_;
+    FrameCallback callback_;
+    JitterBufferOptions options_;
+
+    std::vector<Slot> slots_;
+    uint16_t mask_;
+    bool started_;
+    uint16_t head_seq_;      //下一个要输出的序号
+    uint16_t highest_seq_;   //收到的最新序号
+    uint32_t stored_;        //环中的包数
+    bool head_is_start_;     //队头是否是帧的第一个包，跳过缺包后未知
+    bool head_fixed_;        //已经输出或跳过过包，之后早于队头的包都算迟到
+    std::vector<infra::PacketBuffer::Ptr> frame_;  //输出时复用
+
+    //时间戳到期望到达时间的映射
+    bool timing_started_;
+    int64_t last_unwrapped_ts_;
+    uint32_t last_ts_;
+    int64_t base_ts_;
+    double base_arrival_ms_;
+    int64_t prev_frame_ts_;
+    int64_t prev_frame_arrival_ms_;
+    double jitter_ms_;
+    int64_t target_delay_ms_;
+
+    infra::TaskQueue::TaskId timer_;
+    int64_t timer_deadline_ms_;
+
+    JitterBufferStats stats_;
+};
+
+}
@@ -0,0 +1,202 @@
+#include "nack_generator.h"
+#include <limits>
+#include "infra/utils/time.h"
+#include "rtcp_packet.h"
+
+namespace rtc {
+
+std::shared_ptr<NackGenerator> NackGenerator::create(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc,
+                                                     uint32_t media_ssrc, const FeedbackCallback &callback,
+                                                     const NackOptions &options) {
+    if (!queue || !callback) {
+        return nullptr;
+    }
+    return std::shared_ptr<NackGenerator>(new NackGenerator(queue, sender_ssrc, media_ssrc, callback, options));
+}
+
+NackGenerator::NackGenerator(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc, uint32_t media_ssrc,
+                             const FeedbackCallback &callback, const NackOptions &options)
+    : queue_(queue), sender_ssrc_(sender_ssrc), media_ssrc_(media_ssrc), callback_(callback), options_(options), mask_(0),
+      missing_count_(0), started_(false), highest_seq_(0), rtt_ms_(options.default_rtt_ms), timer_(0), timer_deadline_ms_(0) {
+    size_t capacity = 16;
+    while (capacity < options_.capacity && capacity < 0x8000) {
+        capacity <<= 1;
+    }
+    entries_.resize(capacity);
+    mask_ = (uint16_t)(capacity - 1);
+    order_.reserve(capacity);
+    batch_.reserve(capacity);
+    if (options_.max_packet_size < 16) {
+        options_.max_packet_size = 16;
+    }
+    buffer_.resize(options_.max_packet_size);
+}
+
+NackGenerator::~NackGenerator() {
+    if (timer_) {
+        queue_->cancelDelayedTask(timer_);
+    }
+}
+
+void NackGenerator::setRtt(int64_t rtt_ms) {
+    rtt_ms_ = rtt_ms > 0 ? rtt_ms : 1;
+}
+
+void NackGenerator::reset() {
+    clearMissing();
+    started_ = false;
+    if (timer_) {
+        queue_->cancelDelayedTask(timer_);
+        timer_ = 0;
+    }
+}
+
+void NackGenerator::clearMissing() {
+    for (uint16_t seq : order_) {
+        entries_[seq & mask_].missing = false;
+    }
+    order_.clear();
+    missing_count_ = 0;
+}
+
+void NackGenerator::addMissing(uint16_t seq, int64_t send_ms) {
+    Entry &entry = entries_[seq & mask_];
+    if (entry.missing) {
+        //环上同一位置的旧缺包已经超出跟踪范围
+        missing_count_--;
+        stats_.given_up++;
+    }
+    entry.seq = seq;
+    entry.send_ms = send_ms;
+    entry.retries = 0;
+    entry.missing = true;
+    order_.push_back(seq);
+    missing_count_++;
+    stats_.missing++;
+}
+
+void NackGenerator::onPacket(uint16_t seq, int64_t now_ms) {
+    if (!started_) {
+        started_ = true;
+        highest_seq_ = seq;
+        return;
+    }
+    uint16_t diff = (uint16_t)(seq - highest_seq_);
+    if (diff == 0) {
+        return;
+    }
+    if (diff >= 0x8000) {
+        //旧的包，可能是重传或乱序
+        if (isMissing(seq)) {
+            entries_[seq & mask_].missing = false;
+            missing_count_--;
+            stats_.recovered++;
+        }
+        return;
+    }
+    if (diff > mask_) {
+        //跳跃超出跟踪范围，之前的缺包都放弃，由上层请求关键帧
+        stats_.given_up += missing_count_;
+        clearMissing();
+        highest_seq_ = seq;
+        return;
+    }
+
+    int64_t send_ms = now_ms + options_.send_delay_ms;
+    for (uint16_t missing = (uint16_t)(highest_seq_ + 1); missing != seq; missing++) {
+        addMissing(missing, send_ms);
+    }
+    highest_seq_ = seq;
+    //同一批发现的缺包合并到一次定时处理
+    if (diff > 1 && (!timer_ || send_ms < timer_deadline_ms_)) {
+        schedule(send_ms, now_ms);
+    }
+}
+
+void NackGenerator::process(int64_t now_ms) {
+    batch_.clear();
+    //重传至少要一个rtt才能到达，留出一半的余量避免重复请求
+    int64_t interval = rtt_ms_ + rtt_ms_ / 2;
+    if (interval < options_.min_retry_interval_ms) {
+        interval = options_.min_retry_interval_ms;
+    }
+    int64_t next_ms = std::numeric_limits<int64_t>::max();
+    size_t count = 0;
+    for (size_t i = 0; i < order_.size(); i++) {
+        uint16_t seq = order_[i];
+        if (!isMissing(seq)) {
+            continue;
+        }
+        Entry &entry = entries_[seq & mask_];
+        if (entry.send_ms <= now_ms) {
+            if (entry.retries >= options_.max_retries) {
+                entry.missing = false;
+                missing_count_--;
+                stats_.given_up++;
+                continue;
+            }
+            entry.retries++;
+            entry.send_ms = now_ms + interval;
+            batch_.push_back(seq);
+        }
+        if (entry.send_ms < next_ms) {
+            next_ms = entry.send_ms;
+        }
+        order_[count++] = seq;
+    }
+    order_.resize(count);
+
+    sendBatch();
+    if (next_ms != std::numeric_limits<int64_t>::max()) {
+        schedule(next_ms, now_ms);
+    }
+}
+
+void NackGenerator::sendBatch() {
+    if (batch_.empty()) {
+        return;
+    }
+    stats_.requests += batch_.size();
+    RtcpWriter writer(buffer_.data(), buffer_.size());
+    size_t pos = 0;
+    while (pos < batch_.size()) {
+        //每个序号最多占一个4字节的条目，按剩余空间切分
+        size_t space = buffer_.size() - writer.size();
+        size_t count = space >= 16 ? (space - 12) / 4 : 0;
+        if (count == 0) {
+            callback_(buffer_.data(), writer.size());
+            stats_.feedbacks++;
+            writer.reset();
+            continue;
+        }
+        if (count > batch_.size() - pos) {
+            count = batch_.size() - pos;
+        }
+        writer.addNack(sender_ssrc_, media_ssrc_, batch_.data() + pos, count);
+        pos += count;
+    }
+    callback_(buffer_.data(), writer.size());
+    stats_.feedbacks++;
+    batch_.clear();
+}
+
+void NackGenerator::schedule(int64_t deadline_ms, int64_t now_ms) {
+    if (timer_) {
+        if (timer_deadline_ms_ == deadline_ms) {
+            return;
+        }
+        queue_->cancelDelayedTask(timer_);
+    }
+    std::weak_ptr<NackGenerator> weak_self = shared_from_this();
+    int64_t delay = deadline_ms - now_ms;
+    timer_deadline_ms_ = deadline_ms;
+    timer_ = queue_->postDelayedTask([weak_self]() {
+        auto self = weak_self.lock();
+        if (self) {
+            self->timer_ = 0;
+            self->process(infra::getCurrentMilliseconds());
+        }
+    }, delay > 0 ? delay : 1);
+}
+
+}
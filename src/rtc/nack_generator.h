@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "infra/task_queue.h"
+
+namespace rtc {
+
+typedef struct NackOptions_tag {
+    uint16_t capacity = 1024;        //跟踪的序号跨度，取整为2的幂，更旧的缺包放弃
+    int32_t max_retries = 10;        //同一个序号最多请求的次数
+    int64_t send_delay_ms = 0;       //发现缺包后等待乱序包的时间
+    int64_t min_retry_interval_ms = 10;
+    int64_t default_rtt_ms = 100;    //没有rtt测量时使用
+    size_t max_packet_size = 1200;   //一次回调的RTCP最大长度
+} NackOptions;
+
+struct NackStats {
+    uint64_t missing = 0;            //发现的缺包数
+    uint64_t recovered = 0;          //缺包之后收到(重传或乱序)
+    uint64_t requests = 0;           //发出的请求序号数，包括重复请求
+    uint64_t given_up = 0;           //超过重试次数或太旧而放弃
+    uint64_t feedbacks = 0;          //回调的RTCP包数
+};
+
+/**
+ * 接收端NACK生成
+ * 缺包记录在按序号索引的环里，另有一个按发现顺序排列的序号列表，定时器只遍历还没恢复的缺包
+ * 重试间隔跟随rtt，同一时刻到期的序号合并成一个RTCP NACK回调
+ * 定时由TaskQueue的延时任务驱动，所有接口必须在queue的线程(或串行队列)中调用
+ */
+class NackGenerator : public std::enable_shared_from_this<NackGenerator> {
+public:
+    //data是一个或多个RTCP NACK组成的复合包，只在回调期间有效
+    typedef std::function<void(const uint8_t *data, size_t size)> FeedbackCallback;
+
+    NackGenerator(const NackGenerator&) = delete;
+
+    NackGenerator(NackGenerator&&) = delete;
+
+    static std::shared_ptr<NackGenerator> create(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc,
+                                                 uint32_t media_ssrc, const FeedbackCallback &callback,
+                                                 const NackOptions &options = NackOptions());
+
+    ~NackGenerator();
+
+    /**
+     * 收到的每个包(包括重传恢复的原始序号)都要调用
+     * @param now_ms 必须和infra::getCurrentMilliseconds()是同一个时钟，重试定时器按它计算到期时间
+     */
+    void onPacket(uint16_t seq, int64_t now_ms);
+
+    void setRtt(int64_t rtt_ms);
+
+    void reset();
+
+    //还在请求中的缺包数
+    size_t missingCount() const {
+        return missing_count_;
+    }
+
+    const NackStats &stats() const {
+        return stats_;
+    }
+
+private:
+    NackGenerator(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc, uint32_t media_ssrc,
+                  const FeedbackCallback &callback, const NackOptions &options);
+
+    struct Entry {
+        int64_t send_ms = 0;         //下一次请求的时间
+        uint16_t seq = 0;
+        uint16_t retries = 0;
+        bool missing = false;
+    };
+
+    bool isMissing(uint16_t seq) const {
+        const Entry &entry = entries_[seq & mask_];
+        return entry.missing && entry.seq == seq;
+    }
+
+    void addMissing(uint16_t seq, int64_t send_ms);
+    void clearMissing();
+
+    void process(int64_t now_ms);
+    void sendBatch();
+    void schedule(int64_t deadline_ms, int64_t now_ms);
+
+private:
+    std::shared_ptr<infra::TaskQueue> queue_;
+    uint32_t sender_ssrc_;
+    uint32_t media_ssrc_;
+    FeedbackCallback callback_;
+    NackOptions options_;
+
+    std::vector<Entry> entries_;
+    uint16_t mask_;
+    std::vector<uint16_t> order_;    //按发现顺序的缺包序号，恢复的在遍历时移除
+    size_t missing_count_;
+    bool started_;
+    uint16_t highest_seq_;
+    int64_t rtt_ms_;
+
+    std::vector<uint16_t> batch_;    //本次要请求的序号，复用
+    std::vector<uint8_t> buffer_;
+
+    infra::TaskQueue::TaskId timer_;
+    int64_t timer_deadline_ms_;
+
+    NackStats stats_;
+};
+
+}
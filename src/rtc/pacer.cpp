@@ -0,0 +1,357 @@
+#include "pacer.h"
+#include <string.h>
+#include "infra/logger.h"
+#include "infra/utils/time.h"
+
+#if defined(__linux__)
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+namespace rtc {
+
+//padding包的最大长度
+#define PACER_MAX_PADDING_SIZE 1200
+//每个tick最多生成的padding包个数
+#define PACER_MAX_PADDING_PACKETS 64
+
+std::shared_ptr<PacerScheduler> PacerScheduler::create(const std::shared_ptr<infra::ThreadPool> &loop, int64_t tick_us) {
+    if (!loop) {
+        return nullptr;
+    }
+    std::shared_ptr<PacerScheduler> scheduler(new PacerScheduler(loop, tick_us));
+    if (!scheduler->start()) {
+        return nullptr;
+    }
+    return scheduler;
+}
+
+PacerScheduler::PacerScheduler(const std::shared_ptr<infra::ThreadPool> &loop, int64_t tick_us)
+    : loop_(loop), tick_us_(tick_us > 0 ? tick_us : 1000), timer_fd_(-1), armed_(false), timer_(0), batch_fd_(-1),
+      batch_count_(0), send_failed_(0) {
+}
+
+PacerScheduler::~PacerScheduler() {
+    if (timer_fd_ >= 0) {
+        loop_->eventDriver()->delEvent(timer_fd_);
+        infra::close_socket(timer_fd_);
+    }
+    if (timer_) {
+        loop_->cancelDelayedTask(timer_);
+    }
+}
+
+bool PacerScheduler::start() {
+#if defined(__linux__)
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ < 0) {
+        errorf("pacer timerfd_create failed: %d\n", errno);
+        return false;
+    }
+    std::weak_ptr<PacerScheduler> weak_self = shared_from_this();
+    int ret = loop_->eventDriver()->addEvent(timer_fd_, infra::EventDriver::EventRead, [weak_self](int) {
+        auto self = weak_self.lock();
+        if (!self) {
+            return;
+        }
+        uint64_t expirations = 0;
+        while (read(self->timer_fd_, &expirations, sizeof(expirations)) > 0) {
+        }
+        self->onTick();
+    });
+    if (ret < 0) {
+        errorf("pacer add timerfd to event loop failed\n");
+        infra::close_socket(timer_fd_);
+        timer_fd_ = -1;
+        return false;
+    }
+#endif
+    return true;
+}
+
+void PacerScheduler::arm(bool on) {
+    if (armed_ == on) {
+        return;
+    }
+    armed_ = on;
+#if defined(__linux__)
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (on) {
+        spec.it_value.tv_sec = tick_us_ / 1000000;
+        spec.it_value.tv_nsec = (tick_us_ % 1000000) * 1000;
+        spec.it_interval = spec.it_value;
+    }
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+#else
+    if (!on) {
+        return;
+    }
+    std::weak_ptr<PacerScheduler> weak_self = shared_from_this();
+    timer_ = loop_->postDelayedTask([weak_self]() {
+        auto self = weak_self.lock();
+        if (self) {
+            self->timer_ = 0;
+            self->armed_ = false;
+            self->onTick();
+        }
+    }, (tick_us_ + 999) / 1000);
+#endif
+}
+
+void PacerScheduler::activate(const std::shared_ptr<Pacer> &pacer) {
+    active_.push_back(pacer);
+    arm(true);
+}
+
+void PacerScheduler::onTick() {
+    int64_t now_us = infra::getCurrentMicroseconds();
+    //处理中新激活的Pacer进入active_，下一个tick再处理
+    processing_.swap(active_);
+    for (auto &weak_pacer : processing_) {
+        auto pacer = weak_pacer.lock();
+        if (!pacer) {
+            continue;
+        }
+        if (pacer->process(now_us)) {
+            active_.push_back(std::move(weak_pacer));
+        } else {
+            pacer->active_ = false;
+        }
+    }
+    processing_.clear();
+    flush();
+#if defined(__linux__)
+    if (active_.empty()) {
+        arm(false);
+    }
+#else
+    if (!active_.empty()) {
+        arm(true);
+    }
+#endif
+}
+
+void PacerScheduler::send(int fd, const struct sockaddr_storage &addr, socklen_t addr_len, const infra::PacketBuffer::Ptr &packet) {
+    if (batch_count_ == SOCKET_MAX_BATCH || (batch_count_ > 0 && fd != batch_fd_)) {
+        flush();
+    }
+    batch_fd_ = fd;
+    infra::UdpPacket &udp = batch_[batch_count_];
+    udp.data = (char *)packet->data();
+    udp.capacity = packet->size();
+    udp.size = packet->size();
+    if (addr_len > 0) {
+        memcpy(&udp.addr, &addr, addr_len);
+    }
+    udp.addr_len = addr_len;
+    udp.truncated = false;
+    udp.segment_size = 0;
+    batch_refs_[batch_count_] = packet;
+    batch_count_++;
+}
+
+void PacerScheduler::flush() {
+    if (batch_count_ == 0) {
+        return;
+    }
+    int sent = infra::SocketUtil::sendBatch(batch_fd_, batch_, batch_count_);
+    if (sent < batch_count_) {
+        //发送缓冲满，和路由器队列满一样直接丢弃，由重传和拥塞控制处理
+        send_failed_ += batch_count_ - (sent > 0 ? sent : 0);
+    }
+    for (int32_t i = 0; i < batch_count_; i++) {
+        batch_refs_[i].reset();
+    }
+    batch_count_ = 0;
+}
+
+void Pacer::Queue::push(const infra::PacketBuffer::Ptr &packet, int64_t enqueue_us) {
+    if (count_ == items_.size()) {
+        //按顺序搬到新的环里
+        std::vector<Item> items(items_.empty() ? 16 : items_.size() * 2);
+        for (size_t i = 0; i < count_; i++) {
+            items[i] = std::move(items_[(head_ + i) % items_.size()]);
+        }
+        items_.swap(items);
+        head_ = 0;
+    }
+    Item &item = items_[(head_ + count_) % items_.size()];
+    item.packet = packet;
+    item.enqueue_us = enqueue_us;
+    count_++;
+}
+
+infra::PacketBuffer::Ptr Pacer::Queue::pop() {
+    infra::PacketBuffer::Ptr packet = std::move(items_[head_].packet);
+    head_ = (head_ + 1) % items_.size();
+    count_--;
+    return packet;
+}
+
+std::shared_ptr<Pacer> Pacer::create(const std::shared_ptr<PacerScheduler> &scheduler, int fd,
+                                     const struct sockaddr_storage &addr, socklen_t addr_len, const PacerOptions &options) {
+    if (!scheduler || fd < 0) {
+        return nullptr;
+    }
+    return std::shared_ptr<Pacer>(new Pacer(scheduler, fd, addr, addr_len, options));
+}
+
+Pacer::Pacer(const std::shared_ptr<PacerScheduler> &scheduler, int fd, const struct sockaddr_storage &addr, socklen_t addr_len,
+             const PacerOptions &options)
+    : scheduler_(scheduler), fd_(fd), addr_len_(addr_len), options_(options), queued_bytes_(0), active_(false),
+      bitrate_bps_(options.bitrate_bps), budget_bytes_(0), last_process_us_(0), probe_id_(0), next_probe_id_(1),
+      probe_bitrate_bps_(0), probe_end_us_(0) {
+    memset(&addr_, 0, sizeof(addr_));
+    if (addr_len_ > 0) {
+        memcpy(&addr_, &addr, addr_len_);
+    }
+}
+
+Pacer::~Pacer() {
+}
+
+void Pacer::setSendingCallback(const SendingCallback &callback) {
+    sending_callback_ = callback;
+}
+
+void Pacer::setPaddingCallback(const PaddingCallback &callback) {
+    padding_callback_ = callback;
+}
+
+void Pacer::setBitrate(int64_t bitrate_bps) {
+    bitrate_bps_ = bitrate_bps > 0 ? bitrate_bps : 0;
+}
+
+void Pacer::enqueue(PacketKind kind, const infra::PacketBuffer::Ptr &packet) {
+    if (kind < 0 || kind >= PACKET_KIND_COUNT || !packet) {
+        return;
+    }
+    int64_t now_us = infra::getCurrentMicroseconds();
+    Queue &queue = queues_[kind];
+    if (queue.size() >= options_.max_queue_packets) {
+        queued_bytes_ -= queue.pop()->size();
+        stats_.dropped++;
+    }
+    queue.push(packet, now_us);
+    queued_bytes_ += packet->size();
+    if (!active_) {
+        active_ = true;
+        scheduler_->activate(shared_from_this());
+    }
+}
+
+int32_t Pacer::probe(int64_t bitrate_bps, int64_t duration_ms) {
+    int64_t now_us = infra::getCurrentMicroseconds();
+    probe_id_ = next_probe_id_++;
+    if (next_probe_id_ <= 0) {
+        next_probe_id_ = 1;
+    }
+    probe_bitrate_bps_ = bitrate_bps;
+    probe_end_us_ = now_us + duration_ms * 1000;
+    if (!active_) {
+        active_ = true;
+        scheduler_->activate(shared_from_this());
+    }
+    return probe_id_;
+}
+
+size_t Pacer::queuedPackets() const {
+    size_t count = 0;
+    for (int i = 0; i < PACKET_KIND_COUNT; i++) {
+        count += queues_[i].size();
+    }
+    return count;
+}
+
+int64_t Pacer::queueDelayMs() const {
+    int64_t oldest_us = 0;
+    for (int i = 0; i < PACKET_KIND_COUNT; i++) {
+        if (!queues_[i].empty() && (oldest_us == 0 || queues_[i].frontTime() < oldest_us)) {
+            oldest_us = queues_[i].frontTime();
+        }
+    }
+    return oldest_us == 0 ? 0 : (infra::getCurrentMicroseconds() - oldest_us) / 1000;
+}
+
+int64_t Pacer::pacingRate() const {
+    int64_t rate = bitrate_bps_;
+    if (probe_id_ != 0 && probe_bitrate_bps_ > rate) {
+        rate = probe_bitrate_bps_;
+    }
+    //排队的数据按当前码率发不完时提高码率，保证在max_queue_ms内发完
+    if (options_.max_queue_ms > 0) {
+        int64_t drain_rate = (int64_t)queued_bytes_ * 8 * 1000 / options_.max_queue_ms;
+        if (drain_rate > rate) {
+            rate = drain_rate;
+        }
+    }
+    return rate;
+}
+
+void Pacer::sendPacket(infra::PacketBuffer::Ptr packet, PacketKind kind, int64_t now_us) {
+    if (sending_callback_) {
+        sending_callback_(packet, kind, now_us, probe_id_);
+        if (!packet) {
+            return;
+        }
+    }
+    size_t size = packet->size();
+    budget_bytes_ -= (double)size;
+    stats_.sent_packets++;
+    stats_.sent_bytes += size;
+    if (kind == PACKET_PADDING) {
+        stats_.padding_bytes += size;
+    }
+    scheduler_->send(fd_, addr_, addr_len_, packet);
+}
+
+bool Pacer::process(int64_t now_us) {
+    if (probe_id_ != 0 && now_us >= probe_end_us_) {
+        probe_id_ = 0;
+    }
+    int64_t rate = pacingRate();
+    int64_t elapsed_us = last_process_us_ == 0 ? 0 : now_us - last_process_us_;
+    last_process_us_ = now_us;
+    //空闲之后最多积累max_burst_ms的额度，避免一次发出大量突发，之前超发的部分在空闲期间偿还
+    double max_budget = (double)rate * options_.max_burst_ms / 8000.0;
+    budget_bytes_ += (double)rate * elapsed_us / 8000000.0;
+    if (budget_bytes_ > max_budget) {
+        budget_bytes_ = max_budget;
+    }
+    if (elapsed_us == 0 && budget_bytes_ <= 0) {
+        //第一次处理给一个tick的额度，保证第一个包不用等待
+        budget_bytes_ = (double)rate * scheduler_->tick_us_ / 8000000.0;
+    }
+
+    for (int kind = 0; kind < PACKET_KIND_COUNT; kind++) {
+        Queue &queue = queues_[kind];
+        bool paced = kind != PACKET_AUDIO || options_.pace_audio;
+        while (!queue.empty() && (!paced || budget_bytes_ > 0)) {
+            infra::PacketBuffer::Ptr packet = queue.pop();
+            queued_bytes_ -= packet->size();
+            sendPacket(std::move(packet), (PacketKind)kind, now_us);
+        }
+    }
+
+    //探测期间媒体包不够时用padding补足探测码率
+    if (probe_id_ != 0 && padding_callback_) {
+        for (int i = 0; i < PACER_MAX_PADDING_PACKETS && budget_bytes_ > 0; i++) {
+            size_t bytes = budget_bytes_ < PACER_MAX_PADDING_SIZE ? (size_t)budget_bytes_ + 1 : PACER_MAX_PADDING_SIZE;
+            infra::PacketBuffer::Ptr packet = padding_callback_(bytes);
+            if (!packet || packet->size() == 0) {
+                break;
+            }
+            //发送回调丢弃了包时额度不会减少，继续生成会一直循环
+            double budget = budget_bytes_;
+            sendPacket(std::move(packet), PACKET_PADDING, now_us);
+            if (budget_bytes_ >= budget) {
+                break;
+            }
+        }
+    }
+
+    return queued_bytes_ > 0 || probe_id_ != 0;
+}
+
+}
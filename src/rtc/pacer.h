@@ -0,0 +1,233 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "infra/thread_pool.h"
+#include "infra/socket_util.h"
+#include "infra/packet_buffer.h"
+
+namespace rtc {
+
+//按优先级从高到低
+enum PacketKind {
+    PACKET_AUDIO = 0,
+    PACKET_RETRANSMISSION,
+    PACKET_VIDEO,
+    PACKET_PADDING,
+    PACKET_KIND_COUNT
+};
+
+typedef struct PacerOptions_tag {
+    int64_t bitrate_bps = 1000000;   //初始的发送码率
+    int64_t max_burst_ms = 5;        //令牌桶最多积累的时间
+    int64_t max_queue_ms = 2000;     //队列里的包预计超过这个时间才能发完时提高发送码率
+    bool pace_audio = false;         //音频默认不受码率限制，只和其他包一起按tick批量发送
+    size_t max_queue_packets = 4096; //每个队列最多的包数，超过时丢弃最旧的
+} PacerOptions;
+
+struct PacerStats {
+    uint64_t sent_packets = 0;
+    uint64_t sent_bytes = 0;
+    uint64_t padding_bytes = 0;
+    uint64_t dropped = 0;            //队列满时丢弃的包数
+};
+
+class Pacer;
+
+/**
+ * 一个事件循环上所有Pacer共用的调度器
+ * 有包排队时用timerfd按tick周期唤醒，依次处理有数据的Pacer，空闲时停止定时器
+ * 同一个tick内发往同一个fd的包合并成一次sendmmsg
+ */
+class PacerScheduler : public std::enable_shared_from_this<PacerScheduler> {
+public:
+    PacerScheduler(const PacerScheduler&) = delete;
+
+    PacerScheduler(PacerScheduler&&) = delete;
+
+    /**
+     * @param loop 单线程的事件循环，所属Pacer的所有接口都必须在这个线程调用
+     * @param tick_us 发送周期，不支持timerfd的平台退化为TaskQueue的1ms定时
+     */
+    static std::shared_ptr<PacerScheduler> create(const std::shared_ptr<infra::ThreadPool> &loop, int64_t tick_us = 1000);
+
+    ~PacerScheduler();
+
+    std::shared_ptr<infra::ThreadPool> loop() const {
+        return loop_;
+    }
+
+    //sendmmsg没有发出去的包数，内核发送缓冲满时直接丢弃
+    uint64_t sendFailed() const {
+        return send_failed_;
+    }
+
+private:
+    friend class Pacer;
+
+    PacerScheduler(const std::shared_ptr<infra::ThreadPool> &loop, int64_t tick_us);
+
+    bool start();
+
+    void activate(const std::shared_ptr<Pacer> &pacer);
+
+    void arm(bool on);
+
+    void onTick();
+
+    void send(int fd, const struct sockaddr_storage &addr, socklen_t addr_len, const infra::PacketBuffer::Ptr &packet);
+
+    void flush();
+
+private:
+    std::shared_ptr<infra::ThreadPool> loop_;
+    int64_t tick_us_;
+    int timer_fd_;
+    bool armed_;
+    infra::TaskQueue::TaskId timer_;
+
+    std::vector<std::weak_ptr<Pacer>> active_;
+    std::vector<std::weak_ptr<Pacer>> processing_;
+
+    //当前批次，fd相同的包一起发送
+    int batch_fd_;
+    int32_t batch_count_;
+    infra::UdpPacket batch_[SOCKET_MAX_BATCH];
+    infra::PacketBuffer::Ptr batch_refs_[SOCKET_MAX_BATCH];
+    uint64_t send_failed_;
+};
+
+/**
+ * 每个传输一个的发送节奏控制
+ * 音频、重传、视频、padding各一个队列，按优先级在令牌桶的额度内发送，额度按经过的时间和目标码率累加
+ * 探测时在探测期间把发送码率提高到探测码率，媒体包不够时用padding补足
+ * 所有接口必须在scheduler的线程调用
+ */
+class Pacer : public std::enable_shared_from_this<Pacer> {
+public:
+    /**
+     * 包交给socket之前回调，可以在这里写入transport-wide序号、记录发送时间或者加密
+     * @param probe_id 探测期间发送的包为探测id，否则为0
+     */
+    typedef std::function<void(infra::PacketBuffer::Ptr &packet, PacketKind kind, int64_t send_us, int32_t probe_id)> SendingCallback;
+    //探测时没有足够的包可发，生成大约bytes字节的padding包，返回空表示不生成
+    typedef std::function<infra::PacketBuffer::Ptr(size_t bytes)> PaddingCallback;
+
+    Pacer(const Pacer&) = delete;
+
+    Pacer(Pacer&&) = delete;
+
+    /**
+     * @param fd 发送用的udp socket，可以和其他Pacer共用
+     * @param addr 对端地址，addr_len为0表示使用connect的地址
+     */
+    static std::shared_ptr<Pacer> create(const std::shared_ptr<PacerScheduler> &scheduler, int fd,
+                                         const struct sockaddr_storage &addr, socklen_t addr_len,
+                                         const PacerOptions &options = PacerOptions());
+
+    ~Pacer();
+
+    void setSendingCallback(const SendingCallback &callback);
+
+    void setPaddingCallback(const PaddingCallback &callback);
+
+    void enqueue(PacketKind kind, const infra::PacketBuffer::Ptr &packet);
+
+    void setBitrate(int64_t bitrate_bps);
+
+    int64_t bitrate() const {
+        return bitrate_bps_;
+    }
+
+    /**
+     * 在duration_ms内按bitrate_bps发送，用于带宽探测
+     * @return 探测id，用于在发送回调和反馈中区分探测包
+     */
+    int32_t probe(int64_t bitrate_bps, int64_t duration_ms);
+
+    bool probing() const {
+        return probe_id_ != 0;
+    }
+
+    size_t queuedPackets() const;
+
+    size_t queuedBytes() const {
+        return queued_bytes_;
+    }
+
+    //最早入队的包已经等待的时间
+    int64_t queueDelayMs() const;
+
+    const PacerStats &stats() const {
+        return stats_;
+    }
+
+private:
+    friend class PacerScheduler;
+
+    Pacer(const std::shared_ptr<PacerScheduler> &scheduler, int fd, const struct sockaddr_storage &addr, socklen_t addr_len,
+          const PacerOptions &options);
+
+    //按包数增长的环形队列，稳态下不分配内存
+    class Queue {
+    public:
+        bool empty() const {
+            return count_ == 0;
+        }
+
+        size_t size() const {
+            return count_;
+        }
+
+        void push(const infra::PacketBuffer::Ptr &packet, int64_t enqueue_us);
+
+        infra::PacketBuffer::Ptr pop();
+
+        int64_t frontTime() const {
+            return items_[head_].enqueue_us;
+        }
+
+    private:
+        struct Item {
+            infra::PacketBuffer::Ptr packet;
+            int64_t enqueue_us = 0;
+        };
+        std::vector<Item> items_;
+        size_t head_ = 0;
+        size_t count_ = 0;
+    };
+
+    int64_t pacingRate() const;
+
+    void sendPacket(infra::PacketBuffer::Ptr packet, PacketKind kind, int64_t now_us);
+
+    //处理一个tick，返回是否还有待发送的数据
+    bool process(int64_t now_us);
+
+private:
+    std::shared_ptr<PacerScheduler> scheduler_;
+    int fd_;
+    struct sockaddr_storage addr_;
+    socklen_t addr_len_;
+    PacerOptions options_;
+    SendingCallback sending_callback_;
+    PaddingCallback padding_callback_;
+
+    Queue queues_[PACKET_KIND_COUNT];
+    size_t queued_bytes_;
+    bool active_;
+
+    int64_t bitrate_bps_;
+    double budget_bytes_;            //令牌桶，可以为负，表示上一个包超出的部分
+    int64_t last_process_us_;
+
+    int32_t probe_id_;
+    int32_t next_probe_id_;
+    int64_t probe_bitrate_bps_;
+    int64_t probe_end_us_;
+
+    PacerStats stats_;
+};
+
+}
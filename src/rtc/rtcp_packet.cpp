@@ -0,0 +1,615 @@
+#include "rtcp_packet.h"
+#include <string.h>
+
+namespace rtc {
+
+size_t RtcpPacket::payloadSize() const {
+    size_t padding = (data_[0] & 0x20) ? data_[size_ - 1] : 0;
+    return size_ - RTCP_HEADER_SIZE - padding;
+}
+
+bool RtcpCompoundParser::next(RtcpPacket &packet) {
+    if (error_ || pos_ >= size_) {
+        return false;
+    }
+    const uint8_t *data = data_ + pos_;
+    size_t remain = size_ - pos_;
+    if (remain < RTCP_HEADER_SIZE || (data[0] >> 6) != 2) {
+        error_ = true;
+        return false;
+    }
+    size_t size = ((size_t)readBE16(data + 2) + 1) * 4;
+    if (size > remain) {
+        error_ = true;
+        return false;
+    }
+    if (data[0] & 0x20) {
+        uint8_t padding = data[size - 1];
+        if (padding == 0 || padding > size - RTCP_HEADER_SIZE) {
+            error_ = true;
+            return false;
+        }
+    }
+    packet = RtcpPacket(data, size);
+    pos_ += size;
+    return true;
+}
+
+void RtcpReportBlock::read(const uint8_t *data) {
+    ssrc = readBE32(data);
+    fraction_lost = data[4];
+    //24位有符号数扩展到32位
+    cumulative_lost = (int32_t)(readBE24(data + 5) << 8) >> 8;
+    extended_highest_seq = readBE32(data + 8);
+    jitter = readBE32(data + 12);
+    last_sr = readBE32(data + 16);
+    delay_since_last_sr = readBE32(data + 20);
+}
+
+void RtcpReportBlock::write(uint8_t *data) const {
+    writeBE32(data, ssrc);
+    data[4] = fraction_lost;
+    writeBE24(data + 5, (uint32_t)cumulative_lost & 0xffffff);
+    writeBE32(data + 8, extended_highest_seq);
+    writeBE32(data + 12, jitter);
+    writeBE32(data + 16, last_sr);
+    writeBE32(data + 20, delay_since_last_sr);
+}
+
+bool RtcpSenderReport::parse(const RtcpPacket &packet) {
+    if (packet.type() != RTCP_SR) {
+        return false;
+    }
+    int count = packet.count();
+    if (packet.payloadSize() < 24 + count * RtcpReportBlock::kSize) {
+        return false;
+    }
+    const uint8_t *p = packet.payload();
+    info_.ssrc = readBE32(p);
+    info_.ntp_seconds = readBE32(p + 4);
+    info_.ntp_fraction = readBE32(p + 8);
+    info_.rtp_timestamp = readBE32(p + 12);
+    info_.packet_count = readBE32(p + 16);
+    info_.octet_count = readBE32(p + 20);
+    blocks_ = p + 24;
+    report_count_ = count;
+    return true;
+}
+
+RtcpReportBlock RtcpSenderReport::reportBlock(int index) const {
+    RtcpReportBlock block;
+    block.read(blocks_ + index * RtcpReportBlock::kSize);
+    return block;
+}
+
+bool RtcpReceiverReport::parse(const RtcpPacket &packet) {
+    if (packet.type() != RTCP_RR) {
+        return false;
+    }
+    int count = packet.count();
+    if (packet.payloadSize() < 4 + count * RtcpReportBlock::kSize) {
+        return false;
+    }
+    ssrc_ = readBE32(packet.payload());
+    blocks_ = packet.payload() + 4;
+    report_count_ = count;
+    return true;
+}
+
+RtcpReportBlock RtcpReceiverReport::reportBlock(int index) const {
+    RtcpReportBlock block;
+    block.read(blocks_ + index * RtcpReportBlock::kSize);
+    return block;
+}
+
+bool RtcpSdes::parse(const RtcpPacket &packet) {
+    if (packet.type() != RTCP_SDES) {
+        return false;
+    }
+    data_ = packet.payload();
+    size_ = packet.payloadSize();
+    pos_ = 0;
+    chunks_ = packet.count();
+    in_chunk_ = false;
+    return true;
+}
+
+bool RtcpSdes::nextItem(uint32_t &ssrc, uint8_t &type, const char *&text, size_t &size) {
+    while (true) {
+        if (!in_chunk_) {
+            if (chunks_ == 0 || pos_ + 4 > size_) {
+                return false;
+            }
+            ssrc_ = readBE32(data_ + pos_);
+            pos_ += 4;
+            chunks_--;
+            in_chunk_ = true;
+        }
+        if (pos_ >= size_) {
+            return false;
+        }
+        if (data_[pos_] == RTCP_SDES_END) {
+            //chunk以END结束，之后填充到4字节对齐
+            pos_ = (pos_ + 4) & ~(size_t)3;
+            in_chunk_ = false;
+            continue;
+        }
+        if (pos_ + 2 > size_ || pos_ + 2 + data_[pos_ + 1] > size_) {
+            return false;
+        }
+        ssrc = ssrc_;
+        type = data_[pos_];
+        size = data_[pos_ + 1];
+        text = (const char *)data_ + pos_ + 2;
+        pos_ += 2 + size;
+        return true;
+    }
+}
+
+bool RtcpBye::parse(const RtcpPacket &packet) {
+    if (packet.type() != RTCP_BYE) {
+        return false;
+    }
+    size_t size = packet.payloadSize();
+    int count = packet.count();
+    if (size < (size_t)count * 4) {
+        return false;
+    }
+    data_ = packet.payload();
+    ssrc_count_ = count;
+    reason_ = nullptr;
+    reason_size_ = 0;
+    size_t pos = count * 4;
+    if (pos < size) {
+        size_t length = data_[pos];
+        if (pos + 1 + length > size) {
+            return false;
+        }
+        reason_ = (const char *)data_ + pos + 1;
+        reason_size_ = length;
+    }
+    return true;
+}
+
+bool RtcpFeedback::parse(const RtcpPacket &packet) {
+    if ((packet.type() != RTCP_RTPFB && packet.type() != RTCP_PSFB) || packet.payloadSize() < 8) {
+        return false;
+    }
+    fmt_ = packet.count();
+    sender_ssrc_ = readBE32(packet.payload());
+    media_ssrc_ = readBE32(packet.payload() + 4);
+    fci_ = packet.payload() + 8;
+    fci_size_ = packet.payloadSize() - 8;
+    return true;
+}
+
+bool RtcpNack::parse(const RtcpPacket &packet) {
+    return packet.type() == RTCP_RTPFB && packet.count() == RTCP_RTPFB_NACK && RtcpFeedback::parse(packet);
+}
+
+size_t RtcpNack::lostPackets(uint16_t *out, size_t max) const {
+    size_t count = 0;
+    for (int i = 0; i < itemCount() && count < max; i++) {
+        uint16_t pid, blp;
+        item(i, pid, blp);
+        out[count++] = pid;
+        for (int bit = 0; bit < 16 && count < max; bit++) {
+            if (blp & (1 << bit)) {
+                out[count++] = (uint16_t)(pid + bit + 1);
+            }
+        }
+    }
+    return count;
+}
+
+bool RtcpPli::parse(const RtcpPacket &packet) {
+    return packet.type() == RTCP_PSFB && packet.count() == RTCP_PSFB_PLI && RtcpFeedback::parse(packet);
+}
+
+bool RtcpFir::parse(const RtcpPacket &packet) {
+    return packet.type() == RTCP_PSFB && packet.count() == RTCP_PSFB_FIR && RtcpFeedback::parse(packet);
+}
+
+bool RtcpRemb::parse(const RtcpPacket &packet) {
+    if (packet.type() != RTCP_PSFB || packet.count() != RTCP_PSFB_AFB || !RtcpFeedback::parse(packet)) {
+        return false;
+    }
+    if (fci_size_ < 8 || memcmp(fci_, "REMB", 4) != 0) {
+        return false;
+    }
+    int count = fci_[4];
+    if (fci_size_ < 8 + (size_t)count * 4) {
+        return false;
+    }
+    uint8_t exp = fci_[5] >> 2;
+    uint32_t mantissa = ((uint32_t)(fci_[5] & 0x03) << 16) | readBE16(fci_ + 6);
+    bitrate_ = (uint64_t)mantissa << exp;
+    ssrc_count_ = count;
+    return true;
+}
+
+//状态块的三种格式
+static inline uint16_t chunk_length(uint16_t chunk) {
+    if (!(chunk & 0x8000)) {
+        return chunk & 0x1fff;      //行程编码
+    }
+    return (chunk & 0x4000) ? 7 : 14;  //2位或1位状态向量
+}
+
+static inline uint8_t chunk_status(uint16_t chunk, uint16_t index) {
+    if (!(chunk & 0x8000)) {
+        return (chunk >> 13) & 0x03;
+    }
+    if (!(chunk & 0x4000)) {
+        return (chunk >> (13 - index)) & 0x01;
+    }
+    return (chunk >> (12 - 2 * index)) & 0x03;
+}
+
+static inline size_t delta_size(uint8_t status) {
+    return status == 1 ? 1 : (status == 2 ? 2 : 0);
+}
+
+bool RtcpTransportFeedback::parse(const RtcpPacket &packet) {
+    if (packet.type() != RTCP_RTPFB || packet.count() != RTCP_RTPFB_TRANSPORT_CC || !RtcpFeedback::parse(packet)) {
+        return false;
+    }
+    if (fci_size_ < 8) {
+        return false;
+    }
+    base_seq_ = readBE16(fci_);
+    status_count_ = readBE16(fci_ + 2);
+    reference_time_ = (int32_t)(readBE24(fci_ + 4) << 8) >> 8;
+    fb_count_ = fci_[7];
+
+    //扫描状态块，计算delta的起始位置和总长度
+    size_t pos = 8;
+    size_t deltas = 0;
+    uint32_t remain = status_count_;
+    while (remain > 0) {
+        if (pos + 2 > fci_size_) {
+            return false;
+        }
+        uint16_t chunk = readBE16(fci_ + pos);
+        uint32_t length = chunk_length(chunk);
+        if (length > remain) {
+            length = remain;
+        }
+        if (!(chunk & 0x8000)) {
+            uint8_t status = chunk_status(chunk, 0);
+            if (status == 3) {
+                return false;
+            }
+            deltas += delta_size(status) * length;
+        } else {
+            for (uint16_t i = 0; i < length; i++) {
+                uint8_t status = chunk_status(chunk, i);
+                if (status == 3) {
+                    return false;
+                }
+                deltas += delta_size(status);
+            }
+        }
+        remain -= length;
+        pos += 2;
+    }
+    if (pos + deltas > fci_size_) {
+        return false;
+    }
+    deltas_offset_ = pos;
+    deltas_end_ = pos + deltas;
+    rewind();
+    return true;
+}
+
+void RtcpTransportFeedback::rewind() {
+    index_ = 0;
+    chunk_pos_ = 8;
+    chunk_index_ = 0;
+    chunk_length_ = 0;
+    delta_pos_ = deltas_offset_;
+}
+
+uint8_t RtcpTransportFeedback::statusAt(size_t chunk_pos, uint16_t index_in_chunk) const {
+    return chunk_status(readBE16(fci_ + chunk_pos), index_in_chunk);
+}
+
+bool RtcpTransportFeedback::nextPacket(uint16_t &seq, TransportFeedbackStatus &status) {
+    if (index_ >= status_count_) {
+        return false;
+    }
+    if (index_ == 0) {
+        chunk_length_ = chunk_length(readBE16(fci_ + chunk_pos_));
+    }
+    //长度为0的行程块直接跳过，parse已保证块足够覆盖status_count_
+    while (chunk_index_ >= chunk_length_) {
+        chunk_pos_ += 2;
+        chunk_index_ = 0;
+        chunk_length_ = chunk_length(readBE16(fci_ + chunk_pos_));
+    }
+    uint8_t symbol = statusAt(chunk_pos_, chunk_index_++);
+    seq = (uint16_t)(base_seq_ + index_++);
+    status.received = symbol != 0;
+    status.delta = 0;
+    if (symbol == 1) {
+        status.delta = fci_[delta_pos_];
+        delta_pos_ += 1;
+    } else if (symbol == 2) {
+        status.delta = (int16_t)readBE16(fci_ + delta_pos_);
+        delta_pos_ += 2;
+    }
+    return true;
+}
+
+uint8_t *RtcpWriter::begin(uint8_t count, uint8_t type, size_t size) {
+    if (size_ + size > capacity_) {
+        return nullptr;
+    }
+    uint8_t *p = buffer_ + size_;
+    p[0] = (uint8_t)(0x80 | (count & 0x1f));
+    p[1] = type;
+    writeBE16(p + 2, (uint16_t)(size / 4 - 1));
+    size_ += size;
+    return p;
+}
+
+bool RtcpWriter::addSenderReport(const RtcpSenderInfo &info, const RtcpReportBlock *blocks, int count) {
+    if (count > 31) {
+        return false;
+    }
+    uint8_t *p = begin((uint8_t)count, RTCP_SR, 28 + count * RtcpReportBlock::kSize);
+    if (!p) {
+        return false;
+    }
+    writeBE32(p + 4, info.ssrc);
+    writeBE32(p + 8, info.ntp_seconds);
+    writeBE32(p + 12, info.ntp_fraction);
+    writeBE32(p + 16, info.rtp_timestamp);
+    writeBE32(p + 20, info.packet_count);
+    writeBE32(p + 24, info.octet_count);
+    for (int i = 0; i < count; i++) {
+        blocks[i].write(p + 28 + i * RtcpReportBlock::kSize);
+    }
+    return true;
+}
+
+bool RtcpWriter::addReceiverReport(uint32_t ssrc, const RtcpReportBlock *blocks, int count) {
+    if (count > 31) {
+        return false;
+    }
+    uint8_t *p = begin((uint8_t)count, RTCP_RR, 8 + count * RtcpReportBlock::kSize);
+    if (!p) {
+        return false;
+    }
+    writeBE32(p + 4, ssrc);
+    for (int i = 0; i < count; i++) {
+        blocks[i].write(p + 8 + i * RtcpReportBlock::kSize);
+    }
+    return true;
+}
+
+bool RtcpWriter::addSdesCname(uint32_t ssrc, const char *cname, size_t size) {
+    if (size > 255) {
+        return false;
+    }
+    //ssrc + 类型和长度 + 文本 + 至少一个END，填充到4字节
+    size_t chunk = (4 + 2 + size + 1 + 3) & ~(size_t)3;
+    uint8_t *p = begin(1, RTCP_SDES, 4 + chunk);
+    if (!p) {
+        return false;
+    }
+    memset(p + 4, 0, chunk);
+    writeBE32(p + 4, ssrc);
+    p[8] = RTCP_SDES_CNAME;
+    p[9] = (uint8_t)size;
+    memcpy(p + 10, cname, size);
+    return true;
+}
+
+bool RtcpWriter::addBye(const uint32_t *ssrcs, int count, const char *reason, size_t reason_size) {
+    if (count > 31 || reason_size > 255) {
+        return false;
+    }
+    size_t reason_bytes = reason_size > 0 ? ((1 + reason_size + 3) & ~(size_t)3) : 0;
+    uint8_t *p = begin((uint8_t)count, RTCP_BYE, 4 + count * 4 + reason_bytes);
+    if (!p) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        writeBE32(p + 4 + i * 4, ssrcs[i]);
+    }
+    if (reason_bytes > 0) {
+        uint8_t *r = p + 4 + count * 4;
+        memset(r, 0, reason_bytes);
+        r[0] = (uint8_t)reason_size;
+        memcpy(r + 1, reason, reason_size);
+    }
+    return true;
+}
+
+bool RtcpWriter::addNack(uint32_t sender_ssrc, uint32_t media_ssrc, const uint16_t *lost, size_t count) {
+    if (count == 0) {
+        return false;
+    }
+    //先计算条目数
+    size_t items = 0;
+    for (size_t i = 0; i < count;) {
+        uint16_t pid = lost[i++];
+        while (i < count && (uint16_t)(lost[i] - pid) >= 1 && (uint16_t)(lost[i] - pid) <= 16) {
+            i++;
+        }
+        items++;
+    }
+    uint8_t *p = begin(RTCP_RTPFB_NACK, RTCP_RTPFB, 12 + items * 4);
+    if (!p) {
+        return false;
+    }
+    writeBE32(p + 4, sender_ssrc);
+    writeBE32(p + 8, media_ssrc);
+    uint8_t *item = p + 12;
+    for (size_t i = 0; i < count;) {
+        uint16_t pid = lost[i++];
+        uint16_t blp = 0;
+        while (i < count && (uint16_t)(lost[i] - pid) >= 1 && (uint16_t)(lost[i] - pid) <= 16) {
+            blp |= (uint16_t)(1 << ((uint16_t)(lost[i] - pid) - 1));
+            i++;
+        }
+        writeBE16(item, pid);
+        writeBE16(item + 2, blp);
+        item += 4;
+    }
+    return true;
+}
+
+bool RtcpWriter::addPli(uint32_t sender_ssrc, uint32_t media_ssrc) {
+    uint8_t *p = begin(RTCP_PSFB_PLI, RTCP_PSFB, 12);
+    if (!p) {
+        return false;
+    }
+    writeBE32(p + 4, sender_ssrc);
+    writeBE32(p + 8, media_ssrc);
+    return true;
+}
+
+bool RtcpWriter::addFir(uint32_t sender_ssrc, uint32_t media_ssrc, uint8_t seq) {
+    uint8_t *p = begin(RTCP_PSFB_FIR, RTCP_PSFB, 20);
+    if (!p) {
+        return false;
+    }
+    //RFC 5104要求公共头中的media ssrc为0，目标ssrc放在FCI中
+    writeBE32(p + 4, sender_ssrc);
+    writeBE32(p + 8, 0);
+    writeBE32(p + 12, media_ssrc);
+    p[16] = seq;
+    p[17] = p[18] = p[19] = 0;
+    return true;
+}
+
+bool RtcpWriter::addRemb(uint32_t sender_ssrc, uint64_t bitrate, const uint32_t *ssrcs, int count) {
+    if (count > 255) {
+        return false;
+    }
+    uint8_t *p = begin(RTCP_PSFB_AFB, RTCP_PSFB, 20 + count * 4);
+    if (!p) {
+        return false;
+    }
+    uint8_t exp = 0;
+    while (bitrate > 0x3ffff && exp < 63) {
+        bitrate >>= 1;
+        exp++;
+    }
+    writeBE32(p + 4, sender_ssrc);
+    writeBE32(p + 8, 0);
+    memcpy(p + 12, "REMB", 4);
+    p[16] = (uint8_t)count;
+    p[17] = (uint8_t)((exp << 2) | ((bitrate >> 16) & 0x03));
+    writeBE16(p + 18, (uint16_t)bitrate);
+    for (int i = 0; i < count; i++) {
+        writeBE32(p + 20 + i * 4, ssrcs[i]);
+    }
+    return true;
+}
+
+static inline uint8_t status_symbol(const TransportFeedbackStatus &status) {
+    if (!status.received) {
+        return 0;
+    }
+    return (status.delta >= 0 && status.delta <= 0xff) ? 1 : 2;
+}
+
+bool RtcpWriter::addTransportFeedback(uint32_t sender_ssrc, uint32_t media_ssrc, uint16_t base_seq, int32_t reference_time,
+                                      uint8_t fb_count, const TransportFeedbackStatus *statuses, size_t count) {
+    if (count == 0 || count > 0xffff) {
+        return false;
+    }
+    //先写到缓冲的剩余空间，最后再补公共头和长度
+    size_t start = size_;
+    size_t limit = capacity_;
+    if (start + 20 > limit) {
+        return false;
+    }
+    uint8_t *p = buffer_ + start;
+    size_t pos = 20;
+    size_t deltas = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t symbol = status_symbol(statuses[i]);
+        if (symbol == 2 && (statuses[i].delta < -32768 || statuses[i].delta > 32767)) {
+            return false;
+        }
+        deltas += delta_size(symbol);
+    }
+
+    //状态块：长的行程用行程编码，只有0和1时用1位向量，否则用2位向量
+    size_t i = 0;
+    while (i < count) {
+        if (start + pos + 2 > limit) {
+            return false;
+        }
+        uint8_t symbol = status_symbol(statuses[i]);
+        size_t run = 1;
+        while (i + run < count && run < 0x1fff && status_symbol(statuses[i + run]) == symbol) {
+            run++;
+        }
+        uint16_t chunk;
+        if (run >= 14 || i + run == count) {
+            chunk = (uint16_t)((symbol << 13) | run);
+            i += run;
+        } else {
+            bool one_bit = true;
+            for (size_t j = i; j < i + 14 && j < count; j++) {
+                if (status_symbol(statuses[j]) > 1) {
+                    one_bit = false;
+                    break;
+                }
+            }
+            if (one_bit) {
+                chunk = 0x8000;
+                for (size_t j = 0; j < 14 && i < count; j++, i++) {
+                    chunk |= (uint16_t)(status_symbol(statuses[i]) << (13 - j));
+                }
+            } else {
+                chunk = 0xc000;
+                for (size_t j = 0; j < 7 && i < count; j++, i++) {
+                    chunk |= (uint16_t)(status_symbol(statuses[i]) << (12 - 2 * j));
+                }
+            }
+        }
+        writeBE16(p + pos, chunk);
+        pos += 2;
+    }
+
+    size_t total = pos + deltas;
+    size_t padded = (total + 3) & ~(size_t)3;
+    if (start + padded > limit) {
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        uint8_t symbol = status_symbol(statuses[i]);
+        if (symbol == 1) {
+            p[pos++] = (uint8_t)statuses[i].delta;
+        } else if (symbol == 2) {
+            writeBE16(p + pos, (uint16_t)(int16_t)statuses[i].delta);
+            pos += 2;
+        }
+    }
+    //长度不是4的倍数时用padding补齐，最后一个字节是padding长度
+    size_t padding = padded - total;
+    if (padding > 0) {
+        memset(p + pos, 0, padding);
+        p[padded - 1] = (uint8_t)padding;
+    }
+
+    begin(RTCP_RTPFB_TRANSPORT_CC, RTCP_RTPFB, padded);
+    if (padding > 0) {
+        p[0] |= 0x20;
+    }
+    writeBE32(p + 4, sender_ssrc);
+    writeBE32(p + 8, media_ssrc);
+    writeBE16(p + 12, base_seq);
+    writeBE16(p + 14, (uint16_t)count);
+    writeBE24(p + 16, (uint32_t)reference_time & 0xffffff);
+    p[19] = fb_count;
+    return true;
+}
+
+}
@@ -0,0 +1,397 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "byte_io.h"
+
+namespace rtc {
+
+#define RTCP_HEADER_SIZE 4
+
+enum RtcpPacketType {
+    RTCP_SR = 200,
+    RTCP_RR = 201,
+    RTCP_SDES = 202,
+    RTCP_BYE = 203,
+    RTCP_APP = 204,
+    RTCP_RTPFB = 205,
+    RTCP_PSFB = 206,
+    RTCP_XR = 207,
+};
+
+//RTPFB的fmt
+enum RtcpRtpfbType {
+    RTCP_RTPFB_NACK = 1,
+    RTCP_RTPFB_TRANSPORT_CC = 15,
+};
+
+//PSFB的fmt
+enum RtcpPsfbType {
+    RTCP_PSFB_PLI = 1,
+    RTCP_PSFB_FIR = 4,
+    RTCP_PSFB_AFB = 15,  //REMB
+};
+
+enum RtcpSdesType {
+    RTCP_SDES_END = 0,
+    RTCP_SDES_CNAME = 1,
+};
+
+/**
+ * 复合包中的一个RTCP包，指向原始缓冲
+ */
+class RtcpPacket {
+public:
+    RtcpPacket() : data_(nullptr), size_(0) {}
+
+    RtcpPacket(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+    const uint8_t *data() const {
+        return data_;
+    }
+
+    //包括4字节公共头
+    size_t size() const {
+        return size_;
+    }
+
+    uint8_t type() const {
+        return data_[1];
+    }
+
+    //SR/RR/SDES/BYE中是条目数，反馈包中是fmt
+    uint8_t count() const {
+        return data_[0] & 0x1f;
+    }
+
+    const uint8_t *payload() const {
+        return data_ + RTCP_HEADER_SIZE;
+    }
+
+    //去掉公共头和padding
+    size_t payloadSize() const;
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
+
+/**
+ * 遍历复合包，只校验公共头的版本和长度
+ */
+class RtcpCompoundParser {
+public:
+    RtcpCompoundParser(const uint8_t *data, size_t size) : data_(data), size_(size), pos_(0), error_(false) {}
+
+    bool next(RtcpPacket &packet);
+
+    //遍历是否因为格式错误而结束
+    bool error() const {
+        return error_;
+    }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+    size_t pos_;
+    bool error_;
+};
+
+struct RtcpReportBlock {
+    uint32_t ssrc = 0;
+    uint8_t fraction_lost = 0;
+    int32_t cumulative_lost = 0;    //24位有符号
+    uint32_t extended_highest_seq = 0;
+    uint32_t jitter = 0;
+    uint32_t last_sr = 0;           //收到的最后一个SR中ntp时间的中间32位
+    uint32_t delay_since_last_sr = 0;  //单位1/65536秒
+
+    static const size_t kSize = 24;
+
+    void read(const uint8_t *data);
+    void write(uint8_t *data) const;
+};
+
+struct RtcpSenderInfo {
+    uint32_t ssrc = 0;
+    uint32_t ntp_seconds = 0;
+    uint32_t ntp_fraction = 0;
+    uint32_t rtp_timestamp = 0;
+    uint32_t packet_count = 0;
+    uint32_t octet_count = 0;
+};
+
+/**
+ * 以下各类型的视图都在parse时校验长度，之后的访问不再检查
+ */
+class RtcpSenderReport {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    const RtcpSenderInfo &senderInfo() const {
+        return info_;
+    }
+
+    int reportCount() const {
+        return report_count_;
+    }
+
+    RtcpReportBlock reportBlock(int index) const;
+
+private:
+    RtcpSenderInfo info_;
+    const uint8_t *blocks_ = nullptr;
+    int report_count_ = 0;
+};
+
+class RtcpReceiverReport {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    uint32_t ssrc() const {
+        return ssrc_;
+    }
+
+    int reportCount() const {
+        return report_count_;
+    }
+
+    RtcpReportBlock reportBlock(int index) const;
+
+private:
+    uint32_t ssrc_ = 0;
+    const uint8_t *blocks_ = nullptr;
+    int report_count_ = 0;
+};
+
+class RtcpSdes {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    //依次返回每个chunk中的条目
+    bool nextItem(uint32_t &ssrc, uint8_t &type, const char *&text, size_t &size);
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+    int chunks_ = 0;       //还未开始的chunk数
+    bool in_chunk_ = false;
+    uint32_t ssrc_ = 0;
+};
+
+class RtcpBye {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    int ssrcCount() const {
+        return ssrc_count_;
+    }
+
+    uint32_t ssrc(int index) const {
+        return readBE32(data_ + index * 4);
+    }
+
+    //没有原因时size为0
+    const char *reason(size_t &size) const {
+        size = reason_size_;
+        return reason_;
+    }
+
+private:
+    const uint8_t *data_ = nullptr;
+    int ssrc_count_ = 0;
+    const char *reason_ = nullptr;
+    size_t reason_size_ = 0;
+};
+
+/**
+ * 反馈包(RTPFB/PSFB)的公共部分
+ */
+class RtcpFeedback {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    uint8_t fmt() const {
+        return fmt_;
+    }
+
+    uint32_t senderSsrc() const {
+        return sender_ssrc_;
+    }
+
+    uint32_t mediaSsrc() const {
+        return media_ssrc_;
+    }
+
+protected:
+    uint8_t fmt_ = 0;
+    uint32_t sender_ssrc_ = 0;
+    uint32_t media_ssrc_ = 0;
+    const uint8_t *fci_ = nullptr;   //反馈控制信息
+    size_t fci_size_ = 0;
+};
+
+class RtcpNack : public RtcpFeedback {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    int itemCount() const {
+        return (int)(fci_size_ / 4);
+    }
+
+    //pid和后面16个包的丢失掩码
+    void item(int index, uint16_t &pid, uint16_t &blp) const {
+        pid = readBE16(fci_ + index * 4);
+        blp = readBE16(fci_ + index * 4 + 2);
+    }
+
+    //展开所有丢失的序号，返回写入out的个数
+    size_t lostPackets(uint16_t *out, size_t max) const;
+};
+
+class RtcpPli : public RtcpFeedback {
+public:
+    bool parse(const RtcpPacket &packet);
+};
+
+class RtcpFir : public RtcpFeedback {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    int entryCount() const {
+        return (int)(fci_size_ / 8);
+    }
+
+    void entry(int index, uint32_t &ssrc, uint8_t &seq) const {
+        ssrc = readBE32(fci_ + index * 8);
+        seq = fci_[index * 8 + 4];
+    }
+};
+
+class RtcpRemb : public RtcpFeedback {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    uint64_t bitrate() const {
+        return bitrate_;
+    }
+
+    int ssrcCount() const {
+        return ssrc_count_;
+    }
+
+    uint32_t ssrc(int index) const {
+        return readBE32(fci_ + 8 + index * 4);
+    }
+
+private:
+    uint64_t bitrate_ = 0;
+    int ssrc_count_ = 0;
+};
+
+//transport-cc中一个包的状态，delta单位250us
+struct TransportFeedbackStatus {
+    bool received = false;
+    int32_t delta = 0;
+};
+
+/**
+ * transport-cc反馈(draft-holmer-rmcat-transport-wide-cc-extensions)
+ * parse时扫描一遍状态块确定delta的位置，nextPacket按序号依次解码，不分配内存
+ */
+class RtcpTransportFeedback : public RtcpFeedback {
+public:
+    bool parse(const RtcpPacket &packet);
+
+    uint16_t baseSequence() const {
+        return base_seq_;
+    }
+
+    uint16_t statusCount() const {
+        return status_count_;
+    }
+
+    //单位64ms，24位有符号
+    int32_t referenceTime() const {
+        return reference_time_;
+    }
+
+    uint8_t feedbackCount() const {
+        return fb_count_;
+    }
+
+    //从头开始重新遍历
+    void rewind();
+
+    bool nextPacket(uint16_t &seq, TransportFeedbackStatus &status);
+
+private:
+    //解码第index个状态，0未收到，1小delta，2大delta
+    uint8_t statusAt(size_t chunk_pos, uint16_t index_in_chunk) const;
+
+private:
+    uint16_t base_seq_ = 0;
+    uint16_t status_count_ = 0;
+    int32_t reference_time_ = 0;
+    uint8_t fb_count_ = 0;
+    size_t deltas_offset_ = 0;   //delta数据相对fci_的偏移
+    size_t deltas_end_ = 0;
+
+    //遍历状态
+    uint16_t index_ = 0;
+    size_t chunk_pos_ = 0;
+    uint16_t chunk_index_ = 0;
+    uint16_t chunk_length_ = 0;
+    size_t delta_pos_ = 0;
+};
+
+/**
+ * 在调用者提供的缓冲中依次写入RTCP包组成复合包，空间不足时返回false且不写入
+ */
+class RtcpWriter {
+public:
+    RtcpWriter(uint8_t *buffer, size_t capacity) : buffer_(buffer), capacity_(capacity), size_(0) {}
+
+    size_t size() const {
+        return size_;
+    }
+
+    void reset() {
+        size_ = 0;
+    }
+
+    bool addSenderReport(const RtcpSenderInfo &info, const RtcpReportBlock *blocks, int count);
+
+    bool addReceiverReport(uint32_t ssrc, const RtcpReportBlock *blocks, int count);
+
+    bool addSdesCname(uint32_t ssrc, const char *cname, size_t size);
+
+    bool addBye(const uint32_t *ssrcs, int count, const char *reason = nullptr, size_t reason_size = 0);
+
+    //lost按序号递增排列，连续16个以内的序号合并为一个条目
+    bool addNack(uint32_t sender_ssrc, uint32_t media_ssrc, const uint16_t *lost, size_t count);
+
+    bool addPli(uint32_t sender_ssrc, uint32_t media_ssrc);
+
+    bool addFir(uint32_t sender_ssrc, uint32_t media_ssrc, uint8_t seq);
+
+    bool addRemb(uint32_t sender_ssrc, uint64_t bitrate, const uint32_t *ssrcs, int count);
+
+    /**
+     * @param statuses 从base_seq开始连续序号的状态
+     * @param reference_time 单位64ms
+     */
+    bool addTransportFeedback(uint32_t sender_ssrc, uint32_t media_ssrc, uint16_t base_seq, int32_t reference_time,
+                              uint8_t fb_count, const TransportFeedbackStatus *statuses, size_t count);
+
+private:
+    //写公共头并返回包的起始位置，size必须是4的倍数
+    uint8_t *begin(uint8_t count, uint8_t type, size_t size);
+
+private:
+    uint8_t *buffer_;
+    size_t capacity_;
+    size_t size_;
+};
+
+}
@@ -0,0 +1,85 @@
+#include "rtp_forwarder.h"
+#include <string.h>
+
+namespace rtc {
+
+RtpForwarder::RtpForwarder(uint32_t ssrc, uint32_t clock_rate, bool video)
+    : ssrc_(ssrc), clock_rate_(clock_rate), video_(video), started_(false), target_spatial_(0), current_spatial_(-1),
+      target_temporal_(0xff), current_temporal_(0xff), seq_offset_(0), ts_offset_(0), last_in_seq_(0), last_out_seq_(0),
+      last_out_ts_(0), last_out_ms_(0), forwarded_(0), dropped_(0) {
+}
+
+void RtpForwarder::setTargetLayers(int spatial, int temporal) {
+    target_spatial_ = spatial < 0 ? 0 : spatial;
+    target_temporal_ = temporal < 0 ? 0 : temporal;
+}
+
+void RtpForwarder::switchTo(int spatial, const RtpPacket &packet, int64_t now_ms) {
+    uint16_t seq = packet.sequenceNumber();
+    uint32_t timestamp = packet.timestamp();
+    if (!started_) {
+        //第一个包直接沿用发布者的序号和时间戳
+        seq_offset_ = 0;
+        ts_offset_ = 0;
+        started_ = true;
+    } else {
+        //接在上一个输出包之后，时间戳按经过的墙上时间推进
+        int64_t elapsed = now_ms - last_out_ms_;
+        uint32_t step = elapsed > 0 ? (uint32_t)(elapsed * clock_rate_ / 1000) : 0;
+        if (step == 0) {
+            step = 1;
+        }
+        seq_offset_ = (uint16_t)(seq - (uint16_t)(last_out_seq_ + 1));
+        ts_offset_ = timestamp - (last_out_ts_ + step);
+    }
+    last_in_seq_ = (uint16_t)(seq - 1);
+    current_spatial_ = spatial;
+    current_temporal_ = target_temporal_;
+}
+
+bool RtpForwarder::process(const RtpPacket &packet, int spatial, const RtpPacketInfo &info, int64_t now_ms, uint8_t *header) {
+    if (spatial != current_spatial_) {
+        //音频只有一个流，视频只在目标层的关键帧切换
+        if (spatial != target_spatial_ || (video_ && !info.keyframe)) {
+            return false;
+        }
+        switchTo(spatial, packet, now_ms);
+    }
+
+    uint16_t seq = packet.sequenceNumber();
+    bool newest = isNewerSequence(seq, last_in_seq_);
+    if (video_) {
+        if (current_temporal_ > target_temporal_) {
+            current_temporal_ = target_temporal_;
+        } else if (current_temporal_ < target_temporal_ && info.layer_sync && info.temporal_id <= target_temporal_) {
+            current_temporal_ = target_temporal_;
+        }
+        if (info.temporal_id > current_temporal_) {
+            //跳过的序号从输出中去掉，乱序到达的旧包不再调整
+            if (newest) {
+                seq_offset_++;
+                last_in_seq_ = seq;
+            }
+            dropped_++;
+            return false;
+        }
+    }
+
+    uint16_t out_seq = (uint16_t)(seq - seq_offset_);
+    uint32_t out_ts = packet.timestamp() - ts_offset_;
+    if (newest) {
+        last_in_seq_ = seq;
+        last_out_seq_ = out_seq;
+        last_out_ts_ = out_ts;
+        last_out_ms_ = now_ms;
+    }
+
+    memcpy(header, packet.data(), packet.headerSize());
+    writeBE16(header + 2, out_seq);
+    writeBE32(header + 4, out_ts);
+    writeBE32(header + 8, ssrc_);
+    forwarded_++;
+    return true;
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include "rtp_packet.h"
+#include "codec_info.h"
+
+namespace rtc {
+
+/**
+ * 一个订阅者接收一路轨道的转发状态
+ * 把发布者的一个或多个simulcast流改写成连续的单个流：统一ssrc，序号和时间戳连续
+ * 空间层只在目标层的关键帧切换，时间层降低立即生效、升高要等layer sync
+ */
+class RtpForwarder {
+public:
+    RtpForwarder(uint32_t ssrc, uint32_t clock_rate, bool video);
+
+    //spatial为simulcast流的下标，temporal为允许的最高时间层
+    void setTargetLayers(int spatial, int temporal);
+
+    int targetSpatial() const {
+        return target_spatial_;
+    }
+
+    int currentSpatial() const {
+        return current_spatial_;
+    }
+
+    //正在等待目标空间层的关键帧
+    bool waitingKeyframe() const {
+        return video_ && current_spatial_ != target_spatial_;
+    }
+
+    /**
+     * 决定是否转发，转发时把改写后的RTP头写入header，长度为packet.headerSize()
+     * @param spatial 包所在的simulcast流
+     */
+    bool process(const RtpPacket &packet, int spatial, const RtpPacketInfo &info, int64_t now_ms, uint8_t *header);
+
+    uint32_t ssrc() const {
+        return ssrc_;
+    }
+
+    uint64_t forwardedPackets() const {
+        return forwarded_;
+    }
+
+    uint64_t droppedPackets() const {
+        return dropped_;
+    }
+
+private:
+    void switchTo(int spatial, const RtpPacket &packet, int64_t now_ms);
+
+private:
+    uint32_t ssrc_;
+    uint32_t clock_rate_;
+    bool video_;
+    bool started_;
+
+    int target_spatial_;
+    int current_spatial_;    //-1表示还没有开始转发
+    int target_temporal_;
+    int current_temporal_;
+
+    //输出 = 输入 - offset，丢弃时间层的包时序号偏移加一保持输出连续
+    uint16_t seq_offset_;
+    uint32_t ts_offset_;
+    uint16_t last_in_seq_;
+    uint16_t last_out_seq_;
+    uint32_t last_out_ts_;
+    int64_t last_out_ms_;
+
+    uint64_t forwarded_;
+    uint64_t dropped_;
+};
+
+}
@@ -0,0 +1,130 @@
+#include "rtp_history.h"
+#include "rtp_packet.h"
+
+namespace rtc {
+
+RtpHistory::RtpHistory(const RtpHistoryOptions &options) : options_(options), mask_(0) {
+    size_t capacity = 16;
+    while (capacity < options_.capacity && capacity < 0x8000) {
+        capacity <<= 1;
+    }
+    mask_ = (uint16_t)(capacity - 1);
+}
+
+RtpHistory::~RtpHistory() {
+}
+
+RtpHistory::Stream *RtpHistory::streamOf(uint32_t ssrc, bool create) {
+    auto it = streams_.find(ssrc);
+    if (it != streams_.end()) {
+        return it->second.get();
+    }
+    if (!create) {
+        return nullptr;
+    }
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->slots.resize((size_t)mask_ + 1);
+    Stream *result = stream.get();
+    streams_[ssrc] = std::move(stream);
+    return result;
+}
+
+void RtpHistory::put(const infra::PacketBuffer::Ptr &packet, int64_t now_ms) {
+    RtpPacket rtp;
+    if (!rtp.parse(packet->data(), packet->size())) {
+        return;
+    }
+    Stream &stream = *streamOf(rtp.ssrc(), true);
+    uint16_t seq = rtp.sequenceNumber();
+    if (stream.count == 0) {
+        stream.oldest_seq = seq;
+        stream.newest_seq = seq;
+    } else if (isNewerSequence(seq, stream.newest_seq)) {
+        if ((uint16_t)(seq - stream.newest_seq) > mask_) {
+            //跳得太远，之前的包都不可能再被请求
+            for (auto &slot : stream.slots) {
+                slot.packet.reset();
+            }
+            stream.count = 0;
+            stream.oldest_seq = seq;
+        }
+        stream.newest_seq = seq;
+        //按包数淘汰，环只覆盖最近capacity个序号
+        while ((uint16_t)(stream.newest_seq - stream.oldest_seq) > mask_) {
+            Slot &slot = stream.slots[stream.oldest_seq & mask_];
+            if (slot.packet && slot.seq == stream.oldest_seq) {
+                slot.packet.reset();
+                stream.count--;
+            }
+            stream.oldest_seq++;
+        }
+    } else {
+        //乱序放入的旧包
+        if ((uint16_t)(stream.newest_seq - seq) > mask_) {
+            return;
+        }
+        if (isNewerSequence(stream.oldest_seq, seq)) {
+            stream.oldest_seq = seq;
+        }
+    }
+
+    Slot &slot = stream.slots[seq & mask_];
+    if (!(slot.packet && slot.seq == seq)) {
+        stream.count++;
+    }
+    slot.packet = packet;
+    slot.seq = seq;
+    slot.stored_ms = now_ms;
+    slot.resend_ms = 0;
+    stats_.stored++;
+    evict(stream, now_ms);
+}
+
+void RtpHistory::evict(Stream &stream, int64_t now_ms) {
+    //按存放时间淘汰，最旧的在oldest_seq
+    while (stream.count > 0) {
+        Slot &slot = stream.slots[stream.oldest_seq & mask_];
+        if (slot.packet && slot.seq == stream.oldest_seq) {
+            if (now_ms - slot.stored_ms <= options_.max_age_ms) {
+                break;
+            }
+            slot.packet.reset();
+            stream.count--;
+        }
+        if (stream.oldest_seq == stream.newest_seq) {
+            break;
+        }
+        stream.oldest_seq++;
+    }
+}
+
+infra::PacketBuffer::Ptr RtpHistory::getForResend(uint32_t ssrc, uint16_t seq, int64_t now_ms, int64_t rtt_ms) {
+    Stream *stream = streamOf(ssrc, false);
+    if (!stream) {
+        stats_.misses++;
+        return nullptr;
+    }
+    Slot &slot = stream->slots[seq & mask_];
+    if (!slot.packet || slot.seq != seq || now_ms - slot.stored_ms > options_.max_age_ms) {
+        stats_.misses++;
+        return nullptr;
+    }
+    //上次重传还在路上，接收端的重复请求不再响应
+    if (slot.resend_ms != 0 && now_ms - slot.resend_ms < rtt_ms) {
+        stats_.throttled++;
+        return nullptr;
+    }
+    slot.resend_ms = now_ms;
+    stats_.hits++;
+    return slot.packet;
+}
+
+void RtpHistory::remove(uint32_t ssrc) {
+    streams_.erase(ssrc);
+}
+
+void RtpHistory::clear() {
+    streams_.clear();
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "infra/packet_buffer.h"
+
+namespace rtc {
+
+typedef struct RtpHistoryOptions_tag {
+    uint16_t capacity = 1024;        //每个ssrc保存的最大包数，取整为2的幂
+    int64_t max_age_ms = 1000;       //超过这个时间的包不再重传
+} RtpHistoryOptions;
+
+struct RtpHistoryStats {
+    uint64_t stored = 0;
+    uint64_t hits = 0;               //返回给重传的次数
+    uint64_t misses = 0;             //已经淘汰或从未发送
+    uint64_t throttled = 0;          //一个rtt内重复请求被忽略
+};
+
+/**
+ * 发送端的重传缓存
+ * 每个ssrc一个按序号索引的环，保存发送出去的包的引用，不拷贝数据
+ * 按包数和存放时间两个维度淘汰，不是线程安全的，应在发送所在的线程调用
+ */
+class RtpHistory {
+public:
+    explicit RtpHistory(const RtpHistoryOptions &options = RtpHistoryOptions());
+
+    RtpHistory(const RtpHistory&) = delete;
+
+    RtpHistory(RtpHistory&&) = delete;
+
+    ~RtpHistory();
+
+    //packet必须是合法的RTP包，保存后不应再修改
+    void put(const infra::PacketBuffer::Ptr &packet, int64_t now_ms);
+
+    //取出要重传的包，同一个包在rtt_ms内只返回一次，没有时返回空
+    infra::PacketBuffer::Ptr getForResend(uint32_t ssrc, uint16_t seq, int64_t now_ms, int64_t rtt_ms);
+
+    void remove(uint32_t ssrc);
+
+    void clear();
+
+    const RtpHistoryStats &stats() const {
+        return stats_;
+    }
+
+private:
+    struct Slot {
+        infra::PacketBuffer::Ptr packet;
+        int64_t stored_ms = 0;
+        int64_t resend_ms = 0;       //上次重传时间，0表示没有重传过
+        uint16_t seq = 0;
+    };
+
+    struct Stream {
+        std::vector<Slot> slots;
+        uint16_t oldest_seq = 0;
+        uint16_t newest_seq = 0;
+        uint32_t count = 0;
+    };
+
+    Stream *streamOf(uint32_t ssrc, bool create);
+
+    void evict(Stream &stream, int64_t now_ms);
+
+private:
+    RtpHistoryOptions options_;
+    uint16_t mask_;
+    std::unordered_map<uint32_t, std::unique_ptr<Stream>> streams_;
+    RtpHistoryStats stats_;
+};
+
+}
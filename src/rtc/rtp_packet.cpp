@@ -0,0 +1,139 @@
+#include "rtp_packet.h"
+#include <string.h>
+
+namespace rtc {
+
+RtpPacket::RtpPacket()
+    : data_(nullptr), size_(0), header_size_(0), extension_offset_(0), extension_size_(0), padding_size_(0),
+      payload_size_(0) {
+}
+
+bool RtpPacket::parse(uint8_t *data, size_t size) {
+    data_ = data;
+    size_ = size;
+    header_size_ = 0;
+    extension_offset_ = 0;
+    extension_size_ = 0;
+    padding_size_ = 0;
+    payload_size_ = 0;
+
+    if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+        return false;
+    }
+    size_t header_size = RTP_HEADER_SIZE + csrcCount() * 4;
+    if (size < header_size) {
+        return false;
+    }
+    if (hasExtension()) {
+        if (size < header_size + 4) {
+            return false;
+        }
+        size_t extension_size = readBE16(data + header_size + 2) * 4;
+        if (size < header_size + 4 + extension_size) {
+            return false;
+        }
+        extension_offset_ = (uint32_t)(header_size + 4);
+        extension_size_ = (uint32_t)extension_size;
+        header_size += 4 + extension_size;
+    }
+    size_t padding_size = 0;
+    if (padding()) {
+        //padding长度在最后一个字节，包含自身
+        padding_size = data[size - 1];
+        if (padding_size == 0 || header_size + padding_size > size) {
+            return false;
+        }
+    }
+    header_size_ = (uint32_t)header_size;
+    padding_size_ = (uint16_t)padding_size;
+    payload_size_ = size - header_size - padding_size;
+    return true;
+}
+
+uint16_t RtpPacket::extensionProfile() const {
+    if (!extension_offset_) {
+        return 0;
+    }
+    return readBE16(data_ + extension_offset_ - 4);
+}
+
+RtpPacket::ExtensionIterator RtpPacket::extensions() const {
+    ExtensionIterator it;
+    uint16_t profile = extensionProfile();
+    if (profile == RTP_ONE_BYTE_EXTENSION_PROFILE) {
+        it.two_byte_ = false;
+    } else if ((profile & 0xfff0) == RTP_TWO_BYTE_EXTENSION_PROFILE) {
+        it.two_byte_ = true;
+    } else {
+        //其他profile不按RFC 8285解析
+        return it;
+    }
+    it.data_ = data_ + extension_offset_;
+    it.size_ = extension_size_;
+    return it;
+}
+
+bool RtpPacket::ExtensionIterator::next(uint8_t &id, uint8_t *&data, size_t &size) {
+    while (pos_ < size_) {
+        uint8_t byte = data_[pos_];
+        if (byte == 0) {
+            //元素之间的填充
+            pos_++;
+            continue;
+        }
+        size_t header;
+        if (two_byte_) {
+            if (pos_ + 2 > size_) {
+                break;
+            }
+            id = byte;
+            size = data_[pos_ + 1];
+            header = 2;
+        } else {
+            id = byte >> 4;
+            if (id == 15) {
+                //保留id，之后的数据不再解析
+                break;
+            }
+            size = (byte & 0x0f) + 1;
+            header = 1;
+        }
+        if (pos_ + header + size > size_) {
+            break;
+        }
+        data = data_ + pos_ + header;
+        pos_ += header + size;
+        return true;
+    }
+    pos_ = size_;
+    return false;
+}
+
+uint8_t *RtpPacket::findExtension(uint8_t id, size_t &size) const {
+    ExtensionIterator it = extensions();
+    uint8_t ext_id;
+    uint8_t *data;
+    size_t ext_size;
+    while (it.next(ext_id, data, ext_size)) {
+        if (ext_id == id) {
+            size = ext_size;
+            return data;
+        }
+    }
+    return nullptr;
+}
+
+bool RtpPacket::setExtension(uint8_t id, const uint8_t *value, size_t size) {
+    size_t ext_size = 0;
+    uint8_t *data = findExtension(id, ext_size);
+    if (!data || ext_size != size) {
+        return false;
+    }
+    //两字节格式允许长度为0的扩展
+    if (size > 0) {
+        memcpy(data, value, size);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "byte_io.h"
+
+namespace rtc {
+
+#define RTP_HEADER_SIZE 12
+#define RTP_MAX_CSRCS 15
+
+//RFC 8285头部扩展，两字节格式的profile低4位是appbits
+#define RTP_ONE_BYTE_EXTENSION_PROFILE 0xBEDE
+#define RTP_TWO_BYTE_EXTENSION_PROFILE 0x1000
+
+/**
+ * RTP包的视图，不拷贝也不分配内存
+ * parse只校验长度并记录各部分的偏移，读写都直接访问原始缓冲，setXxx在原地改写
+ */
+class RtpPacket {
+public:
+    //遍历头部扩展，data指向包内的数据，可以原地改写
+    class ExtensionIterator {
+    public:
+        ExtensionIterator() : data_(nullptr), size_(0), pos_(0), two_byte_(false) {}
+
+        bool next(uint8_t &id, uint8_t *&data, size_t &size);
+
+    private:
+        friend class RtpPacket;
+        uint8_t *data_;
+        size_t size_;
+        size_t pos_;
+        bool two_byte_;
+    };
+
+    RtpPacket();
+
+    //格式错误时返回false，之后的访问结果未定义
+    bool parse(uint8_t *data, size_t size);
+
+    uint8_t *data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool padding() const {
+        return (data_[0] & 0x20) != 0;
+    }
+
+    bool hasExtension() const {
+        return (data_[0] & 0x10) != 0;
+    }
+
+    uint8_t csrcCount() const {
+        return data_[0] & 0x0f;
+    }
+
+    bool marker() const {
+        return (data_[1] & 0x80) != 0;
+    }
+
+    uint8_t payloadType() const {
+        return data_[1] & 0x7f;
+    }
+
+    uint16_t sequenceNumber() const {
+        return readBE16(data_ + 2);
+    }
+
+    uint32_t timestamp() const {
+        return readBE32(data_ + 4);
+    }
+
+    uint32_t ssrc() const {
+        return readBE32(data_ + 8);
+    }
+
+    uint32_t csrc(int index) const {
+        return readBE32(data_ + RTP_HEADER_SIZE + index * 4);
+    }
+
+    //包括csrc和头部扩展
+    size_t headerSize() const {
+        return header_size_;
+    }
+
+    uint8_t *payload() const {
+        return data_ + header_size_;
+    }
+
+    size_t payloadSize() const {
+        return payload_size_;
+    }
+
+    size_t paddingSize() const {
+        return padding_size_;
+    }
+
+    void setMarker(bool marker) {
+        data_[1] = (uint8_t)((data_[1] & 0x7f) | (marker ? 0x80 : 0));
+    }
+
+    void setPayloadType(uint8_t payload_type) {
+        data_[1] = (uint8_t)((data_[1] & 0x80) | (payload_type & 0x7f));
+    }
+
+    void setSequenceNumber(uint16_t seq) {
+        writeBE16(data_ + 2, seq);
+    }
+
+    void setTimestamp(uint32_t timestamp) {
+        writeBE32(data_ + 4, timestamp);
+    }
+
+    void setSsrc(uint32_t ssrc) {
+        writeBE32(data_ + 8, ssrc);
+    }
+
+    uint16_t extensionProfile() const;
+
+    ExtensionIterator extensions() const;
+
+    //查找头部扩展，不存在时返回nullptr
+    uint8_t *findExtension(uint8_t id, size_t &size) const;
+
+    //原地改写已有的扩展，要求长度一致
+    bool setExtension(uint8_t id, const uint8_t *value, size_t size);
+
+private:
+    uint8_t *data_;
+    size_t size_;
+    //扩展最长256KB，GRO合并的缓冲也可能超过64KB，偏移用32位
+    uint32_t header_size_;
+    uint32_t extension_offset_;  //扩展数据(跳过4字节扩展头)的偏移，没有扩展时为0
+    uint32_t extension_size_;
+    uint16_t padding_size_;
+    size_t payload_size_;
+};
+
+/**
+ * 同一端口复用RTP和RTCP时区分两者(RFC 5761)，RTCP的包类型在192~223之间
+ */
+inline bool isRtcpPacket(const uint8_t *data, size_t size) {
+    if (size < 4 || (data[0] & 0xc0) != 0x80) {
+        return false;
+    }
+    return data[1] >= 192 && data[1] <= 223;
+}
+
+inline bool isRtpPacket(const uint8_t *data, size_t size) {
+    return size >= RTP_HEADER_SIZE && (data[0] & 0xc0) == 0x80 && !isRtcpPacket(data, size);
+}
+
+//序号比较，考虑回绕
+inline bool isNewerSequence(uint16_t seq, uint16_t prev) {
+    return seq != prev && (uint16_t)(seq - prev) < 0x8000;
+}
+
+inline bool isNewerTimestamp(uint32_t timestamp, uint32_t prev) {
+    return timestamp != prev && (uint32_t)(timestamp - prev) < 0x80000000u;
+}
+
+}
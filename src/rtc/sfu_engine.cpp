@@ -0,0 +1,313 @@
+#include "sfu_engine.h"
+#include <thread>
+#include "infra/logger.h"
+#include "infra/utils/time.h"
+
+namespace rtc {
+
+std::shared_ptr<SfuEngine> SfuEngine::create(const SfuOptions &options) {
+    std::shared_ptr<SfuEngine> engine(new SfuEngine(options));
+    if (!engine->start()) {
+        return nullptr;
+    }
+    return engine;
+}
+
+SfuEngine::SfuEngine(const SfuOptions &options) : options_(options) {
+    if (options_.shards <= 0) {
+        options_.shards = (int32_t)std::thread::hardware_concurrency();
+        if (options_.shards <= 0) {
+            options_.shards = 1;
+        }
+    }
+}
+
+SfuEngine::~SfuEngine() {
+    //先停止所有分片线程，之后房间状态不会再被访问
+    for (auto &shard : shards_) {
+        shard->pool.reset();
+    }
+    shards_.clear();
+}
+
+bool SfuEngine::start() {
+    for (int32_t i = 0; i < options_.shards; i++) {
+        std::unique_ptr<Shard> shard(new Shard());
+        std::vector<int32_t> cpus;
+        if (!options_.cpus.empty()) {
+            cpus.push_back(options_.cpus[i % options_.cpus.size()]);
+        }
+        shard->pool = infra::ThreadPool::create("sfu-" + std::to_string(i), 1, infra::ThreadPool::PRIORITY_NORMAL,
+                                                infra::ThreadPool::SCHEDULE_SHARED_QUEUE, cpus);
+        if (!shard->pool) {
+            return false;
+        }
+        shards_.push_back(std::move(shard));
+    }
+    infof("sfu engine start with %d shards\n", (int)shards_.size());
+    return true;
+}
+
+void SfuEngine::setKeyframeRequestCallback(const KeyframeRequestCallback &callback) {
+    keyframe_request_callback_ = callback;
+}
+
+int32_t SfuEngine::shardCount() const {
+    return (int32_t)shards_.size();
+}
+
+SfuEngine::Shard &SfuEngine::shardOf(uint64_t room_id) const {
+    return *shards_[room_id % shards_.size()];
+}
+
+std::shared_ptr<infra::ThreadPool> SfuEngine::roomPool(uint64_t room_id) const {
+    return shardOf(room_id).pool;
+}
+
+void SfuEngine::runInShard(uint64_t room_id, infra::Task task) {
+    Shard &shard = shardOf(room_id);
+    //转发回调中的修改不能立即执行，否则会删除正在遍历的订阅或轨道
+    if (shard.pool->isCurrentThread() && shard.forwarding == 0) {
+        task();
+    } else {
+        shard.pool->postTask(std::move(task));
+    }
+}
+
+int SfuEngine::clampSpatial(const Track &track, int spatial) {
+    int layers = (int)track.config.ssrcs.size();
+    if (spatial >= layers) {
+        spatial = layers - 1;
+    }
+    return spatial < 0 ? 0 : spatial;
+}
+
+void SfuEngine::removeRoomIfEmpty(Shard &shard, uint64_t room_id) {
+    auto it = shard.rooms.find(room_id);
+    if (it != shard.rooms.end() && it->second.tracks.empty() && it->second.subscribers.empty()) {
+        shard.rooms.erase(it);
+    }
+}
+
+void SfuEngine::addTrack(uint64_t room_id, const SfuTrackConfig &config) {
+    runInShard(room_id, [this, room_id, config]() {
+        if (config.ssrcs.empty()) {
+            return;
+        }
+        Room &room = shardOf(room_id).rooms[room_id];
+        if (room.tracks.count(config.track_id)) {
+            warnf("sfu room %llu track %llu already exists\n", (unsigned long long)room_id, (unsigned long long)config.track_id);
+            return;
+        }
+        std::unique_ptr<Track> track(new Track());
+        track->config = config;
+        track->keyframe_request_ms.resize(config.ssrcs.size(), 0);
+        for (size_t i = 0; i < config.ssrcs.size(); i++) {
+            room.ssrcs[config.ssrcs[i]] = std::make_pair(track.get(), (int)i);
+        }
+        room.tracks[config.track_id] = std::move(track);
+    });
+}
+
+void SfuEngine::removeTrack(uint64_t room_id, uint64_t track_id) {
+    runInShard(room_id, [this, room_id, track_id]() {
+        Shard &shard = shardOf(room_id);
+        auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end()) {
+            return;
+        }
+        Room &room = room_it->second;
+        auto it = room.tracks.find(track_id);
+        if (it == room.tracks.end()) {
+            return;
+        }
+        for (uint32_t ssrc : it->second->config.ssrcs) {
+            room.ssrcs.erase(ssrc);
+        }
+        room.tracks.erase(it);
+        removeRoomIfEmpty(shard, room_id);
+    });
+}
+
+void SfuEngine::addSubscriber(uint64_t room_id, uint64_t subscriber_id, const SendCallback &callback) {
+    runInShard(room_id, [this, room_id, subscriber_id, callback]() {
+        Room &room = shardOf(room_id).rooms[room_id];
+        std::unique_ptr<Subscriber> &subscriber = room.subscribers[subscriber_id];
+        if (!subscriber) {
+            subscriber.reset(new Subscriber());
+            subscriber->id = subscriber_id;
+        }
+        subscriber->callback = callback;
+    });
+}
+
+void SfuEngine::removeSubscriber(uint64_t room_id, uint64_t subscriber_id) {
+    runInShard(room_id, [this, room_id, subscriber_id]() {
+        Shard &shard = shardOf(room_id);
+        auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end()) {
+            return;
+        }
+        Room &room = room_it->second;
+        auto it = room.subscribers.find(subscriber_id);
+        if (it == room.subscribers.end()) {
+            return;
+        }
+        Subscriber *subscriber = it->second.get();
+        for (auto &track : room.tracks) {
+            auto &subscriptions = track.second->subscriptions;
+            for (size_t i = 0; i < subscriptions.size();) {
+                if (subscriptions[i]->subscriber == subscriber) {
+                    //顺序不重要，和最后一个交换后删除
+                    subscriptions[i] = std::move(subscriptions.back());
+                    subscriptions.pop_back();
+                } else {
+                    i++;
+                }
+            }
+        }
+        room.subscribers.erase(it);
+        removeRoomIfEmpty(shard, room_id);
+    });
+}
+
+void SfuEngine::subscribe(uint64_t room_id, uint64_t subscriber_id, uint64_t track_id, uint32_t ssrc, int spatial, int temporal) {
+    runInShard(room_id, [this, room_id, subscriber_id, track_id, ssrc, spatial, temporal]() {
+        Shard &shard = shardOf(room_id);
+        auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end()) {
+            return;
+        }
+        Room &room = room_it->second;
+        auto sub_it = room.subscribers.find(subscriber_id);
+        auto track_it = room.tracks.find(track_id);
+        if (sub_it == room.subscribers.end() || track_it == room.tracks.end()) {
+            warnf("sfu subscribe unknown subscriber %llu or track %llu\n", (unsigned long long)subscriber_id,
+                  (unsigned long long)track_id);
+            return;
+        }
+        Track &track = *track_it->second;
+        for (auto &subscription : track.subscriptions) {
+            if (subscription->subscriber == sub_it->second.get()) {
+                return;
+            }
+        }
+        std::unique_ptr<Subscription> subscription(new Subscription(sub_it->second.get(), ssrc, track.config.clock_rate,
+                                                                    track.config.video));
+        subscription->forwarder.setTargetLayers(clampSpatial(track, spatial), temporal);
+        track.subscriptions.push_back(std::move(subscription));
+    });
+}
+
+void SfuEngine::unsubscribe(uint64_t room_id, uint64_t subscriber_id, uint64_t track_id) {
+    runInShard(room_id, [this, room_id, subscriber_id, track_id]() {
+        Shard &shard = shardOf(room_id);
+        auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end()) {
+            return;
+        }
+        auto track_it = room_it->second.tracks.find(track_id);
+        if (track_it == room_it->second.tracks.end()) {
+            return;
+        }
+        auto &subscriptions = track_it->second->subscriptions;
+        for (size_t i = 0; i < subscriptions.size(); i++) {
+            if (subscriptions[i]->subscriber->id == subscriber_id) {
+                subscriptions[i] = std::move(subscriptions.back());
+                subscriptions.pop_back();
+                break;
+            }
+        }
+    });
+}
+
+void SfuEngine::setLayers(uint64_t room_id, uint64_t subscriber_id, uint64_t track_id, int spatial, int temporal) {
+    runInShard(room_id, [this, room_id, subscriber_id, track_id, spatial, temporal]() {
+        Shard &shard = shardOf(room_id);
+        auto room_it = shard.rooms.find(room_id);
+        if (room_it == shard.rooms.end()) {
+            return;
+        }
+        auto track_it = room_it->second.tracks.find(track_id);
+        if (track_it == room_it->second.tracks.end()) {
+            return;
+        }
+        Track &track = *track_it->second;
+        for (auto &subscription : track.subscriptions) {
+            if (subscription->subscriber->id == subscriber_id) {
+                subscription->forwarder.setTargetLayers(clampSpatial(track, spatial), temporal);
+                break;
+            }
+        }
+    });
+}
+
+void SfuEngine::onRtpPacket(uint64_t room_id, const infra::PacketBuffer::Ptr &packet) {
+    Shard &shard = shardOf(room_id);
+    if (shard.pool->isCurrentThread()) {
+        forward(shard, room_id, packet);
+        return;
+    }
+    infra::PacketBuffer::Ptr copy = packet;
+    shard.pool->postTask([this, room_id, copy]() {
+        forward(shardOf(room_id), room_id, copy);
+    });
+}
+
+void SfuEngine::forward(Shard &shard, uint64_t room_id, const infra::PacketBuffer::Ptr &packet) {
+    auto room_it = shard.rooms.find(room_id);
+    if (room_it == shard.rooms.end()) {
+        return;
+    }
+    Room &room = room_it->second;
+    RtpPacket rtp;
+    if (!rtp.parse(packet->data(), packet->size())) {
+        return;
+    }
+    auto ssrc_it = room.ssrcs.find(rtp.ssrc());
+    if (ssrc_it == room.ssrcs.end()) {
+        return;
+    }
+    Track &track = *ssrc_it->second.first;
+    int spatial = ssrc_it->second.second;
+    RtpPacketInfo info;
+    parseCodecInfo(track.config.codec, rtp.payload(), rtp.payloadSize(), info);
+
+    int64_t now_ms = infra::getCurrentMilliseconds();
+    size_t header_size = rtp.headerSize();
+    size_t body_size = packet->size() - header_size;
+    bool want_keyframe = false;
+    infra::BufferChain chain;
+    infra::PacketBuffer::Ptr header;
+    shard.forwarding++;
+    for (auto &subscription : track.subscriptions) {
+        RtpForwarder &forwarder = subscription->forwarder;
+        if (forwarder.waitingKeyframe() && forwarder.targetSpatial() == spatial && !info.keyframe) {
+            want_keyframe = true;
+        }
+        //每个订阅者只有自己的头部，负载引用同一个缓冲，没有转发时头部缓冲留给下一个订阅者
+        if (!header) {
+            header = infra::PacketBuffer::create(header_size);
+        }
+        if (!forwarder.process(rtp, spatial, info, now_ms, header->data())) {
+            continue;
+        }
+        chain.clear();
+        chain.append(header);
+        if (body_size > 0) {
+            chain.append(packet, header_size, body_size);
+        }
+        header.reset();
+        subscription->subscriber->callback(chain);
+    }
+
+    //在目标层的包到达时才请求，发布者停发某一层时不会反复请求
+    if (want_keyframe && keyframe_request_callback_ &&
+        now_ms - track.keyframe_request_ms[spatial] >= options_.keyframe_request_interval_ms) {
+        track.keyframe_request_ms[spatial] = now_ms;
+        keyframe_request_callback_(room_id, track.config.track_id, track.config.ssrcs[spatial]);
+    }
+    shard.forwarding--;
+}
+
+}
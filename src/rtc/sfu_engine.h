@@ -0,0 +1,132 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "infra/thread_pool.h"
+#include "infra/packet_buffer.h"
+#include "codec_info.h"
+#include "rtp_forwarder.h"
+
+namespace rtc {
+
+typedef struct SfuOptions_tag {
+    int32_t shards = 0;              //分片数，0表示cpu核数
+    std::vector<int32_t> cpus;       //第i个分片绑定到cpus[i % cpus.size()]，为空时不绑核
+    int64_t keyframe_request_interval_ms = 500;  //同一个流两次请求关键帧的最小间隔
+} SfuOptions;
+
+//发布者的一路轨道，simulcast时每个空间层一个ssrc
+struct SfuTrackConfig {
+    uint64_t track_id = 0;
+    CodecType codec = CODEC_UNKNOWN;
+    bool video = false;
+    uint32_t clock_rate = 90000;
+    std::vector<uint32_t> ssrcs;     //按空间层从低到高
+};
+
+/**
+ * 选择性转发引擎
+ * 房间按id分配到分片，每个分片是一个单线程ThreadPool，一个房间的所有状态和扇出都在同一个线程
+ * 转发时订阅者只拷贝改写后的RTP头，负载与发布者的包共享，发送回调收到头部+负载的BufferChain
+ */
+class SfuEngine {
+public:
+    /**
+     * 在房间所在的分片线程回调，packet只在回调期间有效，需要异步发送时复制BufferChain
+     * 回调中可以调用引擎的接口(如发送出错时removeSubscriber)，这些修改在当前包转发完之后才执行
+     */
+    typedef std::function<void(const infra::BufferChain &packet)> SendCallback;
+    //需要发布者发送关键帧时回调，通常转换为PLI发给发布者，同样可以重入引擎
+    typedef std::function<void(uint64_t room_id, uint64_t track_id, uint32_t ssrc)> KeyframeRequestCallback;
+
+    SfuEngine(const SfuEngine&) = delete;
+
+    SfuEngine(SfuEngine&&) = delete;
+
+    static std::shared_ptr<SfuEngine> create(const SfuOptions &options = SfuOptions());
+
+    ~SfuEngine();
+
+    //应在create之后、添加房间之前设置
+    void setKeyframeRequestCallback(const KeyframeRequestCallback &callback);
+
+    int32_t shardCount() const;
+
+    //房间所在的分片，在这个线程调用onRtpPacket不需要投递
+    std::shared_ptr<infra::ThreadPool> roomPool(uint64_t room_id) const;
+
+    //以下接口都投递到房间所在的分片执行，房间在第一次使用时创建，没有轨道和订阅者时删除
+    void addTrack(uint64_t room_id, const SfuTrackConfig &config);
+    void removeTrack(uint64_t room_id, uint64_t track_id);
+
+    void addSubscriber(uint64_t room_id, uint64_t subscriber_id, const SendCallback &callback);
+    void removeSubscriber(uint64_t room_id, uint64_t subscriber_id);
+
+    /**
+     * @param ssrc 订阅者收到的ssrc
+     * @param spatial 希望接收的simulcast层，超过发布的层数时取最高层
+     * @param temporal 允许的最高时间层
+     */
+    void subscribe(uint64_t room_id, uint64_t subscriber_id, uint64_t track_id, uint32_t ssrc, int spatial, int temporal);
+    void unsubscribe(uint64_t room_id, uint64_t subscriber_id, uint64_t track_id);
+    void setLayers(uint64_t room_id, uint64_t subscriber_id, uint64_t track_id, int spatial, int temporal);
+
+    //转发发布者的RTP包，不在房间的分片线程时会投递过去，packet之后不应再修改
+    void onRtpPacket(uint64_t room_id, const infra::PacketBuffer::Ptr &packet);
+
+private:
+    explicit SfuEngine(const SfuOptions &options);
+
+    bool start();
+
+    struct Subscriber {
+        uint64_t id;
+        SendCallback callback;
+    };
+
+    struct Subscription {
+        Subscriber *subscriber;
+        RtpForwarder forwarder;
+
+        Subscription(Subscriber *subscriber, uint32_t ssrc, uint32_t clock_rate, bool video)
+            : subscriber(subscriber), forwarder(ssrc, clock_rate, video) {}
+    };
+
+    struct Track {
+        SfuTrackConfig config;
+        std::vector<std::unique_ptr<Subscription>> subscriptions;
+        std::vector<int64_t> keyframe_request_ms;  //每个空间层上次请求关键帧的时间
+    };
+
+    struct Room {
+        std::unordered_map<uint64_t, std::unique_ptr<Track>> tracks;
+        std::unordered_map<uint64_t, std::unique_ptr<Subscriber>> subscribers;
+        //ssrc到轨道和空间层
+        std::unordered_map<uint32_t, std::pair<Track *, int>> ssrcs;
+    };
+
+    struct Shard {
+        std::shared_ptr<infra::ThreadPool> pool;
+        std::unordered_map<uint64_t, Room> rooms;  //只在分片线程访问
+        int32_t forwarding = 0;  //正在执行的forward层数，不为0时修改房间的操作投递到之后执行
+    };
+
+    Shard &shardOf(uint64_t room_id) const;
+
+    void runInShard(uint64_t room_id, infra::Task task);
+
+    void forward(Shard &shard, uint64_t room_id, const infra::PacketBuffer::Ptr &packet);
+
+    void removeRoomIfEmpty(Shard &shard, uint64_t room_id);
+
+    static int clampSpatial(const Track &track, int spatial);
+
+private:
+    SfuOptions options_;
+    KeyframeRequestCallback keyframe_request_callback_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}
@@ -0,0 +1,339 @@
+#include "sha1.h"
+#include <string.h>
+#include <atomic>
+#include "byte_io.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA1_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rtc {
+
+static bool detectHardware() {
+#ifdef SHA1_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#else
+    return false;
+#endif
+}
+
+static bool hardwareAvailable() {
+    static const bool available = detectHardware();
+    return available;
+}
+
+static std::atomic<int> s_hardware(-1);
+
+bool sha1HardwareEnabled() {
+    int enabled = s_hardware.load(std::memory_order_relaxed);
+    if (enabled < 0) {
+        enabled = hardwareAvailable() ? 1 : 0;
+        s_hardware.store(enabled, std::memory_order_relaxed);
+    }
+    return enabled != 0;
+}
+
+bool setSha1HardwareEnabled(bool enable) {
+    bool enabled = enable && hardwareAvailable();
+    s_hardware.store(enabled ? 1 : 0, std::memory_order_relaxed);
+    return enabled;
+}
+
+static inline uint32_t rotateLeft(uint32_t value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+Sha1::Sha1() {
+    reset();
+}
+
+void Sha1::reset() {
+    state_[0] = 0x67452301;
+    state_[1] = 0xefcdab89;
+    state_[2] = 0x98badcfe;
+    state_[3] = 0x10325476;
+    state_[4] = 0xc3d2e1f0;
+    length_ = 0;
+    buffered_ = 0;
+    hardware_ = sha1HardwareEnabled();
+}
+
+//消息扩展用16个字的环，不展开成80个字
+#define SHA1_W(i) (w[(i) & 15] = rotateLeft(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+#define SHA1_ROUND(a, b, c, d, e, f, k, word) \
+    do { \
+        e += rotateLeft(a, 5) + (f) + (k) + (word); \
+        b = rotateLeft(b, 30); \
+    } while (0)
+#define SHA1_F0(b, c, d) (d ^ (b & (c ^ d)))
+#define SHA1_F1(b, c, d) (b ^ c ^ d)
+#define SHA1_F2(b, c, d) ((b & c) | (d & (b | c)))
+
+static void compressScalar(uint32_t *state, const uint8_t *block) {
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = readBE32(block + i * 4);
+    }
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    //每5轮变量轮换一圈，展开后没有寄存器之间的搬移
+    for (int i = 0; i < 15; i += 5) {
+        SHA1_ROUND(a, b, c, d, e, SHA1_F0(b, c, d), 0x5a827999, w[i]);
+        SHA1_ROUND(e, a, b, c, d, SHA1_F0(a, b, c), 0x5a827999, w[i + 1]);
+        SHA1_ROUND(d, e, a, b, c, SHA1_F0(e, a, b), 0x5a827999, w[i + 2]);
+        SHA1_ROUND(c, d, e, a, b, SHA1_F0(d, e, a), 0x5a827999, w[i + 3]);
+        SHA1_ROUND(b, c, d, e, a, SHA1_F0(c, d, e), 0x5a827999, w[i + 4]);
+    }
+    SHA1_ROUND(a, b, c, d, e, SHA1_F0(b, c, d), 0x5a827999, w[15]);
+    SHA1_ROUND(e, a, b, c, d, SHA1_F0(a, b, c), 0x5a827999, SHA1_W(16));
+    SHA1_ROUND(d, e, a, b, c, SHA1_F0(e, a, b), 0x5a827999, SHA1_W(17));
+    SHA1_ROUND(c, d, e, a, b, SHA1_F0(d, e, a), 0x5a827999, SHA1_W(18));
+    SHA1_ROUND(b, c, d, e, a, SHA1_F0(c, d, e), 0x5a827999, SHA1_W(19));
+    for (int i = 20; i < 40; i += 5) {
+        SHA1_ROUND(a, b, c, d, e, SHA1_F1(b, c, d), 0x6ed9eba1, SHA1_W(i));
+        SHA1_ROUND(e, a, b, c, d, SHA1_F1(a, b, c), 0x6ed9eba1, SHA1_W(i + 1));
+        SHA1_ROUND(d, e, a, b, c, SHA1_F1(e, a, b), 0x6ed9eba1, SHA1_W(i + 2));
+        SHA1_ROUND(c, d, e, a, b, SHA1_F1(d, e, a), 0x6ed9eba1, SHA1_W(i + 3));
+        SHA1_ROUND(b, c, d, e, a, SHA1_F1(c, d, e), 0x6ed9eba1, SHA1_W(i + 4));
+    }
+    for (int i = 40; i < 60; i += 5) {
+        SHA1_ROUND(a, b, c, d, e, SHA1_F2(b, c, d), 0x8f1bbcdc, SHA1_W(i));
+        SHA1_ROUND(e, a, b, c, d, SHA1_F2(a, b, c), 0x8f1bbcdc, SHA1_W(i + 1));
+        SHA1_ROUND(d, e, a, b, c, SHA1_F2(e, a, b), 0x8f1bbcdc, SHA1_W(i + 2));
+        SHA1_ROUND(c, d, e, a, b, SHA1_F2(d, e, a), 0x8f1bbcdc, SHA1_W(i + 3));
+        SHA1_ROUND(b, c, d, e, a, SHA1_F2(c, d, e), 0x8f1bbcdc, SHA1_W(i + 4));
+    }
+    for (int i = 60; i < 80; i += 5) {
+        SHA1_ROUND(a, b, c, d, e, SHA1_F1(b, c, d), 0xca62c1d6, SHA1_W(i));
+        SHA1_ROUND(e, a, b, c, d, SHA1_F1(a, b, c), 0xca62c1d6, SHA1_W(i + 1));
+        SHA1_ROUND(d, e, a, b, c, SHA1_F1(e, a, b), 0xca62c1d6, SHA1_W(i + 2));
+        SHA1_ROUND(c, d, e, a, b, SHA1_F1(d, e, a), 0xca62c1d6, SHA1_W(i + 3));
+        SHA1_ROUND(b, c, d, e, a, SHA1_F1(c, d, e), 0xca62c1d6, SHA1_W(i + 4));
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+#ifdef SHA1_X86
+//每步4轮，msg1/xor/msg2提前为后面的步骤准备消息字
+#define SHA1_NI_STEP(e_next, e_use, msg, func) \
+    do { \
+        e_use = _mm_sha1nexte_epu32(e_use, msg); \
+        e_next = abcd; \
+        abcd = _mm_sha1rnds4_epu32(abcd, e_use, func); \
+    } while (0)
+
+__attribute__((target("sha,sse2,ssse3,sse4.1")))
+static void compressHardware(uint32_t *state, const uint8_t *data, size_t blocks) {
+    const __m128i swap = _mm_set_epi64x(0x0001020304050607ull, 0x08090a0b0c0d0e0full);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    __m128i e1;
+    for (; blocks > 0; blocks--, data += SHA1_BLOCK_SIZE) {
+        __m128i abcd_save = abcd;
+        __m128i e0_save = e0;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), swap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), swap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), swap);
+
+        //0-3轮
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        //4-7
+        SHA1_NI_STEP(e0, e1, m1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        //8-11
+        SHA1_NI_STEP(e1, e0, m2, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+        //12-15
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        SHA1_NI_STEP(e0, e1, m3, 0);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+        //16-19
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        SHA1_NI_STEP(e1, e0, m0, 0);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+        //20-23
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        SHA1_NI_STEP(e0, e1, m1, 1);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        m3 = _mm_xor_si128(m3, m1);
+        //24-27
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        SHA1_NI_STEP(e1, e0, m2, 1);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+        //28-31
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        SHA1_NI_STEP(e0, e1, m3, 1);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+        //32-35
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        SHA1_NI_STEP(e1, e0, m0, 1);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+        //36-39
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        SHA1_NI_STEP(e0, e1, m1, 1);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        m3 = _mm_xor_si128(m3, m1);
+        //40-43
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        SHA1_NI_STEP(e1, e0, m2, 2);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+        //44-47
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        SHA1_NI_STEP(e0, e1, m3, 2);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+        //48-51
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        SHA1_NI_STEP(e1, e0, m0, 2);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+        //52-55
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        SHA1_NI_STEP(e0, e1, m1, 2);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        m3 = _mm_xor_si128(m3, m1);
+        //56-59
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        SHA1_NI_STEP(e1, e0, m2, 2);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+        //60-63
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        SHA1_NI_STEP(e0, e1, m3, 3);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+        //64-67
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        SHA1_NI_STEP(e1, e0, m0, 3);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+        //68-71
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        SHA1_NI_STEP(e0, e1, m1, 3);
+        m3 = _mm_xor_si128(m3, m1);
+        //72-75
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        SHA1_NI_STEP(e1, e0, m2, 3);
+        //76-79
+        SHA1_NI_STEP(e0, e1, m3, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+#endif
+
+void Sha1::compress(const uint8_t *data, size_t blocks) {
+#ifdef SHA1_X86
+    if (hardware_) {
+        compressHardware(state_, data, blocks);
+        return;
+    }
+#endif
+    for (; blocks > 0; blocks--, data += SHA1_BLOCK_SIZE) {
+        compressScalar(state_, data);
+    }
+}
+
+void Sha1::update(const uint8_t *data, size_t size) {
+    length_ += size;
+    if (buffered_ > 0) {
+        size_t copy = SHA1_BLOCK_SIZE - buffered_;
+        if (copy > size) {
+            copy = size;
+        }
+        memcpy(buffer_ + buffered_, data, copy);
+        buffered_ += copy;
+        data += copy;
+        size -= copy;
+        if (buffered_ < SHA1_BLOCK_SIZE) {
+            return;
+        }
+        compress(buffer_, 1);
+        buffered_ = 0;
+    }
+    if (size >= SHA1_BLOCK_SIZE) {
+        size_t blocks = size / SHA1_BLOCK_SIZE;
+        compress(data, blocks);
+        data += blocks * SHA1_BLOCK_SIZE;
+        size -= blocks * SHA1_BLOCK_SIZE;
+    }
+    if (size > 0) {
+        memcpy(buffer_, data, size);
+        buffered_ = size;
+    }
+}
+
+void Sha1::final(uint8_t *digest) {
+    uint64_t bits = length_ * 8;
+    buffer_[buffered_++] = 0x80;
+    if (buffered_ > SHA1_BLOCK_SIZE - 8) {
+        memset(buffer_ + buffered_, 0, SHA1_BLOCK_SIZE - buffered_);
+        compress(buffer_, 1);
+        buffered_ = 0;
+    }
+    memset(buffer_ + buffered_, 0, SHA1_BLOCK_SIZE - 8 - buffered_);
+    writeBE32(buffer_ + SHA1_BLOCK_SIZE - 8, (uint32_t)(bits >> 32));
+    writeBE32(buffer_ + SHA1_BLOCK_SIZE - 4, (uint32_t)bits);
+    compress(buffer_, 1);
+    for (int i = 0; i < 5; i++) {
+        writeBE32(digest + i * 4, state_[i]);
+    }
+}
+
+void HmacSha1::setKey(const uint8_t *key, size_t key_size) {
+    uint8_t block[SHA1_BLOCK_SIZE] = {0};
+    if (key_size > SHA1_BLOCK_SIZE) {
+        Sha1 sha;
+        sha.update(key, key_size);
+        sha.final(block);
+    } else {
+        memcpy(block, key, key_size);
+    }
+    for (int i = 0; i < SHA1_BLOCK_SIZE; i++) {
+        block[i] ^= 0x36;
+    }
+    inner_.reset();
+    inner_.update(block, SHA1_BLOCK_SIZE);
+    for (int i = 0; i < SHA1_BLOCK_SIZE; i++) {
+        block[i] ^= 0x36 ^ 0x5c;
+    }
+    outer_.reset();
+    outer_.update(block, SHA1_BLOCK_SIZE);
+}
+
+void HmacSha1::compute(const uint8_t *data, size_t size, const uint8_t *data2, size_t size2, uint8_t *digest) const {
+    Sha1 inner = inner_;
+    inner.update(data, size);
+    if (size2 > 0) {
+        inner.update(data2, size2);
+    }
+    uint8_t hash[SHA1_DIGEST_SIZE];
+    inner.final(hash);
+    Sha1 outer = outer_;
+    outer.update(hash, SHA1_DIGEST_SIZE);
+    outer.final(digest);
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rtc {
+
+#define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
+//CPU支持SHA扩展指令时默认使用
+bool sha1HardwareEnabled();
+
+//只用于测试和对比纯软件实现的开销，不支持时打开无效，返回实际是否使用
+//只影响之后reset的对象，正在计算的哈希和已经设置过密钥的HMAC不受影响
+bool setSha1HardwareEnabled(bool enable);
+
+class Sha1 {
+public:
+    Sha1();
+
+    void reset();
+
+    void update(const uint8_t *data, size_t size);
+
+    void final(uint8_t *digest);
+
+private:
+    void compress(const uint8_t *data, size_t blocks);
+
+private:
+    uint32_t state_[5];
+    uint64_t length_;
+    bool hardware_;
+    uint8_t buffer_[SHA1_BLOCK_SIZE];
+    size_t buffered_;
+};
+
+/**
+ * HMAC-SHA1
+ * setKey时把ipad、opad各压缩一个分组保存下来，每次计算只需要处理数据本身和外层的一个分组
+ */
+class HmacSha1 {
+public:
+    void setKey(const uint8_t *key, size_t key_size);
+
+    //对两段数据的拼接计算，SRTP用第二段传ROC，不需要拷贝包
+    void compute(const uint8_t *data, size_t size, const uint8_t *data2, size_t size2, uint8_t *digest) const;
+
+private:
+    Sha1 inner_;
+    Sha1 outer_;
+};
+
+}
@@ -0,0 +1,485 @@
+#include "srtp_session.h"
+#include <string.h>
+#include "byte_io.h"
+#include "rtp_packet.h"
+
+namespace rtc {
+
+//AES_CM_128_HMAC_SHA1_80的tag长度和会话认证密钥长度
+#define SRTP_HMAC_TAG_SIZE 10
+#define SRTP_AUTH_KEY_SIZE 20
+#define SRTP_CM_SALT_SIZE 14
+#define SRTP_GCM_SALT_SIZE 12
+#define SRTCP_INDEX_SIZE 4
+#define SRTCP_HEADER_SIZE 8
+#define SRTCP_E_BIT 0x80000000u
+#define SRTCP_INDEX_MASK 0x7fffffffu
+
+//RFC 3711 4.3.1的label
+#define SRTP_LABEL_RTP_ENCRYPTION 0x00
+#define SRTP_LABEL_RTCP_ENCRYPTION 0x03
+
+size_t srtpMasterKeySize(SrtpProfile profile) {
+    return profile == SRTP_AEAD_AES_256_GCM ? 32 : 16;
+}
+
+size_t srtpMasterSaltSize(SrtpProfile profile) {
+    return profile == SRTP_AES128_CM_HMAC_SHA1_80 ? SRTP_CM_SALT_SIZE : SRTP_GCM_SALT_SIZE;
+}
+
+//加密后负载里的padding长度不可读，只按CC和X计算头部长度
+static size_t rtpHeaderSize(const uint8_t *data, size_t size) {
+    if (size < RTP_HEADER_SIZE || (data[0] & 0xc0) != 0x80) {
+        return 0;
+    }
+    size_t header_size = RTP_HEADER_SIZE + (data[0] & 0x0f) * 4;
+    if (data[0] & 0x10) {
+        if (size < header_size + 4) {
+            return 0;
+        }
+        header_size += 4 + (size_t)readBE16(data + header_size + 2) * 4;
+    }
+    return header_size <= size ? header_size : 0;
+}
+
+static bool equalTag(const uint8_t *a, const uint8_t *b, size_t size) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < size; i++) {
+        diff |= (uint8_t)(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+//AES-CM的IV: (salt << 16) ^ (ssrc << 64) ^ (index << 16)
+static void counterIv(const uint8_t *salt, uint32_t ssrc, uint64_t index, uint8_t *iv) {
+    memcpy(iv, salt, SRTP_CM_SALT_SIZE);
+    iv[14] = 0;
+    iv[15] = 0;
+    writeBE32(iv + 4, readBE32(iv + 4) ^ ssrc);
+    writeBE16(iv + 8, (uint16_t)(readBE16(iv + 8) ^ (uint16_t)(index >> 32)));
+    writeBE32(iv + 10, readBE32(iv + 10) ^ (uint32_t)index);
+}
+
+//GCM的IV: salt ^ (00 00 || ssrc || 后6字节)，RTP为ROC和序号，RTCP为00 00和31位index
+static void gcmIv(const uint8_t *salt, uint32_t ssrc, uint16_t high, uint32_t low, uint8_t *iv) {
+    memcpy(iv, salt, SRTP_GCM_SALT_SIZE);
+    writeBE32(iv + 2, readBE32(iv + 2) ^ ssrc);
+    writeBE16(iv + 6, (uint16_t)(readBE16(iv + 6) ^ high));
+    writeBE32(iv + 8, readBE32(iv + 8) ^ low);
+}
+
+SrtpSession::SrtpSession(const SrtpOptions &options) : options_(options), initialized_(false), gcm_(false), tag_size_(0),
+                                                       last_ssrc_(0), last_stream_(nullptr) {
+}
+
+//RFC 3711 4.3.3的AES-CM PRF，base为master salt，label异或在第7字节
+static void prf(const Aes &master, const uint8_t *base, uint8_t label, uint8_t *out, size_t size) {
+    uint8_t iv[AES_BLOCK_SIZE];
+    memcpy(iv, base, AES_BLOCK_SIZE);
+    iv[7] ^= label;
+    memset(out, 0, size);
+    master.ctr(iv, out, out, size);
+}
+
+void SrtpSession::deriveKeys(const Aes &master, const uint8_t *master_salt, size_t key_size, uint8_t label, Keys &keys) {
+    //kdr为0，key_id只有label；GCM的12字节salt后面补0
+    uint8_t base[AES_BLOCK_SIZE] = {0};
+    memcpy(base, master_salt, gcm_ ? SRTP_GCM_SALT_SIZE : SRTP_CM_SALT_SIZE);
+    uint8_t key[32];
+    prf(master, base, label, key, key_size);
+    if (gcm_) {
+        keys.gcm.setKey(key, key_size);
+    } else {
+        keys.cipher.setKey(key, key_size);
+        uint8_t auth[SRTP_AUTH_KEY_SIZE];
+        prf(master, base, (uint8_t)(label + 1), auth, SRTP_AUTH_KEY_SIZE);
+        keys.auth.setKey(auth, SRTP_AUTH_KEY_SIZE);
+    }
+    prf(master, base, (uint8_t)(label + 2), keys.salt, gcm_ ? SRTP_GCM_SALT_SIZE : SRTP_CM_SALT_SIZE);
+}
+
+bool SrtpSession::init(SrtpProfile profile, const uint8_t *master_key, const uint8_t *master_salt) {
+    if (!master_key || !master_salt || (profile != SRTP_AES128_CM_HMAC_SHA1_80 && profile != SRTP_AEAD_AES_128_GCM &&
+                                        profile != SRTP_AEAD_AES_256_GCM)) {
+        return false;
+    }
+    gcm_ = profile != SRTP_AES128_CM_HMAC_SHA1_80;
+    tag_size_ = gcm_ ? AES_GCM_TAG_SIZE : SRTP_HMAC_TAG_SIZE;
+    size_t key_size = srtpMasterKeySize(profile);
+    Aes master;
+    master.setKey(master_key, key_size);
+    deriveKeys(master, master_salt, key_size, SRTP_LABEL_RTP_ENCRYPTION, rtp_keys_);
+    deriveKeys(master, master_salt, key_size, SRTP_LABEL_RTCP_ENCRYPTION, rtcp_keys_);
+    streams_.clear();
+    last_stream_ = nullptr;
+    initialized_ = true;
+    return true;
+}
+
+SrtpSession::Stream *SrtpSession::streamOf(uint32_t ssrc, bool create) {
+    if (last_stream_ && last_ssrc_ == ssrc) {
+        return last_stream_;
+    }
+    auto it = streams_.find(ssrc);
+    if (it == streams_.end()) {
+        if (!create || streams_.size() >= options_.max_streams) {
+            return nullptr;
+        }
+        it = streams_.emplace(ssrc, Stream()).first;
+    }
+    //unordered_map的元素地址在rehash后不变
+    last_ssrc_ = ssrc;
+    last_stream_ = &it->second;
+    return last_stream_;
+}
+
+void SrtpSession::removeStream(uint32_t ssrc) {
+    streams_.erase(ssrc);
+    if (last_ssrc_ == ssrc) {
+        last_stream_ = nullptr;
+    }
+}
+
+int64_t SrtpSession::estimateIndex(const Stream &stream, uint16_t seq) const {
+    if (!stream.rtp_started) {
+        return seq;
+    }
+    //RFC 3711附录A，按和s_l的距离猜ROC是否需要加减1
+    int64_t roc = stream.roc;
+    if (stream.last_seq < 0x8000) {
+        if ((int32_t)seq - stream.last_seq > 0x8000) {
+            roc--;
+        }
+    } else if ((int32_t)stream.last_seq - 0x8000 > seq) {
+        roc++;
+    }
+    return roc * 0x10000 + seq;
+}
+
+void SrtpSession::updateIndex(Stream &stream, int64_t index) {
+    if (!stream.rtp_started || index > (int64_t)stream.roc * 0x10000 + stream.last_seq) {
+        stream.rtp_started = true;
+        stream.roc = (uint32_t)(index >> 16);
+        stream.last_seq = (uint16_t)index;
+    }
+}
+
+bool SrtpSession::replayCheck(const ReplayWindow &window, uint64_t index) {
+    if (!window.started || index > window.top) {
+        return true;
+    }
+    uint64_t delta = window.top - index;
+    if (delta >= SRTP_REPLAY_WINDOW) {
+        return false;
+    }
+    return !((window.bits[delta >> 6] >> (delta & 63)) & 1);
+}
+
+void SrtpSession::replayAdd(ReplayWindow &window, uint64_t index) {
+    if (!window.started) {
+        window.started = true;
+        window.top = index;
+        window.bits[0] = 1;
+        window.bits[1] = 0;
+        return;
+    }
+    if (index > window.top) {
+        uint64_t shift = index - window.top;
+        if (shift >= SRTP_REPLAY_WINDOW) {
+            window.bits[0] = 0;
+            window.bits[1] = 0;
+        } else if (shift >= 64) {
+            window.bits[1] = window.bits[0] << (shift - 64);
+            window.bits[0] = 0;
+        } else {
+            window.bits[1] = (window.bits[1] << shift) | (window.bits[0] >> (64 - shift));
+            window.bits[0] <<= shift;
+        }
+        window.bits[0] |= 1;
+        window.top = index;
+    } else {
+        uint64_t delta = window.top - index;
+        window.bits[delta >> 6] |= 1ull << (delta & 63);
+    }
+}
+
+SrtpResult SrtpSession::record(SrtpResult result) {
+    if (result == SRTP_OK) {
+        stats_.packets++;
+    } else if (result == SRTP_ERROR_AUTH) {
+        stats_.auth_failures++;
+    } else if (result == SRTP_ERROR_REPLAY) {
+        stats_.replays++;
+    }
+    return result;
+}
+
+SrtpResult SrtpSession::protectRtp(uint8_t *data, size_t &size, size_t capacity) {
+    if (!initialized_) {
+        return SRTP_ERROR_NOT_INITIALIZED;
+    }
+    size_t header_size = rtpHeaderSize(data, size);
+    if (header_size == 0) {
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    if (capacity < size + tag_size_) {
+        return record(SRTP_ERROR_NO_SPACE);
+    }
+    uint32_t ssrc = readBE32(data + 8);
+    uint16_t seq = readBE16(data + 2);
+    Stream *stream = streamOf(ssrc, true);
+    if (!stream) {
+        return record(SRTP_ERROR_TOO_MANY_STREAMS);
+    }
+    int64_t index = estimateIndex(*stream, seq);
+    if (index < 0) {
+        //第一个包之前、并且跨过了序号回绕的重传，无法表示
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    updateIndex(*stream, index);
+    uint32_t roc = (uint32_t)(index >> 16);
+    uint8_t *payload = data + header_size;
+    size_t payload_size = size - header_size;
+    if (gcm_) {
+        uint8_t iv[AES_GCM_IV_SIZE];
+        gcmIv(rtp_keys_.salt, ssrc, (uint16_t)(roc >> 16), (roc << 16) | seq, iv);
+        rtp_keys_.gcm.seal(iv, data, header_size, payload, payload, payload_size, data + size);
+    } else {
+        uint8_t iv[AES_BLOCK_SIZE];
+        counterIv(rtp_keys_.salt, ssrc, (uint64_t)index, iv);
+        rtp_keys_.cipher.ctr(iv, payload, payload, payload_size);
+        //tag = HMAC(k_a, 包 || ROC)的前80位
+        uint8_t roc_bytes[4];
+        uint8_t digest[SHA1_DIGEST_SIZE];
+        writeBE32(roc_bytes, roc);
+        rtp_keys_.auth.compute(data, size, roc_bytes, sizeof(roc_bytes), digest);
+        memcpy(data + size, digest, SRTP_HMAC_TAG_SIZE);
+    }
+    size += tag_size_;
+    return record(SRTP_OK);
+}
+
+SrtpResult SrtpSession::unprotectRtp(uint8_t *data, size_t &size) {
+    if (!initialized_) {
+        return SRTP_ERROR_NOT_INITIALIZED;
+    }
+    size_t header_size = rtpHeaderSize(data, size);
+    if (header_size == 0 || size < header_size + tag_size_) {
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    uint32_t ssrc = readBE32(data + 8);
+    uint16_t seq = readBE16(data + 2);
+    //新的ssrc认证通过之后才创建状态，伪造的包不会占用内存
+    Stream *stream = streamOf(ssrc, false);
+    Stream fresh;
+    if (!stream && streams_.size() >= options_.max_streams) {
+        return record(SRTP_ERROR_TOO_MANY_STREAMS);
+    }
+    const Stream &state = stream ? *stream : fresh;
+    int64_t index = estimateIndex(state, seq);
+    if (index < 0 || !replayCheck(state.rtp_replay, (uint64_t)index)) {
+        return record(SRTP_ERROR_REPLAY);
+    }
+    uint32_t roc = (uint32_t)(index >> 16);
+    uint8_t *payload = data + header_size;
+    size_t payload_size = size - header_size - tag_size_;
+    if (gcm_) {
+        uint8_t iv[AES_GCM_IV_SIZE];
+        gcmIv(rtp_keys_.salt, ssrc, (uint16_t)(roc >> 16), (roc << 16) | seq, iv);
+        if (!rtp_keys_.gcm.open(iv, data, header_size, payload, payload, payload_size, data + size - tag_size_)) {
+            return record(SRTP_ERROR_AUTH);
+        }
+    } else {
+        uint8_t roc_bytes[4];
+        uint8_t digest[SHA1_DIGEST_SIZE];
+        writeBE32(roc_bytes, roc);
+        rtp_keys_.auth.compute(data, size - tag_size_, roc_bytes, sizeof(roc_bytes), digest);
+        if (!equalTag(digest, data + size - tag_size_, SRTP_HMAC_TAG_SIZE)) {
+            return record(SRTP_ERROR_AUTH);
+        }
+        uint8_t iv[AES_BLOCK_SIZE];
+        counterIv(rtp_keys_.salt, ssrc, (uint64_t)index, iv);
+        rtp_keys_.cipher.ctr(iv, payload, payload, payload_size);
+    }
+    if (!stream) {
+        stream = streamOf(ssrc, true);
+    }
+    updateIndex(*stream, index);
+    replayAdd(stream->rtp_replay, (uint64_t)index);
+    size -= tag_size_;
+    return record(SRTP_OK);
+}
+
+SrtpResult SrtpSession::protectRtcp(uint8_t *data, size_t &size, size_t capacity) {
+    if (!initialized_) {
+        return SRTP_ERROR_NOT_INITIALIZED;
+    }
+    if (size < SRTCP_HEADER_SIZE || !isRtcpPacket(data, size)) {
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    if (capacity < size + tag_size_ + SRTCP_INDEX_SIZE) {
+        return record(SRTP_ERROR_NO_SPACE);
+    }
+    uint32_t ssrc = readBE32(data + 4);
+    Stream *stream = streamOf(ssrc, true);
+    if (!stream) {
+        return record(SRTP_ERROR_TOO_MANY_STREAMS);
+    }
+    uint32_t index = stream->rtcp_index;
+    stream->rtcp_index = (index + 1) & SRTCP_INDEX_MASK;
+    uint32_t trailer = SRTCP_E_BIT | index;
+    uint8_t *payload = data + SRTCP_HEADER_SIZE;
+    size_t payload_size = size - SRTCP_HEADER_SIZE;
+    if (gcm_) {
+        //RFC 7714: AAD为前8字节加E||index，index放在tag之后
+        uint8_t iv[AES_GCM_IV_SIZE];
+        uint8_t aad[SRTCP_HEADER_SIZE + SRTCP_INDEX_SIZE];
+        gcmIv(rtcp_keys_.salt, ssrc, 0, index, iv);
+        memcpy(aad, data, SRTCP_HEADER_SIZE);
+        writeBE32(aad + SRTCP_HEADER_SIZE, trailer);
+        rtcp_keys_.gcm.seal(iv, aad, sizeof(aad), payload, payload, payload_size, data + size);
+        writeBE32(data + size + tag_size_, trailer);
+    } else {
+        uint8_t iv[AES_BLOCK_SIZE];
+        uint8_t digest[SHA1_DIGEST_SIZE];
+        counterIv(rtcp_keys_.salt, ssrc, index, iv);
+        rtcp_keys_.cipher.ctr(iv, payload, payload, payload_size);
+        writeBE32(data + size, trailer);
+        rtcp_keys_.auth.compute(data, size + SRTCP_INDEX_SIZE, nullptr, 0, digest);
+        memcpy(data + size + SRTCP_INDEX_SIZE, digest, SRTP_HMAC_TAG_SIZE);
+    }
+    size += tag_size_ + SRTCP_INDEX_SIZE;
+    return record(SRTP_OK);
+}
+
+SrtpResult SrtpSession::unprotectRtcp(uint8_t *data, size_t &size) {
+    if (!initialized_) {
+        return SRTP_ERROR_NOT_INITIALIZED;
+    }
+    size_t trailer_size = tag_size_ + SRTCP_INDEX_SIZE;
+    if (size < SRTCP_HEADER_SIZE + trailer_size || !isRtcpPacket(data, size)) {
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    uint32_t ssrc = readBE32(data + 4);
+    Stream *stream = streamOf(ssrc, false);
+    Stream fresh;
+    if (!stream && streams_.size() >= options_.max_streams) {
+        return record(SRTP_ERROR_TOO_MANY_STREAMS);
+    }
+    const Stream &state = stream ? *stream : fresh;
+    //GCM的E||index在最后，AES-CM的在tag之前
+    const uint8_t *trailer_bytes = gcm_ ? data + size - SRTCP_INDEX_SIZE : data + size - trailer_size;
+    uint32_t trailer = readBE32(trailer_bytes);
+    uint32_t index = trailer & SRTCP_INDEX_MASK;
+    if (!replayCheck(state.rtcp_replay, index)) {
+        return record(SRTP_ERROR_REPLAY);
+    }
+    uint8_t *payload = data + SRTCP_HEADER_SIZE;
+    size_t payload_size = size - SRTCP_HEADER_SIZE - trailer_size;
+    if (gcm_) {
+        if (!(trailer & SRTCP_E_BIT)) {
+            //不加密的SRTCP整个包都是AAD，WebRTC不会使用
+            return record(SRTP_ERROR_BAD_PACKET);
+        }
+        uint8_t iv[AES_GCM_IV_SIZE];
+        uint8_t aad[SRTCP_HEADER_SIZE + SRTCP_INDEX_SIZE];
+        gcmIv(rtcp_keys_.salt, ssrc, 0, index, iv);
+        memcpy(aad, data, SRTCP_HEADER_SIZE);
+        writeBE32(aad + SRTCP_HEADER_SIZE, trailer);
+        if (!rtcp_keys_.gcm.open(iv, aad, sizeof(aad), payload, payload, payload_size, payload + payload_size)) {
+            return record(SRTP_ERROR_AUTH);
+        }
+    } else {
+        uint8_t digest[SHA1_DIGEST_SIZE];
+        rtcp_keys_.auth.compute(data, size - tag_size_, nullptr, 0, digest);
+        if (!equalTag(digest, data + size - tag_size_, SRTP_HMAC_TAG_SIZE)) {
+            return record(SRTP_ERROR_AUTH);
+        }
+        if (trailer & SRTCP_E_BIT) {
+            uint8_t iv[AES_BLOCK_SIZE];
+            counterIv(rtcp_keys_.salt, ssrc, index, iv);
+            rtcp_keys_.cipher.ctr(iv, payload, payload, payload_size);
+        }
+    }
+    if (!stream) {
+        stream = streamOf(ssrc, true);
+    }
+    replayAdd(stream->rtcp_replay, index);
+    size -= trailer_size;
+    return record(SRTP_OK);
+}
+
+SrtpResult SrtpSession::protect(infra::PacketBuffer &packet) {
+    size_t size = packet.size();
+    size_t capacity = size + packet.tailroom();
+    SrtpResult result = isRtcpPacket(packet.data(), size) ? protectRtcp(packet.data(), size, capacity)
+                                                          : protectRtp(packet.data(), size, capacity);
+    if (result == SRTP_OK) {
+        packet.resize(size);
+    }
+    return result;
+}
+
+SrtpResult SrtpSession::unprotect(infra::PacketBuffer &packet) {
+    size_t size = packet.size();
+    SrtpResult result = isRtcpPacket(packet.data(), size) ? unprotectRtcp(packet.data(), size)
+                                                          : unprotectRtp(packet.data(), size);
+    if (result == SRTP_OK) {
+        packet.truncate(size);
+    }
+    return result;
+}
+
+SrtpResult SrtpSession::protectPacket(infra::UdpPacket &packet) {
+    if (packet.segment_size > 0) {
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    uint8_t *data = (uint8_t *)packet.data;
+    size_t size = packet.size;
+    SrtpResult result = isRtcpPacket(data, size) ? protectRtcp(data, size, packet.capacity)
+                                                 : protectRtp(data, size, packet.capacity);
+    packet.size = size;
+    return result;
+}
+
+SrtpResult SrtpSession::unprotectPacket(infra::UdpPacket &packet) {
+    if (packet.segment_size > 0 || packet.truncated) {
+        return record(SRTP_ERROR_BAD_PACKET);
+    }
+    uint8_t *data = (uint8_t *)packet.data;
+    size_t size = packet.size;
+    SrtpResult result = isRtcpPacket(data, size) ? unprotectRtcp(data, size) : unprotectRtp(data, size);
+    packet.size = size;
+    return result;
+}
+
+int SrtpSession::runBatch(infra::UdpPacket *packets, int count, SrtpResult *results, BatchFunction function) {
+    int succeeded = 0;
+    for (int i = 0; i < count; i++) {
+        SrtpResult result = (this->*function)(packets[i]);
+        if (results) {
+            results[i] = result;
+        }
+        if (result != SRTP_OK) {
+            continue;
+        }
+        //和排在前面的失败包交换，成功的包保持顺序
+        if (succeeded != i) {
+            infra::UdpPacket packet = packets[succeeded];
+            packets[succeeded] = packets[i];
+            packets[i] = packet;
+        }
+        succeeded++;
+    }
+    return succeeded;
+}
+
+int SrtpSession::protectBatch(infra::UdpPacket *packets, int count, SrtpResult *results) {
+    return runBatch(packets, count, results, &SrtpSession::protectPacket);
+}
+
+int SrtpSession::unprotectBatch(infra::UdpPacket *packets, int count, SrtpResult *results) {
+    return runBatch(packets, count, results, &SrtpSession::unprotectPacket);
+}
+
+}
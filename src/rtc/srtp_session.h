@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <unordered_map>
+#include "infra/packet_buffer.h"
+#include "infra/socket_util.h"
+#include "aes.h"
+#include "sha1.h"
+
+namespace rtc {
+
+//DTLS-SRTP协商出的保护方式，取值为RFC 5764/7714的profile编号
+enum SrtpProfile {
+    SRTP_AES128_CM_HMAC_SHA1_80 = 0x0001,
+    SRTP_AEAD_AES_128_GCM = 0x0007,
+    SRTP_AEAD_AES_256_GCM = 0x0008
+};
+
+enum SrtpResult {
+    SRTP_OK = 0,
+    SRTP_ERROR_NOT_INITIALIZED,
+    SRTP_ERROR_BAD_PACKET,           //长度不够或不是RTP/RTCP
+    SRTP_ERROR_NO_SPACE,             //缓冲后面放不下tag
+    SRTP_ERROR_AUTH,                 //认证失败
+    SRTP_ERROR_REPLAY,               //重复或早于重放窗口的包
+    SRTP_ERROR_TOO_MANY_STREAMS
+};
+
+//protect之后包最多增加的长度，GCM的SRTCP为16字节tag加4字节index
+#define SRTP_MAX_TRAILER_SIZE 20
+//重放窗口的包数
+#define SRTP_REPLAY_WINDOW 128
+
+size_t srtpMasterKeySize(SrtpProfile profile);
+
+size_t srtpMasterSaltSize(SrtpProfile profile);
+
+typedef struct SrtpOptions_tag {
+    size_t max_streams = 1024;       //最多跟踪的ssrc数，入方向只有认证通过的包才会创建
+} SrtpOptions;
+
+struct SrtpStats {
+    uint64_t packets = 0;            //处理成功的包
+    uint64_t auth_failures = 0;
+    uint64_t replays = 0;
+};
+
+/**
+ * 一个方向的SRTP/SRTCP上下文，DTLS握手后发送和接收各创建一个
+ * 会话密钥由master key按RFC 3711派生(kdr为0)，每个ssrc单独维护ROC、SRTCP index和重放窗口
+ * 所有操作都在原地进行，protect要求包后面至少有SRTP_MAX_TRAILER_SIZE字节的空间
+ * 支持AES-NI/PCLMULQDQ/SHA扩展时走硬件路径，不是线程安全的，应在收发所在的线程调用
+ */
+class SrtpSession {
+public:
+    explicit SrtpSession(const SrtpOptions &options = SrtpOptions());
+
+    SrtpSession(const SrtpSession&) = delete;
+
+    SrtpSession(SrtpSession&&) = delete;
+
+    //key、salt的长度见srtpMasterKeySize/srtpMasterSaltSize，重新init会清掉所有ssrc的状态
+    bool init(SrtpProfile profile, const uint8_t *master_key, const uint8_t *master_salt);
+
+    //size为输入和输出的长度，capacity为data可用的总长度
+    SrtpResult protectRtp(uint8_t *data, size_t &size, size_t capacity);
+
+    SrtpResult unprotectRtp(uint8_t *data, size_t &size);
+
+    SrtpResult protectRtcp(uint8_t *data, size_t &size, size_t capacity);
+
+    SrtpResult unprotectRtcp(uint8_t *data, size_t &size);
+
+    //按包头区分RTP和RTCP，tag写在tailroom里
+    SrtpResult protect(infra::PacketBuffer &packet);
+
+    SrtpResult unprotect(infra::PacketBuffer &packet);
+
+    /**
+     * 批量处理一次sendmmsg/recvmmsg的包，按包头区分RTP和RTCP，不支持GSO/GRO合并的包(segment_size不为0)
+     * 失败的包换到数组后面，成功的包保持原来的顺序排在前面，所有data指针仍留在数组里
+     * @param results 不为空时按原来的下标写入每个包的结果
+     * @return 成功的包数，可以直接作为SocketUtil::sendBatch的count
+     */
+    int protectBatch(infra::UdpPacket *packets, int count, SrtpResult *results = nullptr);
+
+    int unprotectBatch(infra::UdpPacket *packets, int count, SrtpResult *results = nullptr);
+
+    void removeStream(uint32_t ssrc);
+
+    const SrtpStats &stats() const {
+        return stats_;
+    }
+
+private:
+    struct ReplayWindow {
+        bool started = false;
+        uint64_t top = 0;                //收到的最大index
+        uint64_t bits[SRTP_REPLAY_WINDOW / 64] = {0};  //第i位对应top - i
+    };
+
+    struct Stream {
+        bool rtp_started = false;
+        uint32_t roc = 0;
+        uint16_t last_seq = 0;           //发送方向为最大的已发送序号，接收方向为RFC 3711的s_l
+        uint32_t rtcp_index = 0;         //发送方向下一个SRTCP index
+        ReplayWindow rtp_replay;
+        ReplayWindow rtcp_replay;
+    };
+
+    struct Keys {
+        Aes cipher;                      //AES-CM
+        AesGcm gcm;
+        HmacSha1 auth;
+        uint8_t salt[14];
+    };
+
+    typedef SrtpResult (SrtpSession::*BatchFunction)(infra::UdpPacket &packet);
+
+    Stream *streamOf(uint32_t ssrc, bool create);
+
+    int64_t estimateIndex(const Stream &stream, uint16_t seq) const;
+
+    static void updateIndex(Stream &stream, int64_t index);
+
+    static bool replayCheck(const ReplayWindow &window, uint64_t index);
+
+    static void replayAdd(ReplayWindow &window, uint64_t index);
+
+    void deriveKeys(const Aes &master, const uint8_t *master_salt, size_t key_size, uint8_t label, Keys &keys);
+
+    SrtpResult protectPacket(infra::UdpPacket &packet);
+
+    SrtpResult unprotectPacket(infra::UdpPacket &packet);
+
+    int runBatch(infra::UdpPacket *packets, int count, SrtpResult *results, BatchFunction function);
+
+    SrtpResult record(SrtpResult result);
+
+private:
+    SrtpOptions options_;
+    bool initialized_;
+    bool gcm_;
+    size_t tag_size_;
+    Keys rtp_keys_;
+    Keys rtcp_keys_;
+    std::unordered_map<uint32_t, Stream> streams_;
+    //连续的包通常属于同一个ssrc，缓存上一次查找的结果
+    uint32_t last_ssrc_;
+    Stream *last_stream_;
+    SrtpStats stats_;
+};
+
+}
@@ -0,0 +1,221 @@
+#include "transport_feedback.h"
+#include "infra/utils/time.h"
+
+namespace rtc {
+
+//一个反馈包最多包含的序号数
+#define TRANSPORT_FEEDBACK_MAX_STATUSES 400
+
+std::shared_ptr<TransportFeedbackGenerator> TransportFeedbackGenerator::create(const std::shared_ptr<infra::TaskQueue> &queue,
+                                                                               uint32_t sender_ssrc, uint32_t media_ssrc,
+                                                                               const FeedbackCallback &callback,
+                                                                               const TransportFeedbackOptions &options) {
+    if (!queue || !callback) {
+        return nullptr;
+    }
+    return std::shared_ptr<TransportFeedbackGenerator>(new TransportFeedbackGenerator(queue, sender_ssrc, media_ssrc, callback, options));
+}
+
+TransportFeedbackGenerator::TransportFeedbackGenerator(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc,
+                                                       uint32_t media_ssrc, const FeedbackCallback &callback,
+                                                       const TransportFeedbackOptions &options)
+    : queue_(queue), sender_ssrc_(sender_ssrc), media_ssrc_(media_ssrc), callback_(callback), options_(options), mask_(0),
+      started_(false), next_seq_(0), highest_seq_(0), fb_count_(0), max_statuses_(0), timer_(0) {
+    size_t capacity = 64;
+    while (capacity < options_.capacity && capacity < 0x8000) {
+        capacity <<= 1;
+    }
+    arrivals_.resize(capacity);
+    mask_ = (uint16_t)(capacity - 1);
+    statuses_.reserve(TRANSPORT_FEEDBACK_MAX_STATUSES);
+    if (options_.max_packet_size < 64) {
+        options_.max_packet_size = 64;
+    }
+    buffer_.resize(options_.max_packet_size);
+    //每个序号最多2字节delta加2/7字节状态块，再留出头部和padding
+    max_statuses_ = (options_.max_packet_size - 24) * 7 / 16;
+    if (max_statuses_ > TRANSPORT_FEEDBACK_MAX_STATUSES) {
+        max_statuses_ = TRANSPORT_FEEDBACK_MAX_STATUSES;
+    }
+}
+
+TransportFeedbackGenerator::~TransportFeedbackGenerator() {
+    if (timer_) {
+        queue_->cancelDelayedTask(timer_);
+    }
+}
+
+void TransportFeedbackGenerator::reset() {
+    for (auto &arrival : arrivals_) {
+        arrival.seq = -1;
+    }
+    started_ = false;
+    if (timer_) {
+        queue_->cancelDelayedTask(timer_);
+        timer_ = 0;
+    }
+}
+
+void TransportFeedbackGenerator::onPacket(uint16_t transport_seq, int64_t arrival_us) {
+    int64_t seq;
+    if (!started_) {
+        started_ = true;
+        seq = transport_seq;
+        next_seq_ = seq;
+        highest_seq_ = seq;
+    } else {
+        seq = highest_seq_ + (int16_t)(uint16_t)(transport_seq - (uint16_t)highest_seq_);
+    }
+    if (seq < next_seq_) {
+        //已经反馈为丢失，忽略
+        return;
+    }
+    if (seq - next_seq_ > mask_) {
+        //环装不下了，先把已有的发出去
+        flush();
+        if (seq - next_seq_ > mask_) {
+            next_seq_ = seq - mask_;
+        }
+    }
+    Arrival &arrival = arrivals_[seq & mask_];
+    arrival.seq = seq;
+    arrival.arrival_us = arrival_us;
+    if (seq > highest_seq_) {
+        highest_seq_ = seq;
+    }
+    if (highest_seq_ - next_seq_ + 1 >= (int64_t)max_statuses_) {
+        flush();
+    } else if (!timer_) {
+        schedule();
+    }
+}
+
+void TransportFeedbackGenerator::flush() {
+    RtcpWriter writer(buffer_.data(), buffer_.size());
+    while (started_ && next_seq_ <= highest_seq_) {
+        //参考时间取第一个收到的包，前面没收到的序号没有意义，直接跳过
+        while (next_seq_ <= highest_seq_ && !received(next_seq_)) {
+            next_seq_++;
+        }
+        if (next_seq_ > highest_seq_) {
+            break;
+        }
+        int64_t base_seq = next_seq_;
+        int32_t reference_time = (int32_t)(arrivals_[base_seq & mask_].arrival_us / 64000);
+        int64_t last_us = (int64_t)reference_time * 64000;
+        statuses_.clear();
+        for (int64_t seq = base_seq; seq <= highest_seq_ && statuses_.size() < max_statuses_; seq++) {
+            TransportFeedbackStatus status;
+            if (received(seq)) {
+                //delta按250us取整，累加取整后的值，误差不会累积
+                int64_t diff = arrivals_[seq & mask_].arrival_us - last_us;
+                int64_t delta = diff >= 0 ? (diff + 125) / 250 : -((-diff + 125) / 250);
+                if (delta < -32768 || delta > 32767) {
+                    break;
+                }
+                status.received = true;
+                status.delta = (int32_t)delta;
+                last_us += delta * 250;
+            }
+            statuses_.push_back(status);
+        }
+        if (!writer.addTransportFeedback(sender_ssrc_, media_ssrc_, (uint16_t)base_seq, reference_time, fb_count_,
+                                         statuses_.data(), statuses_.size())) {
+            if (writer.size() == 0) {
+                //max_statuses_保证一个反馈放得下，不应该走到这里
+                next_seq_ = base_seq + (int64_t)statuses_.size();
+                continue;
+            }
+            callback_(buffer_.data(), writer.size());
+            writer.reset();
+            continue;
+        }
+        fb_count_++;
+        next_seq_ = base_seq + (int64_t)statuses_.size();
+    }
+    if (writer.size() > 0) {
+        callback_(buffer_.data(), writer.size());
+    }
+}
+
+void TransportFeedbackGenerator::schedule() {
+    std::weak_ptr<TransportFeedbackGenerator> weak_self = shared_from_this();
+    timer_ = queue_->postDelayedTask([weak_self]() {
+        auto self = weak_self.lock();
+        if (self) {
+            self->timer_ = 0;
+            self->flush();
+        }
+    }, options_.interval_ms > 0 ? options_.interval_ms : 1);
+}
+
+TransportFeedbackAdapter::TransportFeedbackAdapter(uint16_t capacity) : mask_(0), has_reference_(false), last_reference_(0),
+                                                                        reference_(0) {
+    size_t size = 64;
+    while (size < capacity && size < 0x8000) {
+        size <<= 1;
+    }
+    sent_.resize(size);
+    mask_ = (uint16_t)(size - 1);
+}
+
+void TransportFeedbackAdapter::onPacketSent(uint16_t transport_seq, size_t size, int64_t send_us, int32_t probe_id) {
+    Sent &sent = sent_[transport_seq & mask_];
+    sent.send_us = send_us;
+    sent.size = (uint32_t)size;
+    sent.probe_id = probe_id;
+    sent.seq = transport_seq;
+    sent.valid = true;
+    sent.reported_lost = false;
+}
+
+bool TransportFeedbackAdapter::onFeedback(const RtcpTransportFeedback &feedback, std::vector<PacketResult> &results) {
+    results.clear();
+    //参考时间是24位，按和上一个反馈的差值展开
+    int32_t reference = feedback.referenceTime();
+    if (!has_reference_) {
+        has_reference_ = true;
+        reference_ = (int64_t)reference + (1 << 24);
+    } else {
+        int32_t diff = (int32_t)((uint32_t)(reference - last_reference_) << 8) >> 8;
+        reference_ += diff;
+    }
+    last_reference_ = reference;
+
+    RtcpTransportFeedback reader = feedback;
+    reader.rewind();
+    int64_t arrival_us = reference_ * 64000;
+    uint16_t seq;
+    TransportFeedbackStatus status;
+    while (reader.nextPacket(seq, status)) {
+        if (status.received) {
+            arrival_us += (int64_t)status.delta * 250;
+        }
+        Sent &sent = sent_[seq & mask_];
+        if (!sent.valid || sent.seq != seq) {
+            continue;
+        }
+        if (!status.received && sent.reported_lost) {
+            continue;
+        }
+        PacketResult result;
+        result.send_us = sent.send_us;
+        result.received = status.received;
+        result.arrival_us = status.received ? arrival_us : 0;
+        result.reported_lost = sent.reported_lost;
+        result.size = sent.size;
+        result.probe_id = sent.probe_id;
+        result.seq = seq;
+        results.push_back(result);
+        if (status.received) {
+            //已经确认收到，之后的反馈不再重复计算
+            sent.valid = false;
+        } else {
+            //之后的反馈可能补报收到，保留记录用于时延估计
+            sent.reported_lost = true;
+        }
+    }
+    return !results.empty();
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "infra/task_queue.h"
+#include "rtcp_packet.h"
+
+namespace rtc {
+
+typedef struct TransportFeedbackOptions_tag {
+    uint16_t capacity = 1024;        //记录到达时间的序号跨度，取整为2的幂
+    int64_t interval_ms = 50;        //发送反馈的周期
+    size_t max_packet_size = 1200;   //一次回调的RTCP最大长度
+} TransportFeedbackOptions;
+
+/**
+ * 接收端transport-cc反馈生成
+ * 按transport-wide序号在环里记录到达时间，定时把上次反馈之后的所有序号编码成一个或多个反馈包
+ * 定时由TaskQueue的延时任务驱动，所有接口必须在queue的线程(或串行队列)中调用
+ */
+class TransportFeedbackGenerator : public std::enable_shared_from_this<TransportFeedbackGenerator> {
+public:
+    //data是一个或多个transport-cc反馈组成的复合包，只在回调期间有效
+    typedef std::function<void(const uint8_t *data, size_t size)> FeedbackCallback;
+
+    TransportFeedbackGenerator(const TransportFeedbackGenerator&) = delete;
+
+    TransportFeedbackGenerator(TransportFeedbackGenerator&&) = delete;
+
+    static std::shared_ptr<TransportFeedbackGenerator> create(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc,
+                                                              uint32_t media_ssrc, const FeedbackCallback &callback,
+                                                              const TransportFeedbackOptions &options = TransportFeedbackOptions());
+
+    ~TransportFeedbackGenerator();
+
+    //每个带transport-wide序号扩展的包都要调用
+    void onPacket(uint16_t transport_seq, int64_t arrival_us);
+
+    //立即发送还没有反馈的部分
+    void flush();
+
+    void reset();
+
+private:
+    TransportFeedbackGenerator(const std::shared_ptr<infra::TaskQueue> &queue, uint32_t sender_ssrc, uint32_t media_ssrc,
+                               const FeedbackCallback &callback, const TransportFeedbackOptions &options);
+
+    struct Arrival {
+        int64_t arrival_us = 0;
+        int64_t seq = -1;            //展开后的序号
+    };
+
+    bool received(int64_t seq) const {
+        return arrivals_[seq & mask_].seq == seq;
+    }
+
+    void schedule();
+
+private:
+    std::shared_ptr<infra::TaskQueue> queue_;
+    uint32_t sender_ssrc_;
+    uint32_t media_ssrc_;
+    FeedbackCallback callback_;
+    TransportFeedbackOptions options_;
+
+    std::vector<Arrival> arrivals_;
+    uint16_t mask_;
+    bool started_;
+    int64_t next_seq_;               //还没有反馈的第一个序号
+    int64_t highest_seq_;
+    uint8_t fb_count_;
+
+    std::vector<TransportFeedbackStatus> statuses_;
+    size_t max_statuses_;            //一个反馈包最多的序号数，由max_packet_size决定
+    std::vector<uint8_t> buffer_;
+    infra::TaskQueue::TaskId timer_;
+};
+
+//一个包的反馈结果，arrival_us为接收端时钟，只有差值有意义
+struct PacketResult {
+    int64_t send_us = 0;
+    int64_t arrival_us = 0;          //received为false时无效
+    bool received = false;
+    bool reported_lost = false;      //之前的反馈已经报告过丢失，这次是迟到的接收，丢包统计不应重复计算
+    uint32_t size = 0;
+    int32_t probe_id = 0;
+    uint16_t seq = 0;
+};
+
+/**
+ * 发送端把transport-cc反馈和发送记录对应起来
+ * 发送记录是按序号索引的环，每个包O(1)
+ */
+class TransportFeedbackAdapter {
+public:
+    //capacity取整为2的幂，应大于一个rtt内发送的包数
+    explicit TransportFeedbackAdapter(uint16_t capacity = 4096);
+
+    TransportFeedbackAdapter(const TransportFeedbackAdapter&) = delete;
+
+    TransportFeedbackAdapter(TransportFeedbackAdapter&&) = delete;
+
+    void onPacketSent(uint16_t transport_seq, size_t size, int64_t send_us, int32_t probe_id);
+
+    /**
+     * 按反馈里的序号顺序写入results(会先清空)，没有发送记录的序号跳过
+     * 每个序号最多报告一次丢失、一次接收，重复的反馈不会再写入
+     * @return 是否解析出至少一个结果
+     */
+    bool onFeedback(const RtcpTransportFeedback &feedback, std::vector<PacketResult> &results);
+
+private:
+    struct Sent {
+        int64_t send_us = 0;
+        uint32_t size = 0;
+        int32_t probe_id = 0;
+        uint16_t seq = 0;
+        bool valid = false;
+        bool reported_lost = false;
+    };
+
+    std::vector<Sent> sent_;
+    uint16_t mask_;
+    bool has_reference_;
+    int32_t last_reference_;         //上一个反馈的24位参考时间
+    int64_t reference_;              //展开后的参考时间，单位64ms，从2^24开始，往回跳也不会变成负数
+};
+
+}
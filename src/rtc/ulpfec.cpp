@@ -0,0 +1,436 @@
+#include "ulpfec.h"
+#include <string.h>
+#include "fec_xor.h"
+#include "rtp_packet.h"
+
+namespace rtc {
+
+//L=0时level 0头部只有16位掩码
+#define ULPFEC_SHORT_LEVEL_HEADER_SIZE 4
+#define ULPFEC_SHORT_MASK_BITS 16
+
+static inline uint64_t lowBits(int64_t count) {
+    if (count <= 0) {
+        return 0;
+    }
+    return count >= 64 ? ~0ull : (1ull << count) - 1;
+}
+
+static inline int popCount(uint64_t value) {
+#ifdef __GNUC__
+    return __builtin_popcountll(value);
+#else
+    int count = 0;
+    for (; value; value &= value - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+static inline int lowestBit(uint64_t value) {
+#ifdef __GNUC__
+    return __builtin_ctzll(value);
+#else
+    int index = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+//报文里掩码的最高位对应base，内部第0位对应base
+static uint64_t reverseMask(uint64_t mask, int bits) {
+    uint64_t result = 0;
+    for (int i = 0; i < bits; i++) {
+        if (mask & (1ull << i)) {
+            result |= 1ull << (bits - 1 - i);
+        }
+    }
+    return result;
+}
+
+UlpfecEncoder::UlpfecEncoder(const UlpfecOptions &options) : options_(options), seq_(0) {
+    setProtection(options.media_packets, options.fec_packets, options.mask_type);
+    options_.masks = options.masks;
+    for (auto &mask : options_.masks) {
+        mask &= lowBits(ULPFEC_MAX_MEDIA_PACKETS);
+    }
+    group_.reserve(ULPFEC_MAX_MEDIA_PACKETS);
+}
+
+void UlpfecEncoder::setProtection(uint8_t media_packets, uint8_t fec_packets, FecMaskType mask_type) {
+    if (media_packets < 1) {
+        media_packets = 1;
+    } else if (media_packets > ULPFEC_MAX_MEDIA_PACKETS) {
+        media_packets = ULPFEC_MAX_MEDIA_PACKETS;
+    }
+    if (fec_packets < 1) {
+        fec_packets = 1;
+    } else if (fec_packets > media_packets) {
+        fec_packets = media_packets;
+    }
+    options_.media_packets = media_packets;
+    options_.fec_packets = fec_packets;
+    options_.mask_type = mask_type;
+    options_.masks.clear();
+}
+
+void UlpfecEncoder::reset() {
+    group_.clear();
+}
+
+void UlpfecEncoder::addPacket(const infra::PacketBuffer::Ptr &packet, std::vector<infra::PacketBuffer::Ptr> &fec_packets) {
+    RtpPacket rtp;
+    if (!packet || !rtp.parse(packet->data(), packet->size()) || rtp.ssrc() != options_.media_ssrc) {
+        return;
+    }
+    if (!group_.empty() && rtp.sequenceNumber() != (uint16_t)(readBE16(group_.back()->data() + 2) + 1)) {
+        //序号不连续，一组内的包必须能用base加偏移表示
+        generate(fec_packets);
+    }
+    group_.push_back(packet);
+    stats_.media_packets++;
+
+    size_t group_size = options_.media_packets;
+    if (!options_.masks.empty()) {
+        uint64_t all = 0;
+        for (auto mask : options_.masks) {
+            all |= mask;
+        }
+        group_size = 0;
+        for (; all; all >>= 1) {
+            group_size++;
+        }
+    }
+    if (group_.size() >= group_size) {
+        generate(fec_packets);
+    } else if (options_.frame_aligned && rtp.marker() &&
+               group_.size() * options_.fec_packets * 2 >= options_.media_packets) {
+        //帧结束时按比例至少能生成一个FEC包才提前结束，否则继续和下一帧合成一组
+        generate(fec_packets);
+    }
+}
+
+void UlpfecEncoder::buildMasks(size_t count, std::vector<uint64_t> &masks) const {
+    masks.clear();
+    if (!options_.masks.empty()) {
+        for (auto mask : options_.masks) {
+            mask &= lowBits((int64_t)count);
+            if (mask) {
+                masks.push_back(mask);
+            }
+        }
+        return;
+    }
+    //不满一组时按比例四舍五入
+    size_t fec_count = (count * options_.fec_packets + options_.media_packets / 2) / options_.media_packets;
+    if (fec_count < 1) {
+        fec_count = 1;
+    } else if (fec_count > count) {
+        fec_count = count;
+    }
+    for (size_t j = 0; j < fec_count; j++) {
+        uint64_t mask = 0;
+        if (options_.mask_type == FEC_MASK_INTERLEAVED) {
+            for (size_t i = j; i < count; i += fec_count) {
+                mask |= 1ull << i;
+            }
+        } else {
+            size_t begin = j * count / fec_count;
+            size_t end = (j + 1) * count / fec_count;
+            mask = lowBits((int64_t)end) & ~lowBits((int64_t)begin);
+        }
+        masks.push_back(mask);
+    }
+}
+
+void UlpfecEncoder::generate(std::vector<infra::PacketBuffer::Ptr> &fec_packets) {
+    if (group_.empty()) {
+        return;
+    }
+    buildMasks(group_.size(), masks_);
+    for (auto mask : masks_) {
+        infra::PacketBuffer::Ptr fec = encode(mask);
+        stats_.fec_packets++;
+        stats_.fec_bytes += fec->size();
+        fec_packets.push_back(std::move(fec));
+    }
+    group_.clear();
+}
+
+infra::PacketBuffer::Ptr UlpfecEncoder::encode(uint64_t mask) {
+    bool long_mask = (mask >> ULPFEC_SHORT_MASK_BITS) != 0;
+    size_t header_size = RTP_HEADER_SIZE + ULPFEC_HEADER_SIZE +
+                         (long_mask ? ULPFEC_LEVEL_HEADER_SIZE : ULPFEC_SHORT_LEVEL_HEADER_SIZE);
+    size_t protection_length = 0;
+    for (uint64_t bits = mask; bits; bits &= bits - 1) {
+        size_t length = group_[lowestBit(bits)]->size() - RTP_HEADER_SIZE;
+        if (length > protection_length) {
+            protection_length = length;
+        }
+    }
+
+    infra::PacketBuffer::Ptr fec = infra::PacketBuffer::create(header_size + protection_length);
+    uint8_t *data = fec->data();
+    memset(data, 0, fec->size());
+    uint8_t *header = data + RTP_HEADER_SIZE;
+    uint8_t *payload = data + header_size;
+    uint32_t timestamp = 0;
+    uint16_t length = 0;
+    //固定头部之后的CSRC、扩展、负载和padding一起异或，短的包按补0处理
+    for (uint64_t bits = mask; bits; bits &= bits - 1) {
+        const infra::PacketBuffer::Ptr &media = group_[lowestBit(bits)];
+        const uint8_t *src = media->data();
+        header[0] ^= src[0];
+        header[1] ^= src[1];
+        timestamp ^= readBE32(src + 4);
+        length ^= (uint16_t)(media->size() - RTP_HEADER_SIZE);
+        fecXor(payload, src + RTP_HEADER_SIZE, media->size() - RTP_HEADER_SIZE);
+    }
+    //E=0，L表示掩码长度，低6位是P/X/CC的恢复值
+    header[0] = (uint8_t)((header[0] & 0x3f) | (long_mask ? 0x40 : 0));
+    writeBE16(header + 2, readBE16(group_.front()->data() + 2));
+    writeBE32(header + 4, timestamp);
+    writeBE16(header + 8, length);
+    uint8_t *level = header + ULPFEC_HEADER_SIZE;
+    writeBE16(level, (uint16_t)protection_length);
+    if (long_mask) {
+        uint64_t wire = reverseMask(mask, ULPFEC_MAX_MEDIA_PACKETS);
+        writeBE16(level + 2, (uint16_t)(wire >> 32));
+        writeBE32(level + 4, (uint32_t)wire);
+    } else {
+        writeBE16(level + 2, (uint16_t)reverseMask(mask, ULPFEC_SHORT_MASK_BITS));
+    }
+
+    data[0] = 0x80;
+    data[1] = options_.payload_type & 0x7f;
+    writeBE16(data + 2, seq_++);
+    writeBE32(data + 4, readBE32(group_.back()->data() + 4));
+    writeBE32(data + 8, options_.fec_ssrc);
+    return fec;
+}
+
+UlpfecDecoder::UlpfecDecoder(const UlpfecDecoderOptions &options) : options_(options), mask_(0), started_(false),
+                                                                    highest_seq_(0) {
+    //位图按两个64位字取一个FEC包的窗口，至少两个字
+    size_t capacity = 128;
+    while (capacity < options_.capacity && capacity < 0x8000) {
+        capacity <<= 1;
+    }
+    mask_ = (uint16_t)(capacity - 1);
+    packets_.resize(capacity);
+    bitmap_.resize(capacity / 64);
+    if (options_.max_fec_packets < 1) {
+        options_.max_fec_packets = 1;
+    }
+    fec_.reserve(options_.max_fec_packets);
+}
+
+void UlpfecDecoder::reset() {
+    for (auto &packet : packets_) {
+        packet.reset();
+    }
+    for (auto &word : bitmap_) {
+        word = 0;
+    }
+    fec_.clear();
+    started_ = false;
+}
+
+int64_t UlpfecDecoder::unwrap(uint16_t seq) const {
+    return highest_seq_ + (int16_t)(uint16_t)(seq - (uint16_t)highest_seq_);
+}
+
+bool UlpfecDecoder::present(int64_t seq) const {
+    if (seq > highest_seq_ || highest_seq_ - seq > mask_) {
+        return false;
+    }
+    size_t index = (size_t)(seq & mask_);
+    return (bitmap_[index >> 6] >> (index & 63)) & 1;
+}
+
+bool UlpfecDecoder::insert(int64_t seq, const infra::PacketBuffer::Ptr &packet) {
+    if (seq > highest_seq_) {
+        //新进入窗口的位置上是上一圈的包，先清掉
+        int64_t from = highest_seq_ + 1;
+        if (seq - from > mask_) {
+            from = seq - mask_;
+        }
+        for (int64_t s = from; s <= seq; s++) {
+            size_t index = (size_t)(s & mask_);
+            packets_[index].reset();
+            bitmap_[index >> 6] &= ~(1ull << (index & 63));
+        }
+        highest_seq_ = seq;
+    } else if (highest_seq_ - seq > mask_ || present(seq)) {
+        return false;
+    }
+    size_t index = (size_t)(seq & mask_);
+    packets_[index] = packet;
+    bitmap_[index >> 6] |= 1ull << (index & 63);
+    return true;
+}
+
+uint64_t UlpfecDecoder::receivedBits(int64_t base_seq) const {
+    size_t index = (size_t)(base_seq & mask_);
+    size_t word = index >> 6;
+    size_t shift = index & 63;
+    uint64_t bits = bitmap_[word] >> shift;
+    if (shift) {
+        bits |= bitmap_[(word + 1) & (bitmap_.size() - 1)] << (64 - shift);
+    }
+    //超出窗口的位置可能是上一圈或下一圈的包
+    bits &= lowBits(highest_seq_ - base_seq + 1);
+    bits &= ~lowBits(highest_seq_ - mask_ - base_seq);
+    return bits & lowBits(ULPFEC_MAX_MEDIA_PACKETS);
+}
+
+void UlpfecDecoder::onMediaPacket(const infra::PacketBuffer::Ptr &packet, std::vector<infra::PacketBuffer::Ptr> &recovered) {
+    RtpPacket rtp;
+    if (!packet || !rtp.parse(packet->data(), packet->size()) || rtp.ssrc() != options_.media_ssrc) {
+        return;
+    }
+    if (!started_) {
+        started_ = true;
+        highest_seq_ = (int64_t)rtp.sequenceNumber() - 1;
+    }
+    if (insert(unwrap(rtp.sequenceNumber()), packet) && !fec_.empty()) {
+        process(recovered);
+    }
+}
+
+void UlpfecDecoder::onFecPacket(const infra::PacketBuffer::Ptr &packet, std::vector<infra::PacketBuffer::Ptr> &recovered) {
+    RtpPacket rtp;
+    if (!packet || !rtp.parse(packet->data(), packet->size())) {
+        return;
+    }
+    stats_.fec_packets++;
+    const uint8_t *header = rtp.payload();
+    size_t size = rtp.payloadSize();
+    if (size < ULPFEC_HEADER_SIZE + ULPFEC_SHORT_LEVEL_HEADER_SIZE || (header[0] & 0x80)) {
+        stats_.invalid++;
+        return;
+    }
+    bool long_mask = (header[0] & 0x40) != 0;
+    size_t header_size = ULPFEC_HEADER_SIZE + (long_mask ? ULPFEC_LEVEL_HEADER_SIZE : ULPFEC_SHORT_LEVEL_HEADER_SIZE);
+    const uint8_t *level = header + ULPFEC_HEADER_SIZE;
+    FecPacket fec;
+    fec.protection_length = size >= header_size ? readBE16(level) : 0;
+    if (size < header_size || size - header_size < fec.protection_length) {
+        stats_.invalid++;
+        return;
+    }
+    if (long_mask) {
+        fec.mask = reverseMask(((uint64_t)readBE16(level + 2) << 32) | readBE32(level + 4), ULPFEC_MAX_MEDIA_PACKETS);
+    } else {
+        fec.mask = reverseMask(readBE16(level + 2), ULPFEC_SHORT_MASK_BITS);
+    }
+    if (fec.mask == 0) {
+        stats_.invalid++;
+        return;
+    }
+    uint16_t base = readBE16(header + 2);
+    if (!started_) {
+        started_ = true;
+        highest_seq_ = (int64_t)base - 1;
+    }
+    fec.base_seq = unwrap(base);
+    if (highest_seq_ - fec.base_seq > mask_) {
+        return;
+    }
+    fec.offset = (size_t)(header - packet->data());
+    fec.packet = packet;
+    if (fec_.size() >= options_.max_fec_packets) {
+        //满了丢掉最旧的
+        size_t oldest = 0;
+        for (size_t i = 1; i < fec_.size(); i++) {
+            if (fec_[i].base_seq < fec_[oldest].base_seq) {
+                oldest = i;
+            }
+        }
+        stats_.unrecoverable++;
+        fec_[oldest] = std::move(fec_.back());
+        fec_.pop_back();
+    }
+    fec_.push_back(std::move(fec));
+    process(recovered);
+}
+
+void UlpfecDecoder::process(std::vector<infra::PacketBuffer::Ptr> &recovered) {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t i = 0; i < fec_.size();) {
+            FecPacket &fec = fec_[i];
+            uint64_t missing = fec.mask & ~receivedBits(fec.base_seq);
+            int count = popCount(missing);
+            bool done = count == 0;
+            if (count == 1) {
+                int64_t seq = fec.base_seq + lowestBit(missing);
+                infra::PacketBuffer::Ptr packet = recover(fec, seq);
+                if (packet && insert(seq, packet)) {
+                    recovered.push_back(std::move(packet));
+                    stats_.recovered++;
+                    progress = true;
+                } else {
+                    stats_.invalid++;
+                }
+                done = true;
+            } else if (count > 1 && highest_seq_ - fec.base_seq > mask_) {
+                //保护的包已经移出窗口，不可能再恢复
+                stats_.unrecoverable++;
+                done = true;
+            }
+            if (done) {
+                fec_[i] = std::move(fec_.back());
+                fec_.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+}
+
+infra::PacketBuffer::Ptr UlpfecDecoder::recover(const FecPacket &fec, int64_t seq) {
+    const uint8_t *header = fec.packet->data() + fec.offset;
+    size_t header_size = ULPFEC_HEADER_SIZE + ((header[0] & 0x40) ? ULPFEC_LEVEL_HEADER_SIZE : ULPFEC_SHORT_LEVEL_HEADER_SIZE);
+    uint8_t byte0 = header[0];
+    uint8_t byte1 = header[1];
+    uint32_t timestamp = readBE32(header + 4);
+    uint16_t length = readBE16(header + 8);
+
+    infra::PacketBuffer::Ptr packet = infra::PacketBuffer::create(RTP_HEADER_SIZE + fec.protection_length);
+    uint8_t *data = packet->data();
+    memcpy(data + RTP_HEADER_SIZE, header + header_size, fec.protection_length);
+    uint64_t others = fec.mask & ~(1ull << (seq - fec.base_seq));
+    for (; others; others &= others - 1) {
+        const infra::PacketBuffer::Ptr &media = packets_[(size_t)((fec.base_seq + lowestBit(others)) & mask_)];
+        const uint8_t *src = media->data();
+        size_t media_length = media->size() - RTP_HEADER_SIZE;
+        byte0 ^= src[0];
+        byte1 ^= src[1];
+        timestamp ^= readBE32(src + 4);
+        length ^= (uint16_t)media_length;
+        fecXor(data + RTP_HEADER_SIZE, src + RTP_HEADER_SIZE,
+               media_length < fec.protection_length ? media_length : fec.protection_length);
+    }
+    if (length > fec.protection_length) {
+        return nullptr;
+    }
+    data[0] = (uint8_t)(0x80 | (byte0 & 0x3f));
+    data[1] = byte1;
+    writeBE16(data + 2, (uint16_t)seq);
+    writeBE32(data + 4, timestamp);
+    writeBE32(data + 8, options_.media_ssrc);
+    packet->truncate(RTP_HEADER_SIZE + length);
+    RtpPacket rtp;
+    if (!rtp.parse(packet->data(), packet->size())) {
+        return nullptr;
+    }
+    return packet;
+}
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "infra/packet_buffer.h"
+
+namespace rtc {
+
+//RFC 5109的FEC头部和L=1时的level 0头部长度
+#define ULPFEC_HEADER_SIZE 10
+#define ULPFEC_LEVEL_HEADER_SIZE 8
+//一个FEC包最多保护的媒体包数
+#define ULPFEC_MAX_MEDIA_PACKETS 48
+
+enum FecMaskType {
+    FEC_MASK_INTERLEAVED = 0,        //第j个FEC包保护序号i % fec_packets == j的包，适合突发丢包
+    FEC_MASK_BURSTY                  //每个FEC包保护连续的一段，适合随机丢包
+};
+
+typedef struct UlpfecOptions_tag {
+    uint32_t media_ssrc = 0;         //被保护的媒体流
+    uint32_t fec_ssrc = 0;           //FEC包单独一个ssrc
+    uint8_t payload_type = 0;        //FEC流的负载类型
+    uint8_t media_packets = 10;      //一组保护的媒体包数，最多48
+    uint8_t fec_packets = 2;         //一组生成的FEC包数
+    FecMaskType mask_type = FEC_MASK_INTERLEAVED;
+    std::vector<uint64_t> masks;     //自定义掩码，第i位对应组内第i个包，非空时忽略fec_packets和mask_type
+    bool frame_aligned = true;       //帧结束时提前结束一组，不让FEC跨帧等待
+} UlpfecOptions;
+
+struct UlpfecEncoderStats {
+    uint64_t media_packets = 0;
+    uint64_t fec_packets = 0;
+    uint64_t fec_bytes = 0;
+};
+
+/**
+ * 发送端的XOR FEC生成
+ * FEC载荷使用RFC 5109(ULPFEC)的头部，和FlexFEC一样作为单独的ssrc/负载类型发送，不需要RED封装
+ * 连续的媒体包组成一组，组满或帧结束时按掩码生成FEC包，只保存组内包的引用，不拷贝数据
+ * 不是线程安全的，应在发送所在的线程调用
+ */
+class UlpfecEncoder {
+public:
+    explicit UlpfecEncoder(const UlpfecOptions &options);
+
+    UlpfecEncoder(const UlpfecEncoder&) = delete;
+
+    UlpfecEncoder(UlpfecEncoder&&) = delete;
+
+    //媒体包分配好序号之后调用，生成的FEC包追加到fec_packets
+    void addPacket(const infra::PacketBuffer::Ptr &packet, std::vector<infra::PacketBuffer::Ptr> &fec_packets);
+
+    //调整保护比例，从下一组开始生效，会清掉自定义掩码
+    void setProtection(uint8_t media_packets, uint8_t fec_packets, FecMaskType mask_type);
+
+    //丢弃还没有生成FEC的包
+    void reset();
+
+    const UlpfecEncoderStats &stats() const {
+        return stats_;
+    }
+
+private:
+    void generate(std::vector<infra::PacketBuffer::Ptr> &fec_packets);
+
+    void buildMasks(size_t count, std::vector<uint64_t> &masks) const;
+
+    infra::PacketBuffer::Ptr encode(uint64_t mask);
+
+private:
+    UlpfecOptions options_;
+    std::vector<infra::PacketBuffer::Ptr> group_;
+    std::vector<uint64_t> masks_;
+    uint16_t seq_;                   //FEC流自己的序号
+    UlpfecEncoderStats stats_;
+};
+
+typedef struct UlpfecDecoderOptions_tag {
+    uint32_t media_ssrc = 0;
+    uint16_t capacity = 512;         //保存最近多少个序号的媒体包，取整为2的幂
+    uint16_t max_fec_packets = 64;   //等待恢复的FEC包上限
+} UlpfecDecoderOptions;
+
+struct UlpfecDecoderStats {
+    uint64_t fec_packets = 0;
+    uint64_t recovered = 0;
+    uint64_t unrecoverable = 0;      //过期时仍缺多个包的FEC包
+    uint64_t invalid = 0;
+};
+
+/**
+ * 接收端的FEC恢复
+ * 媒体包按序号保存在环里，同时维护一个收到位图，每个FEC包缺几个包用位运算直接算出
+ * 只缺一个包时把FEC包和其余包异或得到丢失的包，恢复出的包会继续参与其他FEC包的恢复
+ * 不是线程安全的，应在接收所在的线程调用
+ */
+class UlpfecDecoder {
+public:
+    explicit UlpfecDecoder(const UlpfecDecoderOptions &options);
+
+    UlpfecDecoder(const UlpfecDecoder&) = delete;
+
+    UlpfecDecoder(UlpfecDecoder&&) = delete;
+
+    //收到的媒体包(包括重传的)，因此能恢复的包追加到recovered
+    void onMediaPacket(const infra::PacketBuffer::Ptr &packet, std::vector<infra::PacketBuffer::Ptr> &recovered);
+
+    //收到的FEC包(完整的RTP包)，恢复的包追加到recovered
+    void onFecPacket(const infra::PacketBuffer::Ptr &packet, std::vector<infra::PacketBuffer::Ptr> &recovered);
+
+    void reset();
+
+    const UlpfecDecoderStats &stats() const {
+        return stats_;
+    }
+
+private:
+    struct FecPacket {
+        infra::PacketBuffer::Ptr packet;
+        int64_t base_seq = 0;        //展开后的序号
+        uint64_t mask = 0;           //第i位对应base_seq + i
+        size_t offset = 0;           //FEC头部在包内的偏移
+        size_t protection_length = 0;
+    };
+
+    int64_t unwrap(uint16_t seq) const;
+
+    bool present(int64_t seq) const;
+
+    bool insert(int64_t seq, const infra::PacketBuffer::Ptr &packet);
+
+    uint64_t receivedBits(int64_t base_seq) const;
+
+    infra::PacketBuffer::Ptr recover(const FecPacket &fec, int64_t seq);
+
+    void process(std::vector<infra::PacketBuffer::Ptr> &recovered);
+
+private:
+    UlpfecDecoderOptions options_;
+    uint16_t mask_;
+    std::vector<infra::PacketBuffer::Ptr> packets_;
+    std::vector<uint64_t> bitmap_;   //packets_中有效的位置
+    bool started_;
+    int64_t highest_seq_;
+    std::vector<FecPacket> fec_;
+    UlpfecDecoderStats stats_;
+};
+
+}
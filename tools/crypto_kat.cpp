@@ -0,0 +1,321 @@
+/**
+ * SRTP用到的AES、AES-GCM、HMAC-SHA1的已知答案测试
+ * 向量来自FIPS-197附录C、RFC 3711附录B.2/B.3、GCM规范的测试用例2和14、RFC 7714第16/17节、RFC 2202
+ * 每组向量在硬件加速和软件实现下各跑一遍，再用随机数据对比两条路径的输出
+ * 用法: crypto_kat，全部通过返回0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "rtc/aes.h"
+#include "rtc/sha1.h"
+
+using namespace rtc;
+
+static int s_failures = 0;
+
+static std::vector<uint8_t> fromHex(const char *hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        char digits[3] = {hex[i], hex[i + 1], 0};
+        bytes.push_back((uint8_t)strtoul(digits, nullptr, 16));
+    }
+    return bytes;
+}
+
+static std::string toHex(const uint8_t *data, size_t size) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex;
+    for (size_t i = 0; i < size; i++) {
+        hex += kDigits[data[i] >> 4];
+        hex += kDigits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+static void expect(const char *mode, const char *name, const uint8_t *data, size_t size, const char *expected) {
+    std::vector<uint8_t> bytes = fromHex(expected);
+    if (bytes.size() != size || memcmp(bytes.data(), data, size) != 0) {
+        printf("FAIL [%s] %s\n  got      %s\n  expected %s\n", mode, name, toHex(data, size).c_str(), expected);
+        s_failures++;
+    }
+}
+
+static void testAesBlock(const char *mode) {
+    static const struct {
+        const char *name;
+        const char *key;
+        const char *cipher;
+    } kVectors[] = {
+        {"FIPS-197 C.1 AES-128", "000102030405060708090a0b0c0d0e0f", "69c4e0d86a7b0430d8cdb78070b4c55a"},
+        {"FIPS-197 C.3 AES-256", "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+         "8ea2b7ca516745bfeafc49904b496089"},
+    };
+    std::vector<uint8_t> plain = fromHex("00112233445566778899aabbccddeeff");
+    for (const auto &vector : kVectors) {
+        std::vector<uint8_t> key = fromHex(vector.key);
+        Aes aes;
+        aes.setKey(key.data(), key.size());
+        uint8_t out[AES_BLOCK_SIZE];
+        aes.encryptBlock(plain.data(), out);
+        expect(mode, vector.name, out, sizeof(out), vector.cipher);
+    }
+}
+
+static void testAesCm(const char *mode) {
+    std::vector<uint8_t> key = fromHex("2b7e151628aed2a6abf7158809cf4f3c");
+    std::vector<uint8_t> counter = fromHex("f0f1f2f3f4f5f6f7f8f9fafbfcfd0000");
+    Aes aes;
+    aes.setKey(key.data(), key.size());
+    uint8_t zero[48] = {0};
+    uint8_t stream[48];
+    aes.ctr(counter.data(), zero, stream, sizeof(stream));
+    expect(mode, "RFC 3711 B.2 keystream", stream, sizeof(stream),
+           "e03ead0935c95e80e166b16dd92b4eb4d23513162b02d0f72a43a2fe4a5f97ab41e95b3bb0a2e8dd477901e4fca894c0");
+}
+
+//与SrtpSession::deriveKeys相同的计算，kdr为0时index项为0
+static void testKdf(const char *mode) {
+    static const struct {
+        const char *name;
+        uint8_t label;
+        size_t size;
+        const char *expected;
+    } kVectors[] = {
+        {"RFC 3711 B.3 cipher key", 0x00, 16, "c61e7a93744f39ee10734afe3ff7a087"},
+        {"RFC 3711 B.3 cipher salt", 0x02, 14, "30cbbc08863d8c85d49db34a9ae1"},
+        {"RFC 3711 B.3 auth key", 0x01, 20, "cebe321f6ff7716b6fd4ab49af256a156d38baa4"},
+    };
+    std::vector<uint8_t> master_key = fromHex("e1f97a0d3e018be0d64fa32c06de4139");
+    std::vector<uint8_t> master_salt = fromHex("0ec675ad498afeebb6960b3aabe6");
+    Aes aes;
+    aes.setKey(master_key.data(), master_key.size());
+    for (const auto &vector : kVectors) {
+        uint8_t counter[AES_BLOCK_SIZE] = {0};
+        memcpy(counter, master_salt.data(), master_salt.size());
+        counter[7] ^= vector.label;
+        uint8_t zero[32] = {0};
+        uint8_t out[32];
+        aes.ctr(counter, zero, out, vector.size);
+        expect(mode, vector.name, out, vector.size, vector.expected);
+    }
+}
+
+static void testGcm(const char *mode) {
+    static const struct {
+        const char *name;
+        const char *key;
+        const char *cipher;
+        const char *tag;
+    } kVectors[] = {
+        {"GCM test case 2", "00000000000000000000000000000000", "0388dace60b6a392f328c2b971b2fe78",
+         "ab6e47d42cec13bdf53a67b21257bddf"},
+        {"GCM test case 14", "0000000000000000000000000000000000000000000000000000000000000000",
+         "cea7403d4d606b6e074ec5d3baf39d18", "d0d1c8a799996bf0265b98b5d48ab919"},
+    };
+    uint8_t iv[AES_GCM_IV_SIZE] = {0};
+    for (const auto &vector : kVectors) {
+        std::vector<uint8_t> key = fromHex(vector.key);
+        AesGcm gcm;
+        gcm.setKey(key.data(), key.size());
+        uint8_t plain[AES_BLOCK_SIZE] = {0};
+        uint8_t cipher[AES_BLOCK_SIZE];
+        uint8_t tag[AES_GCM_TAG_SIZE];
+        gcm.seal(iv, nullptr, 0, plain, cipher, sizeof(cipher), tag);
+        expect(mode, vector.name, cipher, sizeof(cipher), vector.cipher);
+        expect(mode, vector.name, tag, sizeof(tag), vector.tag);
+        uint8_t opened[AES_BLOCK_SIZE];
+        if (!gcm.open(iv, nullptr, 0, cipher, opened, sizeof(opened), tag) ||
+            memcmp(opened, plain, sizeof(plain)) != 0) {
+            printf("FAIL [%s] %s open\n", mode, vector.name);
+            s_failures++;
+        }
+        tag[0] ^= 1;
+        if (gcm.open(iv, nullptr, 0, cipher, opened, sizeof(opened), tag)) {
+            printf("FAIL [%s] %s accepted a bad tag\n", mode, vector.name);
+            s_failures++;
+        }
+    }
+}
+
+static void checkGcmPacket(const char *mode, const char *name, const AesGcm &gcm, const uint8_t *iv,
+                           const std::vector<uint8_t> &aad, const std::vector<uint8_t> &plain,
+                           const std::vector<uint8_t> &cipher, const char *expected) {
+    std::vector<uint8_t> out(plain.size() + AES_GCM_TAG_SIZE);
+    gcm.seal(iv, aad.data(), aad.size(), plain.data(), out.data(), plain.size(), out.data() + plain.size());
+    expect(mode, name, out.data(), out.size(), expected);
+    size_t size = cipher.size() - AES_GCM_TAG_SIZE;
+    if (!gcm.open(iv, aad.data(), aad.size(), cipher.data(), out.data(), size, cipher.data() + size) ||
+        memcmp(out.data(), plain.data(), plain.size()) != 0) {
+        printf("FAIL [%s] %s open\n", mode, name);
+        s_failures++;
+    }
+    std::vector<uint8_t> modified = cipher;
+    modified[0] ^= 1;
+    if (gcm.open(iv, aad.data(), aad.size(), modified.data(), out.data(), size, modified.data() + size)) {
+        printf("FAIL [%s] %s accepted a modified packet\n", mode, name);
+        s_failures++;
+    }
+}
+
+/**
+ * RFC 7714 16.1.1和17.1，例子里给的是会话密钥和salt，不经过KDF，所以直接用AesGcm
+ * IV = salt ^ (00 00 || SSRC || ROC || SEQ)，SRTCP为salt ^ (00 00 || SSRC || 00 00 || index)
+ */
+static void testSrtpGcm(const char *mode) {
+    std::vector<uint8_t> key = fromHex("000102030405060708090a0b0c0d0e0f");
+    std::vector<uint8_t> salt = fromHex("517569642070726f2071756f");
+    AesGcm gcm;
+    gcm.setKey(key.data(), key.size());
+
+    std::vector<uint8_t> rtp = fromHex("8040f17b8041f8d35501a0b2"
+                                       "47616c6c696120657374206f6d6e69732064697669736120696e207061727465732074726573");
+    const char *rtp_cipher = "f24de3a3fb34de6cacba861c9d7e4bcabe633bd50d294e6f42a5f47a51c7d19b36de3adf8833"
+                             "899d7f27beb16a9152cf765ee4390cce";
+    uint8_t iv[AES_GCM_IV_SIZE] = {0};
+    memcpy(iv + 2, rtp.data() + 8, 4);
+    memcpy(iv + 10, rtp.data() + 2, 2);
+    for (int i = 0; i < AES_GCM_IV_SIZE; i++) {
+        iv[i] ^= salt[i];
+    }
+    checkGcmPacket(mode, "RFC 7714 16.1.1 SRTP", gcm, iv, std::vector<uint8_t>(rtp.begin(), rtp.begin() + 12),
+                   std::vector<uint8_t>(rtp.begin() + 12, rtp.end()), fromHex(rtp_cipher), rtp_cipher);
+
+    //SRTCP的AAD为前8字节加上E标志和index
+    std::vector<uint8_t> rtcp = fromHex("81c8000d4d6172734e5450314e545032525450200000042a0000e9304c756e61"
+                                        "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef");
+    const char *rtcp_cipher = "63e94885dcdab67ca727d7662f6b7e997ff5c0f76c06f32dc676a5f1730d6fda"
+                              "4ce09b4686303ded0bb9275bc84aa45896cf4d2fc5abf87245d9eade";
+    std::vector<uint8_t> aad(rtcp.begin(), rtcp.begin() + 8);
+    std::vector<uint8_t> index = fromHex("800005d4");
+    aad.insert(aad.end(), index.begin(), index.end());
+    memset(iv, 0, sizeof(iv));
+    memcpy(iv + 2, rtcp.data() + 4, 4);
+    iv[10] = 0x05;
+    iv[11] = 0xd4;
+    for (int i = 0; i < AES_GCM_IV_SIZE; i++) {
+        iv[i] ^= salt[i];
+    }
+    checkGcmPacket(mode, "RFC 7714 17.1 SRTCP", gcm, iv, aad, std::vector<uint8_t>(rtcp.begin() + 8, rtcp.end()),
+                   fromHex(rtcp_cipher), rtcp_cipher);
+}
+
+static void testHmac(const char *mode) {
+    static const struct {
+        const char *key;
+        const char *data;
+        size_t repeat;                   //data为单个字节的十六进制时重复的次数，0表示data是字符串
+        const char *digest;
+    } kVectors[] = {
+        {"0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b", "Hi There", 0, "b617318655057264e28bc0b6fb378c8ef146be00"},
+        {"4a656665", "what do ya want for nothing?", 0, "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79"},
+        {"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", "dd", 50, "125d7342b9ac11cd91a39af48aa17b4f63f175d3"},
+        {"0102030405060708090a0b0c0d0e0f10111213141516171819", "cd", 50, "4c9007f4026250c6bc8414f9bf50c86c2d7235da"},
+        {"0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c", "Test With Truncation", 0,
+         "4c1a03424b55e07fe7f27be1d58bb9324a9a5a04"},
+        {nullptr, "Test Using Larger Than Block-Size Key - Hash Key First", 0,
+         "aa4ae5e15272d00e95705637ce8a3b55ed402112"},
+        {nullptr, "Test Using Larger Than Block-Size Key and Larger Than One Block-Size Data", 0,
+         "e8e99d0f45237d786d6bbaa7965c7808bbff1a91"},
+    };
+    int index = 0;
+    for (const auto &vector : kVectors) {
+        index++;
+        //用例6、7的key为80个0xaa
+        std::vector<uint8_t> key = vector.key ? fromHex(vector.key) : std::vector<uint8_t>(80, 0xaa);
+        std::vector<uint8_t> data;
+        if (vector.repeat > 0) {
+            data.assign(vector.repeat, fromHex(vector.data)[0]);
+        } else {
+            data.assign(vector.data, vector.data + strlen(vector.data));
+        }
+        HmacSha1 hmac;
+        hmac.setKey(key.data(), key.size());
+        uint8_t digest[SHA1_DIGEST_SIZE];
+        hmac.compute(data.data(), data.size(), nullptr, 0, digest);
+        char name[32];
+        snprintf(name, sizeof(name), "RFC 2202 case %d", index);
+        expect(mode, name, digest, sizeof(digest), vector.digest);
+        //拆成两段计算结果应该相同，SRTP的ROC走第二段
+        size_t split = data.size() / 3;
+        hmac.compute(data.data(), split, data.data() + split, data.size() - split, digest);
+        expect(mode, name, digest, sizeof(digest), vector.digest);
+    }
+}
+
+static void runVectors(const char *mode) {
+    testAesBlock(mode);
+    testAesCm(mode);
+    testKdf(mode);
+    testGcm(mode);
+    testSrtpGcm(mode);
+    testHmac(mode);
+}
+
+//随机密钥和数据下硬件与软件实现的输出应该完全一致
+static void compareImplementations() {
+    srand(1);
+    std::vector<uint8_t> data(1024);
+    for (int round = 0; round < 200; round++) {
+        size_t key_size = round % 2 ? 32 : 16;
+        uint8_t key[32];
+        uint8_t iv[AES_GCM_IV_SIZE];
+        for (auto &b : key) {
+            b = (uint8_t)rand();
+        }
+        for (auto &b : iv) {
+            b = (uint8_t)rand();
+        }
+        for (auto &b : data) {
+            b = (uint8_t)rand();
+        }
+        size_t size = (size_t)rand() % data.size();
+        size_t aad_size = (size_t)rand() % 64;
+        std::vector<uint8_t> out[2];
+        uint8_t tag[2][AES_GCM_TAG_SIZE];
+        uint8_t digest[2][SHA1_DIGEST_SIZE];
+        for (int hardware = 0; hardware < 2; hardware++) {
+            setAesHardwareEnabled(hardware != 0);
+            setSha1HardwareEnabled(hardware != 0);
+            AesGcm gcm;
+            gcm.setKey(key, key_size);
+            out[hardware].resize(size);
+            const uint8_t *aad = data.data() + data.size() - aad_size;
+            gcm.seal(iv, aad, aad_size, data.data(), out[hardware].data(), size, tag[hardware]);
+            HmacSha1 hmac;
+            hmac.setKey(key, key_size);
+            hmac.compute(data.data(), size, iv, sizeof(iv), digest[hardware]);
+        }
+        if (out[0] != out[1] || memcmp(tag[0], tag[1], sizeof(tag[0])) != 0 ||
+            memcmp(digest[0], digest[1], sizeof(digest[0])) != 0) {
+            printf("FAIL hardware and software differ, key size %zu, size %zu, aad %zu\n", key_size, size, aad_size);
+            s_failures++;
+            break;
+        }
+    }
+}
+
+int main() {
+    runVectors("default");
+    bool aes_hardware = setAesHardwareEnabled(true);
+    bool sha1_hardware = setSha1HardwareEnabled(true);
+    if (aes_hardware || sha1_hardware) {
+        runVectors("hardware");
+    } else {
+        printf("no AES-NI/PCLMULQDQ or SHA extensions, hardware path skipped\n");
+    }
+    setAesHardwareEnabled(false);
+    setSha1HardwareEnabled(false);
+    runVectors("software");
+    if (aes_hardware || sha1_hardware) {
+        compareImplementations();
+    }
+    if (s_failures > 0) {
+        printf("%d failures\n", s_failures);
+        return 1;
+    }
+    printf("all crypto vectors passed\n");
+    return 0;
+}
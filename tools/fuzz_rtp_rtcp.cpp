@@ -0,0 +1,325 @@
+/**
+ * RTP/RTCP解析的fuzz入口(libFuzzer)
+ * 覆盖RtpPacket::parse和头部扩展遍历、RTCP复合包遍历及各类型的parse、transport-cc的nextPacket
+ * clang下用-fsanitize=fuzzer链接；其他编译器定义SIMPLERTC_FUZZ_STANDALONE，
+ * 依次执行参数中的文件，没有参数时用固定种子生成随机输入
+ * 用法: fuzz_rtp_rtcp [corpus dir | files...]
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "rtc/rtp_packet.h"
+#include "rtc/rtcp_packet.h"
+
+using namespace rtc;
+
+//读出的值写到这里，防止访问被优化掉
+static volatile uint64_t s_sink;
+
+static void fuzzRtp(uint8_t *data, size_t size) {
+    RtpPacket packet;
+    if (!packet.parse(data, size)) {
+        return;
+    }
+    s_sink += packet.marker() + packet.payloadType() + packet.sequenceNumber() + packet.timestamp() + packet.ssrc();
+    for (int i = 0; i < packet.csrcCount(); i++) {
+        s_sink += packet.csrc(i);
+    }
+    //payload和padding必须落在包内
+    const uint8_t *payload = packet.payload();
+    if (payload + packet.payloadSize() + packet.paddingSize() != data + size) {
+        __builtin_trap();
+    }
+    if (packet.payloadSize() > 0) {
+        s_sink += payload[0] + payload[packet.payloadSize() - 1];
+    }
+
+    RtpPacket::ExtensionIterator it = packet.extensions();
+    uint8_t id;
+    uint8_t *value;
+    size_t value_size;
+    while (it.next(id, value, value_size)) {
+        if (value + value_size > data + size) {
+            __builtin_trap();
+        }
+        for (size_t i = 0; i < value_size; i++) {
+            s_sink += value[i];
+        }
+        //原地改写为同样的内容
+        std::vector<uint8_t> copy(value, value + value_size);
+        packet.setExtension(id, copy.data(), copy.size());
+    }
+    size_t found_size = 0;
+    s_sink += packet.findExtension(1, found_size) != nullptr;
+}
+
+static void fuzzReportBlocks(const RtcpReportBlock &block) {
+    s_sink += block.ssrc + block.fraction_lost + (uint32_t)block.cumulative_lost + block.extended_highest_seq + block.jitter +
+              block.last_sr + block.delay_since_last_sr;
+}
+
+static void fuzzRtcpPacket(const RtcpPacket &packet) {
+    s_sink += packet.payloadSize();
+    switch (packet.type()) {
+        case RTCP_SR: {
+            RtcpSenderReport report;
+            if (report.parse(packet)) {
+                s_sink += report.senderInfo().ntp_seconds;
+                for (int i = 0; i < report.reportCount(); i++) {
+                    fuzzReportBlocks(report.reportBlock(i));
+                }
+            }
+            break;
+        }
+        case RTCP_RR: {
+            RtcpReceiverReport report;
+            if (report.parse(packet)) {
+                s_sink += report.ssrc();
+                for (int i = 0; i < report.reportCount(); i++) {
+                    fuzzReportBlocks(report.reportBlock(i));
+                }
+            }
+            break;
+        }
+        case RTCP_SDES: {
+            RtcpSdes sdes;
+            if (sdes.parse(packet)) {
+                uint32_t ssrc;
+                uint8_t type;
+                const char *text;
+                size_t size;
+                while (sdes.nextItem(ssrc, type, text, size)) {
+                    s_sink += ssrc + type + size;
+                    if (size > 0) {
+                        s_sink += (uint8_t)text[0] + (uint8_t)text[size - 1];
+                    }
+                }
+            }
+            break;
+        }
+        case RTCP_BYE: {
+            RtcpBye bye;
+            if (bye.parse(packet)) {
+                for (int i = 0; i < bye.ssrcCount(); i++) {
+                    s_sink += bye.ssrc(i);
+                }
+                size_t size;
+                const char *reason = bye.reason(size);
+                if (size > 0) {
+                    s_sink += (uint8_t)reason[0] + (uint8_t)reason[size - 1];
+                }
+            }
+            break;
+        }
+        case RTCP_RTPFB: {
+            if (packet.count() == RTCP_RTPFB_NACK) {
+                RtcpNack nack;
+                if (nack.parse(packet)) {
+                    uint16_t lost[256];
+                    s_sink += nack.lostPackets(lost, sizeof(lost) / sizeof(lost[0]));
+                    for (int i = 0; i < nack.itemCount(); i++) {
+                        uint16_t pid, blp;
+                        nack.item(i, pid, blp);
+                        s_sink += pid + blp;
+                    }
+                }
+            } else if (packet.count() == RTCP_RTPFB_TRANSPORT_CC) {
+                RtcpTransportFeedback feedback;
+                if (feedback.parse(packet)) {
+                    s_sink += feedback.baseSequence() + feedback.referenceTime() + feedback.feedbackCount();
+                    uint16_t seq;
+                    TransportFeedbackStatus status;
+                    size_t count = 0;
+                    while (feedback.nextPacket(seq, status)) {
+                        s_sink += seq + status.received + (uint32_t)status.delta;
+                        count++;
+                    }
+                    //不能多于包头声明的个数
+                    if (count > feedback.statusCount()) {
+                        __builtin_trap();
+                    }
+                    feedback.rewind();
+                    if (feedback.nextPacket(seq, status) != (count > 0)) {
+                        __builtin_trap();
+                    }
+                }
+            } else {
+                RtcpFeedback feedback;
+                if (feedback.parse(packet)) {
+                    s_sink += feedback.senderSsrc() + feedback.mediaSsrc();
+                }
+            }
+            break;
+        }
+        case RTCP_PSFB: {
+            if (packet.count() == RTCP_PSFB_PLI) {
+                RtcpPli pli;
+                s_sink += pli.parse(packet);
+            } else if (packet.count() == RTCP_PSFB_FIR) {
+                RtcpFir fir;
+                if (fir.parse(packet)) {
+                    for (int i = 0; i < fir.entryCount(); i++) {
+                        uint32_t ssrc;
+                        uint8_t seq;
+                        fir.entry(i, ssrc, seq);
+                        s_sink += ssrc + seq;
+                    }
+                }
+            } else if (packet.count() == RTCP_PSFB_AFB) {
+                RtcpRemb remb;
+                if (remb.parse(packet)) {
+                    s_sink += remb.bitrate();
+                    for (int i = 0; i < remb.ssrcCount(); i++) {
+                        s_sink += remb.ssrc(i);
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void fuzzRtcp(const uint8_t *data, size_t size) {
+    RtcpCompoundParser parser(data, size);
+    RtcpPacket packet;
+    while (parser.next(packet)) {
+        if (packet.data() + packet.size() > data + size) {
+            __builtin_trap();
+        }
+        fuzzRtcpPacket(packet);
+    }
+    s_sink += parser.error();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    //拷贝到刚好大小的堆内存，越界读写能被ASan发现，RtpPacket也需要可写的缓冲
+    //不按RFC 5761分流，两个解析器都跑一遍，RTP只会把扩展改写为原来的内容
+    std::vector<uint8_t> buffer(data, data + size);
+    fuzzRtcp(buffer.data(), size);
+    fuzzRtp(buffer.data(), size);
+    return 0;
+}
+
+#if defined(SIMPLERTC_FUZZ_STANDALONE)
+#include <stdio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+
+static bool runFile(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(file);
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+    return true;
+}
+
+static int runPath(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        fprintf(stderr, "can not open %s\n", path.c_str());
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return runFile(path) ? 1 : 0;
+    }
+    int count = 0;
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *item;
+    while ((item = readdir(dir)) != nullptr) {
+        if (item->d_name[0] != '.') {
+            count += runFile(path + "/" + item->d_name) ? 1 : 0;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static uint32_t s_random = 0x12345678;
+
+static uint32_t nextRandom() {
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+//没有语料时生成大致合法的包头再随机改写，比纯随机字节更容易走到深层的解析
+static void generate(std::vector<uint8_t> &data) {
+    size_t size = nextRandom() % 512;
+    data.resize(size);
+    for (auto &byte : data) {
+        byte = (uint8_t)nextRandom();
+    }
+    if (size < 4) {
+        return;
+    }
+    uint32_t kind = nextRandom() % 4;
+    if (kind == 0) {
+        //RTP，可能带扩展
+        data[0] = (uint8_t)(0x80 | (nextRandom() & 0x3f));
+        data[1] &= 0x7f;
+        if (size > 20 && (data[0] & 0x10)) {
+            size_t offset = RTP_HEADER_SIZE + (data[0] & 0x0f) * 4;
+            if (offset + 4 <= size) {
+                writeBE16(&data[offset], nextRandom() % 2 ? RTP_ONE_BYTE_EXTENSION_PROFILE : RTP_TWO_BYTE_EXTENSION_PROFILE);
+                writeBE16(&data[offset + 2], (uint16_t)(nextRandom() % ((size - offset) / 4 + 2)));
+            }
+        }
+    } else {
+        //RTCP复合包，长度字段大多数时候与剩余长度一致
+        static const uint8_t kTypes[] = {RTCP_SR, RTCP_RR, RTCP_SDES, RTCP_BYE, RTCP_RTPFB, RTCP_RTPFB, RTCP_PSFB};
+        size_t pos = 0;
+        while (pos + 4 <= size) {
+            size_t remain = (size - pos) / 4;
+            size_t words = nextRandom() % 8 == 0 ? nextRandom() % (remain + 2) : 1 + nextRandom() % remain;
+            data[pos] = (uint8_t)(0x80 | (nextRandom() & 0x3f));
+            data[pos + 1] = kTypes[nextRandom() % sizeof(kTypes)];
+            if (data[pos + 1] == RTCP_RTPFB) {
+                data[pos] = (uint8_t)((data[pos] & 0xe0) | (nextRandom() % 2 ? RTCP_RTPFB_TRANSPORT_CC : RTCP_RTPFB_NACK));
+            } else if (data[pos + 1] == RTCP_PSFB) {
+                static const uint8_t kFmts[] = {RTCP_PSFB_PLI, RTCP_PSFB_FIR, RTCP_PSFB_AFB};
+                data[pos] = (uint8_t)((data[pos] & 0xe0) | kFmts[nextRandom() % sizeof(kFmts)]);
+                if ((data[pos] & 0x1f) == RTCP_PSFB_AFB && pos + 16 <= size) {
+                    memcpy(&data[pos + 12], "REMB", 4);
+                }
+            }
+            writeBE16(&data[pos + 2], (uint16_t)(words > 0 ? words - 1 : 0));
+            pos += (words > 0 ? words : 1) * 4;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int count = 0;
+    for (int i = 1; i < argc; i++) {
+        count += runPath(argv[i]);
+    }
+    if (argc <= 1) {
+        std::vector<uint8_t> data;
+        for (; count < 2000000; count++) {
+            generate(data);
+            LLVMFuzzerTestOneInput(data.data(), data.size());
+        }
+    }
+    printf("executed %d inputs\n", count);
+    return 0;
+}
+#endif
@@ -0,0 +1,123 @@
+/**
+ * 二进制日志解码工具，把BinaryLogChannel写出的文件还原为文本日志
+ * 用法: log_decoder <binary log file>
+ */
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "infra/log_format.h"
+
+using namespace infra;
+
+struct Format {
+    LogLevel level;
+    int line;
+    std::string file;
+    std::string fmt;
+};
+
+template <typename T>
+static bool readValue(FILE *file, T &value) {
+    return fread(&value, 1, sizeof(value), file) == sizeof(value);
+}
+
+template <typename T>
+static bool readString(FILE *file, std::string &value) {
+    T size = 0;
+    if (!readValue(file, size)) {
+        return false;
+    }
+    value.resize(size);
+    return size == 0 || fread(&value[0], 1, size, file) == size;
+}
+
+static void printPrefix(int64_t timestamp, LogLevel level, const Format &format) {
+    static const char* sLogLevelString[] = {"[error]", "[warning]", "[info]", "[debug]", "[trace]"};
+    time_t tt = (time_t)(timestamp / 1000 + 8 * 60 * 60);  //time zone，与Logger一致
+    struct tm now;
+#if defined(_WIN32)
+    gmtime_s(&now, &tt);
+#else
+    gmtime_r(&tt, &now);
+#endif
+    printf("[%4d-%02d-%02d %02d:%02d:%02d.%03d]%s[%s:%d]", now.tm_year + 1900, now.tm_mon + 1, now.tm_mday,
+        now.tm_hour, now.tm_min, now.tm_sec, int(timestamp % 1000),
+        level <= LogLevelTrace ? sLogLevelString[level] : "[unknown]", format.file.c_str(), format.line);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <binary log file>\n", argv[0]);
+        return 1;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "open %s failed\n", argv[1]);
+        return 1;
+    }
+
+    char magic[sizeof(kLogFileMagic)];
+    uint32_t version = 0;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, kLogFileMagic, sizeof(magic)) != 0 ||
+        !readValue(file, version) || version != kLogFileVersion) {
+        fprintf(stderr, "%s is not a binary log file\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    std::vector<Format> formats;
+    std::string args;
+    std::string text;
+    bool truncated = false;
+    uint8_t entry = 0;
+    while (readValue(file, entry)) {
+        if (entry == LogFileFormat) {
+            uint32_t id = 0;
+            uint8_t level = 0;
+            Format format;
+            if (!readValue(file, id) || !readValue(file, level) || !readValue(file, format.line) ||
+                !readString<uint16_t>(file, format.file) || !readString<uint16_t>(file, format.fmt)) {
+                truncated = true;
+                break;
+            }
+            format.level = LogLevel(level);
+            if (formats.size() <= id) {
+                formats.resize(id + 1);
+            }
+            formats[id] = format;
+        } else if (entry == LogFileRecord) {
+            uint32_t id = 0;
+            int64_t timestamp = 0;
+            if (!readValue(file, id) || !readValue(file, timestamp) || !readString<uint16_t>(file, args)) {
+                truncated = true;
+                break;
+            }
+            if (id >= formats.size()) {
+                fprintf(stderr, "unknown format id %u\n", id);
+                continue;
+            }
+            const Format &format = formats[id];
+            text.clear();
+            formatLogArgs(format.fmt.c_str(), args.data(), args.size(), text);
+            printPrefix(timestamp, format.level, format);
+            fwrite(text.data(), 1, text.size(), stdout);
+        } else if (entry == LogFileText) {
+            uint8_t level = 0;
+            int64_t timestamp = 0;
+            if (!readValue(file, level) || !readValue(file, timestamp) || !readString<uint32_t>(file, text)) {
+                truncated = true;
+                break;
+            }
+            fwrite(text.data(), 1, text.size(), stdout);
+        } else {
+            fprintf(stderr, "corrupted entry type %d\n", entry);
+            break;
+        }
+    }
+    if (truncated) {
+        fprintf(stderr, "log file truncated\n");
+    }
+    fclose(file);
+    return 0;
+}